@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "global.h"
+#include "version.h"
+#include "functions.h"
+#include "arrays.h"
+#include "tis2ovl.h"
+#include "stats.h"
+#include "corpus.h"
+
+#define BENCH_NAME "tis2ovl_bench"
+
+/// Available I/O strategies of the conversion pipeline.
+enum IO_STRATEGY { IO_INPLACE = 0, IO_OUTPUT = 1, IO_COUNT };
+static const char *ioNames[IO_COUNT] = { "inplace", "output" };
+
+/// Measured time per pipeline stage in seconds.
+typedef struct {
+    double parseWed, findTis, copyTis, openTis, readTiles, convertTiles, writeTiles;
+} stages_t;
+
+/// Result of a single benchmark configuration.
+typedef struct {
+    const corpus_t *corpus;
+    int mode;
+    int io;
+    int tiles;          // tile pairs converted per iteration
+    double best, mean;  // end-to-end time per iteration in seconds
+    stages_t stages;    // mean time per stage in seconds
+} result_t;
+def_cleanFunc(cleanResults, result_t*)
+
+// Return monotonic time in seconds.
+double now();
+// Silence (or restore) the standard output channels of the conversion functions.
+void silence(bool enable);
+// Restore pristine copy of TIS file.
+bool restoreTIS(const char *srcFile, const char *dstFile);
+// Perform a conversion by convert() and add the time per pipeline stage reported by its instrumentation.
+int runStaged(const char *wedFile, array_t *searchPath, const char *outputDir, stages_t *stages);
+// Run all iterations of a single configuration.
+bool runBenchmark(const char *dir, const corpus_t *corpus, int io, int iterations, result_t *result);
+// Write results in JSON format.
+bool writeJSON(const char *fileName, const result_t *results, size_t count, int iterations);
+// Create directory if it doesn't exist already.
+bool makeDir(const char *path);
+
+void printBenchHelp() {
+    printf("Usage: %s [OPTIONS]...\n", BENCH_NAME);
+    printf("Generate a synthetic WED/TIS corpus and measure conversion throughput of %s.\n\n", TIS2OVL_NAME);
+    printf("Options:\n");
+    printf("  -d dir        Working directory for the generated corpus. Default: %s.tmp\n", BENCH_NAME);
+    printf("  -n count      Number of iterations per configuration. Default: 3\n");
+    printf("  -o file       Write results in JSON format to the specified file.\n");
+    printf("  -L            Include large tilesets.\n");
+    printf("  -g            Generate corpus only and exit.\n");
+    printf("  -h            Print this help and exit.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *workDir = BENCH_NAME ".tmp";
+    const char *jsonFile = NULL;
+    int iterations = 3;
+    bool large = false, generateOnly = false;
+
+    int c;
+    opterr = 0;
+    while ((c = getopt(argc, argv, "d:n:o:Lgh")) != -1) {
+        switch (c) {
+        case 'd':
+            workDir = optarg;
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            if (iterations < 1) iterations = 1;
+            break;
+        case 'o':
+            jsonFile = optarg;
+            break;
+        case 'L':
+            large = true;
+            break;
+        case 'g':
+            generateOnly = true;
+            break;
+        case 'h':
+            printBenchHelp();
+            return EXIT_SUCCESS;
+        default:
+            printBenchHelp();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // corpus matrix: tile count x overlay density x palette fullness x layout
+    static const int sizes[][2] = { {8, 6}, {40, 30}, {80, 60} };
+    static const int densities[] = { 10, 50 };
+    static const int palettes[] = { 192, 256 };
+    size_t numSizes = large ? 3 : 2;
+    corpus_t corpora[3 * 2 * 2 * 2];
+    size_t numCorpora = 0;
+    for (size_t s = 0; s < numSizes; ++s)
+        for (size_t d = 0; d < sizeof(densities) / sizeof(*densities); ++d)
+            for (size_t p = 0; p < sizeof(palettes) / sizeof(*palettes); ++p)
+                for (int ee = 0; ee < 2; ++ee)
+                    corpusInit(&corpora[numCorpora++], sizes[s][0], sizes[s][1], densities[d], palettes[p], ee);
+
+    char srcDir[FILENAME_MAX];
+    snprintf(srcDir, sizeof(srcDir), "%s/src", workDir);
+    if (!evalOp(makeDir(workDir) && makeDir(srcDir), "Error: Could not create working directory: %s\n", workDir)) return EXIT_FAILURE;
+    printf("Generating %zu tilesets in \"%s\"...\n", numCorpora, srcDir);
+    for (size_t i = 0; i < numCorpora; ++i)
+        if (corpusGenerate(&corpora[i], srcDir, NULL, NULL) < 0) return EXIT_FAILURE;
+    if (generateOnly) return EXIT_SUCCESS;
+
+    result_t *results finally(cleanResults) = calloc(numCorpora * IO_COUNT, sizeof(result_t));
+    size_t numResults = 0;
+    printf("\n%-10s %-9s %-8s %-8s %7s %6s %7s %10s %10s\n", "tileset", "layout", "mode", "io", "pairs", "dens%", "colors", "best[ms]", "tiles/s");
+    for (size_t i = 0; i < numCorpora; ++i) {
+        for (int io = 0; io < IO_COUNT; ++io) {
+            result_t *r = &results[numResults];
+            if (!runBenchmark(workDir, &corpora[i], io, iterations, r)) {
+                printMsg(OUTPUT_ERR, "Error: Benchmark failed for tileset %s (%s)\n", corpora[i].name, ioNames[io]);
+                return EXIT_FAILURE;
+            }
+            numResults++;
+            printf("%-10s %-9s %-8s %-8s %7d %6d %7d %10.2f %10.0f\n", corpora[i].name, corpora[i].eeLayout ? "ee" : "classic",
+                   (r->mode == MODE_TO_EE) ? "to_ee" : "from_ee", ioNames[io], r->tiles, corpora[i].density, corpora[i].paletteUse,
+                   r->best * 1000.0, (r->mean > 0.0) ? r->tiles / r->mean : 0.0);
+        }
+    }
+
+    if (jsonFile) {
+        if (!evalOp(writeJSON(jsonFile, results, numResults, iterations), "Error: Could not write JSON file: %s\n", jsonFile)) return EXIT_FAILURE;
+        printf("\nResults written to \"%s\"\n", jsonFile);
+    }
+    return EXIT_SUCCESS;
+}
+
+
+bool runBenchmark(const char *dir, const corpus_t *corpus, int io, int iterations, result_t *result) {
+    char srcDir[FILENAME_MAX], workDir[FILENAME_MAX], wedFile[FILENAME_MAX], srcFile[FILENAME_MAX], workFile[FILENAME_MAX];
+    snprintf(srcDir, sizeof(srcDir), "%s/src", dir);
+    snprintf(workDir, sizeof(workDir), "%s/%s", dir, (io == IO_INPLACE) ? "work" : "out");
+    if (!makeDir(workDir)) return false;
+    if (snprintf(wedFile, sizeof(wedFile), "%s/%s.wed", srcDir, corpus->name) >= (int)sizeof(wedFile) ||
+        snprintf(srcFile, sizeof(srcFile), "%s/%s.tis", srcDir, corpus->name) >= (int)sizeof(srcFile) ||
+        snprintf(workFile, sizeof(workFile), "%s/%s.tis", workDir, corpus->name) >= (int)sizeof(workFile)) {
+        printMsg(OUTPUT_ERR, "Error: Path too long: %s\n", dir);
+        return false;
+    }
+
+    // in-place conversion operates on a restored copy; output mode reads the pristine source
+    array_t searchPath;
+    arrayInit(&searchPath, 0);
+    arrayAddItem(&searchPath, (io == IO_INPLACE) ? workDir : srcDir);
+    const char *outputDir = (io == IO_OUTPUT) ? workDir : NULL;
+
+    memset(result, 0, sizeof(result_t));
+    result->corpus = corpus;
+    result->io = io;
+    result->mode = param_mode = corpus->eeLayout ? MODE_FROM_EE : MODE_TO_EE;
+    result->best = -1.0;
+    param_quiet = true;
+
+    bool retVal = true;
+    for (int i = 0; i < iterations && retVal; ++i) {
+        // end-to-end run
+        if (io == IO_INPLACE && !restoreTIS(srcFile, workFile)) { retVal = false; break; }
+        silence(true);
+        double t0 = now();
+        int tiles = convert(wedFile, &searchPath, outputDir, NULL);
+        double t = now() - t0;
+        silence(false);
+        if (tiles < 0) { retVal = false; break; }
+        result->tiles = tiles;
+        result->mean += t;
+        if (result->best < 0.0 || t < result->best) result->best = t;
+
+        // staged run
+        if (io == IO_INPLACE && !restoreTIS(srcFile, workFile)) { retVal = false; break; }
+        silence(true);
+        tiles = runStaged(wedFile, &searchPath, outputDir, &result->stages);
+        silence(false);
+        if (tiles < 0) { retVal = false; break; }
+    }
+    arrayFree(&searchPath);
+    if (!retVal) return false;
+
+    result->mean /= iterations;
+    double *stage = (double*)&result->stages;
+    for (size_t i = 0; i < sizeof(stages_t) / sizeof(double); ++i)
+        stage[i] /= iterations;
+    return true;
+}
+
+
+int runStaged(const char *wedFile, array_t *searchPath, const char *outputDir, stages_t *stages) {
+    // stage times accumulate over all runs, only the difference is attributed to this run
+    uint64_t before[STAGE_COUNT];
+    for (int i = 0; i < STAGE_COUNT; ++i)
+        before[i] = statsGetStageTime(i);
+    statsEnable(true);
+    int tiles = convert(wedFile, searchPath, outputDir, NULL);
+    statsEnable(false);
+    if (tiles < 0) return -1;
+
+    double elapsed[STAGE_COUNT];
+    for (int i = 0; i < STAGE_COUNT; ++i)
+        elapsed[i] = (statsGetStageTime(i) - before[i]) * 1e-9;
+    stages->parseWed += elapsed[STAGE_PARSE_WED];
+    stages->findTis += elapsed[STAGE_FIND_TIS];
+    stages->copyTis += elapsed[STAGE_COPY_TIS];
+    stages->openTis += elapsed[STAGE_OPEN_TIS];
+    stages->readTiles += elapsed[STAGE_READ_TILES];
+    stages->convertTiles += elapsed[STAGE_TO_EE] + elapsed[STAGE_FROM_EE];
+    stages->writeTiles += elapsed[STAGE_WRITE_TILES];
+    return tiles;
+}
+
+
+bool writeJSON(const char *fileName, const result_t *results, size_t count, int iterations) {
+    FILE *fp finally(cleanFile) = fopen(fileName, "w");
+    if (!fp) return false;
+    fprintf(fp, "{\n  \"tool\": \"%s\",\n  \"version\": \"%s\",\n  \"timestamp\": %lld,\n  \"iterations\": %d,\n  \"results\": [\n",
+            TIS2OVL_NAME, TIS2OVL_VERSION, (long long)time(NULL), iterations);
+    for (size_t i = 0; i < count; ++i) {
+        const result_t *r = &results[i];
+        const stages_t *s = &r->stages;
+        fprintf(fp, "    {\"tileset\": \"%s\", \"width\": %d, \"height\": %d, \"density\": %d, \"palette\": %d, \"layout\": \"%s\", "
+                    "\"direction\": \"%s\", \"io\": \"%s\", \"tile_pairs\": %d, \"best_sec\": %.6f, \"mean_sec\": %.6f, \"tiles_per_sec\": %.1f, "
+                    "\"stages_sec\": {\"parse_wed\": %.6f, \"find_tis\": %.6f, \"copy_tis\": %.6f, \"open_tis\": %.6f, "
+                    "\"read_tiles\": %.6f, \"convert_tiles\": %.6f, \"write_tiles\": %.6f}}%s\n",
+                r->corpus->name, r->corpus->width, r->corpus->height, r->corpus->density, r->corpus->paletteUse,
+                r->corpus->eeLayout ? "ee" : "classic", (r->mode == MODE_TO_EE) ? "to_ee" : "from_ee", ioNames[r->io],
+                r->tiles, r->best, r->mean, (r->mean > 0.0) ? r->tiles / r->mean : 0.0,
+                s->parseWed, s->findTis, s->copyTis, s->openTis, s->readTiles, s->convertTiles, s->writeTiles,
+                (i + 1 < count) ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return !ferror(fp);
+}
+
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void silence(bool enable) {
+    static int savedErr = -1;
+    fflush(stdout);
+    fflush(stderr);
+    if (enable && savedErr < 0) {
+#ifdef _WIN32
+        int fd = open("NUL", O_WRONLY);
+#else
+        int fd = open("/dev/null", O_WRONLY);
+#endif
+        if (fd >= 0) {
+            savedErr = dup(STDERR_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+    } else if (!enable && savedErr >= 0) {
+        dup2(savedErr, STDERR_FILENO);
+        close(savedErr);
+        savedErr = -1;
+    }
+}
+
+bool restoreTIS(const char *srcFile, const char *dstFile) {
+    return copyFile(srcFile, dstFile, true);
+}
+
+bool makeDir(const char *path) {
+    if (directoryExists(path)) return true;
+#ifdef _WIN32
+    return mkdir(path) == 0;
+#else
+    return mkdir(path, 0755) == 0;
+#endif
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <string.h>
+#include "compat.h"
+#include "functions.h"
+#include "tis2ovl.h"
+#include "corpus.h"
+
+#define WED_HEADER_SIZE 0x20
+#define WED_OVERLAY_SIZE 0x18
+#define WED_TILEMAP_SIZE 10
+
+// Internally used. Store value in little endian byte order.
+static inline void putShort(uint8_t *ptr, int16_t value) { ptr[0] = value & 0xff; ptr[1] = (value >> 8) & 0xff; }
+static inline void putLong(uint8_t *ptr, int32_t value) { putShort(ptr, value & 0xffff); putShort(ptr + 2, (value >> 16) & 0xffff); }
+
+
+void corpusInit(corpus_t *corpus, int width, int height, int density, int paletteUse, bool eeLayout) {
+    if (corpus) {
+        memset(corpus, 0, sizeof(corpus_t));
+        corpus->width = width;
+        corpus->height = height;
+        corpus->density = (density < 0) ? 0 : (density > 100) ? 100 : density;
+        corpus->paletteUse = (paletteUse < 2) ? 2 : (paletteUse > 256) ? 256 : paletteUse;
+        corpus->eeLayout = eeLayout;
+        corpus->seed = 0x9e3779b9u ^ ((uint32_t)width * 73856093u) ^ ((uint32_t)height * 19349663u) ^
+                       ((uint32_t)density * 83492791u) ^ (uint32_t)paletteUse ^ (eeLayout ? 0x5bd1e995u : 0);
+        if (!corpus->seed) corpus->seed = 1;
+        uint32_t hash = corpus->seed;
+        for (int i = 0; i < 4; ++i) corpusRandom(&hash);
+        snprintf(corpus->name, sizeof(corpus->name), "b%c%06x", eeLayout ? 'e' : 'c', (unsigned)(hash & 0xffffff));
+    }
+}
+
+uint8_t* corpusBuildWED(const corpus_t *corpus, size_t *size, int *pairs) {
+    if (!corpus || corpus->width <= 0 || corpus->height <= 0) return NULL;
+    uint32_t state = corpus->seed;
+    int cells = corpus->width * corpus->height;
+    size_t ofsTilemap = WED_HEADER_SIZE + WED_OVERLAY_SIZE;
+    size_t ofsLookup = ofsTilemap + (size_t)cells * WED_TILEMAP_SIZE;
+    size_t wedSize = ofsLookup + (size_t)cells * 2;
+    uint8_t *wed = calloc(1, wedSize);
+    if (!wed) return NULL;
+
+    memcpy(wed, "WED V1.3", 8);
+    putLong(wed + 0x08, 1);
+    putLong(wed + 0x10, WED_HEADER_SIZE);
+    uint8_t *ovl = wed + WED_HEADER_SIZE;
+    putShort(ovl, corpus->width);
+    putShort(ovl + 2, corpus->height);
+    memcpy(ovl + 4, corpus->name, strlen(corpus->name));
+    putShort(ovl + 0x0c, cells);
+    putLong(ovl + 0x10, ofsTilemap);
+    putLong(ovl + 0x14, ofsLookup);
+
+    // secondary tiles are stored after all primary tiles
+    int numPairs = 0;
+    for (int i = 0; i < cells; ++i) {
+        bool overlay = (int)(corpusRandom(&state) % 100) < corpus->density;
+        uint8_t *entry = wed + ofsTilemap + (size_t)i * WED_TILEMAP_SIZE;
+        putShort(entry, i);
+        putShort(entry + 2, 1);
+        putShort(entry + 4, overlay ? cells + numPairs++ : -1);
+        entry[6] = overlay ? 1 : 0;
+        putShort(wed + ofsLookup + (size_t)i * 2, i);
+    }
+
+    if (size) *size = wedSize;
+    if (pairs) *pairs = numPairs;
+    return wed;
+}
+
+int corpusGenerate(const corpus_t *corpus, const char *dir, char *wedFile, char *tisFile) {
+    if (!corpus || !dir) return -1;
+    size_t wedSize;
+    int pairs;
+    uint8_t *wed finally(cleanMem8) = corpusBuildWED(corpus, &wedSize, &pairs);
+    if (!wed) return -1;
+    int cells = corpus->width * corpus->height;
+
+    // writing WED
+    char path[FILENAME_MAX];
+    snprintf(path, sizeof(path), "%s/%s.wed", dir, corpus->name);
+    FILE *fp finally(cleanFile) = fopen(path, "wb");
+    if (!evalOp(fp != NULL, "Error: Could not create WED file: %s\n", path)) return -1;
+    if (!evalOp(fwrite(wed, 1, wedSize, fp) == wedSize, "Error: Could not write WED file: %s\n", path)) return -1;
+    fclose(fp);
+    fp = NULL;
+    if (wedFile) strcpy(wedFile, path);
+
+    // writing TIS
+    uint8_t header[TIS_HEADER_SIZE] = {0};
+    memcpy(header, "TIS V1  ", 8);
+    putLong(header + 0x08, cells + pairs);
+    putLong(header + 0x0c, TILE_SIZE);
+    putLong(header + 0x10, TIS_HEADER_SIZE);
+    putLong(header + 0x14, TILE_DIM);
+    snprintf(path, sizeof(path), "%s/%s.tis", dir, corpus->name);
+    fp = fopen(path, "wb");
+    if (!evalOp(fp != NULL, "Error: Could not create TIS file: %s\n", path)) return -1;
+    if (!evalOp(fwrite(header, 1, sizeof(header), fp) == sizeof(header), "Error: Could not write TIS file: %s\n", path)) return -1;
+    uint32_t state = corpus->seed ^ 0xa5a5a5a5u;
+    if (!state) state = 1;
+    uint8_t tile[TILE_SIZE];
+    for (int i = 0; i < cells + pairs; ++i) {
+        bool primary = (i < cells), overlay = true;
+        if (primary) {
+            int16_t sec;
+            memcpy(&sec, wed + WED_HEADER_SIZE + WED_OVERLAY_SIZE + (size_t)i * WED_TILEMAP_SIZE + 4, 2);
+            overlay = (sec >= 0);
+        }
+        if (corpus->eeLayout)
+            // EE: primary tiles reference transparent palette entry 0 in overlay regions
+            corpusGenerateTile(tile, &state, corpus->paletteUse, primary && overlay, primary && overlay);
+        else
+            // classic: secondary tiles mark overlay regions by color index 0
+            corpusGenerateTile(tile, &state, corpus->paletteUse, false, !primary);
+        if (!evalOp(fwrite(tile, 1, TILE_SIZE, fp) == TILE_SIZE, "Error: Could not write TIS file: %s\n", path)) return -1;
+    }
+    if (tisFile) strcpy(tisFile, path);
+
+    return pairs;
+}
+
+
+void corpusGenerateTile(uint8_t *tile, uint32_t *state, int paletteUse, bool transparent, bool mask) {
+    uint32_t *pal = (uint32_t*)tile;
+    for (int i = 0; i < 256; ++i) {
+        uint32_t color;
+        do {
+            color = corpusRandom(state) & 0x00ffffff;
+        } while (color == TRANSPARENT);
+        pal[i] = color;
+    }
+    if (transparent) pal[0] = TRANSPARENT;
+
+    // overlay region is a circle of random size and position
+    int cx = corpusRandom(state) % TILE_DIM, cy = corpusRandom(state) % TILE_DIM;
+    int r = 8 + corpusRandom(state) % (TILE_DIM / 2);
+    // pixel data in mostly smooth runs to resemble actual tile graphics
+    int first = transparent ? 1 : 0, range = paletteUse - first;
+    int idx = 0;
+    uint8_t *pixels = tile + 1024;
+    for (int y = 0; y < TILE_DIM; ++y) {
+        for (int x = 0; x < TILE_DIM; ++x) {
+            uint32_t rnd = corpusRandom(state);
+            if ((rnd & 7) == 0 || (x == 0 && y == 0))
+                idx = (rnd >> 8) % range;
+            bool inside = (x - cx) * (x - cx) + (y - cy) * (y - cy) < r * r;
+            if (mask && inside)
+                pixels[y * TILE_DIM + x] = 0;
+            else if (mask && !transparent)
+                pixels[y * TILE_DIM + x] = 1 + (idx % (paletteUse - 1));
+            else
+                pixels[y * TILE_DIM + x] = first + idx;
+        }
+    }
+
+    // make sure that all requested palette entries are referenced
+    for (int i = first; i < paletteUse; ++i) {
+        size_t p = (i * 2654435761u) % 4096;
+        if (mask && (pixels[p] == 0 || i == 0)) continue;
+        pixels[p] = i;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef CORPUS_H_INCLUDED
+#define CORPUS_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Definition of a synthetic WED/TIS pair.
+typedef struct {
+    char name[9];       // WED and TIS resref (max. 8 characters)
+    int width, height;  // overlay dimensions in tiles
+    int density;        // percentage of overlay cells with secondary tiles
+    int paletteUse;     // number of distinct palette entries referenced by pixel data (1-256)
+    bool eeLayout;      // whether tile pairs are generated in EE overlay layout
+    uint32_t seed;      // seed for the pseudo-random generator
+} corpus_t;
+
+/// Initialize corpus definition and derive a unique resref from the parameters.
+void corpusInit(corpus_t *corpus, int width, int height, int density, int paletteUse, bool eeLayout);
+
+/// Deterministic pseudo-random generator (xorshift32). "state" must not be zero.
+static inline uint32_t corpusRandom(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * Generate a single palette-based tile.
+ * \param tile         Storage for palette and pixel data (TILE_SIZE bytes).
+ * \param state        State of the pseudo-random generator.
+ * \param paletteUse   Number of distinct palette entries referenced by pixel data.
+ * \param transparent  Whether palette entry 0 is the transparent color.
+ * \param mask         Whether a circular region of pixels is set to color index 0.
+ */
+void corpusGenerateTile(uint8_t *tile, uint32_t *state, int paletteUse, bool transparent, bool mask);
+
+/**
+ * Build WED data for the given corpus definition in memory.
+ * \param corpus   Corpus definition.
+ * \param size     Storage for the size of the returned buffer.
+ * \param pairs    Storage for the number of overlay tile pairs.
+ * \return WED data that has to be released by the caller, or NULL on error.
+ */
+uint8_t* corpusBuildWED(const corpus_t *corpus, size_t *size, int *pairs);
+
+/**
+ * Generate WED and TIS file for the given corpus definition. Output is fully deterministic.
+ * \param corpus    Corpus definition.
+ * \param dir       Output directory.
+ * \param wedFile   Optional storage for the path of the generated WED file.
+ * \param tisFile   Optional storage for the path of the generated TIS file.
+ * \return number of overlay tile pairs, or -1 on error.
+ */
+int corpusGenerate(const corpus_t *corpus, const char *dir, char *wedFile, char *tisFile);
+
+#endif // CORPUS_H_INCLUDED
@@ -0,0 +1,603 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "compat.h"
+#include "global.h"
+#include "functions.h"
+#include "colors.h"
+#include "tis2ovl.h"
+#include "tisv2.h"
+#include "palcache.h"
+#include "quantizer.h"
+#include "corpus.h"
+#include "reference.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define HAVE_TSC 1
+#endif
+
+#define BENCH_NAME "tis2ovl_kernels"
+#define NUM_RANDOM 256
+#define NUM_PIXELS (TILE_DIM * TILE_DIM)
+
+/// Collection of input data for a benchmark set.
+typedef struct {
+    const char *name;
+    size_t count;       // number of tile pairs
+    uint8_t *pri;       // primary tiles (TILE_SIZE bytes each)
+    uint8_t *sec;       // secondary tiles (TILE_SIZE bytes each)
+    uint32_t *rgba;     // composited truecolor tiles (NUM_PIXELS entries each)
+    bool *transparent;  // whether composited tile contains transparent pixels
+    uint8_t **wed;      // WED data for the extraction kernel
+    size_t *wedSize;    // size of WED data in bytes
+    size_t numWed;
+    size_t cells;       // total number of WED overlay cells
+} inputs_t;
+
+/// Scratch buffers shared by all kernels.
+typedef struct {
+    uint8_t a[TILE_SIZE], b[TILE_SIZE], c[TILE_SIZE], d[TILE_SIZE];
+    uint32_t rgba[NUM_PIXELS];
+    arena_t arena;
+    volatile int sink;
+} scratch_t;
+
+/// Kernel definition: "run" executes the current implementation, "check" compares it against the reference.
+/// Lossy kernels can report the color error of their results by "error".
+typedef struct {
+    const char *name;
+    bool ee;                // whether kernel operates on EE tiles instead of classic tiles
+    bool wed;               // whether kernel operates on WED data instead of tiles
+    void (*run)(const inputs_t*, size_t, scratch_t*);
+    bool (*check)(const inputs_t*, size_t, scratch_t*);
+    double (*error)(const inputs_t*, size_t, scratch_t*);   // optional: mean squared error per pixel of the result
+} kernel_t;
+
+#define PRI(in, i) ((in)->pri + (size_t)(i) * TILE_SIZE)
+#define SEC(in, i) ((in)->sec + (size_t)(i) * TILE_SIZE)
+#define RGBA(in, i) ((in)->rgba + (size_t)(i) * NUM_PIXELS)
+
+// Kernel adapters
+static void runGetMode(const inputs_t *in, size_t i, scratch_t *s) { s->sink += getMode(MODE_AUTO, PRI(in, i)); }
+static bool checkGetMode(const inputs_t *in, size_t i, scratch_t *s) { (void)s; return getMode(MODE_AUTO, PRI(in, i)) == refGetMode(MODE_AUTO, PRI(in, i)); }
+
+static void runColorIndex(const inputs_t *in, size_t i, scratch_t *s) { s->sink += colorIndex(PRI(in, i), 256, TRANSPARENT); }
+static bool checkColorIndex(const inputs_t *in, size_t i, scratch_t *s) {
+    (void)s;
+    return colorIndex(PRI(in, i), 256, TRANSPARENT) == refColorIndex(PRI(in, i), 256, TRANSPARENT) &&
+           colorIndex(SEC(in, i), 256, ((uint32_t*)SEC(in, i))[i & 255]) == refColorIndex(SEC(in, i), 256, ((uint32_t*)SEC(in, i))[i & 255]);
+}
+
+static void runGetMergeableColors(const inputs_t *in, size_t i, scratch_t *s) {
+    uint8_t c1, c2;
+    getMergeableColors(PRI(in, i), &c1, &c2);
+    s->sink += c1 + c2;
+}
+static bool checkGetMergeableColors(const inputs_t *in, size_t i, scratch_t *s) {
+    (void)s;
+    uint8_t c1 = 0, c2 = 0, r1 = 0, r2 = 0;
+    bool ok1 = getMergeableColors(PRI(in, i), &c1, &c2);
+    bool ok2 = refGetMergeableColors(PRI(in, i), &r1, &r2);
+    return ok1 == ok2 && c1 == r1 && c2 == r2;
+}
+
+static void runAdjustTileColors(const inputs_t *in, size_t i, scratch_t *s) {
+    memcpy(s->a, PRI(in, i), TILE_SIZE);
+    adjustTileColors(s->a, (uint8_t)i, (uint8_t)(i * 7));
+}
+static bool checkAdjustTileColors(const inputs_t *in, size_t i, scratch_t *s) {
+    uint8_t c1 = 0, c2 = 0;
+    refGetMergeableColors(PRI(in, i), &c1, &c2);
+    uint8_t pairs[][2] = { {c1, c2}, {c2, c1}, {(uint8_t)i, (uint8_t)(i * 7)}, {0, 0}, {255, 0} };
+    for (size_t k = 0; k < sizeof(pairs) / sizeof(*pairs); ++k) {
+        memcpy(s->a, PRI(in, i), TILE_SIZE);
+        memcpy(s->b, PRI(in, i), TILE_SIZE);
+        adjustTileColors(s->a, pairs[k][0], pairs[k][1]);
+        refAdjustTileColors(s->b, pairs[k][0], pairs[k][1]);
+        if (memcmp(s->a, s->b, TILE_SIZE) != 0) return false;
+    }
+    return true;
+}
+
+static void runTileToEE(const inputs_t *in, size_t i, scratch_t *s) {
+    tile_t t = { 0, 1 };
+    tileToEE(&t, PRI(in, i), SEC(in, i), s->a, s->b);
+}
+static bool checkTileToEE(const inputs_t *in, size_t i, scratch_t *s) {
+    tile_t t = { 0, 1 };
+    return tileToEE(&t, PRI(in, i), SEC(in, i), s->a, s->b) == refTileToEE(PRI(in, i), SEC(in, i), s->c, s->d) &&
+           memcmp(s->a, s->c, TILE_SIZE) == 0 && memcmp(s->b, s->d, TILE_SIZE) == 0;
+}
+
+/// Return perceptually weighted squared distance of two colors in BGR format, as used for palette remapping.
+static int squaredDistance(uint32_t c1, uint32_t c2) {
+    static const int weights[3] = { 11, 59, 30 };
+    int d = 0;
+    for (int k = 0; k < 3; ++k) {
+        int dc = ((int)((c1 >> (k * 8)) & 0xff) - (int)((c2 >> (k * 8)) & 0xff)) * weights[k];
+        d += dc * dc;
+    }
+    return d;
+}
+
+/// Return whether each pixel of "tile" refers to the nearest of the used palette entries. Transparent pixels must be
+/// mapped to the transparent color.
+static bool isNearestRemap(const uint32_t *rgba, const uint8_t *tile) {
+    const uint32_t *pal = (const uint32_t*)tile;
+    bool used[256] = { false };
+    for (int p = 0; p < NUM_PIXELS; ++p)
+        used[tile[1024 + p]] = true;
+    for (int p = 0; p < NUM_PIXELS; ++p) {
+        uint32_t color = rgba[p] & 0xffffff, mapped = pal[tile[1024 + p]] & 0xffffff;
+        if ((color == TRANSPARENT) != (mapped == TRANSPARENT)) return false;
+        int dist = squaredDistance(color, mapped);
+        for (int k = 0; k < 256; ++k)
+            if (used[k] && (pal[k] & 0xffffff) != TRANSPARENT && squaredDistance(color, pal[k]) < dist) return false;
+    }
+    return true;
+}
+
+// Composite EE tile pair into truecolor pixels.
+static void compositeTile(const uint8_t *pri, const uint8_t *sec, uint32_t *rgba) {
+    for (int p = 0; p < NUM_PIXELS; ++p)
+        rgba[p] = pri[1024 + p] ? ((const uint32_t*)pri)[pri[1024 + p]] : (sec[1024 + p] ? ((const uint32_t*)sec)[sec[1024 + p]] : TRANSPARENT);
+}
+
+static void runTileFromEE(const inputs_t *in, size_t i, scratch_t *s) {
+    tile_t t = { 0, 1 };
+    tileFromEE(&t, PRI(in, i), SEC(in, i), s->a, s->b, s->rgba, in->name);
+}
+static bool checkTileFromEE(const inputs_t *in, size_t i, scratch_t *s) {
+    tile_t t = { 0, 1 };
+    // libimagequant only: identical to reference
+    double maxError = param_tile_error;
+    param_tile_error = -1.0;
+    bool retVal = tileFromEE(&t, PRI(in, i), SEC(in, i), s->a, s->b, s->rgba, in->name) == refTileFromEE(PRI(in, i), SEC(in, i), s->c, s->d) &&
+                  memcmp(s->a, s->c, TILE_SIZE) == 0 && memcmp(s->b, s->d, TILE_SIZE) == 0;
+    param_tile_error = maxError;
+    // quantization tiers: within error bound, or not less accurate than the reference
+    retVal = retVal && tileFromEE(&t, PRI(in, i), SEC(in, i), s->a, s->b, s->rgba, in->name) && memcmp(s->b, s->d, TILE_SIZE) == 0;
+    compositeTile(PRI(in, i), SEC(in, i), s->rgba);
+    uint64_t error = tileSquaredError(s->rgba, s->a);
+    return retVal && (error <= maxError * NUM_PIXELS || error <= tileSquaredError(s->rgba, s->c));
+}
+
+static palcache_t kernelCache;
+static void runPalCacheRemap(const inputs_t *in, size_t i, scratch_t *s) {
+    tile_t t = { 0, 1 };
+    if (!kernelCache.capacity) palCacheInit(&kernelCache);
+    if (!palCacheRemap(&kernelCache, PRI(in, i), SEC(in, i), s->a, param_tile_error) &&
+        tileFromEE(&t, PRI(in, i), SEC(in, i), s->a, s->b, s->rgba, in->name))
+        palCacheStore(&kernelCache, PRI(in, i), SEC(in, i), s->a);
+}
+static bool checkPalCacheRemap(const inputs_t *in, size_t i, scratch_t *s) {
+    // remapping the tile pair that created the entry reproduces the converted tile
+    tile_t t = { 0, 1 };
+    palCacheInit(&kernelCache);
+    if (!tileFromEE(&t, PRI(in, i), SEC(in, i), s->c, s->d, s->rgba, in->name)) return false;
+    palCacheStore(&kernelCache, PRI(in, i), SEC(in, i), s->c);
+    if (!palCacheRemap(&kernelCache, PRI(in, i), SEC(in, i), s->a, param_tile_error) || memcmp(s->a, s->c, TILE_SIZE) != 0) return false;
+    compositeTile(PRI(in, i), SEC(in, i), s->rgba);
+    uint64_t error = tileSquaredError(s->rgba, s->c);
+
+    // palettes differing in any component, including alpha, never hit the entry
+    memcpy(s->b, PRI(in, i), TILE_SIZE);
+    ((uint32_t*)s->b)[1 + i % 255] ^= 0x01000000;
+    if (palCacheRemap(&kernelCache, s->b, SEC(in, i), s->a, param_tile_error)) return false;
+
+    // other tile pairs with the same palettes are within the error bound of the entry
+    memcpy(s->b, PRI(in, i), TILE_SIZE);
+    memcpy(s->d, SEC(in, i), TILE_SIZE);
+    for (int p = 0; p < NUM_PIXELS; ++p) {
+        s->b[1024 + p] = PRI(in, i)[TILE_SIZE - 1 - p];
+        s->d[1024 + p] = SEC(in, i)[1024 + (p * 7) % NUM_PIXELS];
+    }
+    if (!palCacheRemap(&kernelCache, s->b, s->d, s->a, param_tile_error)) return true;
+    compositeTile(s->b, s->d, s->rgba);
+    uint64_t remapError = tileSquaredError(s->rgba, s->a);
+    for (int p = 0; p < NUM_PIXELS; ++p)
+        if ((s->rgba[p] == TRANSPARENT) != (((uint32_t*)s->a)[s->a[1024 + p]] == TRANSPARENT)) return false;
+    return remapError <= param_tile_error * NUM_PIXELS || remapError <= error;
+}
+
+static void runTileErrorStats(const inputs_t *in, size_t i, scratch_t *s) {
+    tileerror_t error;
+    tileErrorStats(RGBA(in, i), PRI(in, i), &error);
+    s->sink += error.maxDistance;
+}
+static bool checkTileErrorStats(const inputs_t *in, size_t i, scratch_t *s) {
+    (void)s;
+    tileerror_t error;
+    tileErrorStats(RGBA(in, i), PRI(in, i), &error);
+    const uint32_t *pal = (const uint32_t*)PRI(in, i);
+    int maxDistance = 0;
+    for (int p = 0; p < NUM_PIXELS; ++p) {
+        int dist = squaredDistance(RGBA(in, i)[p], pal[PRI(in, i)[1024 + p]]);
+        if (dist > maxDistance) maxDistance = dist;
+    }
+    return error.squaredError == tileSquaredError(RGBA(in, i), PRI(in, i)) && error.maxDistance == maxDistance;
+}
+
+// Full quantization tier of each backend
+static void runQuantizeLiq(const inputs_t *in, size_t i, scratch_t *s) {
+    quantizerGet(QUANTIZER_LIQ)->quantizeTile(RGBA(in, i), s->a, in->transparent[i]);
+}
+static bool checkQuantizeLiq(const inputs_t *in, size_t i, scratch_t *s) {
+    return quantizerGet(QUANTIZER_LIQ)->quantizeTile(RGBA(in, i), s->a, in->transparent[i]) &&
+           refCreateRemappedTile(RGBA(in, i), s->c, in->transparent[i]) && memcmp(s->a, s->c, TILE_SIZE) == 0;
+}
+static double errorQuantizeLiq(const inputs_t *in, size_t i, scratch_t *s) {
+    if (!quantizerGet(QUANTIZER_LIQ)->quantizeTile(RGBA(in, i), s->a, in->transparent[i])) return -1.0;
+    return (double)tileSquaredError(RGBA(in, i), s->a) / NUM_PIXELS;
+}
+static void runQuantizeBuiltin(const inputs_t *in, size_t i, scratch_t *s) {
+    quantizerGet(QUANTIZER_BUILTIN)->quantizeTile(RGBA(in, i), s->a, in->transparent[i]);
+}
+static bool checkQuantizeBuiltin(const inputs_t *in, size_t i, scratch_t *s) {
+    // pixels refer to the nearest palette entry, transparent pixels to the unchanged transparent color
+    return quantizerGet(QUANTIZER_BUILTIN)->quantizeTile(RGBA(in, i), s->a, in->transparent[i]) && isNearestRemap(RGBA(in, i), s->a);
+}
+static double errorQuantizeBuiltin(const inputs_t *in, size_t i, scratch_t *s) {
+    if (!quantizerGet(QUANTIZER_BUILTIN)->quantizeTile(RGBA(in, i), s->a, in->transparent[i])) return -1.0;
+    return (double)tileSquaredError(RGBA(in, i), s->a) / NUM_PIXELS;
+}
+
+static void runCreateRemappedTile(const inputs_t *in, size_t i, scratch_t *s) {
+    createRemappedTile(RGBA(in, i), s->a, in->transparent[i]);
+}
+static bool checkCreateRemappedTile(const inputs_t *in, size_t i, scratch_t *s) {
+    if (remapTileTiered(RGBA(in, i), s->a, in->transparent[i], -1.0) != QUANT_TIER_FULL ||
+        !refCreateRemappedTile(RGBA(in, i), s->c, in->transparent[i]) || memcmp(s->a, s->c, TILE_SIZE) != 0) return false;
+    switch (remapTileTiered(RGBA(in, i), s->a, in->transparent[i], param_tile_error)) {
+    case QUANT_TIER_EXACT:  return tileSquaredError(RGBA(in, i), s->a) == 0;
+    case QUANT_TIER_MERGE:  return tileSquaredError(RGBA(in, i), s->a) <= param_tile_error * NUM_PIXELS ||
+                                   tileSquaredError(RGBA(in, i), s->a) <= tileSquaredError(RGBA(in, i), s->c);
+    case QUANT_TIER_FULL:   return memcmp(s->a, s->c, TILE_SIZE) == 0;
+    default:                return false;
+    }
+}
+
+// DXT1 encoding of a whole tile
+static void encodeTile(const uint32_t *pixels, uint8_t *blocks, int quality) {
+    for (int by = 0; by < TILE_DIM / 4; ++by)
+        for (int bx = 0; bx < TILE_DIM / 4; ++bx, blocks += 8)
+            dxt1EncodeBlock(pixels + by * 4 * TILE_DIM + bx * 4, TILE_DIM, blocks, quality);
+}
+// Squared error of the encoded tile, or UINT64_MAX if transparency is not preserved.
+static uint64_t encodedTileError(const uint32_t *pixels, const uint8_t *blocks, uint32_t *decoded) {
+    for (int by = 0; by < TILE_DIM / 4; ++by)
+        for (int bx = 0; bx < TILE_DIM / 4; ++bx, blocks += 8)
+            dxt1DecodeBlock(blocks, decoded + by * 4 * TILE_DIM + bx * 4, TILE_DIM);
+    uint64_t error = 0;
+    for (int i = 0; i < NUM_PIXELS; ++i) {
+        bool transparent = (pixels[i] >> 24) < 128;
+        if (transparent != (decoded[i] >> 24 == 0)) return UINT64_MAX;
+        for (int shift = 0; !transparent && shift < 24; shift += 8) {
+            int d = (int)((pixels[i] >> shift) & 0xff) - (int)((decoded[i] >> shift) & 0xff);
+            error += (uint64_t)(d * d);
+        }
+    }
+    return error;
+}
+static void runDxt1Encode(const inputs_t *in, size_t i, scratch_t *s) {
+    encodeTile(RGBA(in, i), s->a, DXT_NORMAL);
+}
+static bool checkDxt1Encode(const inputs_t *in, size_t i, scratch_t *s) {
+    // higher quality levels must not increase the error
+    uint64_t errors[3];
+    for (int q = DXT_FAST; q <= DXT_BEST; ++q) {
+        encodeTile(RGBA(in, i), s->a, q);
+        errors[q] = encodedTileError(RGBA(in, i), s->a, s->rgba);
+    }
+    return errors[DXT_FAST] != UINT64_MAX && errors[DXT_NORMAL] != UINT64_MAX && errors[DXT_BEST] <= errors[DXT_NORMAL];
+}
+
+static void runParseWED(const inputs_t *in, size_t i, scratch_t *s) {
+    char tisName[15];
+    tilevec_t list;
+    arenaReset(&s->arena);
+    tilevecInit(&list, 1, &s->arena);
+    parseWEDData(in->wed[i], in->wedSize[i], NULL, tisName, &list);
+    s->sink += (int)list.len;
+}
+static bool checkParseWED(const inputs_t *in, size_t i, scratch_t *s) {
+    char tisName[15];
+    tilevec_t list, ref;
+    arenaReset(&s->arena);
+    tilevecInit(&list, 1, &s->arena);
+    tilevecInit(&ref, 1, &s->arena);
+    if (!parseWEDData(in->wed[i], in->wedSize[i], NULL, tisName, &list) || !refParseWEDData(in->wed[i], &ref)) return false;
+    return list.len == ref.len && memcmp(list.data, ref.data, sizeof(tile_t) * list.len) == 0;
+}
+
+static const kernel_t kernels[] = {
+    { "getMode",              false, false, runGetMode,           checkGetMode,            NULL },
+    { "colorIndex",           false, false, runColorIndex,        checkColorIndex,         NULL },
+    { "getMergeableColors",   false, false, runGetMergeableColors, checkGetMergeableColors, NULL },
+    { "adjustTileColors",     false, false, runAdjustTileColors,  checkAdjustTileColors,   NULL },
+    { "tileToEE",             false, false, runTileToEE,          checkTileToEE,           NULL },
+    { "tileFromEE",           true,  false, runTileFromEE,        checkTileFromEE,         NULL },
+    { "palCacheRemap",        true,  false, runPalCacheRemap,     checkPalCacheRemap,      NULL },
+    { "tileErrorStats",       true,  false, runTileErrorStats,    checkTileErrorStats,     NULL },
+    { "quantizeTile/liq",     true,  false, runQuantizeLiq,       checkQuantizeLiq,        errorQuantizeLiq },
+    { "quantizeTile/builtin", true,  false, runQuantizeBuiltin,   checkQuantizeBuiltin,    errorQuantizeBuiltin },
+    { "createRemappedTile",   true,  false, runCreateRemappedTile, checkCreateRemappedTile, NULL },
+    { "dxt1EncodeBlock",      true,  false, runDxt1Encode,        checkDxt1Encode,         NULL },
+    { "parseWEDData",         false, true,  runParseWED,          checkParseWED,           NULL },
+};
+
+// Allocate input storage for "count" tile pairs.
+bool inputsInit(inputs_t *in, const char *name, size_t count);
+// Release input storage.
+void inputsFree(inputs_t *in);
+// Generate randomized classic or EE tile pairs.
+bool generateRandom(inputs_t *in, bool ee, uint32_t seed);
+// Generate adversarial classic or EE tile pairs.
+bool generateAdversarial(inputs_t *in, bool ee);
+// Generate composited truecolor tiles from EE tile pairs.
+void generateComposite(inputs_t *in);
+// Generate WED data for the extraction kernel.
+bool generateWED(inputs_t *in, uint32_t seed);
+// Return monotonic time in nanoseconds.
+static inline uint64_t nanoTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+// Return CPU timestamp counter, or 0 if not available.
+static inline uint64_t cycles() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+void printBenchHelp() {
+    printf("Usage: %s [OPTIONS]...\n", BENCH_NAME);
+    printf("Measure individual conversion kernels and verify them against the original scalar implementations.\n\n");
+    printf("Options:\n");
+    printf("  -k name       Only run kernels containing the specified name.\n");
+    printf("  -t ms         Minimum measurement time per kernel and input set. Default: 200\n");
+    printf("  -s seed       Seed for randomized input. Default: 1\n");
+    printf("  -c            Only check equivalence, skip measurements.\n");
+    printf("  -h            Print this help and exit.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    uint64_t minTime = 200;
+    uint32_t seed = 1;
+    bool checkOnly = false;
+
+    int c;
+    opterr = 0;
+    while ((c = getopt(argc, argv, "k:t:s:ch")) != -1) {
+        switch (c) {
+        case 'k': filter = optarg; break;
+        case 't': minTime = strtoull(optarg, NULL, 10); break;
+        case 's': seed = (uint32_t)strtoul(optarg, NULL, 10); break;
+        case 'c': checkOnly = true; break;
+        case 'h': printBenchHelp(); return EXIT_SUCCESS;
+        default: printBenchHelp(); return EXIT_FAILURE;
+        }
+    }
+    if (!seed) seed = 1;
+    minTime *= 1000000ull;
+
+    // kernels are called outside of convert(): suppress per-tile log messages
+    param_quiet = true;
+    param_mode = MODE_AUTO;
+    // lower quantization tiers and the palette cache are disabled by default, but measured with a typical error bound
+    param_tile_error = 4.0;
+
+    inputs_t sets[4];
+    memset(sets, 0, sizeof(sets));
+    if (!generateRandom(&sets[0], false, seed) || !generateAdversarial(&sets[1], false) ||
+        !generateRandom(&sets[2], true, seed) || !generateAdversarial(&sets[3], true)) {
+        printMsg(OUTPUT_ERR, "Error: Could not generate input data.\n");
+        return EXIT_FAILURE;
+    }
+    if (!generateWED(&sets[0], seed) || !generateWED(&sets[1], seed ^ 0x5555)) {
+        printMsg(OUTPUT_ERR, "Error: Could not generate WED data.\n");
+        return EXIT_FAILURE;
+    }
+
+    scratch_t *scratch = calloc(1, sizeof(scratch_t));
+    if (!scratch) return EXIT_FAILURE;
+    arenaInit(&scratch->arena, 0);
+
+#ifndef HAVE_TSC
+    printf("Note: CPU cycle counter not available on this platform.\n");
+#endif
+    printf("%-20s %-20s %7s %12s %12s %10s %8s\n", "kernel", "input", "items", "ns/item", "cycles/px", "mse", "check");
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); ++k) {
+        const kernel_t *kernel = &kernels[k];
+        if (filter && !strstr(kernel->name, filter)) continue;
+        for (size_t si = 0; si < 4; ++si) {
+            const inputs_t *in = &sets[si];
+            if (kernel->wed && !in->numWed) continue;
+            if (!kernel->wed && kernel->ee != (si >= 2) && kernel->run != runGetMode && kernel->run != runColorIndex) continue;
+            size_t items = kernel->wed ? in->numWed : in->count;
+
+            // equivalence check
+            int bad = 0;
+            for (size_t i = 0; i < items; ++i)
+                if (!kernel->check(in, i, scratch)) bad++;
+            failures += bad;
+
+            // mean color error of lossy kernels
+            char mse[16] = "-";
+            if (kernel->error) {
+                double error = 0.0;
+                for (size_t i = 0; i < items; ++i)
+                    error += kernel->error(in, i, scratch);
+                snprintf(mse, sizeof(mse), "%.3f", error / (double)items);
+            }
+
+            // measurement
+            double nsPerItem = 0.0, cyclesPerPixel = 0.0;
+            if (!checkOnly) {
+                uint64_t runs = 0, t0 = nanoTime(), c0 = cycles(), t1;
+                do {
+                    for (size_t i = 0; i < items; ++i)
+                        kernel->run(in, i, scratch);
+                    runs += items;
+                    t1 = nanoTime();
+                } while (t1 - t0 < minTime);
+                uint64_t c1 = cycles();
+                // WED extraction is measured per overlay cell
+                size_t units = kernel->wed ? (runs / items) * in->cells : runs;
+                nsPerItem = (double)(t1 - t0) / (double)units;
+                cyclesPerPixel = (double)(c1 - c0) / ((double)units * (kernel->wed ? 1 : NUM_PIXELS));
+            }
+            char label[32];
+            snprintf(label, sizeof(label), "%s%s", in->name, kernel->wed ? "/cell" : "");
+            printf("%-20s %-20s %7zu %12.1f %12.3f %10s %8s\n", kernel->name, label, kernel->wed ? in->cells : items,
+                   nsPerItem, cyclesPerPixel, mse, bad ? "FAIL" : "ok");
+            if (bad) printMsg(OUTPUT_MSG, "Error: %s differs from reference implementation for %d of %zu inputs (%s)\n", kernel->name, bad, items, in->name);
+        }
+    }
+
+    arenaFree(&scratch->arena);
+    free(scratch);
+    for (size_t i = 0; i < 4; ++i) inputsFree(&sets[i]);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+bool inputsInit(inputs_t *in, const char *name, size_t count) {
+    in->name = name;
+    in->count = count;
+    in->pri = calloc(count, TILE_SIZE);
+    in->sec = calloc(count, TILE_SIZE);
+    in->rgba = calloc(count, NUM_PIXELS * sizeof(uint32_t));
+    in->transparent = calloc(count, sizeof(bool));
+    return in->pri && in->sec && in->rgba && in->transparent;
+}
+
+void inputsFree(inputs_t *in) {
+    free(in->pri);
+    free(in->sec);
+    free(in->rgba);
+    free(in->transparent);
+    for (size_t i = 0; i < in->numWed; ++i) free(in->wed[i]);
+    free(in->wed);
+    free(in->wedSize);
+    memset(in, 0, sizeof(inputs_t));
+}
+
+bool generateRandom(inputs_t *in, bool ee, uint32_t seed) {
+    if (!inputsInit(in, ee ? "random-ee" : "random-classic", NUM_RANDOM)) return false;
+    uint32_t state = seed ^ (ee ? 0x1234567u : 0x7654321u);
+    for (size_t i = 0; i < in->count; ++i) {
+        // palette fullness varies from sparse to full
+        int paletteUse = 2 + (int)(i * 254 / (in->count - 1));
+        corpusGenerateTile(PRI(in, i), &state, paletteUse, ee, ee);
+        corpusGenerateTile(SEC(in, i), &state, paletteUse, false, !ee);
+    }
+    generateComposite(in);
+    return true;
+}
+
+bool generateAdversarial(inputs_t *in, bool ee) {
+    enum { UNIFORM, DISTINCT, TRANS_LAST, ZERO_LAST, NO_ZERO, DUP_LAST, ALL_ZERO, CHECKER, NUM_CASES };
+    if (!inputsInit(in, ee ? "adversarial-ee" : "adversarial-classic", NUM_CASES)) return false;
+    for (size_t i = 0; i < in->count; ++i) {
+        uint8_t *pri = PRI(in, i), *sec = SEC(in, i);
+        uint32_t *palPri = (uint32_t*)pri, *palSec = (uint32_t*)sec;
+        // defaults: full palette of distinct colors, all color indices in use
+        for (int c = 0; c < 256; ++c) {
+            palPri[c] = ((c * 0x3b) & 0xff) | (((c * 0x95) & 0xff) << 8) | (((255 - c) & 0xff) << 16);
+            palSec[c] = ((255 - c) & 0xff) | (((c * 0x2f) & 0xff) << 8) | (((c * 0x6d) & 0xff) << 16);
+            if (palPri[c] == TRANSPARENT) palPri[c] ^= 1;
+            if (palSec[c] == TRANSPARENT) palSec[c] ^= 1;
+        }
+        for (int p = 0; p < NUM_PIXELS; ++p) {
+            pri[1024 + p] = (uint8_t)p;
+            sec[1024 + p] = (uint8_t)(p * 3 + 1);
+        }
+        switch (i) {
+        case UNIFORM:       // single color everywhere
+            for (int c = 0; c < 256; ++c) palPri[c] = palSec[c] = 0x00406080;
+            memset(pri + 1024, 1, NUM_PIXELS);
+            memset(sec + 1024, 1, NUM_PIXELS);
+            break;
+        case DISTINCT:      // no unused entries and no identical colors: full merge search
+            break;
+        case TRANS_LAST:    // transparent color at the last palette entry
+            palPri[255] = TRANSPARENT;
+            break;
+        case ZERO_LAST:     // transparent entry 0, color index 0 only at the last pixel
+            palPri[0] = TRANSPARENT;
+            for (int p = 0; p < NUM_PIXELS; ++p) if (!pri[1024 + p]) pri[1024 + p] = 1;
+            pri[TILE_SIZE - 1] = 0;
+            break;
+        case NO_ZERO:       // transparent entry 0, color index 0 unused
+            palPri[0] = TRANSPARENT;
+            for (int p = 0; p < NUM_PIXELS; ++p) if (!pri[1024 + p]) pri[1024 + p] = 255;
+            break;
+        case DUP_LAST:      // only the last two palette entries are identical
+            palPri[255] = palPri[254];
+            break;
+        case ALL_ZERO:      // all pixels reference color index 0
+            if (ee) palPri[0] = TRANSPARENT;
+            memset(pri + 1024, 0, NUM_PIXELS);
+            memset(sec + 1024, 0, NUM_PIXELS);
+            break;
+        case CHECKER:       // alternating overlay mask, 512 distinct colors in the composited tile
+            if (ee) palPri[0] = TRANSPARENT;
+            for (int p = 0; p < NUM_PIXELS; ++p) {
+                bool odd = ((p ^ (p >> 6)) & 1) != 0;
+                if (odd) pri[1024 + p] = 0;
+                else if (!pri[1024 + p]) pri[1024 + p] = 1;
+                sec[1024 + p] = odd ? (uint8_t)(p & 0xff) : 0;
+            }
+            break;
+        }
+    }
+    generateComposite(in);
+    return true;
+}
+
+void generateComposite(inputs_t *in) {
+    for (size_t i = 0; i < in->count; ++i) {
+        const uint8_t *pri = PRI(in, i), *sec = SEC(in, i);
+        const uint32_t *palPri = (const uint32_t*)pri, *palSec = (const uint32_t*)sec;
+        uint32_t *rgba = RGBA(in, i);
+        in->transparent[i] = false;
+        for (int p = 0; p < NUM_PIXELS; ++p) {
+            if (pri[1024 + p]) {
+                rgba[p] = palPri[pri[1024 + p]] | 0xff000000;
+            } else if (sec[1024 + p]) {
+                rgba[p] = palSec[sec[1024 + p]] | 0xff000000;
+            } else {
+                rgba[p] = TRANSPARENT | 0xff000000;
+                in->transparent[i] = true;
+            }
+        }
+    }
+}
+
+bool generateWED(inputs_t *in, uint32_t seed) {
+    static const int sizes[][3] = { {8, 6, 10}, {40, 30, 50}, {80, 60, 100} };
+    size_t count = sizeof(sizes) / sizeof(*sizes);
+    in->wed = calloc(count, sizeof(uint8_t*));
+    in->wedSize = calloc(count, sizeof(size_t));
+    if (!in->wed || !in->wedSize) return false;
+    for (size_t i = 0; i < count; ++i) {
+        corpus_t corpus;
+        corpusInit(&corpus, sizes[i][0], sizes[i][1], sizes[i][2], 256, false);
+        corpus.seed ^= seed;
+        if (!corpus.seed) corpus.seed = 1;
+        in->wed[i] = corpusBuildWED(&corpus, &in->wedSize[i], NULL);
+        if (!in->wed[i]) return false;
+        in->numWed++;
+        in->cells += (size_t)sizes[i][0] * sizes[i][1];
+    }
+    return true;
+}
@@ -0,0 +1,200 @@
+#include <limits.h>
+#include <string.h>
+#include "compat.h"
+#include "reference.h"
+#include "libimagequant.h"
+
+static int refColorDistance(uint32_t color1, uint32_t color2) {
+    int dr = (color1 >> 16) & 0xff;
+    int dg = (color1 >> 8) & 0xff;
+    int db = color1 & 0xff;
+    dr -= (color2 >> 16) & 0xff;
+    dg -= (color2 >> 8) & 0xff;
+    db -= color2 & 0xff;
+    dr *= 30;
+    dg *= 59;
+    db *= 11;
+    return dr*dr + dg*dg + db*db;
+}
+
+int refGetMode(int mode, const uint8_t *pixels_pri) {
+    if (mode != MODE_AUTO) return mode;
+    int mode2 = MODE_TO_EE;
+    if (pixels_pri && ((uint32_t*)pixels_pri)[0] == TRANSPARENT) {
+        for (int i = 1024; i < TILE_SIZE; ++i) {
+            if (pixels_pri[i] == 0) {
+                mode2 = MODE_FROM_EE;
+                break;
+            }
+        }
+    }
+    return mode2;
+}
+
+bool refTileToEE(const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out) {
+    memcpy(pixels_pri_out, pixels_pri, TILE_SIZE);
+    int col_idx = refColorIndex(pixels_pri_out, 256, TRANSPARENT);
+    if (col_idx < 0) {
+        uint8_t ci1, ci2;
+        refGetMergeableColors(pixels_pri_out, &ci1, &ci2);
+        refAdjustTileColors(pixels_pri_out, ci1, ci2);
+        col_idx = 0;
+    }
+    memcpy(pixels_sec_out, pixels_pri_out, TILE_SIZE);
+    for (int p = 1024; p < TILE_SIZE; ++p)
+        if (!pixels_sec[p])
+            pixels_pri_out[p] = col_idx;
+    for (int p = 1024; p < TILE_SIZE; ++p)
+        if (pixels_sec[p])
+            pixels_sec_out[p] = col_idx;
+    return true;
+}
+
+bool refTileFromEE(const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out) {
+    uint32_t pixels_rgba[TILE_DIM * TILE_DIM];
+    const uint32_t *pal_pri = (const uint32_t*)pixels_pri;
+    const uint32_t *pal_sec = (const uint32_t*)pixels_sec;
+    bool useTransparent = false;
+    for (int p = 1024; p < TILE_SIZE; ++p) {
+        if (pixels_pri[p]) {
+            pixels_rgba[p - 1024] = pal_pri[pixels_pri[p]] | 0xff000000;
+        } else if (pixels_sec[p]) {
+            pixels_rgba[p - 1024] = pal_sec[pixels_sec[p]] | 0xff000000;
+        } else {
+            pixels_rgba[p - 1024] = TRANSPARENT | 0xff000000;
+            useTransparent = true;
+        }
+    }
+    if (!refCreateRemappedTile(pixels_rgba, pixels_pri_out, useTransparent)) return false;
+    int colIdx = refColorIndex(pixels_pri_out, 256, TRANSPARENT);
+    if (colIdx > 0) {
+        uint32_t *pal = (uint32_t*)pixels_pri_out;
+        uint32_t tmp = pal[0];
+        pal[0] = pal[colIdx];
+        pal[colIdx] = tmp;
+        for (int p = 1024; p < TILE_SIZE; ++p) {
+            if (pixels_pri_out[p] == 0)
+                pixels_pri_out[p] = colIdx;
+            else if (pixels_pri_out[p] == colIdx)
+                pixels_pri_out[p] = 0;
+        }
+    }
+    memcpy(pixels_sec_out, pixels_pri, TILE_SIZE);
+    return true;
+}
+
+bool refGetMergeableColors(const uint8_t *data, uint8_t *color1, uint8_t *color2) {
+    if (!data || !color1 || !color2) return false;
+    bool used[256] = {false};
+    for (size_t i = 0; i < 4096; ++i)
+        used[data[1024 + i]] = true;
+    for (size_t i = 0; i < 256; ++i) {
+        if (!used[i]) {
+            *color1 = *color2 = (uint8_t)i;
+            return true;
+        }
+    }
+    int i1 = -1, i2 = -1, dist = INT_MAX;
+    for (size_t i = 0; i < 255; ++i) {
+        uint32_t col1 = *(const uint32_t*)(data + i*4);
+        for (size_t j = i + 1; j < 256; ++j) {
+            int d = refColorDistance(col1, *(const uint32_t*)(data + j*4));
+            if (d < dist) { dist = d; i1 = i; i2 = j; }
+            if (dist == 0) break;
+        }
+        if (dist == 0) break;
+    }
+    if (dist != INT_MAX) {
+        *color1 = (uint8_t)i1;
+        *color2 = (uint8_t)i2;
+        return true;
+    }
+    return false;
+}
+
+void refAdjustTileColors(uint8_t *data, uint8_t search, uint8_t replace) {
+    if (!data) return;
+    if (search > replace) {
+        uint8_t tmp = search;
+        search = replace;
+        replace = tmp;
+    }
+    for (size_t p = 1024; p < 5120; ++p) {
+        if (data[p] == search && search != replace)
+            data[p] = replace;
+        else if (data[p] < search)
+            data[p]++;
+    }
+    uint32_t *pal = (uint32_t*)data;
+    for (int i = search; i > 0; --i)
+        pal[i] = pal[i - 1];
+    pal[0] = TRANSPARENT;
+}
+
+int refColorIndex(const void *data, size_t palSize, uint32_t color) {
+    const uint32_t *pal = data;
+    for (size_t i = 0; i < palSize; ++i)
+        if (pal[i] == color)
+            return i;
+    return -1;
+}
+
+bool refCreateRemappedTile(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent) {
+    if (!srcTile || !dstTile) return false;
+    bool retVal = false;
+    liq_attr *attr = liq_attr_create();
+    liq_image *img = attr ? liq_image_create_rgba(attr, srcTile, 64, 64, 0.0) : NULL;
+    liq_result *result = NULL;
+    if (img) {
+        liq_color c; c.b = c.r = 0; c.a = c.g = 255;
+        if ((!useTransparent || liq_image_add_fixed_color(img, c) == LIQ_OK) &&
+            liq_image_quantize(img, attr, &result) == LIQ_OK &&
+            liq_write_remapped_image(result, img, dstTile + 1024, 4096) == LIQ_OK) {
+            const liq_palette *pal = liq_get_palette(result);
+            for (unsigned i = 0; i < pal->count; ++i) {
+                dstTile[i*4] = pal->entries[i].r;
+                dstTile[i*4+1] = pal->entries[i].g;
+                dstTile[i*4+2] = pal->entries[i].b;
+                dstTile[i*4+3] = 0;
+            }
+            if (pal->count < 256)
+                memset(dstTile + pal->count*4, 0, (256-pal->count)*4);
+            retVal = true;
+        }
+    }
+    if (result) liq_result_destroy(result);
+    if (img) liq_image_destroy(img);
+    if (attr) liq_attr_destroy(attr);
+    return retVal;
+}
+
+bool refParseWEDData(const void *data, tilevec_t *tileList) {
+    const uint8_t *ptr = data;
+    int32_t ofs_ovl, ofs_tilemap, ofs_lookup;
+    int16_t num_width, num_height;
+    memcpy(&ofs_ovl, ptr + 0x10, 4);
+    memcpy(&num_width, ptr + ofs_ovl, 2);
+    memcpy(&num_height, ptr + ofs_ovl + 2, 2);
+    memcpy(&ofs_tilemap, ptr + ofs_ovl + 0x10, 4);
+    memcpy(&ofs_lookup, ptr + ofs_ovl + 0x14, 4);
+    size_t num_tiles = num_width * num_height;
+    if (!tilevecReserve(tileList, num_tiles)) return false;
+    for (size_t i = 0, ofs = ofs_tilemap; i < num_tiles; i++, ofs += 10) {
+        int16_t tile_sec, tile_pri_idx, tile_pri;
+        int8_t flags;
+        int pri = -1, sec = -1;
+        memcpy(&tile_sec, ptr + ofs + 4, 2);
+        memcpy(&flags, ptr + ofs + 6, 1);
+        if (flags) {
+            memcpy(&tile_pri_idx, ptr + ofs, 2);
+            memcpy(&tile_pri, ptr + ofs_lookup + tile_pri_idx * 2, 2);
+            pri = tile_pri;
+            sec = tile_sec;
+        }
+        if (pri != -1 && sec != -1) {
+            tile_t t = { pri, sec };
+            tilevecAdd(tileList, t);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef REFERENCE_H_INCLUDED
+#define REFERENCE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "tis2ovl.h"
+
+// Frozen copies of the original scalar kernels. Optimized implementations in src/ must
+// produce byte-identical results. Do not modify these functions to match changed behavior.
+
+int refGetMode(int mode, const uint8_t *pixels_pri);
+bool refTileToEE(const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out);
+bool refTileFromEE(const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out);
+bool refGetMergeableColors(const uint8_t *data, uint8_t *color1, uint8_t *color2);
+void refAdjustTileColors(uint8_t *data, uint8_t search, uint8_t replace);
+int refColorIndex(const void *data, size_t palSize, uint32_t color);
+bool refCreateRemappedTile(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent);
+bool refParseWEDData(const void *data, tilevec_t *tileList);
+
+#endif // REFERENCE_H_INCLUDED
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define DEFAULT_BLOCK_SIZE 65536
+#define ALIGNMENT 16
+
+struct arena_block_t {
+    arena_block_t *next;    // previously allocated block
+    size_t size;            // usable size of the block
+    size_t pos;             // first free byte in the block
+    void *last;             // most recent allocation in this block
+    _Alignas(ALIGNMENT) uint8_t data[];
+};
+
+// Internally used. Allocates a new block that can hold at least "size" bytes.
+arena_block_t* arenaAddBlock(arena_t *arena, size_t size);
+
+static inline size_t alignSize(size_t size) { return (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1); }
+
+bool arenaInit(arena_t *arena, size_t blockSize) {
+    if (arena) {
+        arena->head = NULL;
+        arena->blockSize = blockSize ? alignSize(blockSize) : DEFAULT_BLOCK_SIZE;
+        arena->used = arena->peak = 0;
+        return true;
+    }
+    return false;
+}
+
+void arenaFree(arena_t *arena) {
+    if (arena) {
+        arena_block_t *block = arena->head;
+        while (block) {
+            arena_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+        arena->head = NULL;
+        arena->used = 0;
+    }
+}
+
+void arenaReset(arena_t *arena) {
+    if (arena && arena->head) {
+        arena_block_t *block = arena->head;
+        while (block->next) {
+            arena_block_t *next = block->next;
+            free(block);
+            block = next;
+        }
+        block->pos = 0;
+        block->last = NULL;
+        arena->head = block;
+        arena->used = 0;
+    }
+}
+
+void* arenaAlloc(arena_t *arena, size_t size) {
+    if (!arena) return NULL;
+    size = alignSize(size ? size : 1);
+    arena_block_t *block = arena->head;
+    if (!block || block->size - block->pos < size) {
+        block = arenaAddBlock(arena, size);
+        if (!block) return NULL;
+    }
+    void *ptr = block->data + block->pos;
+    block->pos += size;
+    block->last = ptr;
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return ptr;
+}
+
+void* arenaCalloc(arena_t *arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) return NULL;
+    void *ptr = arenaAlloc(arena, count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+void* arenaRealloc(arena_t *arena, void *ptr, size_t oldSize, size_t newSize) {
+    if (!arena) return NULL;
+    if (!ptr) return arenaAlloc(arena, newSize);
+    if (newSize <= oldSize) return ptr;
+
+    // growing most recent allocation in place
+    arena_block_t *block = arena->head;
+    if (block && block->last == ptr) {
+        size_t start = (uint8_t*)ptr - block->data;
+        size_t oldAligned = alignSize(oldSize ? oldSize : 1), newAligned = alignSize(newSize);
+        if (block->size - start >= newAligned) {
+            block->pos = start + newAligned;
+            arena->used += newAligned - oldAligned;
+            if (arena->used > arena->peak) arena->peak = arena->used;
+            return ptr;
+        }
+    }
+
+    void *data = arenaAlloc(arena, newSize);
+    if (data) memcpy(data, ptr, oldSize);
+    return data;
+}
+
+void cleanArena(arena_t *arena) {
+    arenaFree(arena);
+}
+
+
+// Internally used. Allocates a new block that can hold at least "size" bytes.
+arena_block_t* arenaAddBlock(arena_t *arena, size_t size) {
+    size_t blockSize = (size > arena->blockSize) ? size : arena->blockSize;
+    arena_block_t *block = malloc(sizeof(arena_block_t) + blockSize);
+    if (block) {
+        block->next = arena->head;
+        block->size = blockSize;
+        block->pos = 0;
+        block->last = NULL;
+        arena->head = block;
+    }
+    return block;
+}
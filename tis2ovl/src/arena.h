@@ -0,0 +1,42 @@
+#ifndef ARENA_H_INCLUDED
+#define ARENA_H_INCLUDED
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Internally used: A single memory block of the arena.
+typedef struct arena_block_t arena_block_t;
+
+// Arena structure: Linear allocator for transient data that is released as a whole.
+typedef struct {
+    arena_block_t *head;    // most recently allocated block
+    size_t blockSize;       // default size of new blocks
+    size_t used;            // number of bytes handed out since last reset
+    size_t peak;            // highest number of bytes handed out at once
+} arena_t;
+
+/// Initialize empty arena. "blockSize" defines default size of memory blocks (0 to use default size). Returns success state.
+bool arenaInit(arena_t *arena, size_t blockSize);
+
+/// Release all memory blocks of the arena. Arena can't be used until initialized again by arenaInit().
+void arenaFree(arena_t *arena);
+
+/// Invalidate all allocations at once. The first memory block is retained for reuse.
+void arenaReset(arena_t *arena);
+
+/// Return a pointer to "size" bytes of uninitialized memory, aligned to 16 bytes. Returns NULL on error.
+void* arenaAlloc(arena_t *arena, size_t size);
+
+/// Return a pointer to "count" * "size" bytes of zero-initialized memory. Returns NULL on error.
+void* arenaCalloc(arena_t *arena, size_t count, size_t size);
+
+/// Grow an allocation to "newSize" bytes. Reuses the memory in place if it was the most recent allocation. Returns NULL on error.
+void* arenaRealloc(arena_t *arena, void *ptr, size_t oldSize, size_t newSize);
+
+/// Return number of bytes currently handed out by the arena.
+static inline size_t arenaGetUsage(const arena_t *arena) { return arena ? arena->used : 0; }
+
+/// Cleanup function for arena variables, to be used with "finally".
+void cleanArena(arena_t *arena);
+
+#endif // ARENA_H_INCLUDED
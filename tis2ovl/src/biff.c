@@ -0,0 +1,305 @@
+#include <string.h>
+#include <ctype.h>
+#include <strings.h>
+#include "compat.h"
+#include "functions.h"
+#include "stats.h"
+#include "biff.h"
+
+// Size of the BIFF V1 header
+#define BIFF_HEADER_SIZE    20
+// Size of a BIFF tileset entry
+#define BIFF_TILESET_SIZE   20
+// Size of the KEY V1 header
+#define KEY_HEADER_SIZE     24
+// Size of a KEY BIFF entry
+#define KEY_BIFF_SIZE       12
+// Size of a KEY resource entry
+#define KEY_RES_SIZE        14
+// Location flags of BIFF files added to the KEY (game directory)
+#define KEY_LOCATION        1
+
+// A tileset added to the KEY file
+typedef struct {
+    const char *resref;     // resource name
+    uint32_t locator;       // resource locator in the new BIFF file
+    bool found;             // whether an existing resource entry has been redirected
+} keyres_t;
+
+// KEY path of a BIFF file added to the KEY file
+typedef struct {
+    char path[FILENAME_MAX];
+    uint32_t index;         // index of the BIFF entry in the KEY file
+    bool replaced;          // whether an existing BIFF entry of the same path is reused
+} keypath_t;
+
+static def_cleanFunc(cleanKeyRes, keyres_t*)
+static def_cleanFunc(cleanKeyPath, keypath_t*)
+
+// Internally used. Store 16-bit value in little-endian byte order.
+static void putLE16(uint8_t *buf, uint16_t value) {
+    buf[0] = value & 0xff;
+    buf[1] = (value >> 8) & 0xff;
+}
+
+// Internally used. Store 32-bit value in little-endian byte order.
+static void putLE32(uint8_t *buf, uint32_t value) {
+    buf[0] = value & 0xff;
+    buf[1] = (value >> 8) & 0xff;
+    buf[2] = (value >> 16) & 0xff;
+    buf[3] = (value >> 24) & 0xff;
+}
+
+// Internally used. Return 16-bit value stored in little-endian byte order.
+static uint16_t getLE16(const uint8_t *buf) {
+    return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+// Internally used. Return 32-bit value stored in little-endian byte order.
+static uint32_t getLE32(const uint8_t *buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// Internally used. Write the BIFF header with the given tileset entry count and entry offset.
+static bool writeBiffHeader(FILE *fp, int numTilesets, uint32_t ofsEntries) {
+    uint8_t header[BIFF_HEADER_SIZE] = { 'B', 'I', 'F', 'F', 'V', '1', ' ', ' ' };
+    putLE32(header + 0x08, 0);
+    putLE32(header + 0x0c, (uint32_t)numTilesets);
+    putLE32(header + 0x10, ofsEntries);
+    return fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+}
+
+// Internally used. Store KEY path of the BIFF file, relative to the directory of the KEY file, with backslash separators.
+static void getKeyPath(const char *keyFile, const char *biffFile, char *path, size_t size) {
+    const char *sep = strrchr(keyFile, '/');
+    size_t len = sep ? (size_t)(sep - keyFile) : 0;
+    if (len > 0 && strncmp(biffFile, keyFile, len) == 0 && biffFile[len] == '/')
+        biffFile += len + 1;
+    while (strncmp(biffFile, "./", 2) == 0)
+        biffFile += 2;
+    snprintf(path, size, "%s", biffFile);
+    for (char *p = path; *p; ++p)
+        if (*p == '/') *p = '\\';
+}
+
+// Internally used. Return whether the KEY resource entry refers to the given tileset resource name.
+static bool isTilesetEntry(const uint8_t *entry, const char *resref) {
+    if (getLE16(entry + 8) != RESTYPE_TIS) return false;
+    for (int i = 0; i < 8; ++i) {
+        int c1 = toupper(entry[i]), c2 = toupper((unsigned char)resref[i]);
+        if (c1 != c2) return false;
+        if (!c1) break;
+    }
+    return true;
+}
+
+
+bool biffOpen(biffwriter_t *biff, const char *fileName) {
+    if (!biff || !fileName) return false;
+    memset(biff, 0, sizeof(biffwriter_t));
+    snprintf(biff->fileName, sizeof(biff->fileName), "%s", fileName);
+    biff->fp = fopen(fileName, "wb");
+    if (!evalOp(biff->fp != NULL, "Error: Could not create BIFF file: %s\n", fileName)) return false;
+    // header is completed when the BIFF is closed
+    if (!evalOp(writeBiffHeader(biff->fp, 0, 0), "Error: Could not write BIFF file: %s\n", fileName)) {
+        fclose(biff->fp);
+        biff->fp = NULL;
+        return false;
+    }
+    biff->size = BIFF_HEADER_SIZE;
+    STATS_ADD(COUNTER_IO_CALLS, 2);
+    return true;
+}
+
+bool biffAddTileset(biffwriter_t *biff, const char *resref, const uint8_t *data, int tileCount, int tileSize) {
+    if (!biff || !biff->fp || !resref || (!data && tileCount > 0) || biffIsFull(biff)) return false;
+    size_t size = (size_t)tileCount * tileSize;
+    if (!evalOp(biff->size + size < UINT32_MAX, "Error: BIFF file too large: %s\n", biff->fileName)) return false;
+    if (!evalOp(fwrite(data, 1, size, biff->fp) == size, "Error: Could not write BIFF file: %s\n", biff->fileName)) return false;
+
+    uint8_t *entry = biff->entries + biff->numTilesets * BIFF_TILESET_SIZE;
+    putLE32(entry + 0x00, (uint32_t)(biff->numTilesets + 1) << 14);
+    putLE32(entry + 0x04, (uint32_t)biff->size);
+    putLE32(entry + 0x08, (uint32_t)tileCount);
+    putLE32(entry + 0x0c, (uint32_t)tileSize);
+    putLE16(entry + 0x10, RESTYPE_TIS);
+    putLE16(entry + 0x12, 0);
+    snprintf(biff->resrefs[biff->numTilesets], sizeof(biff->resrefs[0]), "%s", resref);
+    biff->numTilesets++;
+    biff->size += size;
+    STATS_ADD(COUNTER_BYTES_WRITTEN, size);
+    STATS_ADD(COUNTER_IO_CALLS, 1);
+    return true;
+}
+
+bool biffClose(biffwriter_t *biff, bool keep) {
+    if (!biff || !biff->fp) return false;
+    size_t size = (size_t)biff->numTilesets * BIFF_TILESET_SIZE;
+    bool success = keep && fwrite(biff->entries, 1, size, biff->fp) == size;
+    success = success && fseek(biff->fp, 0, SEEK_SET) == 0 && writeBiffHeader(biff->fp, biff->numTilesets, (uint32_t)biff->size);
+    success = (fclose(biff->fp) == 0) && success;
+    biff->fp = NULL;
+    if (!keep) {
+        remove(biff->fileName);
+        return true;
+    }
+    if (!evalOp(success, "Error: Could not write BIFF file: %s\n", biff->fileName)) {
+        remove(biff->fileName);
+        return false;
+    }
+    biff->size += size;
+    STATS_ADD(COUNTER_BYTES_WRITTEN, size + BIFF_HEADER_SIZE);
+    STATS_ADD(COUNTER_IO_CALLS, 4);
+    return true;
+}
+
+bool keyAddBiffs(const char *keyFile, const biffwriter_t *biffs, int count) {
+    if (!keyFile || (!biffs && count > 0)) return false;
+
+    // loading existing KEY file
+    uint8_t *key finally(cleanMem8) = NULL;
+    uint32_t numBiffs = 0, numRes = 0, ofsBiffs = 0, ofsRes = 0;
+    size_t keySize = 0;
+    if (fileExists(keyFile)) {
+        FILE *fp finally(cleanFile) = fopen(keyFile, "rb");
+        if (!evalOp(fp != NULL, "Error: Unable to open KEY file: %s\n", keyFile)) return false;
+        key = readStream(fp, &keySize);
+        if (!evalOp(key != NULL, "Error: Could not read KEY file: %s\n", keyFile)) return false;
+        if (!evalOp(keySize >= KEY_HEADER_SIZE && memcmp(key, "KEY V1  ", 8) == 0, "Error: Not a valid KEY file: %s\n", keyFile)) return false;
+        numBiffs = getLE32(key + 0x08);
+        numRes = getLE32(key + 0x0c);
+        ofsBiffs = getLE32(key + 0x10);
+        ofsRes = getLE32(key + 0x14);
+        if (!evalOp((uint64_t)ofsBiffs + (uint64_t)numBiffs * KEY_BIFF_SIZE <= keySize &&
+                    (uint64_t)ofsRes + (uint64_t)numRes * KEY_RES_SIZE <= keySize, "Error: Not a valid KEY file: %s\n", keyFile)) return false;
+        for (uint32_t i = 0; i < numBiffs; ++i) {
+            const uint8_t *entry = key + ofsBiffs + i * KEY_BIFF_SIZE;
+            uint32_t ofsName = getLE32(entry + 4);
+            uint16_t lenName = getLE16(entry + 8);
+            if (!evalOp(lenName > 0 && (uint64_t)ofsName + lenName <= keySize, "Error: Not a valid KEY file: %s\n", keyFile)) return false;
+        }
+    }
+
+    // BIFF entries of the same path are reused, since the previous BIFF files have been overwritten
+    int numNew = 0, numAppended = 0;
+    for (int i = 0; i < count; ++i)
+        numNew += biffs[i].numTilesets;
+    keyres_t *res finally(cleanKeyRes) = calloc((size_t)numNew + 1, sizeof(keyres_t));
+    keypath_t *paths finally(cleanKeyPath) = calloc((size_t)count + 1, sizeof(keypath_t));
+    uint8_t *replaced finally(cleanMem8) = calloc((size_t)numBiffs + 1, 1);
+    if (!evalOp(res && paths && replaced, "Error: Not enough memory to update KEY file: %s\n", keyFile)) return false;
+    for (int i = 0, n = 0; i < count; ++i) {
+        getKeyPath(keyFile, biffs[i].fileName, paths[i].path, sizeof(paths[i].path));
+        paths[i].index = numBiffs + numAppended;
+        for (uint32_t k = 0; k < numBiffs; ++k) {
+            const uint8_t *entry = key + ofsBiffs + k * KEY_BIFF_SIZE;
+            const char *name = (const char*)key + getLE32(entry + 4);
+            if (strlen(paths[i].path) < getLE16(entry + 8) && strncasecmp(name, paths[i].path, getLE16(entry + 8)) == 0) {
+                paths[i].index = k;
+                paths[i].replaced = true;
+                replaced[k] = true;
+                break;
+            }
+        }
+        if (!paths[i].replaced) numAppended++;
+        for (int j = 0; j < biffs[i].numTilesets; ++j, ++n) {
+            res[n].locator = (paths[i].index << 20) | ((uint32_t)(j + 1) << 14);
+            res[n].resref = biffs[i].resrefs[j];
+        }
+    }
+    if (!evalOp(numBiffs + numAppended < 4096, "Error: Too many BIFF files in KEY file: %s\n", keyFile)) return false;
+
+    // KEY is rebuilt: header, BIFF entries, BIFF names, resource entries
+    char tmpFile[FILENAME_MAX + 8];
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", keyFile);
+    FILE *fp = fopen(tmpFile, "wb");
+    if (!evalOp(fp != NULL, "Error: Could not create KEY file: %s\n", keyFile)) return false;
+    uint32_t ofsName = KEY_HEADER_SIZE + (numBiffs + numAppended) * KEY_BIFF_SIZE, sizeNames = 0;
+    for (uint32_t i = 0; i < numBiffs; ++i)
+        sizeNames += getLE16(key + ofsBiffs + i * KEY_BIFF_SIZE + 8);
+    for (int i = 0; i < count; ++i)
+        if (!paths[i].replaced) sizeNames += strlen(paths[i].path) + 1;
+    uint8_t buf[KEY_HEADER_SIZE];
+    memcpy(buf, "KEY V1  ", 8);
+    putLE32(buf + 0x08, numBiffs + numAppended);
+    putLE32(buf + 0x0c, numRes);    // updated below if resources are added or removed
+    putLE32(buf + 0x10, KEY_HEADER_SIZE);
+    putLE32(buf + 0x14, ofsName + sizeNames);
+    bool success = (fwrite(buf, 1, KEY_HEADER_SIZE, fp) == KEY_HEADER_SIZE);
+    for (uint32_t i = 0; success && i < numBiffs; ++i) {
+        const uint8_t *entry = key + ofsBiffs + i * KEY_BIFF_SIZE;
+        memcpy(buf, entry, KEY_BIFF_SIZE);
+        for (int j = 0; j < count; ++j)
+            if (paths[j].replaced && paths[j].index == i) putLE32(buf, (uint32_t)biffs[j].size);
+        putLE32(buf + 4, ofsName);
+        ofsName += getLE16(entry + 8);
+        success = (fwrite(buf, 1, KEY_BIFF_SIZE, fp) == KEY_BIFF_SIZE);
+    }
+    for (int i = 0; success && i < count; ++i) {
+        if (paths[i].replaced) continue;
+        putLE32(buf, (uint32_t)biffs[i].size);
+        putLE32(buf + 4, ofsName);
+        putLE16(buf + 8, (uint16_t)(strlen(paths[i].path) + 1));
+        putLE16(buf + 10, KEY_LOCATION);
+        ofsName += strlen(paths[i].path) + 1;
+        success = (fwrite(buf, 1, KEY_BIFF_SIZE, fp) == KEY_BIFF_SIZE);
+    }
+    for (uint32_t i = 0; success && i < numBiffs; ++i) {
+        const uint8_t *entry = key + ofsBiffs + i * KEY_BIFF_SIZE;
+        uint16_t len = getLE16(entry + 8);
+        success = (fwrite(key + getLE32(entry + 4), 1, len, fp) == len);
+    }
+    for (int i = 0; success && i < count; ++i)
+        if (!paths[i].replaced) success = (fwrite(paths[i].path, 1, strlen(paths[i].path) + 1, fp) == strlen(paths[i].path) + 1);
+
+    // existing tileset entries are redirected, the remaining tilesets are appended
+    uint32_t removed = 0;
+    for (uint32_t i = 0; success && i < numRes; ++i) {
+        memcpy(buf, key + ofsRes + i * KEY_RES_SIZE, KEY_RES_SIZE);
+        bool found = false;
+        for (int n = 0; n < numNew && !found; ++n) {
+            if (isTilesetEntry(buf, res[n].resref)) {
+                putLE32(buf + 10, res[n].locator);
+                res[n].found = found = true;
+            }
+        }
+        // resources of overwritten BIFF files don't exist anymore
+        uint32_t bif = getLE32(buf + 10) >> 20;
+        if (!found && bif < numBiffs && replaced[bif]) {
+            removed++;
+            continue;
+        }
+        success = (fwrite(buf, 1, KEY_RES_SIZE, fp) == KEY_RES_SIZE);
+    }
+    uint32_t added = 0;
+    for (int n = 0; success && n < numNew; ++n) {
+        if (res[n].found) continue;
+        memset(buf, 0, KEY_RES_SIZE);
+        for (int c = 0; c < 8 && res[n].resref[c]; ++c)
+            buf[c] = (uint8_t)toupper((unsigned char)res[n].resref[c]);
+        putLE16(buf + 8, RESTYPE_TIS);
+        putLE32(buf + 10, res[n].locator);
+        success = (fwrite(buf, 1, KEY_RES_SIZE, fp) == KEY_RES_SIZE);
+        added++;
+    }
+    if (success && (added || removed)) {
+        putLE32(buf, numRes + added - removed);
+        success = (fseek(fp, 0x0c, SEEK_SET) == 0 && fwrite(buf, 1, 4, fp) == 4);
+    }
+    success = (fclose(fp) == 0) && success;
+    if (success) {
+        remove(keyFile);
+        success = (rename(tmpFile, keyFile) == 0);
+    }
+    if (!success) {
+        remove(tmpFile);
+        printMsg(OUTPUT_ERR, "Error: Could not write KEY file: %s\n", keyFile);
+        return false;
+    }
+    STATS_ADD(COUNTER_BYTES_WRITTEN, (uint64_t)ofsName + (numRes + added - removed) * KEY_RES_SIZE);
+    printMsg(OUTPUT_MSG, "KEY file \"%s\" updated: %d BIFF file(s) added, %d replaced, %d tileset(s) redirected, %u added.\n",
+             keyFile, numAppended, count - numAppended, numNew - (int)added, added);
+    if (removed)
+        printMsg(OUTPUT_ERR, "Warning: Removed %u resource(s) of replaced BIFF files from KEY file: %s\n", removed, keyFile);
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef BIFF_H_INCLUDED
+#define BIFF_H_INCLUDED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Max. number of tileset entries of a single BIFF file (6-bit tileset index, starting at 1).
+#define BIFF_MAX_TILESETS   63
+
+/// Resource type of TIS files.
+#define RESTYPE_TIS         0x03eb
+
+/// A BIFF V1 file that is written sequentially. Tileset data is appended as it arrives, the entry table is written last.
+typedef struct {
+    FILE *fp;
+    char fileName[FILENAME_MAX];            // path of the BIFF file
+    char resrefs[BIFF_MAX_TILESETS][9];     // resource name of each tileset entry
+    uint8_t entries[BIFF_MAX_TILESETS * 20];// tileset entries
+    int numTilesets;                        // number of tileset entries
+    uint64_t size;                          // current file size in bytes
+} biffwriter_t;
+
+/// Create a new BIFF file. An existing file is replaced. Returns success state.
+bool biffOpen(biffwriter_t *biff, const char *fileName);
+
+/**
+ * Append a tileset entry to the BIFF file.
+ * \param biff      The BIFF writer.
+ * \param resref    Resource name of the tileset (without extension).
+ * \param data      Tile data without TIS header.
+ * \param tileCount Number of tiles in "data".
+ * \param tileSize  Size of a single tile in bytes.
+ * \return whether the tileset has been written. Returns false if the BIFF is full or on error.
+ */
+bool biffAddTileset(biffwriter_t *biff, const char *resref, const uint8_t *data, int tileCount, int tileSize);
+
+/// Return whether no more tilesets can be added to the BIFF file.
+static inline bool biffIsFull(const biffwriter_t *biff) { return biff && biff->numTilesets >= BIFF_MAX_TILESETS; }
+
+/// Write the entry table and close the BIFF file. The BIFF file is removed if "keep" is false. Returns success state.
+bool biffClose(biffwriter_t *biff, bool keep);
+
+/**
+ * Add the given BIFF files to a KEY file and let the resource entries of their tilesets refer to them.
+ * Existing resource entries of the same tilesets are updated, missing entries are added.
+ * \param keyFile   Path of the KEY file. A new KEY file is created if it doesn't exist. The file is replaced only after
+ *                  the updated KEY has been written completely.
+ * \param biffs     Closed BIFF files. Their paths are stored relative to the directory of the KEY file.
+ * \param count     Number of BIFF files.
+ * \return success state.
+ */
+bool keyAddBiffs(const char *keyFile, const biffwriter_t *biffs, int count);
+
+#endif // BIFF_H_INCLUDED
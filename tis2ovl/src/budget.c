@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "budget.h"
+
+static pthread_mutex_t budgetLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t budgetFreed = PTHREAD_COND_INITIALIZER;
+static uint64_t limit = 0;      // budget in bytes, 0 if unlimited
+static uint64_t reserved = 0;   // currently reserved bytes
+static uint64_t peak = 0;       // max. reserved bytes
+static int active = 0;          // number of jobs holding a reservation
+static int nextOrder = 0;       // position of the next ordered reservation
+static __thread int order = -1; // position of the next reservation of the thread, -1 if unordered
+
+void budgetInit(uint64_t bytes) {
+    pthread_mutex_lock(&budgetLock);
+    limit = bytes;
+    nextOrder = 0;
+    pthread_mutex_unlock(&budgetLock);
+}
+
+uint64_t budgetGetLimit() {
+    return limit;
+}
+
+int budgetScale(int maxItems, uint64_t itemSize) {
+    if (!limit || !itemSize || maxItems < 1) return maxItems;
+    uint64_t share = limit / BUDGET_JOB_SHARE;
+    uint64_t items = (share > BUDGET_JOB_BASE) ? (share - BUDGET_JOB_BASE) / itemSize : 0;
+    if (items < 1) return 1;
+    return (items < (uint64_t)maxItems) ? (int)items : maxItems;
+}
+
+uint64_t budgetAcquire(uint64_t bytes) {
+    if (!limit) return 0;
+    pthread_mutex_lock(&budgetLock);
+    while ((order >= 0 && order != nextOrder) || (active > 0 && reserved + bytes > limit))
+        pthread_cond_wait(&budgetFreed, &budgetLock);
+    if (order >= 0) {
+        nextOrder++;
+        order = -1;
+        pthread_cond_broadcast(&budgetFreed);
+    }
+    reserved += bytes;
+    active++;
+    if (reserved > peak) peak = reserved;
+    pthread_mutex_unlock(&budgetLock);
+    return bytes;
+}
+
+void budgetRelease(uint64_t bytes) {
+    if (!bytes) return;
+    pthread_mutex_lock(&budgetLock);
+    reserved -= (bytes < reserved) ? bytes : reserved;
+    if (active > 0) active--;
+    pthread_cond_broadcast(&budgetFreed);
+    pthread_mutex_unlock(&budgetLock);
+}
+
+void cleanBudget(uint64_t *bytes) {
+    if (bytes) {
+        budgetRelease(*bytes);
+        *bytes = 0;
+    }
+}
+
+void budgetBeginOrder(int position) {
+    order = position;
+}
+
+void budgetEndOrder() {
+    if (limit && order >= 0) {
+        pthread_mutex_lock(&budgetLock);
+        while (order != nextOrder)
+            pthread_cond_wait(&budgetFreed, &budgetLock);
+        nextOrder++;
+        pthread_cond_broadcast(&budgetFreed);
+        pthread_mutex_unlock(&budgetLock);
+    }
+    order = -1;
+}
+
+uint64_t budgetPeak() {
+    pthread_mutex_lock(&budgetLock);
+    uint64_t retVal = peak;
+    pthread_mutex_unlock(&budgetLock);
+    return retVal;
+}
+
+bool budgetParse(const char *value, uint64_t *bytes) {
+    if (!value || !bytes) return false;
+    char *end = NULL;
+    double v = strtod(value, &end);
+    if (end == value || v <= 0.0) return false;
+    double scale = 1.0;
+    switch (toupper((unsigned char)*end)) {
+    case 'K': scale = 1024.0; end++; break;
+    case 'M': scale = 1024.0 * 1024.0; end++; break;
+    case 'G': scale = 1024.0 * 1024.0 * 1024.0; end++; break;
+    }
+    if (toupper((unsigned char)*end) == 'B') end++;
+    if (*end) return false;
+    *bytes = (uint64_t)(v * scale);
+    return *bytes > 0;
+}
@@ -0,0 +1,51 @@
+#ifndef BUDGET_H_INCLUDED
+#define BUDGET_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Memory needed by a conversion job regardless of the tileset size (tile buffers, palette cache, arena).
+#define BUDGET_JOB_BASE     (1024 * 1024)
+
+/// A single job is scaled to this fraction of the budget, so that several tilesets fit into the budget at the same time.
+#define BUDGET_JOB_SHARE    4
+
+/// Set the memory budget of all concurrent conversion jobs in bytes. 0 disables the budget.
+void budgetInit(uint64_t bytes);
+
+/// Return the memory budget in bytes, 0 if no budget is set.
+uint64_t budgetGetLimit();
+
+/// Return the number of items of "itemSize" bytes that fit into the budget share of a single job, limited to
+/// 1..maxItems. Returns "maxItems" if no budget is set.
+int budgetScale(int maxItems, uint64_t itemSize);
+
+/**
+ * Reserve memory for a conversion job. Blocks while the reservation doesn't fit into the remaining budget.
+ * A reservation larger than the whole budget is granted as soon as no other job holds a reservation.
+ * \param bytes     Estimated peak memory of the job.
+ * \return reserved bytes, to be returned by budgetRelease(). Returns 0 if no budget is set.
+ */
+uint64_t budgetAcquire(uint64_t bytes);
+
+/// Return memory reserved by budgetAcquire() to the budget.
+void budgetRelease(uint64_t bytes);
+
+/// Cleanup function for reservation variables, to be used with "finally".
+void cleanBudget(uint64_t *bytes);
+
+/// Make the next budgetAcquire() of the calling thread wait until the reservations of all lower positions have been made.
+/// Positions start at 0 and must be used without gaps. Jobs holding their reservation until earlier jobs have completed
+/// can't block each other this way.
+void budgetBeginOrder(int position);
+
+/// Pass on the position of budgetBeginOrder() if the calling thread didn't call budgetAcquire() for it.
+void budgetEndOrder();
+
+/// Return the largest amount of memory reserved at the same time.
+uint64_t budgetPeak();
+
+/// Parse a memory size with optional unit suffix (K, M or G). Returns success state.
+bool budgetParse(const char *value, uint64_t *bytes);
+
+#endif // BUDGET_H_INCLUDED
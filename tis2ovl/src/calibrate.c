@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+#include "compat.h"
+#include "functions.h"
+#include "global.h"
+#include "arena.h"
+#include "tis2ovl.h"
+#include "tismap.h"
+#include "tisv2.h"
+#include "colors.h"
+#include "quantizer.h"
+#include "calibrate.h"
+
+// Max. number of sampled tilesets
+#define CALIBRATE_TILESETS      8
+// Max. number of sampled tile pairs per tileset
+#define CALIBRATE_PAIRS         64
+// Number of read measurements per I/O backend, the fastest one is used
+#define CALIBRATE_IO_ROUNDS     3
+// Min. speedup in percent of a setting over the default setting to be chosen
+#define CALIBRATE_MIN_GAIN      5.0
+// Max. PSNR loss in dB of a faster quantizer backend
+#define CALIBRATE_MAX_PSNR_LOSS 0.5
+// Max. length of a line of the configuration file
+#define CALIBRATE_LINE_SIZE     1024
+
+// Names of the I/O backends as used by the configuration file and option --io
+static const char *ioNames[] = { "buffered", "mmap" };
+
+// A sampled tileset
+typedef struct {
+    char tisFile[FILENAME_MAX];
+    int ofsTiles;
+    tile_t pairs[CALIBRATE_PAIRS];  // sampled overlay tile pairs
+    int numPairs;
+    uint8_t *tiles;                 // sampled tile pairs in EE format, two tiles per pair
+} calibset_t;
+
+// Sampled tilesets and shared state of the benchmark threads
+typedef struct {
+    calibset_t sets[CALIBRATE_TILESETS];
+    tismap_t maps[CALIBRATE_TILESETS];  // mappings of the sampled tilesets if the mmap backend is measured
+    int numSets;
+    int numPairs;           // number of sampled tile pairs of all tilesets
+    int io;                 // I/O backend of the benchmark threads
+    int mode;               // conversion mode of the calling thread
+    int next;               // next tile pair to convert
+    bool failed;
+    pthread_mutex_t lock;
+} calibration_t;
+
+// Internally used. Cleanup function for calibration data, to be used with "finally".
+static void cleanCalibration(calibration_t **pcalib) {
+    if (pcalib && *pcalib) {
+        for (int i = 0; i < (*pcalib)->numSets; ++i)
+            free((*pcalib)->sets[i].tiles);
+        pthread_mutex_destroy(&(*pcalib)->lock);
+        free(*pcalib);
+        *pcalib = NULL;
+    }
+}
+
+// Internally used. Return elapsed time of a monotonic clock in seconds.
+static double wallTime() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) return 0.0;
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Internally used. Ask the system to discard cached data of the file, so that reads are measured from storage.
+static void dropCache(const char *fileName) {
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(fileName, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)fileName;
+#endif
+}
+
+// Internally used. Read a single tile from the mapping if available, from "fp" otherwise. Returns success state.
+static bool readTile(FILE *fp, const calibset_t *set, const tismap_t *map, int tile, uint8_t *pixels) {
+    if (map && map->data) {
+        memcpy(pixels, tisMapGetTile(map, tile), TILE_SIZE);
+        return true;
+    }
+    return fp && fseek(fp, set->ofsTiles + (long)tile * TILE_SIZE, SEEK_SET) == 0 && fread(pixels, 1, TILE_SIZE, fp) == TILE_SIZE;
+}
+
+// Internally used. Sample overlay tile pairs of up to CALIBRATE_TILESETS tilesets, evenly distributed over the list of
+// WED files and over the tile pairs of each tileset. Returns number of sampled tile pairs.
+static int sampleTilesets(calibration_t *calib, array_t *wedList, array_t *searchPath) {
+    int count = (int)arrayGetSize(wedList);
+    int numSamples = (count < CALIBRATE_TILESETS) ? count : CALIBRATE_TILESETS;
+    for (int k = 0; k < numSamples; ++k) {
+        const char *wedFile = arrayGetItem(wedList, (size_t)k * count / numSamples);
+        arena_t arena finally(cleanArena);
+        arenaInit(&arena, 0);
+        tilevec_t tileList;
+        char tisName[16];
+        if (!tilevecInit(&tileList, 1, &arena) || !parseWED(wedFile, tisName, &tileList, &arena)) continue;
+        calibset_t *set = &calib->sets[calib->numSets];
+        if (!findTISFile(searchPath, tisName, set->tisFile)) {
+            printMsg(OUTPUT_ERR, "Warning: Could not find TIS file: %s. Skipping.\n", tisName);
+            continue;
+        }
+        if (isTISV2File(set->tisFile)) {
+            printMsg(OUTPUT_MSG, "Skipping PVRZ-based tileset \"%s\".\n", set->tisFile);
+            continue;
+        }
+        tismap_t map finally(cleanTisMap);
+        if (!tisMapOpen(&map, set->tisFile)) continue;
+
+        // only overlay tile pairs are converted
+        int *valid = arenaAlloc(&arena, (tilevecGetSize(&tileList) + 1) * sizeof(int));
+        int numValid = 0;
+        for (size_t i = 0, imax = tilevecGetSize(&tileList); valid && i < imax; ++i) {
+            const tile_t *pair = tilevecGetItem(&tileList, i);
+            if (pair->sec >= 0 && pair->pri < map.tileCount && pair->sec < map.tileCount)
+                valid[numValid++] = (int)i;
+        }
+        if (numValid == 0) continue;
+        set->numPairs = (numValid < CALIBRATE_PAIRS) ? numValid : CALIBRATE_PAIRS;
+        set->tiles = malloc((size_t)set->numPairs * 2 * TILE_SIZE);
+        if (!evalOp(set->tiles != NULL, "Error: Not enough memory for calibration.\n")) return -1;
+        set->ofsTiles = map.ofsTiles;
+        calib->numSets++;
+
+        // quantizers are measured on EE tile pairs: classic tile pairs are converted first
+        for (int p = 0; p < set->numPairs; ++p) {
+            set->pairs[p] = *tilevecGetItem(&tileList, valid[(size_t)p * numValid / set->numPairs]);
+            const uint8_t *pri = tisMapGetTile(&map, set->pairs[p].pri), *sec = tisMapGetTile(&map, set->pairs[p].sec);
+            uint8_t *pri_ee = set->tiles + (size_t)p * 2 * TILE_SIZE, *sec_ee = pri_ee + TILE_SIZE;
+            if (getMode(param_mode, pri) == MODE_TO_EE) {
+                if (!tileToEE(&set->pairs[p], pri, sec, pri_ee, sec_ee)) return -1;
+            } else {
+                memcpy(pri_ee, pri, TILE_SIZE);
+                memcpy(sec_ee, sec, TILE_SIZE);
+            }
+        }
+        calib->numPairs += set->numPairs;
+    }
+    return calib->numPairs;
+}
+
+// Internally used. Read all sampled tile pairs from storage with the given I/O backend.
+// Returns elapsed time in seconds, or a negative value on error.
+static double measureRead(const calibration_t *calib, int io, uint8_t *pixels) {
+    for (int s = 0; s < calib->numSets; ++s)
+        dropCache(calib->sets[s].tisFile);
+    double start = wallTime();
+    bool success = true;
+    for (int s = 0; success && s < calib->numSets; ++s) {
+        const calibset_t *set = &calib->sets[s];
+        tismap_t map finally(cleanTisMap);
+        memset(&map, 0, sizeof(map));
+        FILE *fp finally(cleanFile) = NULL;
+        if (io == IO_MMAP)
+            success = tisMapOpen(&map, set->tisFile) && map.mapped;
+        else
+            success = (fp = fopen(set->tisFile, "rb")) != NULL;
+        for (int p = 0; success && p < set->numPairs; ++p)
+            success = readTile(fp, set, &map, set->pairs[p].pri, pixels) && readTile(fp, set, &map, set->pairs[p].sec, pixels + TILE_SIZE);
+    }
+    return success ? wallTime() - start : -1.0;
+}
+
+// Internally used. Convert all sampled EE tile pairs to classic with the given quantizer backend. Tier escalation is
+// disabled, so that every tile pair is passed to the backend. Stores elapsed time in seconds and PSNR of the converted
+// tiles. Returns success state.
+static bool measureQuantizer(const calibration_t *calib, int quantizer, double *time, double *psnr) {
+    uint8_t *output finally(cleanMem8) = malloc(((size_t)calib->numPairs + 1) * TILE_SIZE);
+    uint8_t *scratch finally(cleanMem8) = malloc(TILE_SIZE);
+    uint32_t *pixels_rgba finally(cleanMem32) = malloc(TILE_DIM * TILE_DIM * sizeof(uint32_t));
+    if (!evalOp(output && scratch && pixels_rgba, "Error: Not enough memory for calibration.\n")) return false;
+    int oldQuantizer = param_quantizer;
+    double oldTileError = param_tile_error;
+    param_quantizer = quantizer;
+    param_tile_error = -1.0;
+    bool success = true;
+    double start = wallTime();
+    for (int s = 0, n = 0; success && s < calib->numSets; ++s) {
+        const calibset_t *set = &calib->sets[s];
+        for (int p = 0; success && p < set->numPairs; ++p, ++n) {
+            const uint8_t *pri = set->tiles + (size_t)p * 2 * TILE_SIZE;
+            success = tileFromEE(&set->pairs[p], pri, pri + TILE_SIZE, output + (size_t)n * TILE_SIZE, scratch, pixels_rgba, set->tisFile);
+        }
+    }
+    *time = wallTime() - start;
+    param_quantizer = oldQuantizer;
+    param_tile_error = oldTileError;
+
+    // color error is measured afterwards to keep it out of the timing
+    uint64_t squaredError = 0;
+    for (int s = 0, n = 0; success && s < calib->numSets; ++s) {
+        const calibset_t *set = &calib->sets[s];
+        for (int p = 0; p < set->numPairs; ++p, ++n) {
+            const uint8_t *pri = set->tiles + (size_t)p * 2 * TILE_SIZE;
+            tileerror_t error;
+            compositeTiles(pri, pri + TILE_SIZE, pixels_rgba);
+            tileErrorStats(pixels_rgba, output + (size_t)n * TILE_SIZE, &error);
+            squaredError += error.squaredError;
+        }
+    }
+    *psnr = errorToPsnr(squaredError, (uint64_t)calib->numPairs * TILE_DIM * TILE_DIM);
+    return success;
+}
+
+// Internally used. Benchmark thread: reads and converts sampled tile pairs until all pairs have been processed.
+static void* calibrateWorker(void *arg) {
+    calibration_t *calib = arg;
+    param_mode = calib->mode;
+    uint8_t *pixels finally(cleanMem8) = malloc(4 * TILE_SIZE);
+    uint32_t *pixels_rgba finally(cleanMem32) = malloc(TILE_DIM * TILE_DIM * sizeof(uint32_t));
+    FILE *fp finally(cleanFile) = NULL;
+    int fileSet = -1;
+    bool success = (pixels && pixels_rgba);
+    while (success) {
+        pthread_mutex_lock(&calib->lock);
+        int index = calib->next++;
+        pthread_mutex_unlock(&calib->lock);
+        if (index >= calib->numPairs) break;
+        int s = 0;
+        while (index >= calib->sets[s].numPairs)
+            index -= calib->sets[s++].numPairs;
+        const calibset_t *set = &calib->sets[s];
+        const tile_t *pair = &set->pairs[index];
+
+        // buffered reads use a separate file handle per thread
+        if (calib->io != IO_MMAP && fileSet != s) {
+            if (fp) fclose(fp);
+            fp = fopen(set->tisFile, "rb");
+            fileSet = s;
+        }
+        const tismap_t *map = (calib->io == IO_MMAP) ? &calib->maps[s] : NULL;
+        success = readTile(fp, set, map, pair->pri, pixels) && readTile(fp, set, map, pair->sec, pixels + TILE_SIZE);
+        switch (success ? getMode(param_mode, pixels) : MODE_NONE) {
+        case MODE_TO_EE:
+            success = tileToEE(pair, pixels, pixels + TILE_SIZE, pixels + 2 * TILE_SIZE, pixels + 3 * TILE_SIZE);
+            break;
+        case MODE_FROM_EE:
+            success = tileFromEE(pair, pixels, pixels + TILE_SIZE, pixels + 2 * TILE_SIZE, pixels + 3 * TILE_SIZE, pixels_rgba, set->tisFile);
+            break;
+        }
+    }
+    if (!success) {
+        pthread_mutex_lock(&calib->lock);
+        calib->failed = true;
+        pthread_mutex_unlock(&calib->lock);
+    }
+    return NULL;
+}
+
+// Internally used. Read and convert all sampled tile pairs on "numThreads" threads, including the calling thread.
+// Returns elapsed time in seconds, or a negative value on error.
+static double measureWorkers(calibration_t *calib, int numThreads) {
+    for (int s = 0; s < calib->numSets; ++s)
+        dropCache(calib->sets[s].tisFile);
+    double start = wallTime();
+    calib->next = 0;
+    calib->failed = false;
+    for (int s = 0; s < calib->numSets && calib->io == IO_MMAP; ++s)
+        calib->failed = calib->failed || !tisMapOpen(&calib->maps[s], calib->sets[s].tisFile);
+    pthread_t *threads = (numThreads > 1) ? malloc((numThreads - 1) * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    while (!calib->failed && threads && started < numThreads - 1 && pthread_create(&threads[started], NULL, calibrateWorker, calib) == 0)
+        started++;
+    if (!calib->failed)
+        calibrateWorker(calib);
+    for (int i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    double elapsed = wallTime() - start;
+    for (int s = 0; s < calib->numSets; ++s)
+        tisMapClose(&calib->maps[s]);
+    return (calib->failed || started < numThreads - 1) ? -1.0 : elapsed;
+}
+
+
+bool configLoad(const char *configFile, config_t *config) {
+    if (!configFile || !config) return false;
+    config->workers = config->io = config->quantizer = -1;
+    FILE *fp finally(cleanFile) = fopen(configFile, "r");
+    if (!evalOp(fp != NULL, "Error: Unable to open configuration file: %s\n", configFile)) return false;
+
+    char line[CALIBRATE_LINE_SIZE];
+    for (int lineNo = 1; fgets(line, sizeof(line), fp); ++lineNo) {
+        char *key = line;
+        while (isspace((unsigned char)*key)) key++;
+        if (!*key || *key == '#') continue;
+        char *value = strchr(key, '=');
+        if (!evalOp(value != NULL, "Error: Invalid line %d in configuration file: %s\n", lineNo, configFile)) return false;
+        for (char *p = value; p > key && isspace((unsigned char)p[-1]); --p) p[-1] = 0;
+        *value++ = 0;
+        while (isspace((unsigned char)*value)) value++;
+        for (char *p = value + strlen(value); p > value && isspace((unsigned char)p[-1]); --p) p[-1] = 0;
+
+        bool valid = true;
+        if (strcmp(key, "workers") == 0) {
+            valid = (config->workers = atoi(value)) > 0;
+        } else if (strcmp(key, "io") == 0) {
+            config->io = -1;
+            for (int i = 0; i < (int)(sizeof(ioNames) / sizeof(*ioNames)); ++i)
+                if (strcmp(value, ioNames[i]) == 0) config->io = i;
+            valid = (config->io >= 0);
+        } else if (strcmp(key, "quantizer") == 0) {
+            valid = (config->quantizer = quantizerFind(value)) >= 0;
+        } else {
+            printMsg(OUTPUT_ERR, "Warning: Unknown setting \"%s\" in configuration file: %s\n", key, configFile);
+        }
+        if (!evalOp(valid, "Error: Invalid value of setting \"%s\" in configuration file: %s\n", key, configFile)) return false;
+    }
+    return true;
+}
+
+bool calibrate(array_t *wedList, array_t *searchPath, const char *configFile) {
+    if (!wedList || !searchPath || !configFile) return false;
+    calibration_t *calib finally(cleanCalibration) = calloc(1, sizeof(calibration_t));
+    if (!evalOp(calib != NULL, "Error: Not enough memory for calibration.\n")) return false;
+    pthread_mutex_init(&calib->lock, NULL);
+    calib->mode = param_mode;
+
+    printMsg(OUTPUT_MSG, "Sampling tilesets...\n");
+    int numPairs = sampleTilesets(calib, wedList, searchPath);
+    if (numPairs < 0) return false;
+    if (!evalOp(numPairs > 0, "Error: No overlay tile pairs found for calibration.\n")) return false;
+    printMsg(OUTPUT_MSG, "Calibrating with %d tile pair(s) of %d tileset(s)...\n", numPairs, calib->numSets);
+
+    // I/O backends: rounds alternate between backends to spread out disturbances
+    char ioReason[CALIBRATE_LINE_SIZE / 2];
+    uint8_t pixels[2 * TILE_SIZE];
+    double ioTime[2] = { -1.0, -1.0 };
+    for (int round = 0; round < CALIBRATE_IO_ROUNDS; ++round) {
+        for (int io = IO_BUFFERED; io <= IO_MMAP; ++io) {
+            double elapsed = measureRead(calib, io, pixels);
+            if (elapsed >= 0.0 && (ioTime[io] < 0.0 || elapsed < ioTime[io])) ioTime[io] = elapsed;
+        }
+    }
+    if (!evalOp(ioTime[IO_BUFFERED] >= 0.0, "Error: Could not read sampled tilesets.\n")) return false;
+    double megabytes = (double)numPairs * 2 * TILE_SIZE / (1024.0 * 1024.0);
+    int ioChoice = IO_BUFFERED;
+    if (ioTime[IO_MMAP] < 0.0) {
+        snprintf(ioReason, sizeof(ioReason), "I/O backend: buffered %.1f MB/s, mmap not available", megabytes / ioTime[IO_BUFFERED]);
+    } else {
+        if (ioTime[IO_MMAP] * (1.0 + CALIBRATE_MIN_GAIN / 100.0) < ioTime[IO_BUFFERED]) ioChoice = IO_MMAP;
+        snprintf(ioReason, sizeof(ioReason), "I/O backend: buffered %.1f MB/s, mmap %.1f MB/s -> %s (%s)",
+                 megabytes / ioTime[IO_BUFFERED], megabytes / ioTime[IO_MMAP], ioNames[ioChoice],
+                 (ioChoice == IO_MMAP) ? "mmap is faster" : "mmap is not faster");
+    }
+    printMsg(OUTPUT_MSG, "  %s\n", ioReason);
+
+    // quantizer backends: a faster backend is only chosen if it keeps the color error
+    char quantReason[CALIBRATE_LINE_SIZE / 2];
+    int len = snprintf(quantReason, sizeof(quantReason), "Quantizer:");
+    int quantChoice = -1;
+    double quantTime = 0.0, quantPsnr = 0.0;
+    for (int q = 0; q < QUANTIZER_COUNT; ++q) {
+        double elapsed, psnr;
+        if (!quantizerGet(q) || !measureQuantizer(calib, q, &elapsed, &psnr)) continue;
+        len += snprintf(quantReason + len, sizeof(quantReason) - len, " %s %.0f tiles/s (%.2f dB),", quantizerGet(q)->name,
+                        numPairs / elapsed, psnr);
+        if (quantChoice < 0 || (elapsed * (1.0 + CALIBRATE_MIN_GAIN / 100.0) < quantTime && psnr >= quantPsnr - CALIBRATE_MAX_PSNR_LOSS)) {
+            quantChoice = q;
+            quantTime = elapsed;
+            quantPsnr = psnr;
+        }
+    }
+    if (!evalOp(quantChoice >= 0, "Error: Could not convert sampled tile pairs.\n")) return false;
+    snprintf(quantReason + len - 1, sizeof(quantReason) - len + 1, " -> %s (%s within %.1f dB PSNR)", quantizerGet(quantChoice)->name,
+             (quantChoice == QUANTIZER_LIQ) ? "no faster backend" : "faster", CALIBRATE_MAX_PSNR_LOSS);
+    printMsg(OUTPUT_MSG, "  %s\n", quantReason);
+
+    // concurrent conversions: the fewest threads that come close to the best throughput
+    char workersReason[CALIBRATE_LINE_SIZE / 2];
+    len = snprintf(workersReason, sizeof(workersReason), "Concurrent conversions:");
+    // tier escalation is disabled as for the quantizer backends, so that the backend load matches its measurement
+    int oldQuantizer = param_quantizer;
+    double oldTileError = param_tile_error;
+    param_quantizer = quantChoice;
+    param_tile_error = -1.0;
+    calib->io = ioChoice;
+    int cores = cpuCount(), maxThreads = (cores < numPairs) ? cores : numPairs;
+    double rate[64] = {0.0}, bestRate = 0.0;
+    int threadCounts[64], numCounts = 0;
+    for (int n = 1; numCounts < 64; n *= 2) {
+        if (n > maxThreads) n = maxThreads;
+        double elapsed = measureWorkers(calib, n);
+        if (elapsed > 0.0) {
+            threadCounts[numCounts] = n;
+            rate[numCounts] = numPairs / elapsed;
+            if (rate[numCounts] > bestRate) bestRate = rate[numCounts];
+            len += snprintf(workersReason + len, sizeof(workersReason) - len, " %d: %.0f,", n, rate[numCounts]);
+            numCounts++;
+        }
+        if (n == maxThreads) break;
+    }
+    param_quantizer = oldQuantizer;
+    param_tile_error = oldTileError;
+    if (!evalOp(numCounts > 0, "Error: Could not convert sampled tile pairs.\n")) return false;
+    int workers = threadCounts[numCounts - 1];
+    for (int i = numCounts - 1; i >= 0; --i)
+        if (rate[i] * (1.0 + CALIBRATE_MIN_GAIN / 100.0) >= bestRate) workers = threadCounts[i];
+    snprintf(workersReason + len - 1, sizeof(workersReason) - len + 1, " tile pairs/s -> %d (fewest within %.0f%% of the fastest)",
+             workers, CALIBRATE_MIN_GAIN);
+    printMsg(OUTPUT_MSG, "  %s\n", workersReason);
+
+    // reasons are kept as comments
+    FILE *fp finally(cleanFile) = fopen(configFile, "w");
+    if (!evalOp(fp != NULL, "Error: Could not create configuration file: %s\n", configFile)) return false;
+    char date[32] = {0};
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&now));
+    fprintf(fp, "# tis2ovl configuration, created by --calibrate on %s\n", date);
+    fprintf(fp, "# Sample: %d tile pair(s) of %d tileset(s)\n", numPairs, calib->numSets);
+    fprintf(fp, "# %s\nio=%s\n", ioReason, ioNames[ioChoice]);
+    fprintf(fp, "# %s\nquantizer=%s\n", quantReason, quantizerGet(quantChoice)->name);
+    fprintf(fp, "# %s\nworkers=%d\n", workersReason, workers);
+    if (!evalOp(fflush(fp) == 0 && !ferror(fp), "Error: Could not write configuration file: %s\n", configFile)) return false;
+    printMsg(OUTPUT_MSG, "Configuration written to \"%s\".\n", configFile);
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef CALIBRATE_H_INCLUDED
+#define CALIBRATE_H_INCLUDED
+
+#include <stdbool.h>
+#include "arrays.h"
+
+/// Default configuration file. It is loaded automatically from the current directory if available.
+#define CONFIG_FILE     "tis2ovl.cfg"
+
+/// Settings of a configuration file. Settings that are not specified are negative.
+typedef struct {
+    int workers;        // max. number of concurrent conversions (--workers)
+    int io;             // I/O backend (see IO_BACKEND)
+    int quantizer;      // quantizer backend (see QUANTIZER)
+} config_t;
+
+/// Load settings from the given configuration file. Returns success state.
+bool configLoad(const char *configFile, config_t *config);
+
+/**
+ * Run a short benchmark on a sample of the given tilesets and store the fastest settings for this system in a
+ * configuration file. I/O throughput of each I/O backend, tile throughput and color error of each quantizer backend,
+ * and conversion throughput of increasing numbers of concurrent conversions are measured. No input files are modified.
+ * The measurements behind each chosen setting are printed and stored as comments in the configuration file.
+ * \param wedList       WED files of the tilesets to sample.
+ * \param searchPath    TIS search paths.
+ * \param configFile    Configuration file to create. An existing file is replaced.
+ * \return success state.
+ */
+bool calibrate(array_t *wedList, array_t *searchPath, const char *configFile);
+
+#endif // CALIBRATE_H_INCLUDED
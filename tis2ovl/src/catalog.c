@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "compat.h"
+#include "functions.h"
+#include "arena.h"
+#include "tismap.h"
+#include "catalog.h"
+
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+// Loaded catalog
+static const uint8_t *catalogData = NULL;
+static size_t catalogSize = 0;
+static bool catalogMapped = false;
+static const catalogheader_t *header = NULL;
+static const catalogentry_t *entries = NULL;
+static const tile_t *pairs = NULL;
+static const char *strings = NULL;
+static size_t stringsSize = 0;
+
+// Catalog content under construction
+typedef struct {
+    catalogentry_t *entries;
+    size_t numEntries, capEntries;
+    tile_t *pairs;
+    size_t numPairs, capPairs;
+    char *strings;
+    size_t numStrings, capStrings;
+} catalogbuilder_t;
+
+// String table used to sort catalog entries
+static const char *sortStrings = NULL;
+
+// Internally used. Resolve absolute path of the given file. Falls back to the path itself.
+static void absolutePath(const char *fileName, char *path) {
+#ifdef _WIN32
+    if (!_fullpath(path, fileName, FILENAME_MAX))
+#else
+    char buf[PATH_MAX];
+    if (realpath(fileName, buf) && strlen(buf) < FILENAME_MAX)
+        strcpy(path, buf);
+    else
+#endif
+    {
+        size_t len = strlen(fileName);
+        if (len >= FILENAME_MAX) len = FILENAME_MAX - 1;
+        memcpy(path, fileName, len);
+        path[len] = 0;
+    }
+}
+
+// Internally used. Append string to the string table. Returns string offset, or 0 on error.
+static uint32_t addString(catalogbuilder_t *cb, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (cb->numStrings + len > cb->capStrings) {
+        size_t cap = cb->capStrings ? cb->capStrings : 4096;
+        while (cb->numStrings + len > cap) cap *= 2;
+        char *list = realloc(cb->strings, cap);
+        if (!list) return 0;
+        cb->strings = list;
+        cb->capStrings = cap;
+    }
+    uint32_t ofs = (uint32_t)cb->numStrings;
+    memcpy(cb->strings + ofs, str, len);
+    cb->numStrings += len;
+    return ofs;
+}
+
+// Internally used. Append overlay tile pairs to the pair table. Returns success state.
+static bool addPairs(catalogbuilder_t *cb, const tilevec_t *tileList) {
+    size_t num = tilevecGetSize(tileList);
+    if (cb->numPairs + num > cb->capPairs) {
+        size_t cap = cb->capPairs ? cb->capPairs : 1024;
+        while (cb->numPairs + num > cap) cap *= 2;
+        tile_t *list = realloc(cb->pairs, cap * sizeof(tile_t));
+        if (!list) return false;
+        cb->pairs = list;
+        cb->capPairs = cap;
+    }
+    if (num) memcpy(cb->pairs + cb->numPairs, tileList->data, num * sizeof(tile_t));
+    cb->numPairs += num;
+    return true;
+}
+
+// Internally used. Append new catalog entry. Returns NULL on error.
+static catalogentry_t* addEntry(catalogbuilder_t *cb) {
+    if (cb->numEntries == cb->capEntries) {
+        size_t cap = cb->capEntries ? cb->capEntries * 2 : 256;
+        catalogentry_t *list = realloc(cb->entries, cap * sizeof(catalogentry_t));
+        if (!list) return NULL;
+        cb->entries = list;
+        cb->capEntries = cap;
+    }
+    catalogentry_t *entry = &cb->entries[cb->numEntries++];
+    memset(entry, 0, sizeof(catalogentry_t));
+    return entry;
+}
+
+// Internally used. Release catalog content under construction.
+static void cleanBuilder(catalogbuilder_t *cb) {
+    if (cb) {
+        free(cb->entries);
+        free(cb->pairs);
+        free(cb->strings);
+    }
+}
+
+// Internally used. Order entries by WED path.
+static int compareEntry(const void *a, const void *b) {
+    return strcmp(sortStrings + ((const catalogentry_t*)a)->wedPath, sortStrings + ((const catalogentry_t*)b)->wedPath);
+}
+
+// Internally used. Catalog a single WED file. Returns success state.
+static bool catalogWED(catalogbuilder_t *cb, const char *wedFile, array_t *searchPath, arena_t *arena) {
+    printMsg(OUTPUT_MSG, "Cataloging WED file \"%s\"...\n", wedFile);
+    tilevec_t tileList;
+    char tisName[15] = {0}, tisFile[FILENAME_MAX] = {0}, path[FILENAME_MAX];
+    if (!tilevecInit(&tileList, 1, arena) || !parseWED(wedFile, tisName, &tileList, arena)) return false;
+    bool hasTIS = findTISFile(searchPath, tisName, tisFile);
+    if (!evalOp(hasTIS || tilevecGetSize(&tileList) == 0, "Error: Could not find TIS file: %s\n", tisName)) return false;
+
+    // overlay tiles are classified the same way as by --analyze
+    jobinfo_t info;
+    memset(&info, 0, sizeof(jobinfo_t));
+    if (tilevecGetSize(&tileList) > 0 && analyze(wedFile, searchPath, &info) < 0) return false;
+    int tileCount = -1;
+    if (hasTIS) {
+        tismap_t map finally(cleanTisMap);
+        if (!tisMapOpen(&map, tisFile)) return false;
+        tileCount = map.tileCount;
+    }
+
+    catalogentry_t *entry = addEntry(cb);
+    if (!evalOp(entry != NULL, "Error: Could not allocate memory.\n")) return false;
+    absolutePath(wedFile, path);
+    entry->wedPath = addString(cb, path);
+    entry->tisName = addString(cb, tisName);
+    if (hasTIS) absolutePath(tisFile, path);
+    entry->tisPath = addString(cb, hasTIS ? path : "");
+    entry->firstPair = (uint32_t)cb->numPairs;
+    entry->numPairs = (uint32_t)tilevecGetSize(&tileList);
+    entry->tileCount = tileCount;
+    entry->tilesToEE = info.tilesToEE;
+    entry->tilesFromEE = info.tilesFromEE;
+    entry->wedSize = fileSize(wedFile);
+    entry->wedTime = fileModTime(wedFile);
+    entry->wedHash = fileHash(wedFile);
+    entry->tisSize = hasTIS ? fileSize(tisFile) : -1;
+    entry->tisTime = hasTIS ? fileModTime(tisFile) : -1;
+    entry->tisHash = hasTIS ? fileHash(tisFile) : 0;
+    if (!evalOp(entry->wedPath && entry->tisName && addPairs(cb, &tileList), "Error: Could not allocate memory.\n")) {
+        cb->numEntries--;
+        return false;
+    }
+    if (entry->numPairs == 0)
+        printMsg(OUTPUT_MSG, "  No overlay tile pairs\n");
+    printMsg(OUTPUT_MSG, "\n");
+    return true;
+}
+
+int catalogBuild(const char *catalogFile, array_t *wedList, array_t *searchPath) {
+    if (!catalogFile || !wedList) return -1;
+    catalogbuilder_t cb finally(cleanBuilder);
+    memset(&cb, 0, sizeof(catalogbuilder_t));
+    if (!evalOp(addString(&cb, "") == 0 && cb.numStrings == 1, "Error: Could not allocate memory.\n")) return -1;
+
+    int errors = 0;
+    arena_t arena finally(cleanArena);
+    arenaInit(&arena, 0);
+    for (size_t i = 0, imax = arrayGetSize(wedList); i < imax && !isInterrupted(); ++i) {
+        arenaReset(&arena);
+        if (!catalogWED(&cb, arrayGetItem(wedList, i), searchPath, &arena)) {
+            printMsg(OUTPUT_MSG, "\n");
+            errors++;
+        }
+    }
+    if (isInterrupted()) return -1;
+
+    // entries are sorted for lookup by binary search, duplicate WED paths are removed
+    sortStrings = cb.strings;
+    qsort(cb.entries, cb.numEntries, sizeof(catalogentry_t), compareEntry);
+    size_t numEntries = 0;
+    for (size_t i = 0; i < cb.numEntries; ++i)
+        if (numEntries == 0 || strcmp(cb.strings + cb.entries[i].wedPath, cb.strings + cb.entries[numEntries - 1].wedPath) != 0)
+            cb.entries[numEntries++] = cb.entries[i];
+    sortStrings = NULL;
+
+    // sections are aligned to 8 bytes
+    catalogheader_t hdr;
+    memset(&hdr, 0, sizeof(catalogheader_t));
+    memcpy(hdr.magic, CATALOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = CATALOG_VERSION;
+    hdr.numEntries = (uint32_t)numEntries;
+    hdr.ofsEntries = sizeof(catalogheader_t);
+    hdr.ofsPairs = hdr.ofsEntries + numEntries * sizeof(catalogentry_t);
+    hdr.ofsStrings = hdr.ofsPairs + ((cb.numPairs * sizeof(tile_t) + 7) & ~(size_t)7);
+    hdr.size = hdr.ofsStrings + cb.numStrings;
+
+    char tmpFile[FILENAME_MAX + 8];
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", catalogFile);
+    FILE *fp = fopen(tmpFile, "wb");
+    if (!evalOp(fp != NULL, "Error: Could not create catalog file: %s\n", catalogFile)) return -1;
+    static const uint8_t padding[8] = {0};
+    bool success = (fwrite(&hdr, sizeof(catalogheader_t), 1, fp) == 1 &&
+                    fwrite(cb.entries, sizeof(catalogentry_t), numEntries, fp) == numEntries &&
+                    fwrite(cb.pairs, sizeof(tile_t), cb.numPairs, fp) == cb.numPairs &&
+                    fwrite(padding, 1, hdr.ofsStrings - hdr.ofsPairs - cb.numPairs * sizeof(tile_t), fp) == hdr.ofsStrings - hdr.ofsPairs - cb.numPairs * sizeof(tile_t) &&
+                    fwrite(cb.strings, 1, cb.numStrings, fp) == cb.numStrings);
+    success = (fclose(fp) == 0) && success;
+    if (success)
+        success = (rename(tmpFile, catalogFile) == 0);
+    if (!success) {
+        remove(tmpFile);
+        printMsg(OUTPUT_ERR, "Error: Could not write catalog file: %s\n", catalogFile);
+        return -1;
+    }
+    printMsg(OUTPUT_MSG, "Cataloged %d WED file(s) in \"%s\".\n", (int)numEntries, catalogFile);
+    return errors;
+}
+
+// Internally used. Validate structure of the loaded catalog.
+static bool validateCatalog() {
+    if (catalogSize < sizeof(catalogheader_t)) return false;
+    header = (const catalogheader_t*)catalogData;
+    if (memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) != 0 || header->version != CATALOG_VERSION ||
+        header->size != catalogSize || header->ofsEntries != sizeof(catalogheader_t) ||
+        header->ofsPairs != header->ofsEntries + (uint64_t)header->numEntries * sizeof(catalogentry_t) ||
+        header->ofsStrings < header->ofsPairs || header->ofsStrings >= catalogSize || catalogData[catalogSize - 1] != 0) return false;
+    entries = (const catalogentry_t*)(catalogData + header->ofsEntries);
+    pairs = (const tile_t*)(catalogData + header->ofsPairs);
+    strings = (const char*)(catalogData + header->ofsStrings);
+    stringsSize = catalogSize - header->ofsStrings;
+    uint64_t numPairs = (header->ofsStrings - header->ofsPairs) / sizeof(tile_t);
+    for (uint32_t i = 0; i < header->numEntries; ++i) {
+        const catalogentry_t *entry = &entries[i];
+        if (entry->wedPath >= stringsSize || entry->tisName >= stringsSize || entry->tisPath >= stringsSize ||
+            (uint64_t)entry->firstPair + entry->numPairs > numPairs) return false;
+    }
+    return true;
+}
+
+bool catalogOpen(const char *catalogFile) {
+    if (!catalogFile || catalogData) return false;
+#ifndef _WIN32
+    int fd = open(catalogFile, O_RDONLY);
+    if (!evalOp(fd >= 0, "Error: Unable to open catalog file: %s\n", catalogFile)) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            catalogData = data;
+            catalogSize = (size_t)st.st_size;
+            catalogMapped = true;
+        }
+    }
+    close(fd);
+#endif
+    if (!catalogData) {
+        // fall back to reading the whole file
+        int64_t size = fileSize(catalogFile);
+        FILE *fp finally(cleanFile) = fopen(catalogFile, "rb");
+        uint8_t *buf = (fp && size > 0) ? malloc((size_t)size) : NULL;
+        if (!evalOp(buf && fread(buf, 1, (size_t)size, fp) == (size_t)size, "Error: Could not read catalog file: %s\n", catalogFile)) {
+            free(buf);
+            return false;
+        }
+        catalogData = buf;
+        catalogSize = (size_t)size;
+    }
+    if (!evalOp(validateCatalog(), "Error: Not a valid catalog file: %s\n", catalogFile)) {
+        catalogClose();
+        return false;
+    }
+    return true;
+}
+
+void catalogClose() {
+    if (catalogData) {
+#ifndef _WIN32
+        if (catalogMapped)
+            munmap((void*)catalogData, catalogSize);
+        else
+#endif
+            free((void*)catalogData);
+    }
+    catalogData = NULL;
+    catalogSize = stringsSize = 0;
+    catalogMapped = false;
+    header = NULL;
+    entries = NULL;
+    pairs = NULL;
+    strings = NULL;
+}
+
+// Internally used. Return whether the file matches the given signature.
+static bool isCurrent(const char *fileName, int64_t size, int64_t time, uint64_t hash) {
+    if (fileSize(fileName) != size) return false;
+    return fileModTime(fileName) == time || fileHash(fileName) == hash;
+}
+
+const catalogentry_t* catalogFind(const char *wedFile) {
+    if (!catalogData || !wedFile) return NULL;
+    char path[FILENAME_MAX];
+    absolutePath(wedFile, path);
+    size_t lo = 0, hi = header->numEntries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(strings + entries[mid].wedPath, path);
+        if (cmp == 0)
+            return isCurrent(wedFile, entries[mid].wedSize, entries[mid].wedTime, entries[mid].wedHash) ? &entries[mid] : NULL;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+bool catalogIsTisCurrent(const catalogentry_t *entry) {
+    if (!entry || !catalogData || !*catalogGetString(entry->tisPath)) return false;
+    return isCurrent(catalogGetString(entry->tisPath), entry->tisSize, entry->tisTime, entry->tisHash);
+}
+
+const char* catalogGetString(uint32_t ofs) {
+    return (catalogData && ofs < stringsSize) ? strings + ofs : "";
+}
+
+bool catalogGetPairs(const catalogentry_t *entry, tilevec_t *tileList) {
+    if (!entry || !tileList || !catalogData) return false;
+    if (!tilevecReserve(tileList, tilevecGetSize(tileList) + entry->numPairs)) return false;
+    for (uint32_t i = 0; i < entry->numPairs; ++i)
+        tilevecAdd(tileList, pairs[entry->firstPair + i]);
+    return true;
+}
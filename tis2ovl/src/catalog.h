@@ -0,0 +1,70 @@
+#ifndef CATALOG_H_INCLUDED
+#define CATALOG_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arrays.h"
+#include "tis2ovl.h"
+
+/// Identifies catalog files.
+#define CATALOG_MAGIC       "TIS2OCAT"
+/// Version of the catalog file format.
+#define CATALOG_VERSION     1
+
+/// Header of a catalog file. All values are stored in native byte order.
+typedef struct {
+    char magic[8];          // CATALOG_MAGIC
+    uint32_t version;       // CATALOG_VERSION
+    uint32_t numEntries;    // number of catalog entries
+    uint64_t ofsEntries;    // offset to the catalog entries, sorted by WED path
+    uint64_t ofsPairs;      // offset to the overlay tile pairs of all entries (tile_t)
+    uint64_t ofsStrings;    // offset to the null-terminated strings
+    uint64_t size;          // total size of the catalog file
+} catalogheader_t;
+
+/// Catalog entry of a single WED file.
+typedef struct {
+    uint32_t wedPath;       // string offset of the absolute WED file path
+    uint32_t tisName;       // string offset of the referenced TIS file name
+    uint32_t tisPath;       // string offset of the resolved TIS file path, empty if TIS file was not found
+    uint32_t firstPair;     // index of the first overlay tile pair
+    uint32_t numPairs;      // number of overlay tile pairs
+    int32_t tileCount;      // number of tiles in the TIS file, -1 if not available
+    int32_t tilesToEE;      // overlay tile pairs to convert from classic to EE
+    int32_t tilesFromEE;    // overlay tile pairs to convert from EE to classic
+    int64_t wedSize, wedTime;   // size and modification time of the WED file
+    int64_t tisSize, tisTime;   // size and modification time of the TIS file, -1 if not available
+    uint64_t wedHash;       // content hash of the WED file
+    uint64_t tisHash;       // content hash of the TIS file, 0 if not available
+} catalogentry_t;
+
+/**
+ * Scan the given WED files and write a catalog of their overlays to the specified file.
+ * WED files without overlays are cataloged even if their TIS files can't be found.
+ * \param catalogFile   Path of the catalog file. An existing file is replaced.
+ * \param wedList       WED files to catalog.
+ * \param searchPath    TIS search paths.
+ * \return Number of WED files that could not be cataloged, or -1 if the catalog could not be written.
+ */
+int catalogBuild(const char *catalogFile, array_t *wedList, array_t *searchPath);
+
+/// Load the specified catalog file. The file is mapped into memory. Returns success state.
+bool catalogOpen(const char *catalogFile);
+
+/// Release the loaded catalog.
+void catalogClose();
+
+/// Return the catalog entry of the given WED file, or NULL if not cataloged or the WED file has been modified since
+/// the catalog was built. Modification is detected by file size and time, or by content hash if only the time differs.
+const catalogentry_t* catalogFind(const char *wedFile);
+
+/// Return whether the TIS file of the catalog entry is unchanged since the catalog was built.
+bool catalogIsTisCurrent(const catalogentry_t *entry);
+
+/// Return the string at the given offset of the loaded catalog.
+const char* catalogGetString(uint32_t ofs);
+
+/// Add the overlay tile pairs of the catalog entry to "tileList". Returns success state.
+bool catalogGetPairs(const catalogentry_t *entry, tilevec_t *tileList);
+
+#endif // CATALOG_H_INCLUDED
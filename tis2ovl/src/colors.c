@@ -1,9 +1,16 @@
 #include <limits.h>
+#include <math.h>
 #include <string.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
 #include "compat.h"
 #include "colors.h"
+#include "tis2ovl.h"
 #include "functions.h"
-#include "libimagequant.h"
+#include "stats.h"
+#include "global.h"
+#include "quantizer.h"
 
 // Definition of a colormap entry
 typedef struct {
@@ -18,19 +25,8 @@ typedef struct {
     int dist;               // weighted distance between colors
 } colordiff_t;
 def_cleanFunc(cleanColorDiff, colordiff_t*)
-
-// Convenience structure: Simplify cleanup of pngquant memory.
-typedef struct {
-    liq_attr *attr;
-    liq_result *result;
-} quantize_t;
-
-// Clean up pngquant memory
-void cleanQuantizer(quantize_t **pquant);
-
-// Returns weighted color distance
-int colorDistance(uint32_t color1, uint32_t color2);
-
+def_cleanFunc(cleanColorHist, colorhist_t*)
+def_cleanFunc(cleanMem16, uint16_t*)
 
 bool getMergeableColors(const uint8_t *data, uint8_t *color1, uint8_t *color2) {
     if (data && color1 && color2) {
@@ -107,27 +103,302 @@ int colorIndex(const void *data, size_t palSize, uint32_t color) {
 
 
 bool createRemappedTile(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent) {
-    if (!srcTile || !dstTile) return false;
-    quantize_t *quant finally(cleanQuantizer) = malloc(sizeof(quantize_t));
-    if ((quant->attr = liq_attr_create()) == NULL) return false;
-    liq_image *img = liq_image_create_rgba(quant->attr, srcTile, 64, 64, 0.0);
-    if (!img) return false;
-    if (useTransparent) {
-        liq_color c; c.b = c.r = 0; c.a = c.g = 255;
-        if (liq_image_add_fixed_color(img, c) != LIQ_OK) return false;
-    }
-    if (liq_image_quantize(img, quant->attr, &quant->result) != LIQ_OK) return false;
-    if (liq_write_remapped_image(quant->result, img, dstTile + 1024, 4096) != LIQ_OK) return false;
-    const liq_palette *pal = liq_get_palette(quant->result);
-    for (unsigned i = 0; i < pal->count; ++i) {
-        dstTile[i*4] = pal->entries[i].r;
-        dstTile[i*4+1] = pal->entries[i].g;
-        dstTile[i*4+2] = pal->entries[i].b;
-        dstTile[i*4+3] = 0;
-    }
-    if (pal->count < 256)
-        memset(dstTile + pal->count*4, 0, (256-pal->count)*4);
-    return true;
+    return remapTileTiered(srcTile, dstTile, useTransparent, param_tile_error) != QUANT_TIER_NONE;
+}
+
+
+void colorHistInit(colorhist_t *hist) {
+    if (!hist) return;
+    hist->count = 0;
+    hist->fixed = -1;
+    hist->total = 0;
+    memset(hist->slots, 0xff, sizeof(hist->slots));
+}
+
+int colorHistAdd(colorhist_t *hist, uint32_t color, int weight, bool fixed) {
+    if (!hist) return -1;
+    color &= 0x00ffffff;
+    unsigned h = ((color * 2654435761u) >> 21) & (2 * QUANT_MAX_COLORS - 1);
+    while (hist->slots[h] >= 0 && hist->colors[hist->slots[h]] != color)
+        h = (h + 1) & (2 * QUANT_MAX_COLORS - 1);
+    if (hist->slots[h] < 0) {
+        if (hist->count == QUANT_MAX_COLORS) return -1;
+        hist->slots[h] = hist->count;
+        hist->colors[hist->count] = color;
+        hist->weights[hist->count] = 0;
+        hist->count++;
+    }
+    int idx = hist->slots[h];
+    hist->weights[idx] += weight;
+    hist->total += weight;
+    if (fixed) hist->fixed = idx;
+    return idx;
+}
+
+// Internally used. Return cost of merging two weighted colors (increase of squared error).
+static inline int64_t mergeCost(const colorhist_t *hist, int i, int j) {
+    int64_t wi = hist->weights[i], wj = hist->weights[j];
+    return (int64_t)colorDistance(hist->colors[i], hist->colors[j]) * wi * wj / (wi + wj);
+}
+
+// Internally used. Find the cheapest merge partner of color "i". Returns -1 if not available.
+static int findPartner(const colorhist_t *hist, const bool *active, int i, int64_t *cost) {
+    int retVal = -1;
+    *cost = INT64_MAX;
+    for (int j = 0; j < hist->count; ++j) {
+        if (j == i || !active[j] || j == hist->fixed) continue;
+        int64_t c = mergeCost(hist, i, j);
+        if (c < *cost) {
+            *cost = c;
+            retVal = j;
+        }
+    }
+    return retVal;
+}
+
+// Internally used. Greedily merge the nearest color pairs of "hist" until 256 colors are left.
+// Stores remaining colors in "palette" and returns their number, or -1 on error. Histogram content is modified.
+static int mergeColors(colorhist_t *hist, uint32_t *palette) {
+    bool active[QUANT_MAX_COLORS];
+    int partner[QUANT_MAX_COLORS];
+    int64_t cost[QUANT_MAX_COLORS];
+    int numActive = hist->count;
+    for (int i = 0; i < hist->count; ++i) {
+        active[i] = true;
+        partner[i] = (i == hist->fixed) ? -1 : findPartner(hist, active, i, &cost[i]);
+    }
+
+    while (numActive > 256) {
+        int best = -1;
+        for (int i = 0; i < hist->count; ++i)
+            if (active[i] && partner[i] >= 0 && (best < 0 || cost[i] < cost[best])) best = i;
+        if (best < 0) return -1;
+
+        // replacing both colors by their weighted mean
+        int j = partner[best];
+        int wi = hist->weights[best], wj = hist->weights[j], w = wi + wj;
+        uint32_t ci = hist->colors[best], cj = hist->colors[j], color = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+            color |= (uint32_t)(((int)((ci >> shift) & 0xff) * wi + (int)((cj >> shift) & 0xff) * wj + w / 2) / w) << shift;
+        hist->colors[best] = color;
+        hist->weights[best] = w;
+        active[j] = false;
+        numActive--;
+
+        for (int k = 0; k < hist->count; ++k) {
+            if (!active[k] || k == hist->fixed) continue;
+            if (k == best || partner[k] == best || partner[k] == j) {
+                partner[k] = findPartner(hist, active, k, &cost[k]);
+            } else {
+                int64_t c = mergeCost(hist, k, best);
+                if (c < cost[k]) {
+                    cost[k] = c;
+                    partner[k] = best;
+                }
+            }
+        }
+    }
+
+    int numColors = 0;
+    for (int i = 0; i < hist->count; ++i)
+        if (active[i]) palette[numColors++] = hist->colors[i];
+    return numColors;
+}
+
+// Internally used. Map each histogram color to the nearest palette entry. The transparent color is only matched exactly.
+static void buildRemapTable(const colorhist_t *hist, const uint32_t *palette, int numColors, uint8_t *lut) {
+    uint32_t fixedColor = (hist->fixed >= 0) ? hist->colors[hist->fixed] : 0;
+    for (int i = 0; i < hist->count; ++i) {
+        int idx = 0, dist = INT_MAX;
+        for (int k = 0; k < numColors; ++k) {
+            if (hist->fixed >= 0 && (palette[k] == fixedColor) != (hist->colors[i] == fixedColor)) continue;
+            int d = colorDistance(hist->colors[i], palette[k]);
+            if (d < dist) {
+                dist = d;
+                idx = k;
+            }
+        }
+        lut[i] = (uint8_t)idx;
+    }
+}
+
+// Internally used. Tiers 1 and 2: exact palette, or greedy merge of the nearest colors. Histograms with more than
+// QUANT_MERGE_MAX_COLORS colors are left to tier 3. Returns the tier of the palette. Error bound has to be checked by
+// the caller.
+static int quantizeLowerTiers(const colorhist_t *hist, uint32_t *palette, uint8_t *lut) {
+    memset(palette, 0, 256 * sizeof(uint32_t));
+    if (hist->count <= 256) {
+        memcpy(palette, hist->colors, hist->count * sizeof(uint32_t));
+        for (int i = 0; i < hist->count; ++i)
+            lut[i] = (uint8_t)i;
+        return QUANT_TIER_EXACT;
+    }
+    if (hist->count > QUANT_MERGE_MAX_COLORS) return QUANT_TIER_NONE;
+    colorhist_t *work finally(cleanColorHist) = malloc(sizeof(colorhist_t));
+    if (!work) return QUANT_TIER_NONE;
+    memcpy(work, hist, sizeof(colorhist_t));
+    int numColors = mergeColors(work, palette);
+    if (numColors < 0) return QUANT_TIER_NONE;
+    buildRemapTable(hist, palette, numColors, lut);
+    return QUANT_TIER_MERGE;
+}
+
+// Number of quantizer backend invocations of the current thread
+static __thread int quantizerCalls = 0;
+
+// Internally used. Update statistics of the quantization tiers. "called" specifies whether the quantizer backend has
+// been invoked, which also happens for tier 2 results that are kept because tier 3 was not better.
+static void countTier(int tier, bool called) {
+    switch (tier) {
+    case QUANT_TIER_EXACT:  STATS_ADD(COUNTER_QUANT_TIER_EXACT, 1); break;
+    case QUANT_TIER_MERGE:  STATS_ADD(COUNTER_QUANT_TIER_MERGE, 1); break;
+    case QUANT_TIER_FULL:   STATS_ADD(COUNTER_QUANT_TIER_FULL, 1); break;
+    default:                STATS_ADD(COUNTER_QUANTIZER_ERRORS, 1); break;
+    }
+    if (called) {
+        STATS_ADD(COUNTER_QUANTIZER_CALLS, 1);
+        quantizerCalls++;
+    }
+}
+
+int getQuantizerCalls() {
+    return quantizerCalls;
+}
+
+int remapTileTiered(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent, double maxError) {
+    if (!srcTile || !dstTile) return QUANT_TIER_NONE;
+    STATS_BEGIN(tQuantize);
+    int tier = QUANT_TIER_NONE;
+
+    colorhist_t *hist finally(cleanColorHist) = (maxError >= 0.0) ? malloc(sizeof(colorhist_t)) : NULL;
+    uint16_t *pixels finally(cleanMem16) = hist ? malloc(4096 * sizeof(uint16_t)) : NULL;
+    bool valid = (hist && pixels);
+    if (valid) {
+        colorHistInit(hist);
+        for (int p = 0; p < 4096 && valid; ++p) {
+            uint32_t color = srcTile[p] & 0x00ffffff;
+            int idx = colorHistAdd(hist, color, 1, useTransparent && color == TRANSPARENT);
+            valid = (idx >= 0);
+            pixels[p] = (uint16_t)idx;
+        }
+    }
+    uint8_t lut[QUANT_MAX_COLORS];
+    uint64_t error = 0;
+    if (valid && (tier = quantizeLowerTiers(hist, (uint32_t*)dstTile, lut)) != QUANT_TIER_NONE) {
+        for (int p = 0; p < 4096; ++p)
+            dstTile[1024 + p] = lut[pixels[p]];
+        if (tier == QUANT_TIER_MERGE) error = tileSquaredError(srcTile, dstTile);
+    }
+    const quantizer_t *quantizer = quantizerGet(param_quantizer);
+    bool called = false;
+    if (tier == QUANT_TIER_MERGE && error > maxError * 4096.0) {
+        // tier 2 exceeding the error bound is only replaced by a more accurate tier 3 result
+        uint8_t fullTile[TILE_SIZE];
+        called = (quantizer != NULL);
+        if (quantizer && quantizer->quantizeTile(srcTile, fullTile, useTransparent) && tileSquaredError(srcTile, fullTile) < error) {
+            memcpy(dstTile, fullTile, TILE_SIZE);
+            tier = QUANT_TIER_FULL;
+        }
+    } else if (tier == QUANT_TIER_NONE && quantizer) {
+        called = true;
+        if (quantizer->quantizeTile(srcTile, dstTile, useTransparent)) tier = QUANT_TIER_FULL;
+    }
+
+    STATS_END(STAGE_QUANTIZE, tQuantize);
+    countTier(tier, called);
+    return tier;
+}
+
+
+uint64_t tileSquaredError(const uint32_t *pixels, const uint8_t *tile) {
+    if (!pixels || !tile) return UINT64_MAX;
+    const uint32_t *pal = (const uint32_t*)tile;
+    const uint8_t *indices = tile + 1024;
+    uint64_t error = 0;
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32(0x00ffffff), zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    for (int p = 0; p < 4096; p += 4) {
+        __m128i src = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pixels + p)), mask);
+        __m128i dst = _mm_and_si128(_mm_set_epi32(pal[indices[p + 3]], pal[indices[p + 2]], pal[indices[p + 1]], pal[indices[p]]), mask);
+        __m128i dLo = _mm_sub_epi16(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero));
+        __m128i dHi = _mm_sub_epi16(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero));
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(dLo, dLo), _mm_madd_epi16(dHi, dHi)));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, sum);
+    error = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+    for (int p = 0; p < 4096; ++p) {
+        uint32_t c1 = pixels[p], c2 = pal[indices[p]];
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = (int)((c1 >> shift) & 0xff) - (int)((c2 >> shift) & 0xff);
+            error += (uint64_t)(d * d);
+        }
+    }
+#endif
+    return error;
+}
+
+
+void tileErrorStats(const uint32_t *pixels, const uint8_t *tile, tileerror_t *result) {
+    if (!result) return;
+    result->squaredError = 0;
+    result->maxDistance = 0;
+    if (!pixels || !tile) return;
+    const uint32_t *pal = (const uint32_t*)tile;
+    const uint8_t *indices = tile + 1024;
+#ifdef __SSE2__
+    // weights of colorDistance() for each 16-bit BGRA component
+    const __m128i mask = _mm_set1_epi32(0x00ffffff), zero = _mm_setzero_si128();
+    const __m128i weights = _mm_set_epi16(0, 30, 59, 11, 0, 30, 59, 11);
+    __m128i sum = _mm_setzero_si128(), maxDist = _mm_setzero_si128();
+    for (int p = 0; p < 4096; p += 4) {
+        __m128i src = _mm_and_si128(_mm_loadu_si128((const __m128i*)(pixels + p)), mask);
+        __m128i dst = _mm_and_si128(_mm_set_epi32(pal[indices[p + 3]], pal[indices[p + 2]], pal[indices[p + 1]], pal[indices[p]]), mask);
+        __m128i dLo = _mm_sub_epi16(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero));
+        __m128i dHi = _mm_sub_epi16(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero));
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_madd_epi16(dLo, dLo), _mm_madd_epi16(dHi, dHi)));
+
+        // lanes 0 and 2 receive the weighted distance of a pixel, lanes 1 and 3 a partial sum of it
+        __m128i wLo = _mm_mullo_epi16(dLo, weights), wHi = _mm_mullo_epi16(dHi, weights);
+        wLo = _mm_madd_epi16(wLo, wLo);
+        wHi = _mm_madd_epi16(wHi, wHi);
+        wLo = _mm_add_epi32(wLo, _mm_srli_epi64(wLo, 32));
+        wHi = _mm_add_epi32(wHi, _mm_srli_epi64(wHi, 32));
+        __m128i gt = _mm_cmpgt_epi32(wLo, wHi);
+        __m128i dist = _mm_or_si128(_mm_and_si128(gt, wLo), _mm_andnot_si128(gt, wHi));
+        gt = _mm_cmpgt_epi32(dist, maxDist);
+        maxDist = _mm_or_si128(_mm_and_si128(gt, dist), _mm_andnot_si128(gt, maxDist));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, sum);
+    result->squaredError = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i*)lanes, maxDist);
+    for (int i = 0; i < 4; ++i)
+        if ((int)lanes[i] > result->maxDistance) result->maxDistance = (int)lanes[i];
+#else
+    for (int p = 0; p < 4096; ++p) {
+        uint32_t c1 = pixels[p], c2 = pal[indices[p]];
+        for (int shift = 0; shift < 24; shift += 8) {
+            int d = (int)((c1 >> shift) & 0xff) - (int)((c2 >> shift) & 0xff);
+            result->squaredError += (uint64_t)(d * d);
+        }
+        int dist = colorDistance(c1, c2);
+        if (dist > result->maxDistance) result->maxDistance = dist;
+    }
+#endif
+}
+
+double errorToPsnr(uint64_t squaredError, uint64_t numPixels) {
+    if (squaredError == 0 || numPixels == 0) return PSNR_LOSSLESS;
+    double psnr = 10.0 * log10(255.0 * 255.0 * 3.0 * (double)numPixels / (double)squaredError);
+    return (psnr < PSNR_LOSSLESS) ? psnr : PSNR_LOSSLESS;
+}
+
+double distanceToPixelError(int distance) {
+    // colorDistance() of a uniform difference d in all components is d*d*(30*30 + 59*59 + 11*11)
+    return (distance > 0) ? sqrt(distance / 4502.0) : 0.0;
 }
 
 
@@ -144,11 +415,77 @@ int colorDistance(uint32_t color1, uint32_t color2) {
     return dr*dr + dg*dg + db*db;
 }
 
-void cleanQuantizer(quantize_t **pquant) {
-    if (pquant && *pquant) {
-        if ((*pquant)->result) liq_result_destroy((*pquant)->result);
-        if ((*pquant)->attr) liq_attr_destroy((*pquant)->attr);
-        free(*pquant);
-        *pquant = NULL;
+bool createPaletteTile(const uint32_t *pixels, uint8_t *dstTile) {
+    if (!pixels || !dstTile) return false;
+#define OPAQUE 0xff000000
+#define HASH_SIZE 1024
+    // collecting distinct colors; transparent color is reserved at index 0
+    uint32_t keys[HASH_SIZE];
+    int16_t slots[HASH_SIZE];
+    memset(slots, 0xff, sizeof(slots));
+    uint32_t *pal = (uint32_t*)dstTile;
+    bool useTransparent = false;
+    for (int p = 0; p < 4096; ++p) {
+        if ((pixels[p] >> 24) < 128) {
+            useTransparent = true;
+            break;
+        }
+    }
+    memset(dstTile, 0, 1024);
+    int numColors = 0;
+    if (useTransparent)
+        pal[numColors++] = TRANSPARENT;
+    bool exact = true;
+    for (int p = 0; p < 4096 && exact; ++p) {
+        if ((pixels[p] >> 24) < 128) {
+            dstTile[1024 + p] = 0;
+            continue;
+        }
+        uint32_t color = pixels[p] & ~OPAQUE;
+        unsigned h = ((color * 2654435761u) >> 22) & (HASH_SIZE - 1);
+        while (slots[h] >= 0 && keys[h] != color)
+            h = (h + 1) & (HASH_SIZE - 1);
+        if (slots[h] < 0) {
+            if (numColors == 256) {
+                exact = false;
+                break;
+            }
+            keys[h] = color;
+            slots[h] = numColors;
+            pal[numColors++] = color;
+        }
+        dstTile[1024 + p] = (uint8_t)slots[h];
+    }
+    if (exact) return true;
+
+    // too many colors: quantizing tile
+    uint32_t rgba[4096];
+    for (int p = 0; p < 4096; ++p)
+        rgba[p] = ((pixels[p] >> 24) < 128) ? (TRANSPARENT | OPAQUE) : (pixels[p] | OPAQUE);
+    if (!createRemappedTile(rgba, dstTile, useTransparent)) return false;
+    if (useTransparent)
+        moveColorToFront(dstTile, TRANSPARENT);
+#undef HASH_SIZE
+#undef OPAQUE
+    return true;
+}
+
+
+void moveColorToFront(uint8_t *tile, uint32_t color) {
+    if (!tile) return;
+    int colIdx = colorIndex(tile, 256, color);
+    if (colIdx > 0) {
+        // swapping palette entry
+        uint32_t *pal = (uint32_t*)tile;
+        pal[0] ^= pal[colIdx];
+        pal[colIdx] ^= pal[0];
+        pal[0] ^= pal[colIdx];
+        // swapping color indices
+        for (int p = 1024; p < 5120; ++p) {
+            if (tile[p] == 0)
+                tile[p] = colIdx;
+            else if (tile[p] == colIdx)
+                tile[p] = 0;
+        }
     }
 }
@@ -28,8 +28,20 @@ void adjustTileColors(uint8_t *data, uint8_t search, uint8_t replace);
 /// Return palette index of matching color. -1 if not found.
 int colorIndex(const void *data, size_t palSize, uint32_t color);
 
+/// Return perceptually weighted squared distance of two colors in BGR format.
+int colorDistance(uint32_t color1, uint32_t color2);
+
+/// Quantization tiers of remapTileTiered().
+enum QUANT_TIER {
+    QUANT_TIER_NONE = 0,    // quantization failed
+    QUANT_TIER_EXACT = 1,   // tile has no more than 256 colors, palette is exact
+    QUANT_TIER_MERGE = 2,   // nearest colors merged greedily until 256 colors are left
+    QUANT_TIER_FULL = 3     // full quantization by the selected quantizer backend (see QUANTIZER)
+};
+
 /**
  * Create a new paletted tile from the specified source tile.
+ * Uses the quantization tiers of remapTileTiered() with the error bound specified by "param_tile_error".
  * \param srcTile   Source tile converted to RGBA truecolor format (0xaabbggrr).
  * \param dstTile   Storage for resulting tile with new palette.
  * \param useTransparent    Whether tile contains transparent pixel regions.
@@ -37,4 +49,84 @@ int colorIndex(const void *data, size_t palSize, uint32_t color);
  */
 bool createRemappedTile(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent);
 
+/// Max. number of distinct colors reduced by tier 2. Merging is quadratic in the number of colors, so tiles with more
+/// colors are passed to tier 3 right away.
+#define QUANT_MERGE_MAX_COLORS  512
+
+/**
+ * Create a new paletted tile from the specified source tile. Cheaper quantization tiers are tried first.
+ * A tier is escalated to the next one if the mean squared error per pixel exceeds "maxError". The result of tier 3
+ * is only used if its error is lower than the error of tier 2.
+ * \param srcTile   Source tile converted to RGBA truecolor format (0xaabbggrr).
+ * \param dstTile   Storage for resulting tile with new palette.
+ * \param useTransparent    Whether tile contains transparent pixel regions.
+ * \param maxError  Max. mean squared error per pixel of the lower tiers. Specify a negative value to use
+ *                  the quantizer backend only.
+ * \return the QUANT_TIER that produced the tile.
+ */
+int remapTileTiered(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent, double maxError);
+
+/// Max. number of distinct colors of a color histogram.
+#define QUANT_MAX_COLORS    1024
+
+/// Weighted color histogram, e.g. of a tile.
+typedef struct {
+    uint32_t colors[QUANT_MAX_COLORS];      // distinct colors in BGR format
+    int weights[QUANT_MAX_COLORS];          // number of pixels of each color
+    int count;                              // number of distinct colors
+    int fixed;                              // index of the transparent color that is kept unchanged, -1 if not available
+    int total;                              // total number of pixels
+    int16_t slots[2 * QUANT_MAX_COLORS];    // hash table of color indices
+} colorhist_t;
+
+/// Initialize an empty color histogram.
+void colorHistInit(colorhist_t *hist);
+
+/**
+ * Add pixels of the given color to the histogram.
+ * \param hist      The color histogram.
+ * \param color     Color in BGR format. Alpha is ignored.
+ * \param weight    Number of pixels.
+ * \param fixed     Whether the color is the transparent color that must be kept unchanged.
+ * \return histogram index of the color, or -1 if the histogram is full.
+ */
+int colorHistAdd(colorhist_t *hist, uint32_t color, int weight, bool fixed);
+
+/// Return number of quantizer backend invocations (tier 3) of the calling thread, including failed ones.
+int getQuantizerCalls();
+
+/// Return sum of squared color component differences between 64x64 true color pixels and the given paletted tile.
+uint64_t tileSquaredError(const uint32_t *pixels, const uint8_t *tile);
+
+/// PSNR reported for tiles without any color error.
+#define PSNR_LOSSLESS   100.0
+
+/// Color error of a paletted tile compared to true color pixels.
+typedef struct {
+    uint64_t squaredError;  // sum of squared color component differences
+    int maxDistance;        // largest colorDistance() of a single pixel
+} tileerror_t;
+
+/// Measure the color error between 64x64 true color pixels and the given paletted tile.
+void tileErrorStats(const uint32_t *pixels, const uint8_t *tile, tileerror_t *result);
+
+/// Return the peak signal-to-noise ratio in dB of a sum of squared color component differences over "numPixels"
+/// pixels. Returns PSNR_LOSSLESS if there is no error.
+double errorToPsnr(uint64_t squaredError, uint64_t numPixels);
+
+/// Return the color component difference on a 0-255 scale that is equivalent to the given colorDistance().
+double distanceToPixelError(int distance);
+
+/**
+ * Create a new paletted tile from true color pixels. Pixels with alpha below 128 are mapped to the transparent color
+ * at palette index 0. Tiles with up to 256 colors are stored without loss, otherwise the colors are quantized.
+ * \param pixels    64x64 pixels in BGRA format.
+ * \param dstTile   Storage for resulting tile with palette.
+ * \return whether operation was successful.
+ */
+bool createPaletteTile(const uint32_t *pixels, uint8_t *dstTile);
+
+/// Move the given color to palette index 0 and update pixel data accordingly. Does nothing if the color isn't found.
+void moveColorToFront(uint8_t *tile, uint32_t color);
+
 #endif // COLORS_H_INCLUDED
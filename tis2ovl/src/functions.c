@@ -2,38 +2,41 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <string.h>
+#include <signal.h>
 #include "functions.h"
 #include "global.h"
 #include "compat.h"
+#include "stats.h"
+#include "log.h"
 
+#include <sys/stat.h>
 #ifdef _WIN32
 #   include <windows.h>
+#   include <io.h>
+#   include <fcntl.h>
 #else
-#   include <sys/stat.h>
+#   include <unistd.h>
 #endif
 
+static volatile sig_atomic_t interrupted = 0;
+
+// Internally used. Signal handler for graceful shutdown requests.
+static void interruptHandler(int sig) {
+    interrupted = 1;
+#ifdef _WIN32
+    signal(sig, interruptHandler);
+#else
+    (void)sig;
+#endif
+}
+
 int printMsg(int outputType, const char *format, ...) {
-    bool show = false;
-    FILE *ch = NULL;
-    switch (outputType) {
-    case OUTPUT_LOG:
-        show = !param_quiet && param_verbose;
-        ch = stdout;
-        break;
-    case OUTPUT_ERR:
-        show = !param_quiet;
-        ch = stdout;
-        break;
-    default:
-        show = true;
-        ch = stderr;
-    }
-    if (ch && show && format) {
-        va_list args;
-        va_start(args, format);
-        return vfprintf(ch, format, args);
-    }
-    return 0;
+    if (!format) return 0;
+    va_list args;
+    va_start(args, format);
+    int retVal = logWrite(outputType, logChannel(outputType), format, args);
+    va_end(args);
+    return retVal;
 }
 
 bool sort(void *data, size_t size, size_t count, fnGT cmp) {
@@ -103,6 +106,49 @@ bool fileExists(const char *fileName) {
     return retVal;
 }
 
+int64_t fileSize(const char *fileName) {
+    if (fileName && *fileName) {
+        struct stat st;
+        if (stat(fileName, &st) == 0)
+            return (int64_t)st.st_size;
+    }
+    return -1;
+}
+
+int64_t fileModTime(const char *fileName) {
+    if (fileName && *fileName) {
+        struct stat st;
+        if (stat(fileName, &st) == 0) {
+#if defined(_WIN32)
+            return (int64_t)st.st_mtime * 1000000000LL;
+#elif defined(__APPLE__)
+            return (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+            return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+        }
+    }
+    return -1;
+}
+
+uint64_t fileHash(const char *fileName) {
+    FILE *fp finally(cleanFile) = fileName ? fopen(fileName, "rb") : NULL;
+    if (!fp) return 0;
+    uint8_t *buf finally(cleanMem8) = malloc(65536);
+    if (!buf) return 0;
+    // 64-bit FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    size_t len;
+    while ((len = fread(buf, 1, 65536, fp)) > 0) {
+        for (size_t i = 0; i < len; ++i) {
+            hash ^= buf[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    if (ferror(fp)) return 0;
+    return hash ? hash : 1;
+}
+
 bool directoryExists(const char *pathName) {
     bool retVal = false;
     if (pathName && *pathName) {
@@ -193,8 +239,12 @@ bool copyFile(const char *srcFile, const char *dstFile, bool overwrite) {
                 return false;
             }
             fsize += len;
+            STATS_ADD(COUNTER_IO_CALLS, 2);
         } while (!feof(fin));
 #undef BUF_SIZE
+        STATS_ADD(COUNTER_BYTES_READ, fsize);
+        STATS_ADD(COUNTER_BYTES_WRITTEN, fsize);
+        STATS_ADD(COUNTER_IO_CALLS, 4);
         fclose(fout);
         fclose(fin);
         return true;
@@ -202,6 +252,65 @@ bool copyFile(const char *srcFile, const char *dstFile, bool overwrite) {
     return false;
 }
 
+FILE* openStream(const char *spec, bool write) {
+    if (!spec || !*spec) return NULL;
+    FILE *fp = NULL;
+    if (strcmp(spec, "-") == 0) {
+        fp = write ? stdout : stdin;
+#ifdef _WIN32
+        _setmode(_fileno(fp), _O_BINARY);
+#endif
+    } else if (strncmp(spec, "fd:", 3) == 0) {
+        char *end = NULL;
+        long fd = strtol(spec + 3, &end, 10);
+        if (end == spec + 3 || *end || fd < 0) return NULL;
+        fp = fdopen((int)fd, write ? "wb" : "rb");
+    } else {
+        fp = fopen(spec, write ? "wb" : "rb");
+    }
+    return fp;
+}
+
+void closeStream(FILE *fp) {
+    if (!fp) return;
+    if (fp == stdin || fp == stdout)
+        fflush(fp);
+    else
+        fclose(fp);
+}
+
+void cleanStream(FILE **fp) {
+    if (fp) {
+        closeStream(*fp);
+        *fp = NULL;
+    }
+}
+
+uint8_t* readStream(FILE *fp, size_t *size) {
+    if (!fp || !size) return NULL;
+    size_t capacity = 65536, len = 0;
+    uint8_t *data = malloc(capacity);
+    while (data) {
+        len += fread(data + len, 1, capacity - len, fp);
+        STATS_ADD(COUNTER_IO_CALLS, 1);
+        if (len < capacity) break;
+        uint8_t *data2 = realloc(data, capacity * 2);
+        if (!data2) {
+            free(data);
+            return NULL;
+        }
+        data = data2;
+        capacity *= 2;
+    }
+    if (data && ferror(fp)) {
+        free(data);
+        return NULL;
+    }
+    STATS_ADD(COUNTER_BYTES_READ, len);
+    *size = len;
+    return data;
+}
+
 bool getString(void *ptr, int ofs, int len, char *str) {
     if (ptr && ofs >= 0 && len >= 0 && str) {
         memcpy(str, (int8_t*)ptr + ofs, len);
@@ -288,11 +397,56 @@ bool readLong(FILE *fp, int ofs, int32_t *value) {
     return false;
 }
 
+void printJSONString(FILE *fp, const char *str) {
+    if (!fp) return;
+    fputc('"', fp);
+    for (const unsigned char *p = (const unsigned char*)str; p && *p; ++p) {
+        if (*p == '"' || *p == '\\')
+            fprintf(fp, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(fp, "\\u%04x", *p);
+        else
+            fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+void initInterruptHandler() {
+#ifdef _WIN32
+    signal(SIGINT, interruptHandler);
+    signal(SIGTERM, interruptHandler);
+#else
+    // no SA_RESTART: blocking calls return early to check for shutdown requests
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = interruptHandler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+#endif
+}
+
+bool isInterrupted() {
+    return interrupted != 0;
+}
+
 bool evalOp(bool condition, const char *fmt, ...) {
     if (!condition && fmt) {
         va_list args;
         va_start(args, fmt);
-        vfprintf(stderr, fmt, args);
+        logWrite(OUTPUT_ERR, LOG_CHANNEL_STDERR, fmt, args);
+        va_end(args);
     }
     return condition;
 }
+
+int cpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long cores = (long)info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (cores > 0) ? (int)cores : 1;
+}
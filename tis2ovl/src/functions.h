@@ -38,6 +38,15 @@ char* upperString(char *str);
 /// Return whether fileName refers to an existing file.
 bool fileExists(const char *fileName);
 
+/// Return size of the specified file in bytes, or -1 on error.
+int64_t fileSize(const char *fileName);
+
+/// Return modification time of the specified file in nanoseconds, or -1 on error.
+int64_t fileModTime(const char *fileName);
+
+/// Return 64-bit hash of the specified file content. Never returns 0 for existing files. Returns 0 if the file could not be read.
+uint64_t fileHash(const char *fileName);
+
 /// Return whether pathName refers to an existing path.
 bool directoryExists(const char *pathName);
 
@@ -55,6 +64,29 @@ char* normalizeDir(char *str);
 /// Copy source file to destination. Existing destination will be overwritten if "overwrite" is true. Otherwise function will return false.
 bool copyFile(const char *srcFile, const char *dstFile, bool overwrite);
 
+/**
+ * Open a stream by specification: "-" refers to standard input (or standard output if "write" is true), "fd:N" to the
+ * already open file descriptor N, everything else to a file path.
+ * \param spec     Stream specification.
+ * \param write    Whether the stream is opened for writing instead of reading.
+ * \return opened stream, or NULL on error. Close it with closeStream().
+ */
+FILE* openStream(const char *spec, bool write);
+
+/// Close a stream opened by openStream(). Standard input and output are only flushed.
+void closeStream(FILE *fp);
+
+/// Cleanup function for stream variables opened by openStream(), to be used with "finally".
+void cleanStream(FILE **fp);
+
+/**
+ * Read a stream until end of file.
+ * \param fp       Stream to read from. It doesn't need to be seekable.
+ * \param size     Storage for the number of bytes read.
+ * \return allocated buffer with the stream content, or NULL on error. Must be released with free().
+ */
+uint8_t* readStream(FILE *fp, size_t *size);
+
 /// Extract string of given length to str.
 bool getString(void *ptr, int ofs, int len, char *str);
 
@@ -79,6 +111,18 @@ bool readShort(FILE *fp, int ofs, int16_t *value);
 /// Read long value from file and store it in value.
 bool readLong(FILE *fp, int ofs, int32_t *value);
 
+/// Write string as quoted and escaped JSON string literal to the given file.
+void printJSONString(FILE *fp, const char *str);
+
+/// Install handlers for SIGINT and SIGTERM that request a graceful shutdown instead of terminating the process.
+void initInterruptHandler();
+
+/// Return whether a graceful shutdown has been requested by SIGINT or SIGTERM.
+bool isInterrupted();
+
+/// Return number of available CPU cores. Returns at least 1.
+int cpuCount();
+
 /// Helper function: Print message if condition fails. Return specified condition.
 bool evalOp(bool condition, const char *fmt, ...);
 
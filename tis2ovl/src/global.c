@@ -1,5 +1,17 @@
 #include "global.h"
+#include "quantizer.h"
 
 bool param_quiet = false;
 bool param_verbose = false;
-int param_mode = MODE_NONE;
+bool param_stats = false;
+bool param_analyze = false;
+bool param_watch = false;
+bool param_pvrz = false;
+int param_dxt_quality = DXT_NORMAL;
+double param_tile_error = -1.0;
+int param_quantizer = QUANTIZER_LIQ;
+bool param_fidelity = false;
+double param_min_psnr = 0.0;
+int param_io = IO_BUFFERED;
+bool param_stream = false;
+__thread int param_mode = MODE_NONE;
@@ -6,13 +6,52 @@
 /// Available tile conversion modes.
 enum MODE { MODE_NONE = 0, MODE_TO_EE = 1, MODE_FROM_EE = 2, MODE_AUTO = 3};
 
+/// Available I/O backends for reading tiles of palette-based TIS files.
+enum IO_BACKEND { IO_BUFFERED = 0, IO_MMAP = 1 };
+
+/// Available quality levels of the DXT encoder.
+enum DXT_QUALITY { DXT_FAST = 0, DXT_NORMAL = 1, DXT_BEST = 2 };
+
 /// Indicates whether log messages are printed.
 extern bool param_quiet;
 
 /// Indicates whether verbose log messages are printed.
 extern bool param_verbose;
 
-/// Specified conversion mode.
-extern int param_mode;
+/// Indicates whether runtime statistics are collected and printed.
+extern bool param_stats;
+
+/// Indicates whether tilesets are only analyzed instead of converted.
+extern bool param_analyze;
+
+/// Indicates whether input files are watched for changes after the initial conversion.
+extern bool param_watch;
+
+/// Indicates whether converted tilesets are written as PVRZ-based tilesets.
+extern bool param_pvrz;
+
+/// Quality level of the DXT encoder for PVRZ output (see DXT_QUALITY).
+extern int param_dxt_quality;
+
+/// Max. mean squared color error per pixel accepted from the fast quantization tiers. Negative values disable them.
+extern double param_tile_error;
+
+/// Quantizer backend of the full quantization tier (see QUANTIZER).
+extern int param_quantizer;
+
+/// Indicates whether the color error of converted tiles is measured.
+extern bool param_fidelity;
+
+/// Min. PSNR in dB of every converted tile pair. Conversion fails if a tile pair falls below it. 0 disables the check.
+extern double param_min_psnr;
+
+/// I/O backend for reading tiles during conversion (see IO_BACKEND).
+extern int param_io;
+
+/// Indicates whether standard output is reserved for converted tileset data. Messages are printed to standard error instead.
+extern bool param_stream;
+
+/// Specified conversion mode. Thread-local, so that server workers can process requests with different modes.
+extern __thread int param_mode;
 
 #endif // GLOBAL_H_INCLUDED
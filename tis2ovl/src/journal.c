@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "compat.h"
+#include "functions.h"
+#include "tis2ovl.h"
+#include "journal.h"
+
+// Identifies journal files
+#define JOURNAL_HEADER  "TIS2OVL-JOURNAL 1"
+
+// Recorded hashes of a single tile pair
+typedef struct {
+    uint64_t out;           // hash of the converted tile pair, 0 if not recorded
+    uint64_t in;            // hash of the tile pair before conversion, 0 if unknown
+} journalpair_t;
+
+// Recorded state of a single tileset
+typedef struct {
+    uint64_t wedHash;       // hash of the WED file content
+    char *wedFile;          // WED file path
+    char *tisFile;          // path of the converted TIS file
+    bool done;              // whether conversion has been completed
+    uint64_t tisHash;       // hash of the completed TIS file
+    journalpair_t *pairs;   // hashes of each converted tile pair by index
+    size_t numPairs;        // number of entries in "pairs"
+    size_t numDone;         // number of converted tile pairs
+} journaljob_t;
+
+static FILE *journalFile = NULL;
+static journaljob_t *jobs = NULL;   // job identifier is the index in this list
+static size_t numJobs = 0, capJobs = 0;
+static pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Internally used. Update 64-bit FNV-1a hash with the given data.
+static uint64_t hashData(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Internally used. Return hash of the given tile pair. Never returns 0.
+static uint64_t hashPair(const uint8_t *pixels_pri, const uint8_t *pixels_sec) {
+    uint64_t hash = hashData(14695981039346656037ULL, pixels_pri, TILE_SIZE);
+    hash = hashData(hash, pixels_sec, TILE_SIZE);
+    return hash ? hash : 1;
+}
+
+// Internally used. Add new job entry. Returns job identifier, or -1 on error.
+static int addJob(uint64_t wedHash, const char *wedFile, const char *tisFile) {
+    if (numJobs == capJobs) {
+        size_t cap = capJobs ? capJobs * 2 : 16;
+        journaljob_t *list = realloc(jobs, cap * sizeof(journaljob_t));
+        if (!list) return -1;
+        jobs = list;
+        capJobs = cap;
+    }
+    journaljob_t *job = &jobs[numJobs];
+    memset(job, 0, sizeof(journaljob_t));
+    job->wedHash = wedHash;
+    job->wedFile = strdup(wedFile);
+    job->tisFile = strdup(tisFile);
+    if (!job->wedFile || !job->tisFile) {
+        free(job->wedFile);
+        free(job->tisFile);
+        return -1;
+    }
+    return (int)numJobs++;
+}
+
+// Internally used. Store hashes of converted tile pair.
+static bool setPair(journaljob_t *job, size_t index, uint64_t hashOut, uint64_t hashIn) {
+    if (index >= job->numPairs) {
+        size_t num = job->numPairs ? job->numPairs : 64;
+        while (num <= index) num *= 2;
+        journalpair_t *pairs = realloc(job->pairs, num * sizeof(journalpair_t));
+        if (!pairs) return false;
+        memset(pairs + job->numPairs, 0, (num - job->numPairs) * sizeof(journalpair_t));
+        job->pairs = pairs;
+        job->numPairs = num;
+    }
+    if (!job->pairs[index].out) job->numDone++;
+    job->pairs[index].out = hashOut;
+    job->pairs[index].in = hashIn;
+    return true;
+}
+
+// Internally used. Discard converted tile pairs.
+static void clearPairs(journaljob_t *job) {
+    if (job->pairs)
+        memset(job->pairs, 0, job->numPairs * sizeof(journalpair_t));
+    job->numDone = 0;
+    job->done = false;
+}
+
+// Internally used. Load records of an existing journal. Incomplete records are ignored.
+static bool loadJournal(FILE *fp) {
+    char line[2 * FILENAME_MAX + 64];
+    if (!fgets(line, sizeof(line), fp)) return true;    // empty journal
+    if (strncmp(line, JOURNAL_HEADER, strlen(JOURNAL_HEADER)) != 0) return false;
+    while (fgets(line, sizeof(line), fp)) {
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n') break;   // truncated by an interrupted write
+        line[len - 1] = 0;
+        int id = -1, index = -1;
+        uint64_t hash = 0, hashIn = 0;
+        char *p = NULL;
+        switch (line[0]) {
+        case 'B':
+            if (sscanf(line, "B\t%d\t%" SCNx64, &id, &hash) == 2 && id == (int)numJobs &&
+                (p = strchr(line + 2, '\t')) && (p = strchr(p + 1, '\t'))) {
+                char *tis = strchr(p + 1, '\t');
+                if (!tis) break;
+                *tis++ = 0;
+                addJob(hash, p + 1, tis);
+            }
+            break;
+        case 'P':
+            // hash of the input tile pair is missing in records of older journals
+            if (sscanf(line, "P\t%d\t%d\t%" SCNx64 "\t%" SCNx64, &id, &index, &hash, &hashIn) >= 3 && id >= 0 && id < (int)numJobs &&
+                index >= 0 && hash)
+                setPair(&jobs[id], index, hash, hashIn);
+            break;
+        case 'R':
+            if (sscanf(line, "R\t%d", &id) == 1 && id >= 0 && id < (int)numJobs)
+                clearPairs(&jobs[id]);
+            break;
+        case 'D':
+            if (sscanf(line, "D\t%d\t%" SCNx64, &id, &hash) == 2 && id >= 0 && id < (int)numJobs) {
+                jobs[id].done = true;
+                jobs[id].tisHash = hash;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+bool journalOpen(const char *fileName, bool resume) {
+    if (!fileName || journalFile) return false;
+    if (resume && fileExists(fileName)) {
+        FILE *fp finally(cleanFile) = fopen(fileName, "r");
+        if (!evalOp(fp != NULL, "Error: Could not open journal file: %s\n", fileName)) return false;
+        if (!evalOp(loadJournal(fp), "Error: Not a valid journal file: %s\n", fileName)) {
+            journalClose();
+            return false;
+        }
+        journalFile = fopen(fileName, "a");
+        // terminate record that was truncated by an interrupted write
+        if (journalFile && fseek(fp, -1, SEEK_END) == 0 && fgetc(fp) != '\n')
+            fputc('\n', journalFile);
+    } else {
+        journalFile = fopen(fileName, "w");
+        if (journalFile) fprintf(journalFile, "%s\n", JOURNAL_HEADER);
+    }
+    if (!evalOp(journalFile != NULL, "Error: Could not create journal file: %s\n", fileName)) {
+        journalClose();
+        return false;
+    }
+    fflush(journalFile);
+    return true;
+}
+
+bool journalIsOpen() {
+    return journalFile != NULL;
+}
+
+void journalClose() {
+    pthread_mutex_lock(&journalLock);
+    if (journalFile) {
+        fclose(journalFile);
+        journalFile = NULL;
+    }
+    for (size_t i = 0; i < numJobs; ++i) {
+        free(jobs[i].wedFile);
+        free(jobs[i].tisFile);
+        free(jobs[i].pairs);
+    }
+    free(jobs);
+    jobs = NULL;
+    numJobs = capJobs = 0;
+    pthread_mutex_unlock(&journalLock);
+}
+
+int journalBegin(const char *wedFile, const char *tisFile) {
+    if (!journalFile || !wedFile || !tisFile) return -1;
+    uint64_t wedHash = fileHash(wedFile);
+    pthread_mutex_lock(&journalLock);
+    int retVal = -1;
+    for (size_t i = numJobs; i > 0; --i) {
+        const journaljob_t *job = &jobs[i - 1];
+        if (strcmp(job->wedFile, wedFile) == 0 && strcmp(job->tisFile, tisFile) == 0) {
+            if (job->wedHash == wedHash) retVal = (int)i - 1;
+            break;
+        }
+    }
+    if (retVal < 0 && (retVal = addJob(wedHash, wedFile, tisFile)) >= 0) {
+        fprintf(journalFile, "B\t%d\t%016" PRIx64 "\t%s\t%s\n", retVal, wedHash, wedFile, tisFile);
+        fflush(journalFile);
+    }
+    pthread_mutex_unlock(&journalLock);
+    return retVal;
+}
+
+bool journalIsDone(int job) {
+    pthread_mutex_lock(&journalLock);
+    bool retVal = (journalFile && job >= 0 && job < (int)numJobs && jobs[job].done &&
+                   fileHash(jobs[job].tisFile) == jobs[job].tisHash);
+    pthread_mutex_unlock(&journalLock);
+    return retVal;
+}
+
+bool journalIsPartial(int job) {
+    pthread_mutex_lock(&journalLock);
+    bool retVal = (journalFile && job >= 0 && job < (int)numJobs && jobs[job].numDone > 0);
+    pthread_mutex_unlock(&journalLock);
+    return retVal;
+}
+
+void journalReset(int job) {
+    pthread_mutex_lock(&journalLock);
+    if (journalFile && job >= 0 && job < (int)numJobs && (jobs[job].numDone || jobs[job].done)) {
+        clearPairs(&jobs[job]);
+        fprintf(journalFile, "R\t%d\n", job);
+        fflush(journalFile);
+    }
+    pthread_mutex_unlock(&journalLock);
+}
+
+int journalCheckPair(int job, int index, const uint8_t *pixels_pri, const uint8_t *pixels_sec) {
+    int retVal = JOURNAL_PAIR_NONE;
+    pthread_mutex_lock(&journalLock);
+    if (journalFile && job >= 0 && job < (int)numJobs && index >= 0 && (size_t)index < jobs[job].numPairs && jobs[job].pairs[index].out) {
+        // tile pairs recorded right before they were written may still be unchanged
+        const journalpair_t *pair = &jobs[job].pairs[index];
+        uint64_t hash = hashPair(pixels_pri, pixels_sec);
+        retVal = (hash == pair->out) ? JOURNAL_PAIR_DONE : (hash == pair->in) ? JOURNAL_PAIR_NONE : JOURNAL_PAIR_MODIFIED;
+    }
+    pthread_mutex_unlock(&journalLock);
+    return retVal;
+}
+
+void journalPair(int job, int index, const uint8_t *pixels_pri_in, const uint8_t *pixels_sec_in, const uint8_t *pixels_pri_out,
+                 const uint8_t *pixels_sec_out) {
+    if (job < 0 || index < 0) return;
+    uint64_t hashOut = hashPair(pixels_pri_out, pixels_sec_out);
+    uint64_t hashIn = hashPair(pixels_pri_in, pixels_sec_in);
+    pthread_mutex_lock(&journalLock);
+    if (journalFile && job < (int)numJobs && setPair(&jobs[job], index, hashOut, hashIn)) {
+        fprintf(journalFile, "P\t%d\t%d\t%016" PRIx64 "\t%016" PRIx64 "\n", job, index, hashOut, hashIn);
+        fflush(journalFile);
+    }
+    pthread_mutex_unlock(&journalLock);
+}
+
+void journalDone(int job) {
+    pthread_mutex_lock(&journalLock);
+    if (journalFile && job >= 0 && job < (int)numJobs) {
+        jobs[job].done = true;
+        jobs[job].tisHash = fileHash(jobs[job].tisFile);
+        fprintf(journalFile, "D\t%d\t%016" PRIx64 "\n", job, jobs[job].tisHash);
+        fflush(journalFile);
+    }
+    pthread_mutex_unlock(&journalLock);
+}
@@ -0,0 +1,56 @@
+#ifndef JOURNAL_H_INCLUDED
+#define JOURNAL_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// States of a tile pair returned by journalCheckPair().
+enum JOURNAL_PAIR { JOURNAL_PAIR_NONE = 0, JOURNAL_PAIR_DONE = 1, JOURNAL_PAIR_MODIFIED = 2 };
+
+/**
+ * Open journal file for recording conversion progress.
+ *
+ * The journal is a text file with one record per line. It records each started tileset, every converted tile pair
+ * together with a hash of the input and output tiles, and each completed tileset together with a hash of the resulting
+ * TIS file.
+ * Records are flushed immediately.
+ * \param fileName  Path of the journal file.
+ * \param resume    Specify true to load the records of an existing journal and continue it. Otherwise a new journal
+ *                  is created.
+ * \return Success state.
+ */
+bool journalOpen(const char *fileName, bool resume);
+
+/// Return whether a journal is currently being written.
+bool journalIsOpen();
+
+/// Close the journal file and release all loaded records.
+void journalClose();
+
+/// Start or continue journaling conversion of the given tileset. Returns job identifier, or -1 if no journal is open.
+/// Progress of a previous run is only continued if the WED file is unchanged.
+int journalBegin(const char *wedFile, const char *tisFile);
+
+/// Return whether the tileset has been completed by a previous run and the TIS file is unchanged since then.
+bool journalIsDone(int job);
+
+/// Return whether tile pairs have been recorded for the tileset by a previous run.
+bool journalIsPartial(int job);
+
+/// Discard recorded progress of the tileset, e.g. if the TIS file has been recreated.
+void journalReset(int job);
+
+/// Check whether the given tile pair has been converted by a previous run. Returns one of the JOURNAL_PAIR constants.
+/// JOURNAL_PAIR_NONE is also returned if the recorded tile pair has not been written yet. JOURNAL_PAIR_MODIFIED
+/// indicates that tile data differs from both the recorded input and output.
+int journalCheckPair(int job, int index, const uint8_t *pixels_pri, const uint8_t *pixels_sec);
+
+/// Record converted tile pair together with the tile pair it was converted from. Must be called before the converted
+/// tile data is written to the TIS file, so that an interruption at any point leaves a recognizable state.
+void journalPair(int job, int index, const uint8_t *pixels_pri_in, const uint8_t *pixels_sec_in, const uint8_t *pixels_pri_out,
+                 const uint8_t *pixels_sec_out);
+
+/// Record completion of the tileset. All tile data must have been written to the TIS file before.
+void journalDone(int job);
+
+#endif // JOURNAL_H_INCLUDED
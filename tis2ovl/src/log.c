@@ -0,0 +1,264 @@
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "compat.h"
+#include "functions.h"
+#include "global.h"
+#include "log.h"
+
+// Size of the message buffer of a single thread in bytes.
+#define LOG_BUFFER_SIZE 65536
+// Max. length of a single message. Longer messages are truncated.
+#define LOG_MAX_MESSAGE 4096
+// Interval of the background writer in milliseconds for messages that don't request immediate output.
+#define LOG_INTERVAL 50
+
+// Message buffer of a single thread. Each record consists of level, channel and the null-terminated message.
+typedef struct logbuffer_t {
+    struct logbuffer_t *next;
+    pthread_mutex_t lock;
+    size_t size;
+    char data[LOG_BUFFER_SIZE];
+} logbuffer_t;
+
+// Names of the rate-limited message categories
+static const char *categoryNames[LOG_CATEGORY_COUNT] = { "tile conversion mode" };
+
+// Lock order: outputLock before any buffer lock
+static pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;   // serializes writing to console and log file
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;   // protects buffer list and writer state
+static pthread_cond_t writerWakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t writerDone = PTHREAD_COND_INITIALIZER;
+static logbuffer_t *bufferList = NULL;
+static pthread_t writerThread;
+static volatile bool running = false;
+static bool stopping = false, pending = false;
+static uint64_t passes = 0;     // number of completed writer passes
+static char writerData[LOG_BUFFER_SIZE];
+
+static FILE *logFile = NULL;
+static int logFileLevel = OUTPUT_LOG;
+
+static __thread logbuffer_t *localBuffer = NULL;
+static __thread int limitPrinted[LOG_CATEGORY_COUNT];
+static __thread int limitSuppressed[LOG_CATEGORY_COUNT];
+
+// Internally used. Write all records of "data". Must be called with outputLock held.
+static void writeRecords(const char *data, size_t size) {
+    for (size_t pos = 0; pos < size; ) {
+        int level = data[pos], channel = data[pos + 1];
+        const char *msg = data + pos + 2;
+        size_t len = strlen(msg);
+        if (channel != LOG_CHANNEL_NONE)
+            fwrite(msg, 1, len, (channel == LOG_CHANNEL_STDERR) ? stderr : stdout);
+        if (logFile && level >= logFileLevel)
+            fwrite(msg, 1, len, logFile);
+        pos += len + 3;
+    }
+}
+
+// Internally used. Write a single message directly. Used if the background writer isn't running.
+static void writeDirect(int level, int channel, const char *msg, size_t len) {
+    pthread_mutex_lock(&outputLock);
+    if (channel != LOG_CHANNEL_NONE)
+        fwrite(msg, 1, len, (channel == LOG_CHANNEL_STDERR) ? stderr : stdout);
+    if (logFile && level >= logFileLevel)
+        fwrite(msg, 1, len, logFile);
+    pthread_mutex_unlock(&outputLock);
+}
+
+// Internally used. Write and clear all messages of the given buffer.
+static void drainBuffer(logbuffer_t *buffer) {
+    pthread_mutex_lock(&outputLock);
+    pthread_mutex_lock(&buffer->lock);
+    size_t size = buffer->size;
+    memcpy(writerData, buffer->data, size);
+    buffer->size = 0;
+    pthread_mutex_unlock(&buffer->lock);
+    writeRecords(writerData, size);
+    pthread_mutex_unlock(&outputLock);
+}
+
+// Internally used. Return message buffer of the calling thread, register it on first use.
+static logbuffer_t* getLocalBuffer() {
+    if (!localBuffer) {
+        logbuffer_t *buffer = calloc(1, sizeof(logbuffer_t));
+        if (!buffer) return NULL;
+        pthread_mutex_init(&buffer->lock, NULL);
+        pthread_mutex_lock(&writerLock);
+        buffer->next = bufferList;
+        bufferList = buffer;
+        pthread_mutex_unlock(&writerLock);
+        localBuffer = buffer;
+    }
+    return localBuffer;
+}
+
+// Internally used. Background writer: drains the buffers of all threads periodically or when requested.
+static void* logWriter(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&writerLock);
+    while (true) {
+        if (!pending && !stopping) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += LOG_INTERVAL * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&writerWakeup, &writerLock, &ts);
+        }
+        bool stop = stopping;
+        pending = false;
+        // buffers are only added at the front of the list and never removed while the writer is running
+        logbuffer_t *list = bufferList;
+        pthread_mutex_unlock(&writerLock);
+
+        for (logbuffer_t *buffer = list; buffer; buffer = buffer->next)
+            drainBuffer(buffer);
+        pthread_mutex_lock(&outputLock);
+        fflush(stdout);
+        fflush(stderr);
+        if (logFile) fflush(logFile);
+        pthread_mutex_unlock(&outputLock);
+
+        pthread_mutex_lock(&writerLock);
+        passes++;
+        pthread_cond_broadcast(&writerDone);
+        if (stop) break;
+    }
+    pthread_mutex_unlock(&writerLock);
+    return NULL;
+}
+
+
+bool logStart() {
+    if (running) return true;
+    stopping = pending = false;
+    if (!evalOp(pthread_create(&writerThread, NULL, logWriter, NULL) == 0, "Error: Could not start log writer.\n")) return false;
+    running = true;
+    return true;
+}
+
+void logStop() {
+    if (running) {
+        pthread_mutex_lock(&writerLock);
+        stopping = true;
+        pthread_cond_signal(&writerWakeup);
+        pthread_mutex_unlock(&writerLock);
+        pthread_join(writerThread, NULL);
+        running = false;
+
+        // messages added during the last pass of the writer
+        for (logbuffer_t *buffer = bufferList; buffer; buffer = buffer->next)
+            drainBuffer(buffer);
+        while (bufferList) {
+            logbuffer_t *buffer = bufferList;
+            bufferList = buffer->next;
+            pthread_mutex_destroy(&buffer->lock);
+            free(buffer);
+        }
+        localBuffer = NULL;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    if (logFile) {
+        fclose(logFile);
+        logFile = NULL;
+    }
+}
+
+bool logOpenFile(const char *fileName, int level) {
+    if (!fileName || logFile) return false;
+    logFile = fopen(fileName, "w");
+    if (!evalOp(logFile != NULL, "Error: Could not create log file: %s\n", fileName)) return false;
+    logFileLevel = level;
+    return true;
+}
+
+int logChannel(int level) {
+    // standard output may carry tileset data
+    int console = param_stream ? LOG_CHANNEL_STDERR : LOG_CHANNEL_STDOUT;
+    switch (level) {
+    case OUTPUT_LOG:
+        return (!param_quiet && param_verbose) ? console : LOG_CHANNEL_NONE;
+    case OUTPUT_ERR:
+        return !param_quiet ? console : LOG_CHANNEL_NONE;
+    default:
+        return LOG_CHANNEL_STDERR;
+    }
+}
+
+int logWrite(int level, int channel, const char *format, va_list args) {
+    if (!format || (channel == LOG_CHANNEL_NONE && !(logFile && level >= logFileLevel))) return 0;
+    char msg[LOG_MAX_MESSAGE];
+    int retVal = vsnprintf(msg, sizeof(msg), format, args);
+    if (retVal <= 0) return retVal;
+    size_t len = ((size_t)retVal < sizeof(msg)) ? (size_t)retVal : sizeof(msg) - 1;
+
+    logbuffer_t *buffer = running ? getLocalBuffer() : NULL;
+    if (!buffer) {
+        writeDirect(level, channel, msg, len);
+        return retVal;
+    }
+
+    pthread_mutex_lock(&buffer->lock);
+    if (buffer->size + len + 3 > LOG_BUFFER_SIZE) {
+        // buffer is full: the calling thread writes its pending messages itself
+        pthread_mutex_unlock(&buffer->lock);
+        drainBuffer(buffer);
+        pthread_mutex_lock(&buffer->lock);
+    }
+    char *rec = buffer->data + buffer->size;
+    rec[0] = (char)level;
+    rec[1] = (char)channel;
+    memcpy(rec + 2, msg, len);
+    rec[len + 2] = 0;
+    buffer->size += len + 3;
+    pthread_mutex_unlock(&buffer->lock);
+
+    // verbose messages are collected until the next regular pass of the writer
+    if (level > OUTPUT_LOG) {
+        pthread_mutex_lock(&writerLock);
+        pending = true;
+        pthread_cond_signal(&writerWakeup);
+        pthread_mutex_unlock(&writerLock);
+    }
+    return retVal;
+}
+
+void logFlush() {
+    if (!running || !localBuffer) return;
+    pthread_mutex_lock(&writerLock);
+    // a pass in progress may have missed the latest messages
+    uint64_t target = passes + 2;
+    pending = true;
+    pthread_cond_signal(&writerWakeup);
+    while (passes < target && !stopping)
+        pthread_cond_wait(&writerDone, &writerLock);
+    pthread_mutex_unlock(&writerLock);
+}
+
+void printMsgLimited(int category, const char *format, ...) {
+    if (category < 0 || category >= LOG_CATEGORY_COUNT || !format) return;
+    int channel = logChannel(OUTPUT_LOG);
+    if (channel == LOG_CHANNEL_NONE && !(logFile && logFileLevel <= OUTPUT_LOG)) return;
+    if (limitPrinted[category] >= LOG_LIMIT) {
+        limitSuppressed[category]++;
+        return;
+    }
+    limitPrinted[category]++;
+    va_list args;
+    va_start(args, format);
+    logWrite(OUTPUT_LOG, channel, format, args);
+    va_end(args);
+}
+
+void logSummarize() {
+    for (int i = 0; i < LOG_CATEGORY_COUNT; ++i) {
+        if (limitSuppressed[i] > 0)
+            printMsg(OUTPUT_LOG, "(%d more %s messages suppressed)\n", limitSuppressed[i], categoryNames[i]);
+        limitPrinted[i] = limitSuppressed[i] = 0;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef LOG_H_INCLUDED
+#define LOG_H_INCLUDED
+
+#include <stdarg.h>
+#include <stdbool.h>
+
+/// Max. number of rate-limited messages of the same category printed by a thread between calls of logSummarize().
+#define LOG_LIMIT 16
+
+/// Categories of rate-limited messages (see printMsgLimited()).
+enum LOG_CATEGORY {
+    LOG_TILE_MODE,      // conversion mode of single tile pairs
+    LOG_CATEGORY_COUNT
+};
+
+/// Console channels of log messages.
+enum LOG_CHANNEL { LOG_CHANNEL_NONE = 0, LOG_CHANNEL_STDOUT = 1, LOG_CHANNEL_STDERR = 2 };
+
+/**
+ * Start the background writer. From now on messages are collected in per-thread buffers and written by the background
+ * writer instead of the calling thread. Messages of a single thread keep their order. Returns success state.
+ */
+bool logStart();
+
+/// Write all pending messages, stop the background writer and close the log file.
+void logStop();
+
+/**
+ * Write log messages to the given file in addition to the console.
+ * \param fileName  Path of the log file. An existing file is replaced.
+ * \param level     Min. OUTPUT_TYPE of messages written to the file, regardless of -q and -x.
+ * \return success state.
+ */
+bool logOpenFile(const char *fileName, int level);
+
+/// Return the console channel of messages of the given OUTPUT_TYPE (see LOG_CHANNEL), depending on -q and -x.
+int logChannel(int level);
+
+/**
+ * Add a message to the log.
+ * \param level     OUTPUT_TYPE of the message.
+ * \param channel   Console channel of the message (see LOG_CHANNEL). LOG_CHANNEL_NONE writes to the log file only.
+ * \param format    Formatted string with variable arguments.
+ * \param args      Variable arguments of "format".
+ * \return number of characters of the formatted message.
+ */
+int logWrite(int level, int channel, const char *format, va_list args);
+
+/// Hand buffered messages of the calling thread over to the background writer and wait until they are written.
+void logFlush();
+
+/// Print a verbose message of the given LOG_CATEGORY. Only the first LOG_LIMIT messages of each category are printed
+/// by a thread, further messages are counted and reported by logSummarize().
+void printMsgLimited(int category, const char *format, ...);
+
+/// Print the number of rate-limited messages suppressed by the calling thread and reset the limits.
+void logSummarize();
+
+#endif // LOG_H_INCLUDED
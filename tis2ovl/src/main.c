@@ -4,11 +4,106 @@
 #include <locale.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <getopt.h>
 #include "global.h"
 #include "version.h"
 #include "functions.h"
 #include "arrays.h"
 #include "tis2ovl.h"
+#include "stats.h"
+#include "trace.h"
+#include "report.h"
+#include "watch.h"
+#include "server.h"
+#include "shard.h"
+#include "journal.h"
+#include "catalog.h"
+#include "log.h"
+#include "quantizer.h"
+#include "budget.h"
+#include "pack.h"
+#include "calibrate.h"
+
+// Identifiers of options without short form
+enum LONG_OPTION { OPT_STATS = 256, OPT_TRACE, OPT_REPORT, OPT_ANALYZE, OPT_WATCH, OPT_SERVE, OPT_CONNECT, OPT_WORKERS, OPT_SHARD, OPT_SHARD_BALANCE, OPT_JOURNAL, OPT_RESUME, OPT_PVRZ, OPT_DXT_QUALITY, OPT_MAX_TILE_ERROR,
+                   OPT_BUILD_CATALOG, OPT_CATALOG, OPT_FIDELITY, OPT_MIN_PSNR, OPT_LOG,
+                   OPT_LOG_LEVEL, OPT_QUANTIZER, OPT_MAX_MEMORY, OPT_STREAM, OPT_BIFF, OPT_KEY,
+                   OPT_IO, OPT_CALIBRATE, OPT_CONFIG };
+
+static const struct option longOptions[] = {
+    { "stats", no_argument, NULL, OPT_STATS },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "report", required_argument, NULL, OPT_REPORT },
+    { "analyze", no_argument, NULL, OPT_ANALYZE },
+    { "watch", no_argument, NULL, OPT_WATCH },
+    { "stream", no_argument, NULL, OPT_STREAM },
+    { "biff", required_argument, NULL, OPT_BIFF },
+    { "key", required_argument, NULL, OPT_KEY },
+    { "serve", required_argument, NULL, OPT_SERVE },
+    { "connect", required_argument, NULL, OPT_CONNECT },
+    { "workers", required_argument, NULL, OPT_WORKERS },
+    { "max-memory", required_argument, NULL, OPT_MAX_MEMORY },
+    { "io", required_argument, NULL, OPT_IO },
+    { "calibrate", no_argument, NULL, OPT_CALIBRATE },
+    { "config", required_argument, NULL, OPT_CONFIG },
+    { "shard", required_argument, NULL, OPT_SHARD },
+    { "shard-balance", no_argument, NULL, OPT_SHARD_BALANCE },
+    { "journal", required_argument, NULL, OPT_JOURNAL },
+    { "resume", no_argument, NULL, OPT_RESUME },
+    { "pvrz", no_argument, NULL, OPT_PVRZ },
+    { "dxt-quality", required_argument, NULL, OPT_DXT_QUALITY },
+    { "max-tile-error", required_argument, NULL, OPT_MAX_TILE_ERROR },
+    { "quantizer", required_argument, NULL, OPT_QUANTIZER },
+    { "build-catalog", required_argument, NULL, OPT_BUILD_CATALOG },
+    { "catalog", required_argument, NULL, OPT_CATALOG },
+    { "fidelity", no_argument, NULL, OPT_FIDELITY },
+    { "min-psnr", required_argument, NULL, OPT_MIN_PSNR },
+    { "log", required_argument, NULL, OPT_LOG },
+    { "log-level", required_argument, NULL, OPT_LOG_LEVEL },
+    { NULL, 0, NULL, 0 }
+};
+
+// Number of analyzed tilesets by detected conversion direction
+typedef struct {
+    int toEE, fromEE, mixed, none, ambiguous;
+} analysis_t;
+
+// Connection to the conversion server if jobs are forwarded (client mode)
+static int serverConn = -1;
+
+// Internally used. Prints peak memory usage if a memory budget is set.
+static void printMemoryUsage() {
+    if (!budgetGetLimit()) return;
+    printMsg(OUTPUT_MSG, "Peak memory: %.1f MB (budget: %.1f MB, max. reserved: %.1f MB)\n", statsPeakMemory() / (1024.0 * 1024.0),
+             budgetGetLimit() / (1024.0 * 1024.0), budgetPeak() / (1024.0 * 1024.0));
+}
+
+// Internally used. Converts or analyzes the specified WED file. Returns whether the job finished successfully.
+static bool processJob(const char *wedFile, array_t *searchList, const char *outputDir, analysis_t *analysis, jobinfo_t *info) {
+    int num = 0;
+    if (serverConn >= 0) {
+        printMsg(OUTPUT_MSG, "Forwarding WED file \"%s\" to server...\n", wedFile);
+        num = clientConvert(serverConn, wedFile, searchList, outputDir, info);
+    } else if (param_analyze) {
+        num = analyze(wedFile, searchList, info);
+    } else {
+        num = convert(wedFile, searchList, outputDir, info);
+    }
+    reportAddJob(wedFile, info);
+    if (num >= 0 && param_analyze) {
+        if (info->tilesToEE && info->tilesFromEE) analysis->mixed++;
+        else if (info->tilesToEE) analysis->toEE++;
+        else if (info->tilesFromEE) analysis->fromEE++;
+        else analysis->none++;
+        if (info->ambiguous) analysis->ambiguous++;
+        printMsg(OUTPUT_MSG, "\n");
+    } else if (num >= 0) {
+        printMsg(OUTPUT_MSG, "Tileset converted successfully. %d tiles updated.\n\n", num);
+    } else {
+        printMsg(OUTPUT_MSG, "\n");
+    }
+    return num >= 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -21,7 +116,13 @@ int main(int argc, char *argv[])
     }
 
     int errors = 0;
-    char *outputDir = NULL;
+    char *outputDir = NULL, *traceFile = NULL, *reportFile = NULL, *serveSocket = NULL, *connectSocket = NULL, *journalFile = NULL,
+         *buildCatalogFile = NULL, *catalogFile = NULL, *logFile = NULL,
+         *biffFile = NULL, *keyFile = NULL, *configFile = NULL;
+    bool resume = false, shardBalance = false, calibrateMode = false, ioSet = false, quantizerSet = false;
+    bool dxtQualitySet = false, tileErrorSet = false;
+    int logLevel = OUTPUT_LOG;
+    int workers = 0, shardIndex = 0, shardCount = 0;
     array_t wedList, searchList;
     arrayInit(&searchList, 0);
     arrayInit(&wedList, 0);
@@ -29,7 +130,7 @@ int main(int argc, char *argv[])
     // parsing cmd options
     opterr = 0; // no automatic error messages
     int c;
-    while ((c = getopt(argc, argv, "ceqxhvs:o:")) != -1) {
+    while ((c = getopt_long(argc, argv, "ceqxhvs:o:", longOptions, NULL)) != -1) {
         switch (c) {
         case 'c':
             param_mode |= MODE_TO_EE;
@@ -66,8 +167,168 @@ int main(int argc, char *argv[])
                 return EXIT_FAILURE;
             }
             break;
+        case OPT_STATS:
+#ifdef TIS2OVL_STATS
+            param_stats = true;
+#else
+            printMsg(OUTPUT_ERR, "Warning: Statistics are not available in this build. Ignoring option --stats.\n");
+#endif
+            break;
+        case OPT_TRACE:
+#ifdef TIS2OVL_STATS
+            traceFile = optarg;
+#else
+            printMsg(OUTPUT_ERR, "Warning: Tracing is not available in this build. Ignoring option --trace.\n");
+#endif
+            break;
+        case OPT_REPORT:
+            reportFile = optarg;
+            break;
+        case OPT_ANALYZE:
+            param_analyze = true;
+            break;
+        case OPT_WATCH:
+            param_watch = true;
+            break;
+        case OPT_SERVE:
+            serveSocket = optarg;
+            break;
+        case OPT_CONNECT:
+            connectSocket = optarg;
+            break;
+        case OPT_WORKERS:
+            workers = atoi(optarg);
+            if (workers <= 0) {
+                printMsg(OUTPUT_ERR, "Error: Invalid number of workers: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_JOURNAL:
+            journalFile = optarg;
+            break;
+        case OPT_RESUME:
+            resume = true;
+            break;
+        case OPT_PVRZ:
+            param_pvrz = true;
+            break;
+        case OPT_DXT_QUALITY:
+            if (strcmp(optarg, "fast") == 0) {
+                param_dxt_quality = DXT_FAST;
+            } else if (strcmp(optarg, "normal") == 0) {
+                param_dxt_quality = DXT_NORMAL;
+            } else if (strcmp(optarg, "best") == 0) {
+                param_dxt_quality = DXT_BEST;
+            } else {
+                printMsg(OUTPUT_ERR, "Error: Invalid DXT quality level: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            dxtQualitySet = true;
+            break;
+        case OPT_MAX_TILE_ERROR:
+        {
+            char *end = NULL;
+            param_tile_error = strtod(optarg, &end);
+            if (end == optarg || *end) {
+                printMsg(OUTPUT_ERR, "Error: Invalid tile error bound: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            tileErrorSet = true;
+            break;
+        }
+        case OPT_QUANTIZER:
+            if ((param_quantizer = quantizerFind(optarg)) < 0) {
+                printMsg(OUTPUT_ERR, "Error: Invalid quantizer: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            quantizerSet = true;
+            break;
+        case OPT_IO:
+            if (strcmp(optarg, "buffered") == 0) {
+                param_io = IO_BUFFERED;
+            } else if (strcmp(optarg, "mmap") == 0) {
+                param_io = IO_MMAP;
+            } else {
+                printMsg(OUTPUT_ERR, "Error: Invalid I/O backend: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            ioSet = true;
+            break;
+        case OPT_CALIBRATE:
+            calibrateMode = true;
+            break;
+        case OPT_CONFIG:
+            configFile = optarg;
+            break;
+        case OPT_FIDELITY:
+            param_fidelity = true;
+            break;
+        case OPT_MIN_PSNR:
+        {
+            char *end = NULL;
+            param_min_psnr = strtod(optarg, &end);
+            if (end == optarg || *end || param_min_psnr <= 0.0) {
+                printMsg(OUTPUT_ERR, "Error: Invalid PSNR bound: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            param_fidelity = true;
+            break;
+        }
+        case OPT_LOG:
+            logFile = optarg;
+            break;
+        case OPT_LOG_LEVEL:
+            if (strcmp(optarg, "verbose") == 0) {
+                logLevel = OUTPUT_LOG;
+            } else if (strcmp(optarg, "info") == 0) {
+                logLevel = OUTPUT_MSG;
+            } else if (strcmp(optarg, "error") == 0) {
+                logLevel = OUTPUT_ERR;
+            } else {
+                printMsg(OUTPUT_ERR, "Error: Invalid log level: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_BUILD_CATALOG:
+            buildCatalogFile = optarg;
+            break;
+        case OPT_CATALOG:
+            catalogFile = optarg;
+            break;
+        case OPT_STREAM:
+            param_stream = true;
+            break;
+        case OPT_BIFF:
+            biffFile = optarg;
+            break;
+        case OPT_KEY:
+            keyFile = optarg;
+            break;
+        case OPT_MAX_MEMORY:
+        {
+            uint64_t bytes = 0;
+            if (!budgetParse(optarg, &bytes)) {
+                printMsg(OUTPUT_ERR, "Error: Invalid memory budget: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            budgetInit(bytes);
+            break;
+        }
+        case OPT_SHARD:
+            if (!shardParse(optarg, &shardIndex, &shardCount)) {
+                printMsg(OUTPUT_ERR, "Error: Invalid shard specification: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SHARD_BALANCE:
+            shardBalance = true;
+            break;
         case '?':
-            if (optopt == 's' || optopt == 'o') {
+            if (optopt == 0) {
+                printMsg(OUTPUT_ERR, "Error: Unknown option: %s\n", argv[optind - 1]);
+            } else if (optopt >= OPT_STATS) {
+                printMsg(OUTPUT_ERR, "Error: Option %s requires an argument.\n", argv[optind - 1]);
+            } else if (optopt == 's' || optopt == 'o') {
                 printMsg(OUTPUT_ERR, "Error: Option -%c requires an argument.\n", optopt);
             } else if (isprint(optopt)) {
                 printMsg(OUTPUT_ERR, "Error: Unknown option: -%c\n", optopt);
@@ -81,27 +342,168 @@ int main(int argc, char *argv[])
         arrayAddItem(&searchList, ".");
     if (param_mode == MODE_NONE)
         param_mode = MODE_AUTO;
+    statsEnable(param_stats);
+    // messages are written by a background thread from now on
+    if (logFile && !logOpenFile(logFile, logLevel))
+        return EXIT_FAILURE;
+    if (!logStart())
+        return EXIT_FAILURE;
+    atexit(logStop);
+    if (traceFile && !traceStart(traceFile)) {
+        printMsg(OUTPUT_ERR, "Error: Could not start tracing: %s\n", traceFile);
+        return EXIT_FAILURE;
+    }
     if (outputDir && !*outputDir)
         outputDir = ".";
 
+    if (reportFile && !reportOpen(reportFile))
+        return EXIT_FAILURE;
+    if (resume && !journalFile) {
+        printMsg(OUTPUT_ERR, "Error: Option --resume requires a journal file (--journal).\n");
+        return EXIT_FAILURE;
+    }
+    if (shardBalance && shardCount == 0) {
+        printMsg(OUTPUT_ERR, "Error: Option --shard-balance requires a shard specification (--shard).\n");
+        return EXIT_FAILURE;
+    }
+    // settings of the configuration file apply unless specified on the command line
+    if (!configFile && fileExists(CONFIG_FILE))
+        configFile = CONFIG_FILE;
+    if (configFile && !calibrateMode) {
+        config_t config;
+        if (!configLoad(configFile, &config))
+            return EXIT_FAILURE;
+        if (workers == 0 && config.workers > 0)
+            workers = config.workers;
+        if (!ioSet && config.io >= 0)
+            param_io = config.io;
+        if (!quantizerSet && config.quantizer >= 0)
+            param_quantizer = config.quantizer;
+    }
+    // conversion settings of forwarded jobs are defined by the server
+    if (connectSocket && (param_pvrz || dxtQualitySet || tileErrorSet || quantizerSet || param_fidelity || ioSet || journalFile || param_watch ||
+                          catalogFile)) {
+        printMsg(OUTPUT_ERR, "Error: Option --connect can't be combined with --pvrz, --dxt-quality, --max-tile-error, --quantizer, --fidelity, "
+                             "--min-psnr, --io, --journal, --watch or --catalog. Specify conversion options when starting the server.\n");
+        return EXIT_FAILURE;
+    }
+    if (calibrateMode && (param_stream || serveSocket || connectSocket)) {
+        printMsg(OUTPUT_ERR, "Error: Option --calibrate can't be combined with --stream, --serve or --connect.\n");
+        return EXIT_FAILURE;
+    }
+    if (param_pvrz && param_mode == MODE_FROM_EE) {
+        printMsg(OUTPUT_ERR, "Error: Option --pvrz can't be combined with -e. Classic games only support palette-based tilesets.\n");
+        return EXIT_FAILURE;
+    }
+    if (keyFile && !biffFile) {
+        printMsg(OUTPUT_ERR, "Error: Option --key requires a BIFF file (--biff).\n");
+        return EXIT_FAILURE;
+    }
+    if (biffFile && (outputDir || param_analyze || param_watch || param_pvrz || param_stream || serveSocket || connectSocket || journalFile)) {
+        printMsg(OUTPUT_ERR, "Error: Option --biff can't be combined with -o, --analyze, --watch, --pvrz, --stream, --serve, --connect or --journal.\n");
+        return EXIT_FAILURE;
+    }
+    if (param_watch && !param_analyze && !biffFile && !param_stream) {
+        // tilesets converted in place would be converted again by their own changes
+        bool inPlace = (outputDir == NULL);
+        for (size_t i = 0; outputDir && i < arrayGetSize(&searchList); ++i)
+            inPlace |= (strcmp(outputDir, arrayGetItem(&searchList, i)) == 0);
+        if (inPlace) {
+            printMsg(OUTPUT_ERR, "Error: Option --watch requires an output directory (-o) that is not a TIS search path.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (journalFile && !journalOpen(journalFile, resume))
+        return EXIT_FAILURE;
+    if (catalogFile && !buildCatalogFile && !catalogOpen(catalogFile))
+        return EXIT_FAILURE;
+    initInterruptHandler();
+
+    if (param_stream) {
+        // standard output carries the converted tileset
+        if (outputDir || param_analyze || param_watch || param_pvrz || serveSocket || connectSocket || journalFile || buildCatalogFile) {
+            printMsg(OUTPUT_ERR, "Error: Option --stream can't be combined with -o, --analyze, --watch, --pvrz, --serve, --connect, --journal or --build-catalog.\n");
+            return EXIT_FAILURE;
+        }
+        if (optind >= argc || argc - optind > 2) {
+            printMsg(OUTPUT_ERR, "Error: Option --stream requires a WED source and an optional TIS source.\n");
+            return EXIT_FAILURE;
+        }
+        const char *wedSource = argv[optind], *tisSource = (optind + 1 < argc) ? argv[optind + 1] : "-";
+        if (strcmp(wedSource, "-") == 0 && strcmp(tisSource, "-") == 0) {
+            printMsg(OUTPUT_ERR, "Error: WED and TIS can't both be read from standard input.\n");
+            return EXIT_FAILURE;
+        }
+        jobinfo_t info;
+        int num = convertStream(wedSource, tisSource, "-", &info);
+        reportAddJob(wedSource, &info);
+        if (num >= 0)
+            printMsg(OUTPUT_MSG, "Tileset converted successfully. %d tiles updated.\n", num);
+        statsPrint();
+        printMemoryUsage();
+        bool success = traceStop() && num >= 0;
+        success = reportClose() && success;
+        catalogClose();
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (serveSocket) {
+        // requests are processed until interrupted
+        if (optind < argc)
+            printMsg(OUTPUT_ERR, "Warning: Input WED files are ignored in server mode.\n");
+        bool success = serverRun(serveSocket, workers);
+        statsPrint();
+        printMemoryUsage();
+        success = traceStop() && success;
+        success = reportClose() && success;
+        journalClose();
+        catalogClose();
+        return success ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // fetching remaining arguments
     for (int i = optind; i < argc; ++i) {
         if (fileExists(argv[i])) {
                 arrayAddItem(&wedList, argv[i]);
         } else {
             printMsg(OUTPUT_ERR, "Error: WED file does not exist: %s. Skipping.\n", argv[i]);
+            reportAddJob(argv[i], NULL);
             errors++;
         }
     }
 
+    if (buildCatalogFile) {
+        // catalog covers all input files, regardless of shard
+        int failed = catalogBuild(buildCatalogFile, &wedList, &searchList);
+        if (failed > 0)
+            printMsg(OUTPUT_MSG, "Could not catalog %d WED file(s).\n", failed);
+        journalClose();
+        return (failed == 0 && errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (calibrateMode) {
+        // sample covers all input files, regardless of shard
+        bool success = calibrate(&wedList, &searchList, configFile ? configFile : CONFIG_FILE);
+        journalClose();
+        catalogClose();
+        return (success && errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    size_t numInput = arrayGetSize(&wedList);
+    if (shardCount > 0 && shardFilter(&wedList, shardIndex, shardCount, shardBalance) < 0)
+        return EXIT_FAILURE;
+
     printMsg(OUTPUT_MSG, "Using configuration:\n");
+    if (param_analyze)
+        printMsg(OUTPUT_MSG, "  Analyze only: no files will be modified\n");
     switch (param_mode) {
     case MODE_AUTO:
         printMsg(OUTPUT_MSG, "  Conversion mode: Autodetect\n");
         break;
     case MODE_TO_EE:
         printMsg(OUTPUT_MSG, "  Conversion mode: to EE\n");
-        break;    case MODE_FROM_EE:
+        break;
+    case MODE_FROM_EE:
         printMsg(OUTPUT_MSG, "  Conversion mode: from EE\n");
         break;
     }
@@ -115,20 +517,106 @@ int main(int argc, char *argv[])
     } else {
         printMsg(OUTPUT_MSG, "  TIS search path: current directory\n");
     }
-    printMsg(OUTPUT_MSG, "  Output directory: %s\n", outputDir ?  outputDir : "(Update input files)");
-    printMsg(OUTPUT_MSG, "  Found %d input WED file(s)\n", arrayGetSize(&wedList));
+    if (biffFile) {
+        printMsg(OUTPUT_MSG, "  Output BIFF file: %s\n", biffFile);
+        if (keyFile)
+            printMsg(OUTPUT_MSG, "  KEY file: %s\n", keyFile);
+    } else if (!param_analyze) {
+        printMsg(OUTPUT_MSG, "  Output directory: %s\n", outputDir ?  outputDir : "(Update input files)");
+    }
+    if (param_pvrz && !param_analyze)
+        printMsg(OUTPUT_MSG, "  Output format: PVRZ-based tilesets (DXT quality: %s)\n",
+                 (param_dxt_quality == DXT_FAST) ? "fast" : (param_dxt_quality == DXT_BEST) ? "best" : "normal");
+    if (param_quantizer != QUANTIZER_LIQ && !param_analyze)
+        printMsg(OUTPUT_MSG, "  Quantizer: %s\n", quantizerGet(param_quantizer)->name);
+    if (param_fidelity && !param_analyze) {
+        if (param_min_psnr > 0.0)
+            printMsg(OUTPUT_MSG, "  Fidelity measurement: enabled (min. PSNR: %.2f dB)\n", param_min_psnr);
+        else
+            printMsg(OUTPUT_MSG, "  Fidelity measurement: enabled\n");
+    }
+    if (param_io != IO_BUFFERED && !param_analyze)
+        printMsg(OUTPUT_MSG, "  I/O backend: mmap\n");
+    if (budgetGetLimit() && !param_analyze)
+        printMsg(OUTPUT_MSG, "  Memory budget: %.1f MB\n", budgetGetLimit() / (1024.0 * 1024.0));
+    if (connectSocket)
+        printMsg(OUTPUT_MSG, "  Conversion server: %s\n", connectSocket);
+    if (catalogFile)
+        printMsg(OUTPUT_MSG, "  Catalog: %s\n", catalogFile);
+    if (configFile)
+        printMsg(OUTPUT_MSG, "  Configuration file: %s\n", configFile);
+    printMsg(OUTPUT_MSG, "  Found %d input WED file(s)\n", numInput);
+    if (shardCount > 0)
+        printMsg(OUTPUT_MSG, "  Shard %d of %d: %d WED file(s)\n", shardIndex, shardCount, arrayGetSize(&wedList));
     printMsg(OUTPUT_MSG, "\n");
 
+    if (connectSocket && (serverConn = clientConnect(connectSocket)) < 0)
+        return EXIT_FAILURE;
+
+    // watching must start before the initial conversion to catch changes made in the meantime
+    watch_t watch;
+    if (param_watch && !watchInit(&watch, &wedList, &searchList))
+        return EXIT_FAILURE;
+
     // performing conversion
-    for (size_t idx = 0; idx < arrayGetSize(&wedList); ++idx) {
-        int num = 0;
-        num = convert((char*)arrayGetItem(&wedList, idx), &searchList, outputDir);
-        if (num >= 0) {
-            printMsg(OUTPUT_MSG, "Tileset converted successfully. %d tiles updated.\n\n", num);
-        } else {
+    analysis_t analysis = {0};
+    if (biffFile) {
+        int failed = packTilesets(&wedList, &searchList, biffFile, keyFile, workers);
+        errors += (failed < 0) ? 1 : failed;
+    }
+    for (size_t idx = 0; idx < arrayGetSize(&wedList) && !biffFile && !isInterrupted(); ++idx) {
+        jobinfo_t info;
+        const char *wedFile = arrayGetItem(&wedList, idx);
+        if (!processJob(wedFile, &searchList, outputDir, &analysis, &info))
             errors++;
-            putchar('\n');
+        if (param_watch)
+            watchUpdate(&watch, wedFile, &info);
+    }
+
+    if (param_watch) {
+        // reconverting tilesets on changes until interrupted
+        array_t changed;
+        arrayInit(&changed, 0);
+        printMsg(OUTPUT_MSG, "Watching for changes. Press Ctrl+C to stop.\n\n");
+        int count;
+        while ((count = watchWait(&watch, &changed)) > 0) {
+            printMsg(OUTPUT_MSG, "Detected changes in %d tileset(s).\n", count);
+            for (size_t idx = 0; idx < arrayGetSize(&changed) && !isInterrupted(); ++idx) {
+                jobinfo_t info;
+                const char *wedFile = arrayGetItem(&changed, idx);
+                if (!processJob(wedFile, &searchList, outputDir, &analysis, &info))
+                    errors++;
+                watchUpdate(&watch, wedFile, &info);
+            }
         }
+        if (count < 0)
+            errors++;
+        arrayFree(&changed);
+        watchFree(&watch);
+    }
+
+    if (isInterrupted()) {
+        printMsg(OUTPUT_MSG, "Interrupted.%s\n", journalIsOpen() ? " Call again with --resume to continue." : "");
+        errors++;
+    }
+    clientDisconnect(serverConn);
+    journalClose();
+    catalogClose();
+    statsPrint();
+    if (!param_analyze)
+        printMemoryUsage();
+    if (!traceStop())
+        errors++;
+    if (!reportClose())
+        errors++;
+
+    if (param_analyze) {
+        printMsg(OUTPUT_MSG, "Analysis summary:\n");
+        printMsg(OUTPUT_MSG, "  Tilesets to convert to EE: %d\n", analysis.toEE);
+        printMsg(OUTPUT_MSG, "  Tilesets to convert from EE: %d\n", analysis.fromEE);
+        printMsg(OUTPUT_MSG, "  Tilesets with mixed overlay types: %d (ambiguous: %d)\n", analysis.mixed, analysis.ambiguous);
+        printMsg(OUTPUT_MSG, "  Tilesets without overlays: %d\n", analysis.none);
+        printMsg(OUTPUT_MSG, "  Errors: %d\n", errors);
     }
 
     if (errors) {
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include "compat.h"
+#include "functions.h"
+#include "global.h"
+#include "tis2ovl.h"
+#include "report.h"
+#include "biff.h"
+#include "budget.h"
+#include "pack.h"
+
+// Max. number of converted tilesets per worker that are waiting to be written
+#define PACK_PENDING_JOBS   2
+
+// Conversion result of a single tileset
+typedef struct {
+    uint8_t *data;          // converted tile data, NULL if not available
+    int tileCount;
+    uint64_t reserved;      // memory budget reserved for the converted tile data
+    int result;             // result of convertTileData()
+    bool done;              // whether conversion has finished
+    char tisName[16];
+    jobinfo_t info;
+} packjob_t;
+
+// Shared state of worker threads and the BIFF writer
+typedef struct {
+    array_t *wedList;
+    array_t *searchPath;
+    packjob_t *jobs;
+    int numJobs;
+    int next;               // next job to convert
+    int written;            // number of jobs processed by the writer
+    int window;             // max. number of jobs ahead of the writer
+    int mode;               // conversion mode of the calling thread
+    int active;             // number of running worker threads
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} packer_t;
+
+// Internally used. Worker thread: converts tilesets in list order, as long as the writer keeps up.
+static void* packWorker(void *arg) {
+    packer_t *packer = arg;
+    param_mode = packer->mode;
+    pthread_mutex_lock(&packer->lock);
+    while (!packer->stop && packer->next < packer->numJobs && !isInterrupted()) {
+        if (packer->next >= packer->written + packer->window) {
+            pthread_cond_wait(&packer->cond, &packer->lock);
+            continue;
+        }
+        int idx = packer->next++;
+        pthread_mutex_unlock(&packer->lock);
+
+        // tile data is held until written in list order, so the budget is reserved in the same order
+        packjob_t *job = &packer->jobs[idx];
+        budgetBeginOrder(idx);
+        job->result = convertTileData(arrayGetItem(packer->wedList, idx), packer->searchPath, job->tisName, &job->data,
+                                      &job->tileCount, &job->reserved, &job->info);
+        budgetEndOrder();
+
+        pthread_mutex_lock(&packer->lock);
+        job->done = true;
+        pthread_cond_broadcast(&packer->cond);
+    }
+    // jobs left unclaimed after an interruption must not block the writer
+    packer->active--;
+    pthread_cond_broadcast(&packer->cond);
+    pthread_mutex_unlock(&packer->lock);
+    return NULL;
+}
+
+// Internally used. Store path of the BIFF file with the given zero-based index in "fileName".
+static void getBiffName(const char *biffFile, int index, char *fileName) {
+    if (index == 0) {
+        snprintf(fileName, FILENAME_MAX, "%s", biffFile);
+        return;
+    }
+    // suffix is inserted before the file extension
+    const char *ext = strrchr(biffFile, '.');
+    const char *sep = strrchr(biffFile, '/');
+    if (!ext || (sep && ext < sep) || ext == biffFile || ext[-1] == '/')
+        ext = biffFile + strlen(biffFile);
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), PACK_BIFF_SUFFIX, index + 1);
+    snprintf(fileName, FILENAME_MAX, "%.*s%s%s", (int)(ext - biffFile), biffFile, suffix, ext);
+}
+
+// Internally used. Return whether a tileset of the given name has already been added to one of the BIFF files.
+static bool isPacked(const biffwriter_t *biffs, int numBiffs, const char *resref) {
+    for (int i = 0; i < numBiffs; ++i) {
+        for (int j = 0; j < biffs[i].numTilesets; ++j) {
+            if (strcasecmp(biffs[i].resrefs[j], resref) == 0) return true;
+        }
+    }
+    return false;
+}
+
+// Internally used. Write a converted tileset to the current BIFF file, a new BIFF file is started if needed.
+// Returns success state.
+static bool writeTileset(biffwriter_t *biffs, int *numBiffs, const char *biffFile, const char *resref, const packjob_t *job) {
+    if (*numBiffs == 0 || biffIsFull(&biffs[*numBiffs - 1])) {
+        if (*numBiffs > 0 && !biffClose(&biffs[*numBiffs - 1], true)) return false;
+        char fileName[FILENAME_MAX];
+        getBiffName(biffFile, *numBiffs, fileName);
+        if (!biffOpen(&biffs[*numBiffs], fileName)) return false;
+        (*numBiffs)++;
+    }
+    return biffAddTileset(&biffs[*numBiffs - 1], resref, job->data, job->tileCount, TILE_SIZE);
+}
+
+int packTilesets(array_t *wedList, array_t *searchPath, const char *biffFile, const char *keyFile, int workers) {
+    if (!wedList || !searchPath || !biffFile) return -1;
+    if (workers <= 0)
+        workers = cpuCount();
+    packer_t packer;
+    memset(&packer, 0, sizeof(packer));
+    packer.wedList = wedList;
+    packer.searchPath = searchPath;
+    packer.numJobs = (int)arrayGetSize(wedList);
+    packer.window = workers * PACK_PENDING_JOBS;
+    packer.mode = param_mode;
+    packer.jobs = calloc(packer.numJobs + 1, sizeof(packjob_t));
+    biffwriter_t *biffs = calloc(packer.numJobs / BIFF_MAX_TILESETS + 1, sizeof(biffwriter_t));
+    if (!evalOp(packer.jobs && biffs, "Error: Not enough memory to pack tilesets.\n")) {
+        free(packer.jobs);
+        free(biffs);
+        return -1;
+    }
+    pthread_mutex_init(&packer.lock, NULL);
+    pthread_cond_init(&packer.cond, NULL);
+
+    if (workers > packer.numJobs)
+        workers = packer.numJobs;
+    pthread_t *threads = calloc(workers + 1, sizeof(pthread_t));
+    int numThreads = 0;
+    packer.active = workers;
+    while (threads && numThreads < workers && pthread_create(&threads[numThreads], NULL, packWorker, &packer) == 0)
+        numThreads++;
+    pthread_mutex_lock(&packer.lock);
+    packer.active -= workers - numThreads;
+    pthread_mutex_unlock(&packer.lock);
+    bool success = evalOp(numThreads > 0 || packer.numJobs == 0, "Error: Could not start worker threads.\n");
+
+    // tilesets are written in list order, regardless of the order of completion
+    int failed = 0, numBiffs = 0;
+    for (int idx = 0; success && idx < packer.numJobs && !isInterrupted(); ++idx) {
+        packjob_t *job = &packer.jobs[idx];
+        pthread_mutex_lock(&packer.lock);
+        while (!job->done && packer.active > 0)
+            pthread_cond_wait(&packer.cond, &packer.lock);
+        bool done = job->done;
+        pthread_mutex_unlock(&packer.lock);
+        if (!done) break;
+
+        const char *wedFile = arrayGetItem(wedList, idx);
+        if (job->result >= 0) {
+            char resref[16];
+            strcpy(resref, job->tisName);
+            char *ext = strrchr(resref, '.');
+            if (ext) *ext = 0;
+            if (isPacked(biffs, numBiffs, resref)) {
+                printMsg(OUTPUT_ERR, "Warning: Tileset %s has already been added. Skipping WED file: %s\n\n", resref, wedFile);
+            } else if (writeTileset(biffs, &numBiffs, biffFile, resref, job)) {
+                strcpy(job->info.tisFile, biffs[numBiffs - 1].fileName);
+                printMsg(OUTPUT_MSG, "Tileset converted successfully. %d tiles updated.\n\n", job->result);
+            } else {
+                success = false;
+            }
+        } else {
+            failed++;
+            printMsg(OUTPUT_MSG, "\n");
+        }
+        reportAddJob(wedFile, &job->info);
+        free(job->data);
+        job->data = NULL;
+        cleanBudget(&job->reserved);
+
+        pthread_mutex_lock(&packer.lock);
+        packer.written++;
+        pthread_cond_broadcast(&packer.cond);
+        pthread_mutex_unlock(&packer.lock);
+    }
+
+    pthread_mutex_lock(&packer.lock);
+    packer.stop = true;
+    pthread_cond_broadcast(&packer.cond);
+    pthread_mutex_unlock(&packer.lock);
+    for (int i = 0; i < numThreads; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    for (int idx = 0; idx < packer.numJobs; ++idx) {
+        free(packer.jobs[idx].data);
+        cleanBudget(&packer.jobs[idx].reserved);
+    }
+    free(packer.jobs);
+    pthread_cond_destroy(&packer.cond);
+    pthread_mutex_destroy(&packer.lock);
+
+    // incomplete BIFF files are removed
+    success = success && !isInterrupted();
+    if (numBiffs > 0)
+        success = biffClose(&biffs[numBiffs - 1], success) && success;
+    for (int i = 0; success && i < numBiffs; ++i)
+        printMsg(OUTPUT_MSG, "BIFF file \"%s\" written: %d tileset(s).\n", biffs[i].fileName, biffs[i].numTilesets);
+    if (success && keyFile && numBiffs > 0)
+        success = keyAddBiffs(keyFile, biffs, numBiffs);
+    if (!success) {
+        for (int i = 0; i < numBiffs; ++i)
+            remove(biffs[i].fileName);
+    }
+    free(biffs);
+    return (success || isInterrupted()) ? failed : -1;
+}
@@ -0,0 +1,23 @@
+#ifndef PACK_H_INCLUDED
+#define PACK_H_INCLUDED
+
+#include "arrays.h"
+
+/// File name suffix of additional BIFF files if more tilesets are packed than a single BIFF file can hold.
+#define PACK_BIFF_SUFFIX    "_%d"
+
+/**
+ * Convert the tilesets of all WED files and write them into new BIFF files without modifying any input files.
+ * Tilesets are converted in memory and written sequentially in the order of "wedList", a single write per tileset.
+ * A new BIFF file is started whenever the current one is full (see BIFF_MAX_TILESETS).
+ * \param wedList       WED files to process.
+ * \param searchPath    TIS search paths.
+ * \param biffFile      Path of the first BIFF file. Additional BIFF files are named by appending PACK_BIFF_SUFFIX to
+ *                      the base name.
+ * \param keyFile       KEY file to update with the new BIFF files. Specify NULL to skip.
+ * \param workers       Max. number of concurrently converted tilesets. Specify 0 to use the number of CPU cores.
+ * \return Number of failed tilesets. Returns -1 if the BIFF or KEY files could not be written.
+ */
+int packTilesets(array_t *wedList, array_t *searchPath, const char *biffFile, const char *keyFile, int workers);
+
+#endif // PACK_H_INCLUDED
@@ -0,0 +1,162 @@
+#include <string.h>
+#include <limits.h>
+#include "tis2ovl.h"
+#include "colors.h"
+#include "stats.h"
+#include "budget.h"
+#include "palcache.h"
+
+// Internally used. Return hash of the primary and secondary palette. Never returns 0.
+// Entry 0 is never referenced by EE tiles and therefore ignored.
+static uint64_t hashPalettes(const uint8_t *pixels_pri, const uint8_t *pixels_sec) {
+    const uint32_t *pal_pri = (const uint32_t*)pixels_pri;
+    const uint32_t *pal_sec = (const uint32_t*)pixels_sec;
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 1; i < 256; ++i) {
+        hash ^= pal_pri[i];
+        hash *= 1099511628211ULL;
+    }
+    for (int i = 1; i < 256; ++i) {
+        hash ^= pal_sec[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+// Internally used. Return sum of squared color component differences of two colors.
+static inline uint64_t squaredError(uint32_t color1, uint32_t color2) {
+    uint64_t error = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        int d = (int)((color1 >> shift) & 0xff) - (int)((color2 >> shift) & 0xff);
+        error += (uint64_t)(d * d);
+    }
+    return error;
+}
+
+// Internally used. Return index of the nearest opaque palette entry.
+static int nearestColor(const uint32_t *palette, uint32_t color) {
+    int retVal = 0, dist = INT_MAX;
+    for (int i = 0; i < 256; ++i) {
+        if (palette[i] == TRANSPARENT) continue;
+        int d = colorDistance(color, palette[i]);
+        if (d < dist) {
+            dist = d;
+            retVal = i;
+        }
+    }
+    return retVal;
+}
+
+// Internally used. Return cache entry of the given palette pair, or NULL if not available. Palettes are compared in full,
+// so that hash collisions are never mistaken for hits.
+static palcacheentry_t* findEntry(palcache_t *cache, uint64_t hash, const uint8_t *pixels_pri, const uint8_t *pixels_sec) {
+    for (int i = 0; i < cache->capacity; ++i) {
+        palcacheentry_t *entry = &cache->entries[i];
+        if (entry->hash == hash && memcmp(entry->inputPri + 1, pixels_pri + 4, 255 * sizeof(uint32_t)) == 0 &&
+            memcmp(entry->inputSec + 1, pixels_sec + 4, 255 * sizeof(uint32_t)) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+
+void palCacheInit(palcache_t *cache) {
+    if (!cache) return;
+    memset(cache, 0, sizeof(palcache_t));
+    cache->capacity = budgetScale(PALCACHE_SIZE, sizeof(palcacheentry_t));
+}
+
+bool palCacheRemap(palcache_t *cache, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_out, double maxError) {
+    if (!cache || !pixels_pri || !pixels_sec || !pixels_out) return false;
+    palcacheentry_t *entry = findEntry(cache, hashPalettes(pixels_pri, pixels_sec), pixels_pri, pixels_sec);
+    if (!entry) {
+        cache->misses++;
+        STATS_ADD(COUNTER_PALCACHE_MISSES, 1);
+        return false;
+    }
+
+    // counting pixels of each input color
+    int countPri[256] = { 0 }, countSec[256] = { 0 }, countTransparent = 0;
+    for (int p = 1024; p < TILE_SIZE; ++p) {
+        if (pixels_pri[p])
+            countPri[pixels_pri[p]]++;
+        else if (pixels_sec[p])
+            countSec[pixels_sec[p]]++;
+        else
+            countTransparent++;
+    }
+
+    // resolving input colors not used by previous tile pairs
+    const uint32_t *pal_pri = (const uint32_t*)pixels_pri;
+    const uint32_t *pal_sec = (const uint32_t*)pixels_sec;
+    bool valid = (countTransparent == 0 || entry->transparent >= 0);
+    uint64_t error = 0;
+    for (int i = 1; i < 256 && valid; ++i) {
+        if (countPri[i]) {
+            if (entry->lutPri[i] < 0) entry->lutPri[i] = nearestColor(entry->palette, pal_pri[i] & 0x00ffffff);
+            error += countPri[i] * squaredError(pal_pri[i], entry->palette[entry->lutPri[i]]);
+        }
+        if (countSec[i]) {
+            if (entry->lutSec[i] < 0) entry->lutSec[i] = nearestColor(entry->palette, pal_sec[i] & 0x00ffffff);
+            error += countSec[i] * squaredError(pal_sec[i], entry->palette[entry->lutSec[i]]);
+        }
+    }
+    if (!valid || (error > maxError * 4096.0 && error > entry->error)) {
+        cache->misses++;
+        STATS_ADD(COUNTER_PALCACHE_MISSES, 1);
+        return false;
+    }
+
+    // remapping pixels
+    uint8_t lutPri[256], lutSec[256];
+    for (int i = 0; i < 256; ++i) {
+        lutPri[i] = (uint8_t)entry->lutPri[i];
+        lutSec[i] = (uint8_t)entry->lutSec[i];
+    }
+    uint8_t transparent = (uint8_t)((entry->transparent >= 0) ? entry->transparent : 0);
+    memcpy(pixels_out, entry->palette, 1024);
+    for (int p = 1024; p < TILE_SIZE; ++p)
+        pixels_out[p] = pixels_pri[p] ? lutPri[pixels_pri[p]] : (pixels_sec[p] ? lutSec[pixels_sec[p]] : transparent);
+
+    entry->lastUsed = ++cache->counter;
+    cache->hits++;
+    STATS_ADD(COUNTER_PALCACHE_HITS, 1);
+    return true;
+}
+
+void palCacheStore(palcache_t *cache, const uint8_t *pixels_pri, const uint8_t *pixels_sec, const uint8_t *pixels_out) {
+    if (!cache || !pixels_pri || !pixels_sec || !pixels_out) return;
+    uint64_t hash = hashPalettes(pixels_pri, pixels_sec);
+
+    // replacing entry of the same palette pair or least recently used entry
+    palcacheentry_t *entry = findEntry(cache, hash, pixels_pri, pixels_sec);
+    for (int i = 0; i < cache->capacity && !entry; ++i)
+        if (!cache->entries[i].hash) entry = &cache->entries[i];
+    for (int i = 0; i < cache->capacity && !entry; ++i)
+        if (i == 0 || cache->entries[i].lastUsed < entry->lastUsed) entry = &cache->entries[i];
+
+    // output index of each used input color is taken from the converted tile
+    const uint32_t *pal_pri = (const uint32_t*)pixels_pri;
+    const uint32_t *pal_sec = (const uint32_t*)pixels_sec;
+    entry->hash = hash;
+    entry->lastUsed = ++cache->counter;
+    entry->error = 0;
+    entry->transparent = -1;
+    memcpy(entry->inputPri, pixels_pri, 1024);
+    memcpy(entry->inputSec, pixels_sec, 1024);
+    memcpy(entry->palette, pixels_out, 1024);
+    memset(entry->lutPri, 0xff, sizeof(entry->lutPri));
+    memset(entry->lutSec, 0xff, sizeof(entry->lutSec));
+    for (int p = 1024; p < TILE_SIZE; ++p) {
+        uint8_t idx = pixels_out[p];
+        if (pixels_pri[p]) {
+            entry->lutPri[pixels_pri[p]] = idx;
+            entry->error += squaredError(pal_pri[pixels_pri[p]], entry->palette[idx]);
+        } else if (pixels_sec[p]) {
+            entry->lutSec[pixels_sec[p]] = idx;
+            entry->error += squaredError(pal_sec[pixels_sec[p]], entry->palette[idx]);
+        } else {
+            entry->transparent = idx;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef PALCACHE_H_INCLUDED
+#define PALCACHE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Max. number of palette pairs kept by the palette cache. Reduced if a memory budget is set.
+#define PALCACHE_SIZE   64
+
+/// Cached palette of an EE->classic converted tile pair.
+typedef struct {
+    uint64_t hash;          // hash of primary and secondary input palette, 0 if unused
+    uint64_t lastUsed;      // access counter value of the last access
+    uint64_t error;         // squared color error of the tile pair that created the entry
+    uint32_t inputPri[256]; // primary input palette
+    uint32_t inputSec[256]; // secondary input palette
+    uint32_t palette[256];  // merged output palette
+    int16_t lutPri[256];    // output palette index of each primary palette index, -1 if not resolved yet
+    int16_t lutSec[256];    // output palette index of each secondary palette index, -1 if not resolved yet
+    int transparent;        // output palette index of transparent pixels, -1 if not available
+} palcacheentry_t;
+
+/// Cache of merged palettes for EE->classic conversion, keyed by the palettes of the input tile pair.
+/// Tile pairs with the same palettes are remapped by table lookups instead of quantizing a new palette.
+typedef struct {
+    palcacheentry_t entries[PALCACHE_SIZE];
+    int capacity;           // number of usable entries
+    uint64_t counter;       // access counter
+    int hits;               // number of tile pairs remapped from cache
+    int misses;             // number of tile pairs that had to be quantized
+} palcache_t;
+
+/// Initialize an empty palette cache.
+void palCacheInit(palcache_t *cache);
+
+/**
+ * Convert an EE tile pair into a classic primary tile by using the cached palette of the same palette pair.
+ * \param cache         The palette cache.
+ * \param pixels_pri    Primary EE input tile.
+ * \param pixels_sec    Secondary EE input tile.
+ * \param pixels_out    Storage for the classic primary output tile.
+ * \param maxError      Max. mean squared error per pixel. Larger errors are accepted if the tile pair that created the
+ *                      cache entry had a larger error.
+ * \return whether the output tile was created from cache. Returns false if the palette pair isn't cached or the
+ *         cached palette doesn't fit the tile pair.
+ */
+bool palCacheRemap(palcache_t *cache, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_out, double maxError);
+
+/// Add the palette of an EE->classic converted tile pair to the cache. Replaces the least recently used entry if needed.
+void palCacheStore(palcache_t *cache, const uint8_t *pixels_pri, const uint8_t *pixels_sec, const uint8_t *pixels_out);
+
+#endif // PALCACHE_H_INCLUDED
@@ -0,0 +1,325 @@
+#include <string.h>
+#include <limits.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+#include "compat.h"
+#include "tis2ovl.h"
+#include "quantizer.h"
+#include "libimagequant.h"
+
+// Max. number of distinct colors processed by the built-in quantizer: one per pixel of a tile.
+#define BUILTIN_MAX_COLORS  4096
+// Max. number of k-means refinement passes of the built-in quantizer.
+#define KMEANS_PASSES       3
+
+// Convenience structure: Simplify cleanup of pngquant memory.
+typedef struct {
+    liq_attr *attr;
+    liq_result *result;
+} quantize_t;
+
+// Clean up pngquant memory
+static void cleanQuantizer(quantize_t **pquant) {
+    if (pquant && *pquant) {
+        if ((*pquant)->result) liq_result_destroy((*pquant)->result);
+        if ((*pquant)->attr) liq_attr_destroy((*pquant)->attr);
+        free(*pquant);
+        *pquant = NULL;
+    }
+}
+
+// Palette of the nearest color search in 16-bit weighted components (see colorDistance()).
+// Entries are padded to a multiple of 4 by repeating the last entry.
+typedef struct {
+    int16_t rg[2 * 260];    // 30*r and 59*g of each entry
+    int16_t b[2 * 260];     // 11*b and 0 of each entry
+    int count;              // number of palette entries
+} searchpal_t;
+
+// Median cut box: a range of the sorted color list.
+typedef struct {
+    int first, count;
+    double error;           // weighted squared error of the box colors to their mean
+    int channel;            // color channel of the largest error (bit shift)
+} box_t;
+
+// Working memory of the built-in quantizer.
+typedef struct {
+    int order[BUILTIN_MAX_COLORS];      // color indices sorted by boxes
+    int tmp[BUILTIN_MAX_COLORS];        // temporary storage for sorting
+    int assign[BUILTIN_MAX_COLORS];     // palette index of each color
+    box_t boxes[256];
+    uint32_t colors[BUILTIN_MAX_COLORS];    // distinct colors of a tile
+    int weights[BUILTIN_MAX_COLORS];        // number of pixels of each distinct color
+    uint16_t pixels[4096];                  // distinct color index of each pixel
+    uint32_t keys[2 * BUILTIN_MAX_COLORS];  // hash table of distinct colors
+    int16_t slots[2 * BUILTIN_MAX_COLORS];
+} builtin_t;
+def_cleanFunc(cleanBuiltin, builtin_t*)
+
+// Channel weights of colorDistance(), by bit shift / 8
+static const int channelWeights[3] = { 11, 59, 30 };
+
+
+// Internally used. Performs quantization of the tile with libimagequant.
+static bool liqQuantizeTile(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent) {
+    quantize_t *quant finally(cleanQuantizer) = calloc(1, sizeof(quantize_t));
+    if (!quant || (quant->attr = liq_attr_create()) == NULL) return false;
+    liq_image *img = liq_image_create_rgba(quant->attr, srcTile, 64, 64, 0.0);
+    if (!img) return false;
+    if (useTransparent) {
+        liq_color c; c.b = c.r = 0; c.a = c.g = 255;
+        if (liq_image_add_fixed_color(img, c) != LIQ_OK) return false;
+    }
+    if (liq_image_quantize(img, quant->attr, &quant->result) != LIQ_OK) return false;
+    if (liq_write_remapped_image(quant->result, img, dstTile + 1024, 4096) != LIQ_OK) return false;
+    const liq_palette *pal = liq_get_palette(quant->result);
+    for (unsigned i = 0; i < pal->count; ++i) {
+        dstTile[i*4] = pal->entries[i].r;
+        dstTile[i*4+1] = pal->entries[i].g;
+        dstTile[i*4+2] = pal->entries[i].b;
+        dstTile[i*4+3] = 0;
+    }
+    if (pal->count < 256)
+        memset(dstTile + pal->count*4, 0, (256-pal->count)*4);
+    return true;
+}
+
+// Internally used. Prepare the nearest color search for the given palette entries.
+static void initSearch(searchpal_t *sp, const uint32_t *palette, int count) {
+    sp->count = count;
+    int padded = (count + 3) & ~3;
+    for (int k = 0; k < padded; ++k) {
+        uint32_t c = palette[(k < count) ? k : count - 1];
+        sp->rg[2*k] = (int16_t)(30 * ((c >> 16) & 0xff));
+        sp->rg[2*k+1] = (int16_t)(59 * ((c >> 8) & 0xff));
+        sp->b[2*k] = (int16_t)(11 * (c & 0xff));
+        sp->b[2*k+1] = 0;
+    }
+}
+
+// Internally used. Return index of the palette entry with the smallest colorDistance() to "color".
+// The first entry is returned if several entries have the same distance.
+static int findNearest(const searchpal_t *sp, uint32_t color) {
+    int r = (color >> 16) & 0xff, g = (color >> 8) & 0xff, b = color & 0xff;
+#ifdef __SSE2__
+    const __m128i crg = _mm_set1_epi32((int)(((uint32_t)(59 * g) << 16) | (uint32_t)(30 * r)));
+    const __m128i cb = _mm_set1_epi32(11 * b);
+    const __m128i four = _mm_set1_epi32(4);
+    __m128i best = _mm_set1_epi32(INT_MAX), bestIdx = _mm_setzero_si128(), idx = _mm_set_epi32(3, 2, 1, 0);
+    for (int k = 0; k < sp->count; k += 4) {
+        __m128i drg = _mm_sub_epi16(crg, _mm_loadu_si128((const __m128i*)(sp->rg + 2*k)));
+        __m128i db = _mm_sub_epi16(cb, _mm_loadu_si128((const __m128i*)(sp->b + 2*k)));
+        __m128i d = _mm_add_epi32(_mm_madd_epi16(drg, drg), _mm_madd_epi16(db, db));
+        __m128i lt = _mm_cmplt_epi32(d, best);
+        best = _mm_or_si128(_mm_and_si128(lt, d), _mm_andnot_si128(lt, best));
+        bestIdx = _mm_or_si128(_mm_and_si128(lt, idx), _mm_andnot_si128(lt, bestIdx));
+        idx = _mm_add_epi32(idx, four);
+    }
+    int dist[4], index[4];
+    _mm_storeu_si128((__m128i*)dist, best);
+    _mm_storeu_si128((__m128i*)index, bestIdx);
+    int retVal = index[0], minDist = dist[0];
+    for (int i = 1; i < 4; ++i) {
+        if (dist[i] < minDist || (dist[i] == minDist && index[i] < retVal)) {
+            minDist = dist[i];
+            retVal = index[i];
+        }
+    }
+    return retVal;
+#else
+    int retVal = 0, minDist = INT_MAX;
+    for (int k = 0; k < sp->count; ++k) {
+        int dr = 30 * r - sp->rg[2*k], dg = 59 * g - sp->rg[2*k+1], db = 11 * b - sp->b[2*k];
+        int d = dr*dr + dg*dg + db*db;
+        if (d < minDist) {
+            minDist = d;
+            retVal = k;
+        }
+    }
+    return retVal;
+#endif
+}
+
+// Internally used. Calculate the weighted mean of the box colors and update the error of the box.
+static uint32_t updateBox(const builtin_t *work, const uint32_t *colors, const int *weights, box_t *box) {
+    uint64_t sum[3] = { 0 }, sumSq[3] = { 0 }, total = 0;
+    for (int i = box->first; i < box->first + box->count; ++i) {
+        uint32_t c = colors[work->order[i]];
+        uint64_t w = (uint64_t)weights[work->order[i]];
+        for (int ch = 0; ch < 3; ++ch) {
+            uint64_t v = (c >> (ch * 8)) & 0xff;
+            sum[ch] += v * w;
+            sumSq[ch] += v * v * w;
+        }
+        total += w;
+    }
+    uint32_t mean = 0;
+    box->error = 0.0;
+    double maxError = -1.0;
+    for (int ch = 0; ch < 3; ++ch) {
+        double m = (double)sum[ch] / total;
+        double err = ((double)sumSq[ch] - m * (double)sum[ch]) * channelWeights[ch] * channelWeights[ch];
+        box->error += err;
+        if (err > maxError) {
+            maxError = err;
+            box->channel = ch * 8;
+        }
+        mean |= (uint32_t)((sum[ch] + total / 2) / total) << (ch * 8);
+    }
+    // single colors can't be split
+    if (box->count < 2) box->error = 0.0;
+    return mean;
+}
+
+// Internally used. Split the box at the weighted median of its largest channel. Returns the new box.
+static box_t splitBox(builtin_t *work, const uint32_t *colors, const int *weights, box_t *box) {
+    // counting sort by channel value
+    int shift = box->channel, histo[257] = { 0 };
+    int *order = work->order + box->first;
+    for (int i = 0; i < box->count; ++i)
+        histo[((colors[order[i]] >> shift) & 0xff) + 1]++;
+    for (int v = 1; v < 257; ++v)
+        histo[v] += histo[v - 1];
+    for (int i = 0; i < box->count; ++i)
+        work->tmp[histo[(colors[order[i]] >> shift) & 0xff]++] = order[i];
+    memcpy(order, work->tmp, box->count * sizeof(int));
+
+    uint64_t total = 0, acc = 0;
+    for (int i = 0; i < box->count; ++i)
+        total += (uint64_t)weights[order[i]];
+    int split = 1;
+    for (int i = 0; i < box->count - 1; ++i) {
+        acc += (uint64_t)weights[order[i]];
+        split = i + 1;
+        if (acc * 2 >= total) break;
+    }
+    box_t retVal = { box->first + split, box->count - split, 0.0, 0 };
+    box->count = split;
+    return retVal;
+}
+
+// Internally used. Median cut with k-means refinement, specialized for the colors of a single tile.
+static int builtinQuantizeColors(const uint32_t *colors, const int *weights, int count, int fixed, uint32_t *palette) {
+    if (!colors || !weights || !palette || count <= 0 || count > BUILTIN_MAX_COLORS) return -1;
+    builtin_t *work finally(cleanBuiltin) = malloc(sizeof(builtin_t));
+    if (!work) return -1;
+    memset(palette, 0, 256 * sizeof(uint32_t));
+
+    int numColors = 0;
+    for (int i = 0; i < count; ++i)
+        if (i != fixed) work->order[numColors++] = i;
+    int maxColors = (fixed >= 0) ? 255 : 256;
+    int numBoxes = 0;
+    if (numColors <= maxColors) {
+        // palette is exact
+        for (int i = 0; i < numColors; ++i)
+            palette[numBoxes++] = colors[work->order[i]];
+    } else {
+        // median cut: splitting the box with the largest error until the palette is full
+        work->boxes[0] = (box_t){ 0, numColors, 0.0, 0 };
+        palette[0] = updateBox(work, colors, weights, &work->boxes[0]);
+        numBoxes = 1;
+        while (numBoxes < maxColors) {
+            int sel = -1;
+            for (int i = 0; i < numBoxes; ++i)
+                if (work->boxes[i].error > 0.0 && (sel < 0 || work->boxes[i].error > work->boxes[sel].error)) sel = i;
+            if (sel < 0) break;
+            work->boxes[numBoxes] = splitBox(work, colors, weights, &work->boxes[sel]);
+            palette[sel] = updateBox(work, colors, weights, &work->boxes[sel]);
+            palette[numBoxes] = updateBox(work, colors, weights, &work->boxes[numBoxes]);
+            numBoxes++;
+        }
+
+        // k-means refinement: moving each palette entry to the mean of its nearest colors
+        searchpal_t sp;
+        for (int i = 0; i < numColors; ++i)
+            work->assign[i] = -1;
+        for (int pass = 0; pass < KMEANS_PASSES; ++pass) {
+            initSearch(&sp, palette, numBoxes);
+            uint64_t sum[256][3], total[256];
+            memset(sum, 0, sizeof(sum));
+            memset(total, 0, sizeof(total));
+            bool changed = false;
+            for (int i = 0; i < numColors; ++i) {
+                uint32_t c = colors[work->order[i]];
+                uint64_t w = (uint64_t)weights[work->order[i]];
+                int k = findNearest(&sp, c);
+                changed |= (k != work->assign[i]);
+                work->assign[i] = k;
+                for (int ch = 0; ch < 3; ++ch)
+                    sum[k][ch] += ((c >> (ch * 8)) & 0xff) * w;
+                total[k] += w;
+            }
+            if (!changed) break;
+            for (int k = 0; k < numBoxes; ++k) {
+                if (!total[k]) continue;
+                palette[k] = 0;
+                for (int ch = 0; ch < 3; ++ch)
+                    palette[k] |= (uint32_t)((sum[k][ch] + total[k] / 2) / total[k]) << (ch * 8);
+            }
+        }
+    }
+    if (fixed >= 0)
+        palette[numBoxes++] = colors[fixed] & 0x00ffffff;
+    return numBoxes;
+}
+
+// Internally used. Quantize a tile with the built-in quantizer and remap its pixels to the nearest palette entries.
+static bool builtinQuantizeTile(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent) {
+    if (!srcTile || !dstTile) return false;
+    builtin_t *work finally(cleanBuiltin) = malloc(sizeof(builtin_t));
+    if (!work) return false;
+
+    // collecting distinct colors
+    int count = 0, fixed = -1;
+    memset(work->slots, 0xff, sizeof(work->slots));
+    for (int p = 0; p < 4096; ++p) {
+        uint32_t color = srcTile[p] & 0x00ffffff;
+        unsigned h = ((color * 2654435761u) >> 19) & (2 * BUILTIN_MAX_COLORS - 1);
+        while (work->slots[h] >= 0 && work->keys[h] != color)
+            h = (h + 1) & (2 * BUILTIN_MAX_COLORS - 1);
+        if (work->slots[h] < 0) {
+            work->keys[h] = color;
+            work->slots[h] = (int16_t)count;
+            work->colors[count] = color;
+            work->weights[count] = 0;
+            if (useTransparent && color == TRANSPARENT) fixed = count;
+            count++;
+        }
+        work->weights[work->slots[h]]++;
+        work->pixels[p] = (uint16_t)work->slots[h];
+    }
+
+    uint32_t *palette = (uint32_t*)dstTile;
+    int numEntries = builtinQuantizeColors(work->colors, work->weights, count, fixed, palette);
+    if (numEntries <= 0) return false;
+
+    // transparent color is only used by transparent pixels
+    searchpal_t sp;
+    initSearch(&sp, palette, (fixed >= 0) ? numEntries - 1 : numEntries);
+    uint8_t *lut = (uint8_t*)work->tmp;
+    for (int i = 0; i < count; ++i)
+        lut[i] = (uint8_t)((i == fixed) ? numEntries - 1 : findNearest(&sp, work->colors[i]));
+    for (int p = 0; p < 4096; ++p)
+        dstTile[1024 + p] = lut[work->pixels[p]];
+    return true;
+}
+
+
+static const quantizer_t quantizers[QUANTIZER_COUNT] = {
+    { "liq", liqQuantizeTile },
+    { "builtin", builtinQuantizeTile }
+};
+
+const quantizer_t* quantizerGet(int type) {
+    return (type >= 0 && type < QUANTIZER_COUNT) ? &quantizers[type] : NULL;
+}
+
+int quantizerFind(const char *name) {
+    if (!name) return -1;
+    for (int i = 0; i < QUANTIZER_COUNT; ++i)
+        if (strcmp(quantizers[i].name, name) == 0) return i;
+    return -1;
+}
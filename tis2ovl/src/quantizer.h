@@ -0,0 +1,30 @@
+#ifndef QUANTIZER_H_INCLUDED
+#define QUANTIZER_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Available backends of the full quantization tier.
+enum QUANTIZER { QUANTIZER_LIQ = 0, QUANTIZER_BUILTIN = 1, QUANTIZER_COUNT };
+
+/// Color quantizer backend of the full quantization tier (QUANT_TIER_FULL).
+typedef struct {
+    const char *name;
+
+    /**
+     * Create a new paletted tile from 64x64 RGBA pixels.
+     * \param srcTile   Source tile in RGBA truecolor format. Alpha is ignored.
+     * \param dstTile   Storage for resulting tile with palette.
+     * \param useTransparent    Whether the transparent color must be kept unchanged.
+     * \return whether quantization was successful.
+     */
+    bool (*quantizeTile)(const uint32_t *srcTile, uint8_t *dstTile, bool useTransparent);
+} quantizer_t;
+
+/// Return the quantizer backend of the given QUANTIZER type, or NULL if not available.
+const quantizer_t* quantizerGet(int type);
+
+/// Return the QUANTIZER type of the given backend name ("liq" or "builtin"), or -1 if not available.
+int quantizerFind(const char *name);
+
+#endif // QUANTIZER_H_INCLUDED
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "compat.h"
+#include "functions.h"
+#include "version.h"
+#include "colors.h"
+#include "stats.h"
+#include "report.h"
+
+// Running totals of the batch. Records themselves are not kept in memory.
+typedef struct {
+    int wedFiles, failed, ambiguous;
+    uint64_t tilePairs, tilesToEE, tilesFromEE, tilesSkipped, tilesCached;
+    uint64_t quantizerCalls, quantizerErrors, bytesRead, bytesWritten;
+    uint64_t fidelityTiles, squaredError;
+    double minPsnr, maxPixelError;
+    double wallTime, cpuTime;
+} summary_t;
+
+static FILE *reportFile = NULL;
+static char *reportName = NULL;
+static summary_t summary;
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Internally used. Return mode name for the given tile counts.
+static const char* modeName(const jobinfo_t *info) {
+    if (info->tilesToEE && info->tilesFromEE) return "mixed";
+    if (info->tilesToEE) return "to_ee";
+    if (info->tilesFromEE) return "from_ee";
+    return "none";
+}
+
+bool reportOpen(const char *fileName) {
+    if (!fileName || reportFile) return false;
+    reportFile = fopen(fileName, "w");
+    if (!evalOp(reportFile != NULL, "Error: Could not create report file: %s\n", fileName)) return false;
+    reportName = strdup(fileName);
+    memset(&summary, 0, sizeof(summary));
+    fprintf(reportFile, "{\n  \"tool\": \"%s\",\n  \"version\": \"%s\",\n  \"started\": %lld,\n  \"records\": [",
+            TIS2OVL_NAME, TIS2OVL_VERSION, (long long)time(NULL));
+    fflush(reportFile);
+    return true;
+}
+
+bool reportIsOpen() {
+    return reportFile != NULL;
+}
+
+// Internally used. Write record of a single job. Must be called with reportLock held.
+static void addJob(const char *wedFile, const jobinfo_t *info) {
+    FILE *fp = reportFile;
+    fprintf(fp, "%s\n    {\"wed\": ", summary.wedFiles ? "," : "");
+    printJSONString(fp, wedFile ? wedFile : "");
+    summary.wedFiles++;
+    if (!info) {
+        fprintf(fp, ", \"status\": \"missing\"}");
+        summary.failed++;
+        fflush(fp);
+        return;
+    }
+
+    fprintf(fp, ", \"tis_source\": ");
+    printJSONString(fp, info->tisSource);
+    fprintf(fp, ", \"tis\": ");
+    printJSONString(fp, info->tisFile);
+    fprintf(fp, ", \"status\": \"%s\", \"mode\": \"%s\", \"tiles\": {\"pairs\": %d, \"to_ee\": %d, \"from_ee\": %d, \"skipped\": %d, \"cached\": %d}, "
+                "\"bytes_read\": %llu, \"bytes_written\": %llu, \"wall_sec\": %.6f, \"cpu_sec\": %.6f, "
+                "\"quantizer\": {\"calls\": %d, \"errors\": %d}, \"invalid_refs\": %d",
+            info->success ? (info->analyzed ? "analyzed" : "ok") : "failed", modeName(info), info->tilePairs, info->tilesToEE, info->tilesFromEE,
+            info->tilesSkipped, info->tilesCached, (unsigned long long)info->bytesRead, (unsigned long long)info->bytesWritten,
+            info->wallTime, info->cpuTime, info->quantizerCalls, info->quantizerErrors, info->invalidRefs);
+    if (info->fidelityTiles > 0)
+        fprintf(fp, ", \"fidelity\": {\"tiles\": %d, \"psnr\": %.3f, \"min_psnr\": %.3f, \"max_pixel_error\": %.3f}",
+                info->fidelityTiles, errorToPsnr(info->squaredError, (uint64_t)info->fidelityTiles * TILE_DIM * TILE_DIM),
+                info->minPsnr, info->maxPixelError);
+    if (info->classifiedMode != MODE_NONE)
+        fprintf(fp, ", \"classification\": {\"verdict\": \"%s\", \"confidence\": %.4f, \"outliers\": %d, \"ambiguous\": %s}",
+                (info->classifiedMode == MODE_FROM_EE) ? "from_ee" : "to_ee", info->confidence, info->outliers, info->ambiguous ? "true" : "false");
+    fputc('}', fp);
+    fflush(fp);
+
+    if (!info->success) summary.failed++;
+    if (info->ambiguous) summary.ambiguous++;
+    summary.tilePairs += info->tilePairs;
+    summary.tilesToEE += info->tilesToEE;
+    summary.tilesFromEE += info->tilesFromEE;
+    summary.tilesSkipped += info->tilesSkipped;
+    summary.tilesCached += info->tilesCached;
+    summary.quantizerCalls += info->quantizerCalls;
+    summary.quantizerErrors += info->quantizerErrors;
+    summary.bytesRead += info->bytesRead;
+    summary.bytesWritten += info->bytesWritten;
+    summary.wallTime += info->wallTime;
+    summary.cpuTime += info->cpuTime;
+    if (info->fidelityTiles > 0) {
+        if (summary.fidelityTiles == 0 || info->minPsnr < summary.minPsnr) summary.minPsnr = info->minPsnr;
+        if (info->maxPixelError > summary.maxPixelError) summary.maxPixelError = info->maxPixelError;
+        summary.fidelityTiles += info->fidelityTiles;
+        summary.squaredError += info->squaredError;
+    }
+}
+
+void reportAddJob(const char *wedFile, const jobinfo_t *info) {
+    if (!reportFile) return;
+    pthread_mutex_lock(&reportLock);
+    addJob(wedFile, info);
+    pthread_mutex_unlock(&reportLock);
+}
+
+bool reportClose() {
+    if (!reportFile) return true;
+    FILE *fp = reportFile;
+    fprintf(fp, "\n  ],\n  \"summary\": {\"wed_files\": %d, \"failed\": %d, \"ambiguous\": %d, \"tiles\": {\"pairs\": %llu, \"to_ee\": %llu, \"from_ee\": %llu, "
+                "\"skipped\": %llu, \"cached\": %llu}, \"bytes_read\": %llu, \"bytes_written\": %llu, \"wall_sec\": %.6f, \"cpu_sec\": %.6f, "
+                "\"tiles_per_sec\": %.1f, \"quantizer\": {\"calls\": %llu, \"errors\": %llu}, \"peak_memory_bytes\": %llu",
+            summary.wedFiles, summary.failed, summary.ambiguous, (unsigned long long)summary.tilePairs, (unsigned long long)summary.tilesToEE,
+            (unsigned long long)summary.tilesFromEE, (unsigned long long)summary.tilesSkipped, (unsigned long long)summary.tilesCached,
+            (unsigned long long)summary.bytesRead, (unsigned long long)summary.bytesWritten, summary.wallTime, summary.cpuTime,
+            (summary.wallTime > 0.0) ? (summary.tilesToEE + summary.tilesFromEE) / summary.wallTime : 0.0,
+            (unsigned long long)summary.quantizerCalls, (unsigned long long)summary.quantizerErrors, (unsigned long long)statsPeakMemory());
+    if (summary.fidelityTiles > 0)
+        fprintf(fp, ", \"fidelity\": {\"tiles\": %llu, \"psnr\": %.3f, \"min_psnr\": %.3f, \"max_pixel_error\": %.3f}",
+                (unsigned long long)summary.fidelityTiles, errorToPsnr(summary.squaredError, summary.fidelityTiles * TILE_DIM * TILE_DIM),
+                summary.minPsnr, summary.maxPixelError);
+    fprintf(fp, "}\n}\n");
+    bool retVal = !ferror(fp);
+    retVal &= (fclose(fp) == 0);
+    reportFile = NULL;
+    evalOp(retVal, "Error: Could not write report file: %s\n", reportName);
+    free(reportName);
+    reportName = NULL;
+    return retVal;
+}
@@ -0,0 +1,23 @@
+#ifndef REPORT_H_INCLUDED
+#define REPORT_H_INCLUDED
+
+#include <stdbool.h>
+#include "tis2ovl.h"
+
+/// Create report file and start writing the JSON document. Returns success state.
+bool reportOpen(const char *fileName);
+
+/// Return whether a report is currently being written.
+bool reportIsOpen();
+
+/**
+ * Append record of a single WED file to the report. Records are written immediately. Can be called from multiple threads.
+ * \param wedFile   Path of the WED file.
+ * \param info      Results of the conversion job. Specify NULL if the WED file could not be processed at all.
+ */
+void reportAddJob(const char *wedFile, const jobinfo_t *info);
+
+/// Write batch summary and close the report file. Returns success state.
+bool reportClose();
+
+#endif // REPORT_H_INCLUDED
@@ -0,0 +1,499 @@
+#include <string.h>
+#include "compat.h"
+#include "functions.h"
+#include "global.h"
+#include "report.h"
+#include "trace.h"
+#include "server.h"
+
+#ifndef _WIN32
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <limits.h>
+#   include <poll.h>
+#   include <pthread.h>
+#   include <signal.h>
+#   include <unistd.h>
+#   include <sys/socket.h>
+#   include <sys/stat.h>
+#   include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#   define MSG_NOSIGNAL 0
+#endif
+
+// Interval in milliseconds for checking shutdown requests while waiting for socket operations
+#define POLL_INTERVAL   250
+
+// List of connection handles
+typedef struct {
+    int *items;
+    size_t count, cap;
+} connlist_t;
+
+// Client connections shared by the polling thread and all workers
+typedef struct {
+    int *conns;             // ring buffer of connections with a pending request
+    size_t head, count;     // position of first item and number of items
+    size_t cap;             // capacity of the ring buffer
+    connlist_t idle;        // connections whose request has been answered, to be polled again
+    int wake[2];            // pipe to wake up the polling thread when connections are returned
+    bool closed;            // whether server is shutting down
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} connqueue_t;
+
+static volatile bool serverStop = false;
+static connqueue_t queue = { NULL, 0, 0, 0, { NULL, 0, 0 }, { -1, -1 }, false, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+// Internally used. Return whether the server is shutting down.
+static bool isStopping() {
+    return serverStop || isInterrupted();
+}
+
+// Internally used. Store 32-bit value in little-endian byte order.
+static void putLE32(uint8_t *buf, uint32_t value) {
+    buf[0] = value & 0xff;
+    buf[1] = (value >> 8) & 0xff;
+    buf[2] = (value >> 16) & 0xff;
+    buf[3] = (value >> 24) & 0xff;
+}
+
+// Internally used. Return 32-bit value stored in little-endian byte order.
+static uint32_t getLE32(const uint8_t *buf) {
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// Internally used. Wait until the socket is ready for the given events. Returns false on error or server shutdown.
+static bool waitSocket(int fd, short events) {
+    for (;;) {
+        struct pollfd pfd = { fd, events, 0 };
+        int ret = poll(&pfd, 1, POLL_INTERVAL);
+        if (ret > 0) return true;
+        if (ret < 0 && errno != EINTR) return false;
+        if (isStopping()) return false;
+    }
+}
+
+// Internally used. Read exactly "size" bytes from the socket. Returns false on error or end of stream.
+static bool readFull(int fd, void *buf, size_t size) {
+    uint8_t *p = buf;
+    while (size > 0) {
+        if (!waitSocket(fd, POLLIN)) return false;
+        ssize_t len = recv(fd, p, size, 0);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) return false;
+        p += len;
+        size -= len;
+    }
+    return true;
+}
+
+// Internally used. Write exactly "size" bytes to the socket. Returns success state.
+static bool writeFull(int fd, const void *buf, size_t size) {
+    const uint8_t *p = buf;
+    while (size > 0) {
+        if (!waitSocket(fd, POLLOUT)) return false;
+        ssize_t len = send(fd, p, size, MSG_NOSIGNAL);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) return false;
+        p += len;
+        size -= len;
+    }
+    return true;
+}
+
+// Internally used. Read a length-prefixed message. Returned data is null-terminated and must be freed by the caller.
+static bool readMessage(int fd, uint8_t **data, uint32_t *size, uint32_t maxSize) {
+    uint8_t header[4];
+    if (!readFull(fd, header, sizeof(header))) return false;
+    *size = getLE32(header);
+    if (*size > maxSize) return false;
+    *data = malloc(*size + 1);
+    if (!*data) return false;
+    if (!readFull(fd, *data, *size)) {
+        free(*data);
+        *data = NULL;
+        return false;
+    }
+    (*data)[*size] = 0;
+    return true;
+}
+
+// Internally used. Process a single request. Returns result of the conversion job.
+static int32_t processRequest(const char *data, uint32_t size, jobinfo_t *info) {
+    memset(info, 0, sizeof(jobinfo_t));
+    const char *fields[5];
+    int numFields = 0;
+    array_t searchPath;
+    arrayInit(&searchPath, 0);
+    for (uint32_t pos = 0; pos < size; ) {
+        const char *str = data + pos;
+        pos += strlen(str) + 1;
+        if (numFields < 5)
+            fields[numFields++] = str;
+        else
+            arrayAddItem(&searchPath, (void*)str);
+    }
+    if (numFields < 5 || strcmp(fields[0], SERVER_MAGIC) != 0) {
+        printMsg(OUTPUT_ERR, "Error: Invalid request received.\n");
+        arrayFree(&searchPath);
+        return -1;
+    }
+
+    param_mode = atoi(fields[1]);
+    const char *outputDir = *fields[3] ? fields[3] : NULL;
+    const char *wedFile = fields[4];
+    int32_t retVal;
+    if (fields[2][0] == '1')
+        retVal = analyze(wedFile, &searchPath, info);
+    else
+        retVal = convert(wedFile, &searchPath, outputDir, info);
+    reportAddJob(wedFile, info);
+    arrayFree(&searchPath);
+    return retVal;
+}
+
+// Internally used. Process a single request of a client connection. Returns false if the connection should be closed.
+static bool serveRequest(int conn) {
+    uint8_t response[8 + sizeof(jobinfo_t)];
+    uint8_t *data = NULL;
+    uint32_t size = 0;
+    if (!readMessage(conn, &data, &size, SERVER_MAX_REQUEST)) return false;
+    jobinfo_t info;
+    int32_t result = processRequest((const char*)data, size, &info);
+    free(data);
+
+    putLE32(response, 4 + sizeof(jobinfo_t));
+    putLE32(response + 4, (uint32_t)result);
+    memcpy(response + 8, &info, sizeof(jobinfo_t));
+    return writeFull(conn, response, sizeof(response));
+}
+
+// Internally used. Append connection to the list. Returns success state.
+static bool listAdd(connlist_t *list, int conn) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 16;
+        int *items = realloc(list->items, cap * sizeof(int));
+        if (!items) return false;
+        list->items = items;
+        list->cap = cap;
+    }
+    list->items[list->count++] = conn;
+    return true;
+}
+
+// Internally used. Close all connections of the list and release it.
+static void listClose(connlist_t *list) {
+    for (size_t i = 0; i < list->count; ++i)
+        close(list->items[i]);
+    free(list->items);
+    memset(list, 0, sizeof(connlist_t));
+}
+
+// Internally used. Hand connection back to the polling thread after its request has been answered.
+static void queueReturn(int conn) {
+    pthread_mutex_lock(&queue.lock);
+    bool success = listAdd(&queue.idle, conn);
+    pthread_mutex_unlock(&queue.lock);
+    if (!success) {
+        close(conn);
+        return;
+    }
+    // a full pipe already wakes up the polling thread
+    ssize_t len = write(queue.wake[1], "", 1);
+    (void)len;
+}
+
+// Internally used. Add connection with a pending request to the queue. Returns success state.
+static bool queuePush(int conn) {
+    pthread_mutex_lock(&queue.lock);
+    if (queue.count == queue.cap) {
+        size_t cap = queue.cap ? queue.cap * 2 : 16;
+        int *conns = malloc(cap * sizeof(int));
+        if (!conns) {
+            pthread_mutex_unlock(&queue.lock);
+            return false;
+        }
+        for (size_t i = 0; i < queue.count; ++i)
+            conns[i] = queue.conns[(queue.head + i) % queue.cap];
+        free(queue.conns);
+        queue.conns = conns;
+        queue.head = 0;
+        queue.cap = cap;
+    }
+    queue.conns[(queue.head + queue.count) % queue.cap] = conn;
+    queue.count++;
+    pthread_cond_signal(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+    return true;
+}
+
+// Internally used. Worker thread function. Serves queued requests until the server is shutting down.
+static void* serverWorker(void *arg) {
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", (int)(intptr_t)arg);
+    traceSetThreadName(name);
+    for (;;) {
+        pthread_mutex_lock(&queue.lock);
+        while (!queue.count && !queue.closed)
+            pthread_cond_wait(&queue.cond, &queue.lock);
+        if (!queue.count) {
+            pthread_mutex_unlock(&queue.lock);
+            break;
+        }
+        int conn = queue.conns[queue.head];
+        queue.head = (queue.head + 1) % queue.cap;
+        queue.count--;
+        pthread_mutex_unlock(&queue.lock);
+
+        if (serveRequest(conn))
+            queueReturn(conn);
+        else
+            close(conn);
+    }
+    return NULL;
+}
+
+// Internally used. Accept connections and queue every connection that has a pending request, until the server is
+// shutting down. Idle connections are only polled and don't occupy a worker. Returns success state.
+static bool pollConnections(int fd) {
+    connlist_t watched = { NULL, 0, 0 };
+    struct pollfd *pfds = NULL;
+    size_t pfdsCap = 0;
+    bool retVal = true;
+    while (retVal && !isStopping()) {
+        // connections of answered requests are polled again
+        pthread_mutex_lock(&queue.lock);
+        for (size_t i = 0; retVal && i < queue.idle.count; ++i)
+            retVal = listAdd(&watched, queue.idle.items[i]);
+        queue.idle.count = 0;
+        pthread_mutex_unlock(&queue.lock);
+        if (!evalOp(retVal, "Error: Could not allocate memory.\n")) break;
+
+        if (watched.count + 2 > pfdsCap) {
+            size_t cap = watched.cap + 2;
+            struct pollfd *p = realloc(pfds, cap * sizeof(struct pollfd));
+            if (!evalOp(p != NULL, "Error: Could not allocate memory.\n")) {
+                retVal = false;
+                break;
+            }
+            pfds = p;
+            pfdsCap = cap;
+        }
+        pfds[0] = (struct pollfd){ fd, POLLIN, 0 };
+        pfds[1] = (struct pollfd){ queue.wake[0], POLLIN, 0 };
+        for (size_t i = 0; i < watched.count; ++i)
+            pfds[i + 2] = (struct pollfd){ watched.items[i], POLLIN, 0 };
+        int ret = poll(pfds, watched.count + 2, POLL_INTERVAL);
+        if (ret < 0 && errno == EINTR) continue;
+        if (!evalOp(ret >= 0, "Error: Could not wait for connections.\n")) {
+            retVal = false;
+            break;
+        }
+        if (pfds[1].revents) {
+            char buf[64];
+            ssize_t len = read(queue.wake[0], buf, sizeof(buf));
+            (void)len;
+        }
+
+        // requests and disconnects are both handled by a worker
+        for (size_t i = watched.count; i > 0; --i) {
+            if (!pfds[i + 1].revents) continue;
+            int conn = watched.items[i - 1];
+            watched.items[i - 1] = watched.items[--watched.count];
+            if (!queuePush(conn)) {
+                printMsg(OUTPUT_ERR, "Error: Could not allocate memory.\n");
+                close(conn);
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int conn = accept(fd, NULL, NULL);
+            if (conn < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                printMsg(OUTPUT_ERR, "Error: Could not accept connection.\n");
+                retVal = false;
+            } else if (!listAdd(&watched, conn)) {
+                printMsg(OUTPUT_ERR, "Error: Could not allocate memory.\n");
+                close(conn);
+            }
+        }
+    }
+    free(pfds);
+    listClose(&watched);
+    return retVal;
+}
+
+// Internally used. Initialize socket address structure. Returns success state.
+static bool initAddress(struct sockaddr_un *addr, const char *socketFile) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (!evalOp(strlen(socketFile) < sizeof(addr->sun_path), "Error: Socket path too long: %s\n", socketFile)) return false;
+    strcpy(addr->sun_path, socketFile);
+    return true;
+}
+
+bool serverRun(const char *socketFile, int workers) {
+    if (!socketFile) return false;
+    struct sockaddr_un addr;
+    if (!initAddress(&addr, socketFile)) return false;
+    if (workers <= 0)
+        workers = cpuCount();
+
+    // only stale sockets are replaced
+    struct stat st;
+    if (lstat(socketFile, &st) == 0) {
+        if (!evalOp(S_ISSOCK(st.st_mode), "Error: File exists and is not a socket: %s\n", socketFile)) return false;
+        unlink(socketFile);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!evalOp(fd >= 0, "Error: Could not create socket.\n")) return false;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        printMsg(OUTPUT_ERR, "Error: Could not listen on socket: %s\n", socketFile);
+        close(fd);
+        return false;
+    }
+
+    // disconnected clients must not terminate the server
+    struct sigaction sa, oldSigPipe;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_IGN;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPIPE, &sa, &oldSigPipe);
+    serverStop = false;
+
+    bool retVal = evalOp(pipe(queue.wake) == 0, "Error: Could not create pipe.\n");
+    if (retVal) {
+        fcntl(queue.wake[0], F_SETFL, O_NONBLOCK);
+        fcntl(queue.wake[1], F_SETFL, O_NONBLOCK);
+    }
+    queue.closed = false;
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    int numThreads = 0;
+    while (retVal && threads && numThreads < workers && pthread_create(&threads[numThreads], NULL, serverWorker, (void*)(intptr_t)(numThreads + 1)) == 0)
+        numThreads++;
+    if (retVal && !evalOp(numThreads > 0, "Error: Could not start worker threads.\n")) {
+        retVal = false;
+    } else if (retVal) {
+        printMsg(OUTPUT_MSG, "Listening on \"%s\" with %d worker(s). Press Ctrl+C to stop.\n\n", socketFile, numThreads);
+    }
+
+    // processing requests until interrupted
+    if (retVal)
+        retVal = pollConnections(fd);
+
+    // shutting down: pending requests are dropped by the workers
+    serverStop = true;
+    pthread_mutex_lock(&queue.lock);
+    queue.closed = true;
+    pthread_cond_broadcast(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < numThreads; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    free(queue.conns);
+    queue.conns = NULL;
+    queue.head = queue.count = queue.cap = 0;
+    listClose(&queue.idle);
+    for (int i = 0; i < 2; ++i) {
+        if (queue.wake[i] >= 0)
+            close(queue.wake[i]);
+        queue.wake[i] = -1;
+    }
+
+    close(fd);
+    unlink(socketFile);
+    sigaction(SIGPIPE, &oldSigPipe, NULL);
+    printMsg(OUTPUT_MSG, "Server stopped.\n");
+    return retVal;
+}
+
+int clientConnect(const char *socketFile) {
+    if (!socketFile) return -1;
+    struct sockaddr_un addr;
+    if (!initAddress(&addr, socketFile)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!evalOp(fd >= 0, "Error: Could not create socket.\n")) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        printMsg(OUTPUT_ERR, "Error: Could not connect to server: %s\n", socketFile);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void clientDisconnect(int conn) {
+    if (conn >= 0)
+        close(conn);
+}
+
+// Internally used. Append null-terminated string to the request buffer. Returns false if the request size is exceeded.
+static bool appendString(uint8_t *buf, size_t *pos, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (*pos + len > 4 + SERVER_MAX_REQUEST) return false;
+    memcpy(buf + *pos, str, len);
+    *pos += len;
+    return true;
+}
+
+// Internally used. Return absolute path of the given path. Returns the unmodified path if it could not be resolved.
+static const char* absolutePath(const char *path, char *buf) {
+    return realpath(path, buf) ? buf : path;
+}
+
+int clientConvert(int conn, const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info) {
+    jobinfo_t jobInfo;
+    if (!info) info = &jobInfo;
+    memset(info, 0, sizeof(jobinfo_t));
+    if (conn < 0 || !wedFile || !searchPath) return -1;
+
+    uint8_t *buf finally(cleanMem8) = malloc(4 + SERVER_MAX_REQUEST);
+    if (!evalOp(buf != NULL, "Error: Could not allocate memory.\n")) return -1;
+    char path[PATH_MAX], mode[16];
+    snprintf(mode, sizeof(mode), "%d", param_mode);
+    size_t pos = 4;
+    bool success = appendString(buf, &pos, SERVER_MAGIC) &&
+                   appendString(buf, &pos, mode) &&
+                   appendString(buf, &pos, param_analyze ? "1" : "0") &&
+                   appendString(buf, &pos, outputDir ? absolutePath(outputDir, path) : "") &&
+                   appendString(buf, &pos, absolutePath(wedFile, path));
+    for (size_t i = 0; success && i < arrayGetSize(searchPath); ++i)
+        success = appendString(buf, &pos, absolutePath(arrayGetItem(searchPath, i), path));
+    if (!evalOp(success, "Error: Request too large: %s\n", wedFile)) return -1;
+    putLE32(buf, (uint32_t)(pos - 4));
+    if (!evalOp(writeFull(conn, buf, pos), "Error: Could not send request to server.\n")) return -1;
+
+    uint8_t *data finally(cleanMem8) = NULL;
+    uint32_t size = 0;
+    if (!evalOp(readMessage(conn, &data, &size, 4 + sizeof(jobinfo_t)), "Error: No response from server.\n")) return -1;
+    if (!evalOp(size == 4 + sizeof(jobinfo_t), "Error: Invalid response from server.\n")) return -1;
+    memcpy(info, data + 4, sizeof(jobinfo_t));
+    return (int32_t)getLE32(data);
+}
+
+#else
+
+bool serverRun(const char *socketFile, int workers) {
+    (void)socketFile; (void)workers;
+    printMsg(OUTPUT_ERR, "Error: Server mode is not supported on this platform.\n");
+    return false;
+}
+
+int clientConnect(const char *socketFile) {
+    (void)socketFile;
+    printMsg(OUTPUT_ERR, "Error: Client mode is not supported on this platform.\n");
+    return -1;
+}
+
+void clientDisconnect(int conn) {
+    (void)conn;
+}
+
+int clientConvert(int conn, const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info) {
+    (void)conn; (void)wedFile; (void)searchPath; (void)outputDir;
+    if (info) memset(info, 0, sizeof(jobinfo_t));
+    return -1;
+}
+
+#endif
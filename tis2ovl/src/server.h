@@ -0,0 +1,48 @@
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+
+#include <stdbool.h>
+#include "arrays.h"
+#include "tis2ovl.h"
+
+/// Protocol identifier of requests. Requests with a different identifier are rejected.
+#define SERVER_MAGIC        "TIS2OVL1"
+
+/// Max. size of a single request in bytes.
+#define SERVER_MAX_REQUEST  65536
+
+/**
+ * Run conversion server on the given Unix domain socket until interrupted by SIGINT or SIGTERM (see initInterruptHandler()).
+ *
+ * Each request is a length-prefixed message (32-bit little-endian size, followed by a sequence of null-terminated strings):
+ * protocol identifier, conversion mode, analyze flag ("0" or "1"), output directory (empty to update source files),
+ * WED file, and any number of TIS search paths. Each response is a length-prefixed message containing the 32-bit result
+ * of the job followed by the resulting jobinfo_t structure.
+ *
+ * Requests of all connections are queued individually, so that idle connections don't occupy a worker.
+ *
+ * \param socketFile    Path of the socket file. An existing socket file is replaced.
+ * \param workers       Max. number of concurrently processed requests. Specify 0 to use the number of CPU cores.
+ * \return Success state.
+ */
+bool serverRun(const char *socketFile, int workers);
+
+/// Connect to the conversion server listening on the given socket. Returns connection handle, or -1 on error.
+int clientConnect(const char *socketFile);
+
+/// Close a connection to the conversion server.
+void clientDisconnect(int conn);
+
+/**
+ * Forward conversion or analysis of a single WED file to the conversion server.
+ * Relative paths are resolved by the client, since the server may run in a different working directory.
+ * \param conn          Connection handle returned by clientConnect().
+ * \param wedFile       WED file to process.
+ * \param searchPath    TIS search paths.
+ * \param outputDir     Output directory for TIS files. Specify NULL to update source files.
+ * \param info          Results of the job.
+ * \return Result of convert() or analyze() on the server, or -1 on error.
+ */
+int clientConvert(int conn, const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info);
+
+#endif // SERVER_H_INCLUDED
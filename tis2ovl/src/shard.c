@@ -0,0 +1,157 @@
+#include <string.h>
+#include <ctype.h>
+#include "compat.h"
+#include "functions.h"
+#include "shard.h"
+#include "catalog.h"
+
+// Shard assignment of a single WED file
+typedef struct {
+    const char *wedFile;    // WED file path
+    char tisName[15];       // referenced TIS file name, empty if WED file could not be read
+    uint32_t hash;          // hash of the TIS name
+    uint64_t weight;        // number of overlay tile pairs (+1, to account for tilesets without overlays)
+    int shard;              // assigned shard (0-based)
+} shardentry_t;
+
+// Group of WED files referencing the same TIS file
+typedef struct {
+    shardentry_t **items;   // first WED file of the group in the list sorted by TIS name
+    size_t count;           // number of WED files in the group
+    uint64_t weight;        // total weight of the group
+} shardgroup_t;
+
+def_cleanFunc(cleanEntries, shardentry_t*)
+def_cleanFunc(cleanEntryList, shardentry_t**)
+def_cleanFunc(cleanGroups, shardgroup_t*)
+def_cleanFunc(cleanLoads, uint64_t*)
+def_cleanFunc(cleanData, uint8_t*)
+
+// Internally used. Read referenced TIS name and, if "numPairs" is specified, the number of overlay tile pairs of a WED
+// file without printing errors. Tile pairs are only counted, tile references are not validated. Returns success state.
+static bool readWEDInfo(const char *wedFile, char *tisName, uint64_t *numPairs) {
+    FILE *fp finally(cleanFile) = fopen(wedFile, "rb");
+    if (!fp) return false;
+    uint8_t header[0x20], ovl[0x18];
+    char sig[9] = {0}, tisResref[9] = {0};
+    int32_t ofs_ovl, ofs_tilemap;
+    int16_t num_width, num_height;
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) || !getString(header, 0, 8, sig) || strcmp(sig, "WED V1.3") != 0) return false;
+    if (!getLong(header, 0x10, &ofs_ovl) || ofs_ovl < 0 || fseek(fp, ofs_ovl, SEEK_SET) != 0) return false;
+    if (fread(ovl, 1, sizeof(ovl), fp) != sizeof(ovl) || !getString(ovl, 4, 8, tisResref) || !strlen(tisResref)) return false;
+    lowerString(tisResref);
+    sprintf(tisName, "%s.tis", tisResref);
+    if (!numPairs) return true;
+
+    // counting tilemap entries with overlay flags
+    if (!getShort(ovl, 0, &num_width) || !getShort(ovl, 2, &num_height) || !getLong(ovl, 0x10, &ofs_tilemap) || ofs_tilemap < 0) return false;
+    size_t num_tiles = (num_width > 0 && num_height > 0) ? (size_t)num_width * num_height : 0;
+    uint8_t *tilemap finally(cleanData) = malloc(num_tiles * 10 + 1);
+    if (!tilemap || fseek(fp, ofs_tilemap, SEEK_SET) != 0 || fread(tilemap, 1, num_tiles * 10, fp) != num_tiles * 10) return false;
+    *numPairs = 0;
+    for (size_t i = 0, ofs = 0; i < num_tiles; ++i, ofs += 10) {
+        int16_t tile_sec;
+        int8_t flags;
+        if (getShort(tilemap, ofs + 4, &tile_sec) && getByte(tilemap, ofs + 6, &flags) && flags && tile_sec != -1)
+            (*numPairs)++;
+    }
+    return true;
+}
+
+// Internally used. Return hash of the file name of the given path, without directory.
+static uint32_t hashBaseName(const char *path) {
+    const char *name = path;
+    for (const char *p = path; *p; ++p)
+        if (*p == '/' || *p == '\\') name = p + 1;
+    return shardHash(name);
+}
+
+// Internally used. Order entries by TIS name.
+static int compareName(const void *a, const void *b) {
+    const shardentry_t *e1 = *(shardentry_t * const *)a, *e2 = *(shardentry_t * const *)b;
+    return strcmp(e1->tisName, e2->tisName);
+}
+
+// Internally used. Order groups by descending weight, then by hash and TIS name.
+static int compareGroup(const void *a, const void *b) {
+    const shardgroup_t *g1 = a, *g2 = b;
+    if (g1->weight != g2->weight) return (g1->weight > g2->weight) ? -1 : 1;
+    if (g1->items[0]->hash != g2->items[0]->hash) return (g1->items[0]->hash < g2->items[0]->hash) ? -1 : 1;
+    return strcmp(g1->items[0]->tisName, g2->items[0]->tisName);
+}
+
+bool shardParse(const char *spec, int *index, int *count) {
+    if (!spec || !index || !count) return false;
+    int len = 0;
+    if (sscanf(spec, "%d/%d%n", index, count, &len) != 2 || spec[len] != 0) return false;
+    return (*count > 0 && *index > 0 && *index <= *count);
+}
+
+uint32_t shardHash(const char *str) {
+    uint32_t hash = 2166136261u;
+    for (; str && *str; ++str) {
+        hash ^= (uint8_t)tolower((uint8_t)*str);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int shardFilter(array_t *wedList, int index, int count, bool balanced) {
+    if (!wedList || count <= 0 || index <= 0 || index > count) return -1;
+    size_t numEntries = arrayGetSize(wedList);
+    if (numEntries == 0) return 0;
+
+    shardentry_t *entries finally(cleanEntries) = calloc(numEntries, sizeof(shardentry_t));
+    shardentry_t **sorted finally(cleanEntryList) = calloc(numEntries, sizeof(shardentry_t*));
+    shardgroup_t *groups finally(cleanGroups) = calloc(numEntries, sizeof(shardgroup_t));
+    uint64_t *loads finally(cleanLoads) = calloc(count, sizeof(uint64_t));
+    if (!evalOp(entries && sorted && groups && loads, "Error: Could not allocate memory.\n")) return -1;
+
+    // resolving TIS names and weights, errors are left to the shard processing the WED file
+    size_t numSorted = 0;
+    for (size_t i = 0; i < numEntries; ++i) {
+        shardentry_t *entry = &entries[i];
+        entry->wedFile = arrayGetItem(wedList, i);
+        const catalogentry_t *cataloged = catalogFind(entry->wedFile);
+        uint64_t numPairs = 0;
+        if (cataloged) {
+            strcpy(entry->tisName, catalogGetString(cataloged->tisName));
+            numPairs = cataloged->numPairs;
+        } else if (!readWEDInfo(entry->wedFile, entry->tisName, balanced ? &numPairs : NULL)) {
+            entry->tisName[0] = 0;
+            entry->shard = hashBaseName(entry->wedFile) % count;
+            continue;
+        }
+        entry->hash = shardHash(entry->tisName);
+        entry->weight = numPairs + 1;
+        entry->shard = entry->hash % count;
+        sorted[numSorted++] = entry;
+    }
+
+    // balanced shards: grouping WED files by TIS file
+    if (balanced) qsort(sorted, numSorted, sizeof(shardentry_t*), compareName);
+    size_t numGroups = 0;
+    for (size_t i = 0; balanced && i < numSorted; ++i) {
+        if (i == 0 || strcmp(sorted[i]->tisName, sorted[i-1]->tisName) != 0)
+            groups[numGroups++].items = &sorted[i];
+        groups[numGroups-1].count++;
+        groups[numGroups-1].weight += sorted[i]->weight;
+    }
+
+    // assigning heaviest groups first to the least loaded shard
+    qsort(groups, numGroups, sizeof(shardgroup_t), compareGroup);
+    for (size_t i = 0; i < numGroups; ++i) {
+        int shard = 0;
+        for (int s = 1; s < count; ++s)
+            if (loads[s] < loads[shard]) shard = s;
+        loads[shard] += groups[i].weight;
+        for (size_t j = 0; j < groups[i].count; ++j)
+            groups[i].items[j]->shard = shard;
+    }
+
+    arrayClear(wedList, false);
+    for (size_t i = 0; i < numEntries; ++i)
+        if (entries[i].shard == index - 1)
+            arrayAddItem(wedList, (void*)entries[i].wedFile);
+    return (int)arrayGetSize(wedList);
+}
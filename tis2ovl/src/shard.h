@@ -0,0 +1,31 @@
+#ifndef SHARD_H_INCLUDED
+#define SHARD_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arrays.h"
+
+/// Parse shard specification of the form "i/n" with 1 <= i <= n. Returns success state.
+bool shardParse(const char *spec, int *index, int *count);
+
+/// Return stable 32-bit hash (FNV-1a) of the given string. Letter case is ignored.
+uint32_t shardHash(const char *str);
+
+/**
+ * Remove all WED files from the list that are not owned by the given shard.
+ *
+ * By default each WED file is owned by shard hash(TIS name) % count, so that each TIS file is owned by exactly one shard
+ * regardless of the other WED files given to the shard. With "balanced" WED files are grouped by the TIS file they
+ * reference and groups are assigned greedily to the least loaded shard, heaviest group first, weighted by number of
+ * overlay tile pairs. Ties are broken by the hash of the TIS name. The balanced partition is only consistent if all
+ * shards are given the same WED files. WED files that can't be read are assigned by hash of their file name, so errors
+ * are reported by a single shard. No errors are printed.
+ * \param wedList   List of WED files. Remaining list is ordered as before.
+ * \param index     Shard index (1-based).
+ * \param count     Total number of shards.
+ * \param balanced  Whether shards are balanced by number of overlay tile pairs.
+ * \return Number of remaining WED files, or -1 on error.
+ */
+int shardFilter(array_t *wedList, int index, int count, bool balanced);
+
+#endif // SHARD_H_INCLUDED
@@ -0,0 +1,207 @@
+#include <string.h>
+#include <time.h>
+#include "compat.h"
+#include "functions.h"
+#include "stats.h"
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <psapi.h>
+#else
+#   include <sys/resource.h>
+#endif
+
+#ifdef TIS2OVL_STATS
+#include <pthread.h>
+
+// Samples are stored in logarithmic buckets: 8 sub-buckets per power of two (max. error 12.5%).
+#define SUB_BITS 3
+#define NUM_BUCKETS (64 << SUB_BITS)
+
+// Statistics of a single stage.
+typedef struct {
+    uint64_t count;                 // number of samples
+    uint64_t total;                 // sum of all samples in nanoseconds
+    uint64_t max;                   // longest sample in nanoseconds
+    uint32_t buckets[NUM_BUCKETS];  // sample distribution
+} stage_t;
+
+// Statistics collected by a single thread.
+typedef struct thread_stats_t {
+    struct thread_stats_t *next;
+    stage_t stages[STAGE_COUNT];
+    uint64_t counters[COUNTER_COUNT];
+} thread_stats_t;
+def_cleanFunc(cleanThreadStats, thread_stats_t*)
+
+bool stats_enabled = false;
+
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static thread_stats_t *statsList = NULL;
+static __thread thread_stats_t *localStats = NULL;
+
+static const char *stageNames[STAGE_COUNT] = {
+    "Parse WED", "Find TIS", "Copy TIS", "Open TIS", "Read tiles", "Convert to EE", "Convert from EE", "  Quantize", "Write tiles", "Fidelity"
+};
+
+// Internally used. Return statistics of the calling thread, register them on first use.
+static thread_stats_t* getLocalStats();
+// Internally used. Merge statistics of all threads into "merged".
+static void mergeStats(thread_stats_t *merged);
+// Internally used. Return approximated sample value at the given percentile.
+static uint64_t getPercentile(const stage_t *stage, double percentile);
+
+static inline int bucketIndex(uint64_t nanos) {
+    if (nanos < (1u << SUB_BITS)) return (int)nanos;
+    int msb = 63 - __builtin_clzll(nanos);
+    int sub = (int)((nanos >> (msb - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+    return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+static inline uint64_t bucketValue(int index) {
+    if (index < (1 << SUB_BITS)) return (uint64_t)index;
+    int msb = (index >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(index & ((1 << SUB_BITS) - 1));
+    // center of bucket
+    return (((1ull << SUB_BITS) + sub) << (msb - SUB_BITS)) + ((1ull << (msb - SUB_BITS)) >> 1);
+}
+
+void statsEnable(bool enable) {
+    stats_enabled = enable;
+}
+
+uint64_t statsNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void statsRecord(int stage, uint64_t nanos) {
+    thread_stats_t *stats = getLocalStats();
+    if (stats && stage >= 0 && stage < STAGE_COUNT) {
+        stage_t *s = &stats->stages[stage];
+        s->count++;
+        s->total += nanos;
+        if (nanos > s->max) s->max = nanos;
+        s->buckets[bucketIndex(nanos)]++;
+    }
+}
+
+void statsAdd(int counter, uint64_t value) {
+    thread_stats_t *stats = getLocalStats();
+    if (stats && counter >= 0 && counter < COUNTER_COUNT)
+        stats->counters[counter] += value;
+}
+
+uint64_t statsGetStageTime(int stage) {
+    if (stage < 0 || stage >= STAGE_COUNT) return 0;
+    thread_stats_t *merged finally(cleanThreadStats) = calloc(1, sizeof(thread_stats_t));
+    if (!merged) return 0;
+    mergeStats(merged);
+    return merged->stages[stage].total;
+}
+
+void statsPrint() {
+    if (!stats_enabled) return;
+    thread_stats_t *merged finally(cleanThreadStats) = calloc(1, sizeof(thread_stats_t));
+    if (!merged) return;
+    mergeStats(merged);
+
+    printMsg(OUTPUT_MSG, "Statistics:\n");
+    printMsg(OUTPUT_MSG, "  %-16s %10s %12s %10s %10s %10s %10s %10s\n", "Stage", "Count", "Total[ms]", "Mean[us]", "p50[us]", "p90[us]", "p99[us]", "Max[us]");
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        const stage_t *s = &merged->stages[i];
+        if (!s->count) continue;
+        printMsg(OUTPUT_MSG, "  %-16s %10llu %12.3f %10.1f %10.1f %10.1f %10.1f %10.1f\n", stageNames[i],
+                 (unsigned long long)s->count, s->total / 1e6, (double)s->total / s->count / 1e3,
+                 getPercentile(s, 0.5) / 1e3, getPercentile(s, 0.9) / 1e3, getPercentile(s, 0.99) / 1e3, s->max / 1e3);
+    }
+    const uint64_t *c = merged->counters;
+    printMsg(OUTPUT_MSG, "  Tiles converted to EE:   %llu\n", (unsigned long long)c[COUNTER_TILES_TO_EE]);
+    printMsg(OUTPUT_MSG, "  Tiles converted from EE: %llu\n", (unsigned long long)c[COUNTER_TILES_FROM_EE]);
+    printMsg(OUTPUT_MSG, "  Quantizer calls:         %llu (%llu failed)\n", (unsigned long long)c[COUNTER_QUANTIZER_CALLS], (unsigned long long)c[COUNTER_QUANTIZER_ERRORS]);
+    uint64_t tiers = c[COUNTER_QUANT_TIER_EXACT] + c[COUNTER_QUANT_TIER_MERGE] + c[COUNTER_QUANT_TIER_FULL];
+    if (tiers)
+        printMsg(OUTPUT_MSG, "  Quantizer tiers:         exact %.1f%%, merge %.1f%%, full %.1f%%\n",
+                 100.0 * c[COUNTER_QUANT_TIER_EXACT] / tiers, 100.0 * c[COUNTER_QUANT_TIER_MERGE] / tiers,
+                 100.0 * c[COUNTER_QUANT_TIER_FULL] / tiers);
+    uint64_t lookups = c[COUNTER_PALCACHE_HITS] + c[COUNTER_PALCACHE_MISSES];
+    if (lookups)
+        printMsg(OUTPUT_MSG, "  Palette cache hits:      %llu of %llu (%.1f%%)\n", (unsigned long long)c[COUNTER_PALCACHE_HITS],
+                 (unsigned long long)lookups, 100.0 * c[COUNTER_PALCACHE_HITS] / lookups);
+    printMsg(OUTPUT_MSG, "  Bytes read:              %llu\n", (unsigned long long)c[COUNTER_BYTES_READ]);
+    printMsg(OUTPUT_MSG, "  Bytes written:           %llu\n", (unsigned long long)c[COUNTER_BYTES_WRITTEN]);
+    printMsg(OUTPUT_MSG, "  I/O calls:               %llu\n", (unsigned long long)c[COUNTER_IO_CALLS]);
+    uint64_t peak = statsPeakMemory();
+    if (peak)
+        printMsg(OUTPUT_MSG, "  Peak memory (RSS):       %.1f MB\n", peak / (1024.0 * 1024.0));
+    printMsg(OUTPUT_MSG, "\n");
+}
+
+
+// Internally used. Return statistics of the calling thread, register them on first use.
+static thread_stats_t* getLocalStats() {
+    if (!localStats) {
+        thread_stats_t *stats = calloc(1, sizeof(thread_stats_t));
+        if (stats) {
+            pthread_mutex_lock(&statsLock);
+            stats->next = statsList;
+            statsList = stats;
+            pthread_mutex_unlock(&statsLock);
+            localStats = stats;
+        }
+    }
+    return localStats;
+}
+
+// Internally used. Merge statistics of all threads into "merged".
+static void mergeStats(thread_stats_t *merged) {
+    pthread_mutex_lock(&statsLock);
+    for (thread_stats_t *t = statsList; t; t = t->next) {
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            stage_t *dst = &merged->stages[i];
+            const stage_t *src = &t->stages[i];
+            dst->count += src->count;
+            dst->total += src->total;
+            if (src->max > dst->max) dst->max = src->max;
+            for (int b = 0; b < NUM_BUCKETS; ++b)
+                dst->buckets[b] += src->buckets[b];
+        }
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+            merged->counters[i] += t->counters[i];
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+// Internally used. Return approximated sample value at the given percentile.
+static uint64_t getPercentile(const stage_t *stage, double percentile) {
+    uint64_t rank = (uint64_t)(percentile * (stage->count - 1)) + 1, sum = 0;
+    for (int b = 0; b < NUM_BUCKETS; ++b) {
+        sum += stage->buckets[b];
+        if (sum >= rank) {
+            uint64_t value = bucketValue(b);
+            return (value > stage->max) ? stage->max : value;
+        }
+    }
+    return stage->max;
+}
+
+#endif  // TIS2OVL_STATS
+
+
+uint64_t statsPeakMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (K32GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return (uint64_t)pmc.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#   ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;           // bytes
+#   else
+    return (uint64_t)usage.ru_maxrss * 1024;    // kilobytes
+#   endif
+#endif
+}
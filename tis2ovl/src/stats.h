@@ -0,0 +1,84 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Instrumented pipeline stages.
+enum STATS_STAGE {
+    STAGE_PARSE_WED,    // loading and parsing WED file
+    STAGE_FIND_TIS,     // resolving TIS file in search paths
+    STAGE_COPY_TIS,     // copying TIS file to output directory
+    STAGE_OPEN_TIS,     // opening TIS file and reading header
+    STAGE_READ_TILES,   // reading tile pairs
+    STAGE_TO_EE,        // converting tile pairs from classic to EE
+    STAGE_FROM_EE,      // converting tile pairs from EE to classic
+    STAGE_QUANTIZE,     // quantizing tiles (part of STAGE_FROM_EE)
+    STAGE_WRITE_TILES,  // writing tile pairs
+    STAGE_FIDELITY,     // measuring color error of converted tile pairs
+    STAGE_COUNT
+};
+
+/// Instrumented event counters.
+enum STATS_COUNTER {
+    COUNTER_TILES_TO_EE,        // tile pairs converted from classic to EE
+    COUNTER_TILES_FROM_EE,      // tile pairs converted from EE to classic
+    COUNTER_QUANTIZER_CALLS,    // invocations of the quantizer backend (tier 3)
+    COUNTER_QUANTIZER_ERRORS,   // failed invocations of the quantizer backend
+    COUNTER_QUANT_TIER_EXACT,   // tiles quantized by exact palette
+    COUNTER_QUANT_TIER_MERGE,   // tiles quantized by merging nearest colors
+    COUNTER_QUANT_TIER_FULL,    // tiles quantized by libimagequant
+    COUNTER_PALCACHE_HITS,      // tile pairs remapped by the palette cache
+    COUNTER_PALCACHE_MISSES,    // tile pairs not available in the palette cache
+    COUNTER_BYTES_READ,         // bytes read from files
+    COUNTER_BYTES_WRITTEN,      // bytes written to files
+    COUNTER_IO_CALLS,           // file open, seek, read and write calls
+    COUNTER_COUNT
+};
+
+#ifdef TIS2OVL_STATS
+
+/// Indicates whether statistics are collected. Set by statsEnable().
+extern bool stats_enabled;
+
+/// Enable collection of statistics. Must be called before any worker threads are started.
+void statsEnable(bool enable);
+
+/// Return monotonic time in nanoseconds.
+uint64_t statsNow();
+
+/// Add a timed sample of the given stage to the statistics of the calling thread.
+void statsRecord(int stage, uint64_t nanos);
+
+/// Add value to the given counter of the calling thread.
+void statsAdd(int counter, uint64_t value);
+
+/// Merge statistics of all threads and print summary.
+void statsPrint();
+
+/// Return total time spent in the given stage (merged over all threads) in nanoseconds.
+uint64_t statsGetStageTime(int stage);
+
+/// Start timing a stage. Declares a local timestamp variable of the specified name.
+#define STATS_BEGIN(var) uint64_t var = stats_enabled ? statsNow() : 0
+/// Finish timing of a stage that was started by STATS_BEGIN.
+#define STATS_END(stage, var) do { if (stats_enabled) statsRecord((stage), statsNow() - (var)); } while (0)
+/// Add a value to a counter.
+#define STATS_ADD(counter, value) do { if (stats_enabled) statsAdd((counter), (value)); } while (0)
+
+#else   // TIS2OVL_STATS
+
+// Instrumentation is compiled out
+static inline void statsEnable(bool enable) { (void)enable; }
+static inline void statsPrint() {}
+static inline uint64_t statsGetStageTime(int stage) { (void)stage; return 0; }
+#define STATS_BEGIN(var) do {} while (0)
+#define STATS_END(stage, var) do {} while (0)
+#define STATS_ADD(counter, value) do {} while (0)
+
+#endif  // TIS2OVL_STATS
+
+/// Return peak resident memory of the process in bytes, or 0 if unavailable.
+uint64_t statsPeakMemory();
+
+#endif // STATS_H_INCLUDED
@@ -1,42 +1,25 @@
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
 #include "tis2ovl.h"
 #include "version.h"
 #include "compat.h"
 #include "arrays.h"
+#include "arena.h"
 #include "functions.h"
 #include "colors.h"
-
-#define TILE_SIZE 5120
-#define TILE_DIM 64
-
-#define TRANSPARENT 0x0000ff00
-
-// Used by the convertXX functions
-typedef struct {
-    int pri, sec;
-} tile_t;
-
-// Cleanup function definitions
-void cleanArrayRelease(array_t **pvar) {
-    if (pvar) {
-        arrayClear(*pvar, true);
-        free(*pvar);
-    }
-}
-
-// Detect conversion mode from pixel data.
-int getMode(int, const uint8_t *);
-// Convert a single tile from classic to EE mode.
-bool tileToEE(const tile_t *, const uint8_t *, const uint8_t *, uint8_t *, uint8_t *);
-// Convert a single tile from EE to classic mode.
-bool tileFromEE(const tile_t *, const uint8_t *, const uint8_t *, uint8_t *, uint8_t *, const char *);
-// Retrieve relevant information from WED file.
-bool parseWED(const char *, char *, array_t *);
-// Retrieve header information from TIS file.
-FILE* parseTISFile(const char *, int *, int *);
-// Store full path of TIS file based on given search path list and TIS filename.
-bool findTISFile(array_t *, const char *, char *);
+#include "stats.h"
+#include "trace.h"
+#include "tismap.h"
+#include "journal.h"
+#include "tisv2.h"
+#include "palcache.h"
+#include "catalog.h"
+#include "log.h"
+#include "budget.h"
 
 void printHelp(const char *name) {
     printf("Usage: %s [OPTIONS]... WEDFILE...\n", (name && *name) ? name : TIS2OVL_NAME);
@@ -48,7 +31,61 @@ void printHelp(const char *name) {
     printf("  -s path       Search path for TIS files. This option can be specified multiple times.\n");
     printf("                Default: current directory\n");
     printf("  -o out_path   Output directory for TIS files. Omit to update source TIS files instead.\n");
+    printf("  --analyze     Only report which tilesets need conversion in which direction. No files are modified.\n");
+    printf("  --watch       Keep running and reconvert tilesets whenever their WED or TIS files change. Requires -o.\n");
+    printf("  --stream      Read WED and TIS from streams and write the converted TIS to standard output. Expects\n");
+    printf("                WEDFILE and an optional TIS source: \"-\" for standard input (default for TIS), \"fd:N\" for\n");
+    printf("                file descriptor N, or a file path. Messages are printed to standard error.\n");
+    printf("  --serve socket\n");
+    printf("                Run as conversion server on the given Unix domain socket. Input WED files are ignored.\n");
+    printf("  --biff file   Write all converted tilesets into a new BIFF file instead of updating TIS files. Additional\n");
+    printf("                BIFF files (file_2.bif, ...) are started if more than 63 tilesets are packed.\n");
+    printf("  --key file    Add the BIFF files of --biff to the given KEY file. The KEY file is created if it doesn't\n");
+    printf("                exist. Existing tileset entries are redirected to the new BIFF files.\n");
+    printf("  --workers num Max. number of concurrent conversions in server mode or with --biff.\n");
+    printf("                Default: number of CPU cores\n");
+    printf("  --max-memory size\n");
+    printf("                Memory budget of all concurrent conversions, e.g. 256M or 2G. Tilesets wait until they fit\n");
+    printf("                into the budget, and page caches and PVRZ output are reduced accordingly. Default: unlimited\n");
+    printf("  --connect socket\n");
+    printf("                Forward conversions to the server listening on the given socket.\n");
+    printf("  --shard i/n   Only process tilesets owned by shard i of n. Every TIS file is owned by exactly one shard.\n");
+    printf("  --shard-balance\n");
+    printf("                Balance shards by number of overlay tiles instead of TIS names. All shards must be called\n");
+    printf("                with the same WED files.\n");
+    printf("  --max-tile-error value\n");
+    printf("                Enable the fast palette reduction for EE->classic conversion with the given max. mean\n");
+    printf("                squared color error per pixel, e.g. 4.0. Tiles exceeding it are fully quantized (see\n");
+    printf("                --quantizer). Default: -1 (always quantize fully)\n");
+    printf("  --quantizer name\n");
+    printf("                Quantizer for tiles with too many colors: liq (libimagequant, fastest) or builtin (median\n");
+    printf("                cut without dithering, lower color error but slower). Default: liq\n");
+    printf("  --io backend  How tiles are read during conversion: buffered (file reads) or mmap (memory-mapped).\n");
+    printf("                Default: buffered\n");
+    printf("  --calibrate   Measure I/O, quantizer and conversion throughput on a sample of the input tilesets and\n");
+    printf("                store the fastest settings in the configuration file. No files are converted.\n");
+    printf("  --config file Configuration file with settings for --workers, --io and --quantizer. Command line options\n");
+    printf("                take precedence. Default: tis2ovl.cfg in the current directory if available\n");
+    printf("  --fidelity    Measure PSNR and max. pixel error of every converted tile pair and print them per tileset.\n");
+    printf("  --min-psnr value\n");
+    printf("                Fail conversion of a tileset if a tile pair falls below the given PSNR in dB. Implies --fidelity.\n");
+    printf("  --pvrz        Write converted tilesets as PVRZ-based tilesets (TIS V2) for Enhanced Edition games.\n");
+    printf("  --dxt-quality level\n");
+    printf("                Quality of the DXT1 encoder for PVRZ output: fast, normal or best. Default: normal\n");
+    printf("  --journal file\n");
+    printf("                Record conversion progress in the given journal file.\n");
+    printf("  --resume      Continue an interrupted conversion recorded in the journal file.\n");
+    printf("  --build-catalog file\n");
+    printf("                Scan the input WED files and store their overlays in the given catalog file.\n");
+    printf("  --catalog file\n");
+    printf("                Use overlay information of the given catalog file instead of parsing unchanged WED files.\n");
+    printf("  --log file    Write all log messages to the given file in addition to the console.\n");
+    printf("  --log-level level\n");
+    printf("                Min. level of messages written to the log file: verbose, info or error. Default: verbose\n");
     printf("  -q            Enable quiet mode. Do not print any log messages to standard output.\n");
+    printf("  --stats       Print per-stage timing, counters and peak memory usage when finished.\n");
+    printf("  --trace file  Record a timeline of all conversion steps as Chrome trace JSON (e.g. for Perfetto).\n");
+    printf("  --report file Write a machine-readable JSON report with one record per WED file and a batch summary.\n");
     printf("  -h            Print this help and exit.\n");
     printf("  -v            Print version information and exit.\n");
 }
@@ -59,8 +96,202 @@ void printVersion() {
 }
 
 
-int convert(const char *wedFile, array_t *searchPath, const char *outputDir) {
-    if (!wedFile || !searchPath) {
+// Performs the actual conversion job of convert().
+int convertJob(const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info);
+
+// Return value of the specified clock in seconds.
+static double clockTime(clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) return 0.0;
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+bool compositeTiles(const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint32_t *pixels_rgba) {
+#define OPAQUE 0xff000000
+    const uint32_t *pal_pri = (const uint32_t*)pixels_pri;
+    const uint32_t *pal_sec = (const uint32_t*)pixels_sec;
+    bool useTransparent = false;
+    for (int p = 1024; p < TILE_SIZE; ++p) {
+        if (pixels_pri[p]) {
+            pixels_rgba[p - 1024] = pal_pri[pixels_pri[p]] | OPAQUE;
+        } else if (pixels_sec[p]) {
+            pixels_rgba[p - 1024] = pal_sec[pixels_sec[p]] | OPAQUE;
+        } else {
+            pixels_rgba[p - 1024] = TRANSPARENT | OPAQUE;
+            useTransparent = true;
+        }
+    }
+#undef OPAQUE
+    return useTransparent;
+}
+
+// Internally used. Measure the color error between the EE tile pair and the classic tile of a converted tile pair
+// and add it to the job results. Returns false if the tile pair falls below the PSNR bound.
+static bool measureFidelity(const tile_t *tileInfo, const uint8_t *pixels_ee_pri, const uint8_t *pixels_ee_sec, const uint8_t *pixels_classic,
+                            uint32_t *pixels_rgba, jobinfo_t *info, const char *tisFile) {
+    STATS_BEGIN(tFidelity);
+    compositeTiles(pixels_ee_pri, pixels_ee_sec, pixels_rgba);
+    tileerror_t error;
+    tileErrorStats(pixels_rgba, pixels_classic, &error);
+    double psnr = errorToPsnr(error.squaredError, TILE_DIM * TILE_DIM);
+    double pixelError = distanceToPixelError(error.maxDistance);
+    if (info->fidelityTiles == 0 || psnr < info->minPsnr) info->minPsnr = psnr;
+    if (pixelError > info->maxPixelError) info->maxPixelError = pixelError;
+    info->squaredError += error.squaredError;
+    info->fidelityTiles++;
+    STATS_END(STAGE_FIDELITY, tFidelity);
+
+    if (param_min_psnr > 0.0 && psnr < param_min_psnr) {
+        printMsg(OUTPUT_ERR, "Error: Tile %d falls below min. PSNR (%.2f dB < %.2f dB) in TIS file: %s\n", tileInfo->pri, psnr, param_min_psnr, tisFile);
+        return false;
+    }
+    return true;
+}
+
+// Internally used. Return estimated peak memory of converting the given tileset, considering the memory budget.
+// "inMemory" includes the output buffer of a tileset converted into memory.
+static uint64_t estimateMemory(const char *tisFile, bool inMemory) {
+    uint64_t retVal = BUDGET_JOB_BASE;
+    int64_t size = fileSize(tisFile);
+    bool isV2 = isTISV2File(tisFile);
+    int64_t tiles = (size > TIS_HEADER_SIZE) ? (size - TIS_HEADER_SIZE) / (isV2 ? TIS_V2_TILE_SIZE : TILE_SIZE) : 0;
+    if (isV2)
+        retVal += (uint64_t)budgetScale(PVRZ_CACHE_PAGES, PVRZ_PAGE_SIZE) * PVRZ_PAGE_SIZE;
+    if (param_pvrz && tiles > 0) {
+        // pair placement may add a few unused slots
+        int pages = (int)((tiles + tiles / (PVRZ_PAGE_TILES * PVRZ_PAGE_TILES) + PVRZ_PAGE_TILES * PVRZ_PAGE_TILES) / (PVRZ_PAGE_TILES * PVRZ_PAGE_TILES));
+        retVal += (uint64_t)budgetScale(pages, PVRZ_PAGE_SIZE / 2) * (PVRZ_PAGE_SIZE / 2) + (uint64_t)tiles * (3 * sizeof(int) + 1);
+    }
+    if (inMemory && tiles > 0)
+        retVal += (uint64_t)tiles * TILE_SIZE;
+    return retVal;
+}
+
+// Internally used. Convert a single tile pair in the given direction and add the results to the job information.
+// Returns success state.
+static bool convertTilePair(int mode, const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out,
+                            uint8_t *pixels_sec_out, uint32_t *pixels_rgba, palcache_t *palCache, jobinfo_t *info, const char *tisFile) {
+    STATS_BEGIN(tConvert);
+    switch (mode) {
+    case MODE_TO_EE:
+    {
+        TRACE_SCOPE(traceConvert, "to EE", TRACE_CAT_TILE, NULL, -1);
+        if (!tileToEE(tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out)) return false;
+        STATS_END(STAGE_TO_EE, tConvert);
+        STATS_ADD(COUNTER_TILES_TO_EE, 1);
+        info->tilesToEE++;
+        break;
+    }
+    case MODE_FROM_EE:
+    {
+        TRACE_SCOPE(traceConvert, "from EE", TRACE_CAT_TILE, NULL, -1);
+        if (palCache && palCacheRemap(palCache, pixels_pri, pixels_sec, pixels_pri_out, param_tile_error)) {
+            memcpy(pixels_sec_out, pixels_pri, TILE_SIZE);
+            info->tilesCached++;
+        } else {
+            // only tile pairs escalated to the quantizer backend are counted
+            int calls = getQuantizerCalls();
+            bool success = tileFromEE(tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out, pixels_rgba, tisFile);
+            info->quantizerCalls += getQuantizerCalls() - calls;
+            if (!success) {
+                info->quantizerErrors++;
+                return false;
+            }
+            palCacheStore(palCache, pixels_pri, pixels_sec, pixels_pri_out);
+        }
+        STATS_END(STAGE_FROM_EE, tConvert);
+        STATS_ADD(COUNTER_TILES_FROM_EE, 1);
+        info->tilesFromEE++;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    // EE tile pair is compared with the classic tile it was converted from or into
+    if (param_fidelity) {
+        bool valid = (mode == MODE_TO_EE) ? measureFidelity(tileInfo, pixels_pri_out, pixels_sec_out, pixels_pri, pixels_rgba, info, tisFile)
+                                          : measureFidelity(tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_rgba, info, tisFile);
+        if (!valid) return false;
+    }
+    return true;
+}
+
+// Internally used. Print palette cache and fidelity results of the converted tile pairs.
+static void printPairSummary(const palcache_t *palCache, const jobinfo_t *info) {
+    if (palCache && palCache->hits)
+        printMsg(OUTPUT_LOG, "Palette cache: %d of %d tile pairs remapped (%.1f%%)\n", palCache->hits,
+                 palCache->hits + palCache->misses, 100.0 * palCache->hits / (palCache->hits + palCache->misses));
+    if (info->fidelityTiles > 0)
+        printMsg(OUTPUT_MSG, "Fidelity: PSNR %.2f dB (worst tile: %.2f dB), max. pixel error %.1f\n",
+                 errorToPsnr(info->squaredError, (uint64_t)info->fidelityTiles * TILE_DIM * TILE_DIM), info->minPsnr, info->maxPixelError);
+}
+
+// Internally used. Store the classification of a tileset in the job information and report tilesets that are not
+// in a uniform conversion state.
+static void applyClassification(const tisclass_t *tisClass, const tilevec_t *tileList, const char *tisFile, jobinfo_t *info) {
+    info->classifiedMode = tisClass->mode;
+    info->confidence = tisClass->confidence;
+    info->outliers = tisClass->numOutliers;
+    info->ambiguous = tisClass->ambiguous;
+    if (tisClass->mode == MODE_NONE) return;
+
+    printMsg(OUTPUT_LOG, "Tileset classification: %s (%.1f%% of %d tile pairs)\n", (tisClass->mode == MODE_TO_EE) ? "classic->EE" : "EE->classic",
+             100.0 * tisClass->confidence, tisClass->pairsToEE + tisClass->pairsFromEE);
+    if (tisClass->ambiguous)
+        printMsg(OUTPUT_ERR, "Warning: Ambiguous conversion state (to EE: %d, from EE: %d) of TIS file: %s\n",
+                 tisClass->pairsToEE, tisClass->pairsFromEE, tisFile);
+    for (int i = 0; i < tisClass->numOutliers && i < CLASSIFY_MAX_OUTLIERS; ++i) {
+        const tile_t *tileInfo = tilevecGetItem(tileList, tisClass->outliers[i]);
+        printMsg(OUTPUT_LOG, "Outlier tile pair (%d, %d)\n", tileInfo->pri, tileInfo->sec);
+    }
+}
+
+// Internally used. Classify the palette-based tileset of "tisFile" as a whole for conversion. Tile pairs without
+// secondary tile or with invalid tile references are ignored. Returns the detected conversion mode of each tile pair,
+// allocated from "arena", or NULL on error.
+static uint8_t* classifyTISFile(const char *tisFile, const tilevec_t *tileList, arena_t *arena, jobinfo_t *info) {
+    TRACE_SCOPE(traceClassify, "classify TIS", TRACE_CAT_JOB, tisFile, -1);
+    tismap_t map finally(cleanTisMap);
+    if (!tisMapOpen(&map, tisFile)) return NULL;
+    if (!evalOp(map.tileSize == TILE_SIZE, "Error: Not a palette-based TIS file: %s\n", tisFile)) return NULL;
+    size_t numPairs = tilevecGetSize(tileList);
+    const uint8_t **primaries = arenaCalloc(arena, numPairs + 1, sizeof(uint8_t*));
+    uint8_t *states = arenaAlloc(arena, numPairs + 1);
+    if (!evalOp(primaries && states, "Error: Not enough memory to process tileset.\n")) return NULL;
+    for (size_t i = 0; i < numPairs; ++i) {
+        const tile_t *tileInfo = tilevecGetItem(tileList, i);
+        if (tileInfo->sec >= 0 && tileInfo->sec < map.tileCount)
+            primaries[i] = tisMapGetTile(&map, tileInfo->pri);
+    }
+    tisclass_t tisClass;
+    classifyTileset(primaries, (int)numPairs, states, &tisClass);
+    applyClassification(&tisClass, tileList, tisFile, info);
+    if (tisClass.numOutliers > 0)
+        printMsg(OUTPUT_MSG, "Converting %d tile pair(s) not matching the conversion state of the tileset in their own direction.\n",
+                 tisClass.numOutliers);
+    return states;
+}
+
+int convert(const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info) {
+    jobinfo_t jobInfo;
+    if (!info) info = &jobInfo;
+    memset(info, 0, sizeof(jobinfo_t));
+
+    TRACE_SCOPE(traceJob, "convert WED", TRACE_CAT_JOB, wedFile, -1);
+    double wall = clockTime(CLOCK_MONOTONIC), cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+    int retVal = convertJob(wedFile, searchPath, outputDir, info);
+    logSummarize();
+    info->wallTime = clockTime(CLOCK_MONOTONIC) - wall;
+    info->cpuTime = clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    info->success = (retVal >= 0);
+    info->tilesSkipped = info->tilePairs - info->tilesToEE - info->tilesFromEE;
+    return retVal;
+}
+
+
+int convertJob(const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info) {
+    if (!wedFile || !searchPath || !info) {
         printMsg(OUTPUT_ERR, "Error: Internal error.\n");
         return -1;
     }
@@ -74,37 +305,128 @@ int convert(const char *wedFile, array_t *searchPath, const char *outputDir) {
       return -1;
     }
 
-    array_t *tileList finally(cleanArrayRelease) = malloc(sizeof(array_t));
-    arrayInit(tileList, 1);
+    // transient data of this job is released at once when leaving the function
+    arena_t arena finally(cleanArena);
+    arenaInit(&arena, 0);
+    tilevec_t tileList;
+    if (!tilevecInit(&tileList, 1, &arena)) {
+        printMsg(OUTPUT_ERR, "Error: Not enough memory to process tileset.\n");
+        return -1;
+    }
     char tisName[15] = {0}, tisFile[FILENAME_MAX] = {0};
 
-    // Parsing WED
-    printMsg(OUTPUT_MSG, "Parsing WED file \"%s\"...\n", wedFile);
-    if (!parseWED(wedFile, tisName, tileList)) return -1;
+    // Parsing WED, unless it is cataloged
+    STATS_BEGIN(tParse);
+    const catalogentry_t *entry = catalogFind(wedFile);
+    if (entry && entry->numPairs == 0) {
+        printMsg(OUTPUT_MSG, "WED file \"%s\" has no overlays (cataloged). Skipping.\n", wedFile);
+        strcpy(info->tisSource, catalogGetString(entry->tisPath));
+        strcpy(info->tisFile, info->tisSource);
+        return 0;
+    } else if (entry) {
+        printMsg(OUTPUT_MSG, "Using cataloged WED file \"%s\"...\n", wedFile);
+        strcpy(tisName, catalogGetString(entry->tisName));
+        if (!evalOp(catalogGetPairs(entry, &tileList), "Error: Not enough memory to process tileset.\n")) return -1;
+    } else {
+        printMsg(OUTPUT_MSG, "Parsing WED file \"%s\"...\n", wedFile);
+        TRACE_SCOPE(traceParse, "parse WED", TRACE_CAT_IO, wedFile, -1);
+        if (!parseWED(wedFile, tisName, &tileList, &arena)) return -1;
+        info->bytesRead += (uint64_t)fileSize(wedFile);
+    }
+    info->tilePairs = (int)tilevecGetSize(&tileList);
+    STATS_END(STAGE_PARSE_WED, tParse);
 
     // preparing TIS file
-    if (!evalOp(findTISFile(searchPath, tisName, tisFile), "Error: Could not find TIS file: %s\n", tisName)) return false;
-    if (outputDir) {
-        char tisFileOut[FILENAME_MAX] = {0};
+    STATS_BEGIN(tFind);
+    {
+        TRACE_SCOPE(traceFind, "find TIS", TRACE_CAT_IO, tisName, -1);
+        if (!evalOp(findTISFile(searchPath, tisName, tisFile), "Error: Could not find TIS file: %s\n", tisName)) return false;
+    }
+    STATS_END(STAGE_FIND_TIS, tFind);
+    strcpy(info->tisSource, tisFile);
+
+    // tileset is processed as soon as it fits into the memory budget
+    uint64_t reserved finally(cleanBudget) = budgetAcquire(estimateMemory(tisFile, false));
+
+    // progress of an interrupted run is continued if journal is enabled
+    char tisFileOut[FILENAME_MAX] = {0};
+    if (outputDir)
         sprintf(tisFileOut, "%s/%s", outputDir, tisName);
-        if (!isFileIdentical(tisFile, tisFileOut)) {
+    else
+        strcpy(tisFileOut, tisFile);
+    int job = journalBegin(wedFile, tisFileOut);
+    if (journalIsDone(job)) {
+        printMsg(OUTPUT_MSG, "Tileset has already been converted. Skipping.\n");
+        strcpy(info->tisFile, tisFileOut);
+        return 0;
+    }
+
+    if (isTISV2File(tisFile) && !(journalIsPartial(job) && fileExists(tisFileOut) && !isTISV2File(tisFileOut))) {
+        // PVRZ-based tilesets are turned into palette-based tilesets first
+        journalReset(job);
+        STATS_BEGIN(tCopy);
+        if (!convertTISV2(tisFile, searchPath, tisFileOut, &info->bytesRead, &info->bytesWritten)) return -1;
+        STATS_END(STAGE_COPY_TIS, tCopy);
+        strcpy(tisFile, tisFileOut);
+    } else if (outputDir) {
+        if (!isFileIdentical(tisFile, tisFileOut) && !(journalIsPartial(job) && fileExists(tisFileOut))) {
+            journalReset(job);
+            STATS_BEGIN(tCopy);
+            TRACE_SCOPE(traceCopy, "copy TIS", TRACE_CAT_IO, tisFileOut, -1);
             if (!evalOp(copyFile(tisFile, tisFileOut, true), "Error: Could not create output TIS file: %s\n", tisFileOut)) return false;
+            int64_t size = fileSize(tisFileOut);
+            info->bytesRead += size;
+            info->bytesWritten += size;
+            STATS_END(STAGE_COPY_TIS, tCopy);
         }
         strcpy(tisFile, tisFileOut);
     }
+    if (journalIsPartial(job))
+        printMsg(OUTPUT_MSG, "Resuming interrupted conversion.\n");
 
     // Processing TIS
     printMsg(OUTPUT_MSG, "Processing TIS file \"%s\"...\n", tisFile);
     int num_processed = 0;
     int tileCount, ofsTiles;
+    TRACE_SCOPE(traceTIS, "convert TIS", TRACE_CAT_JOB, tisFile, -1);
+    STATS_BEGIN(tOpen);
+    TRACE_BEGIN("open TIS", TRACE_CAT_IO, tisFile, -1);
     FILE *fp finally(cleanFile) = parseTISFile(tisFile, &ofsTiles, &tileCount);
+    TRACE_END("open TIS", TRACE_CAT_IO);
     if (!fp) return -1;
-    uint8_t *pixels_pri finally(cleanMem8) = malloc(TILE_SIZE);
-    uint8_t *pixels_sec finally(cleanMem8) = malloc(TILE_SIZE);
-    uint8_t *pixels_pri_out finally(cleanMem8) = malloc(TILE_SIZE);
-    uint8_t *pixels_sec_out finally(cleanMem8) = malloc(TILE_SIZE);
-    for (int i = 0, imax = arrayGetSize(tileList); i < imax; ++i) {
-        tile_t *tileInfo = (tile_t*)arrayGetItem(tileList, i);
+    STATS_END(STAGE_OPEN_TIS, tOpen);
+    strcpy(info->tisFile, tisFile);
+    info->bytesRead += 0x18;
+    // tiles are read from a memory mapping if requested, the mapping reflects tiles written through "fp" once flushed
+    tismap_t map finally(cleanTisMap);
+    memset(&map, 0, sizeof(map));
+    if (param_io == IO_MMAP && tisMapOpen(&map, tisFile) && !(map.mapped && map.tileSize == TILE_SIZE && map.tileCount == tileCount))
+        tisMapClose(&map);
+    uint8_t *pixels_pri = arenaAlloc(&arena, TILE_SIZE);
+    uint8_t *pixels_sec = arenaAlloc(&arena, TILE_SIZE);
+    uint8_t *pixels_pri_out = arenaAlloc(&arena, TILE_SIZE);
+    uint8_t *pixels_sec_out = arenaAlloc(&arena, TILE_SIZE);
+    uint32_t *pixels_rgba = arenaAlloc(&arena, TILE_DIM * TILE_DIM * sizeof(uint32_t));
+    // tile pairs sharing the same palettes reuse the palette of the first converted pair
+    palcache_t *palCache = (param_tile_error >= 0.0) ? arenaAlloc(&arena, sizeof(palcache_t)) : NULL;
+    if (!pixels_pri || !pixels_sec || !pixels_pri_out || !pixels_sec_out || !pixels_rgba || (param_tile_error >= 0.0 && !palCache)) {
+        printMsg(OUTPUT_ERR, "Error: Not enough memory to process tileset.\n");
+        return -1;
+    }
+    palCacheInit(palCache);
+
+    // autodetected tilesets are converted as a whole in the direction of the majority of tile pairs,
+    // tile pairs of a resumed conversion are detected individually
+    const uint8_t *states = NULL;
+    if (param_mode == MODE_AUTO && !journalIsPartial(job) && !(states = classifyTISFile(tisFile, &tileList, &arena, info))) return -1;
+
+    for (size_t i = 0, imax = tilevecGetSize(&tileList); i < imax; ++i) {
+        // stopping between tile pairs leaves the TIS file in a resumable state
+        if (isInterrupted()) {
+            printMsg(OUTPUT_ERR, "Error: Conversion interrupted: %s\n", tisFile);
+            return -1;
+        }
+        const tile_t *tileInfo = tilevecGetItem(&tileList, i);
         if (tileInfo->sec >= 0) {
             if (tileInfo->pri >= tileCount) {
                 printMsg(OUTPUT_ERR, "Error: Invalid tile reference %d. Only %d tiles available in TIS file: %s\n", tileInfo->pri, tileCount, tisFile);
@@ -115,34 +437,58 @@ int convert(const char *wedFile, array_t *searchPath, const char *outputDir) {
                 return -1;
             }
 
+            TRACE_SCOPE(traceTile, "tile pair", TRACE_CAT_TILE, NULL, tileInfo->pri);
+
             // reading primary tile
-            fseek(fp, ofsTiles + tileInfo->pri * TILE_SIZE, SEEK_SET);
-            if (fread(pixels_pri, 1, (size_t)TILE_SIZE, fp) != (size_t)TILE_SIZE) {
-                printMsg(OUTPUT_ERR, "Error: Error reading tile %d from TIS file: %s\n", tileInfo->pri, tisFile);
-                return -1;
-            }
-            // reading secondary tile
-            fseek(fp, ofsTiles + tileInfo->sec * TILE_SIZE, SEEK_SET);
-            if (fread(pixels_sec, 1, (size_t)TILE_SIZE, fp) != (size_t)TILE_SIZE) {
-                printMsg(OUTPUT_ERR, "Error: Error reading tile %d from TIS file: %s\n", tileInfo->sec, tisFile);
-                return -1;
+            STATS_BEGIN(tRead);
+            TRACE_BEGIN("read tiles", TRACE_CAT_IO, NULL, -1);
+            if (map.data) {
+                memcpy(pixels_pri, tisMapGetTile(&map, tileInfo->pri), TILE_SIZE);
+                memcpy(pixels_sec, tisMapGetTile(&map, tileInfo->sec), TILE_SIZE);
+            } else {
+                fseek(fp, ofsTiles + tileInfo->pri * TILE_SIZE, SEEK_SET);
+                if (fread(pixels_pri, 1, (size_t)TILE_SIZE, fp) != (size_t)TILE_SIZE) {
+                    TRACE_END("read tiles", TRACE_CAT_IO);
+                    printMsg(OUTPUT_ERR, "Error: Error reading tile %d from TIS file: %s\n", tileInfo->pri, tisFile);
+                    return -1;
+                }
+                // reading secondary tile
+                fseek(fp, ofsTiles + tileInfo->sec * TILE_SIZE, SEEK_SET);
+                if (fread(pixels_sec, 1, (size_t)TILE_SIZE, fp) != (size_t)TILE_SIZE) {
+                    TRACE_END("read tiles", TRACE_CAT_IO);
+                    printMsg(OUTPUT_ERR, "Error: Error reading tile %d from TIS file: %s\n", tileInfo->sec, tisFile);
+                    return -1;
+                }
+                STATS_ADD(COUNTER_IO_CALLS, 4);
             }
+            TRACE_END("read tiles", TRACE_CAT_IO);
+            STATS_END(STAGE_READ_TILES, tRead);
+            STATS_ADD(COUNTER_BYTES_READ, 2 * TILE_SIZE);
+            info->bytesRead += 2 * TILE_SIZE;
 
-            // performing tile conversion
-            switch (getMode(param_mode, pixels_pri)) {
-            case MODE_TO_EE:
-                if (!tileToEE(tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out)) return -1;
-                break;
-            case MODE_FROM_EE:
-                if (!tileFromEE(tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out, tisFile)) return -1;
-                break;
-            default:
+            // skipping tile pairs completed by an interrupted run
+            switch (journalCheckPair(job, (int)i, pixels_pri, pixels_sec)) {
+            case JOURNAL_PAIR_DONE:
+                continue;
+            case JOURNAL_PAIR_MODIFIED:
+                printMsg(OUTPUT_ERR, "Error: Tile %d has been modified since the interrupted run. Unable to resume conversion of TIS file: %s\n",
+                         tileInfo->pri, tisFile);
                 return -1;
             }
 
+            // performing tile conversion, outliers of a classified tileset are converted in their own direction
+            int mode = states ? states[i] : getMode(param_mode, pixels_pri);
+            if (!convertTilePair(mode, tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out, pixels_rgba, palCache, info, tisFile)) return -1;
+
+            // recording tile pair before writing it, so that both states are recognized when resuming
+            if (job >= 0) journalPair(job, (int)i, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out);
+
             // writing primary output tile
+            STATS_BEGIN(tWrite);
+            TRACE_BEGIN("write tiles", TRACE_CAT_IO, NULL, -1);
             fseek(fp, ofsTiles + tileInfo->pri * TILE_SIZE, SEEK_SET);
             if (fwrite(pixels_pri_out, 1, (size_t)TILE_SIZE, fp) != (size_t)TILE_SIZE) {
+                TRACE_END("write tiles", TRACE_CAT_IO);
                 printMsg(OUTPUT_ERR, "Error: Error writing tile %d to TIS file: %s\n", tileInfo->pri, tisFile);
                 return -1;
             }
@@ -150,17 +496,418 @@ int convert(const char *wedFile, array_t *searchPath, const char *outputDir) {
             // writing secondary output tile
             fseek(fp, ofsTiles + tileInfo->sec * TILE_SIZE, SEEK_SET);
             if (fwrite(pixels_sec_out, 1, (size_t)TILE_SIZE, fp) != (size_t)TILE_SIZE) {
+                TRACE_END("write tiles", TRACE_CAT_IO);
                 printMsg(OUTPUT_ERR, "Error: Error writing tile %d to TIS file: %s\n", tileInfo->sec, tisFile);
                 return -1;
             }
+            // tile data must be stored before it is read from the mapping or a journaled job is completed
+            if (job >= 0 || map.data) fflush(fp);
+            TRACE_END("write tiles", TRACE_CAT_IO);
+            STATS_END(STAGE_WRITE_TILES, tWrite);
+            STATS_ADD(COUNTER_BYTES_WRITTEN, 2 * TILE_SIZE);
+            info->bytesWritten += 2 * TILE_SIZE;
+            STATS_ADD(COUNTER_IO_CALLS, 4);
+
+            num_processed++;
+        }
+    }
+    printPairSummary(palCache, info);
+
+    // EE tilesets can be stored as PVRZ-based tilesets right away, classic games only support palette-based tilesets
+    bool toClassic = (info->classifiedMode == MODE_FROM_EE) || (info->tilesFromEE > 0);
+    if (param_pvrz && toClassic) {
+        printMsg(OUTPUT_MSG, "Tileset has been converted to classic mode. Keeping palette-based TIS file.\n");
+    } else if (param_pvrz) {
+        fflush(fp);
+        if (!writeTISV2(tisFile, &tileList, tisFile, param_dxt_quality, &info->bytesRead, &info->bytesWritten)) return -1;
+    }
+
+    if (job >= 0) {
+        fflush(fp);
+        journalDone(job);
+    }
+    return num_processed;
+}
+
+
+// Tiles of a stream conversion that are kept in memory.
+typedef struct {
+    uint8_t **tiles;    // tile data of each tile index, NULL if not buffered
+    int count;          // number of tile indices
+} streamtiles_t;
+
+// Internally used. Cleanup function for converted tile data, to be used with "finally".
+static def_cleanFunc(cleanTileData, uint8_t*)
+
+// Internally used. Cleanup function for buffered tiles of a stream conversion, to be used with "finally".
+static void cleanStreamTiles(streamtiles_t *buffer) {
+    if (buffer && buffer->tiles) {
+        for (int i = 0; i < buffer->count; ++i)
+            free(buffer->tiles[i]);
+        free(buffer->tiles);
+        buffer->tiles = NULL;
+    }
+}
+
+// Internally used. Convert the TIS data of "fin" and write it to "fout". Both streams are accessed strictly sequentially.
+// Tile pairs are converted in the mode given by "states" if specified (see classifyTISFile()). If "tileData" is specified,
+// only tile data is stored in a newly allocated buffer instead of "fout". Number of tiles is stored in "numTiles" if specified.
+// Returns number of converted tile pairs, or -1 on error.
+static int streamTiles(const tilevec_t *tileList, const uint8_t *states, FILE *fin, const char *tisSource, FILE *fout, const char *outTarget,
+                       uint8_t **tileData, int *numTiles, jobinfo_t *info) {
+    arena_t arena finally(cleanArena);
+    arenaInit(&arena, 0);
+    uint8_t *tile = arenaAlloc(&arena, TILE_SIZE);
+    if (!evalOp(tile != NULL, "Error: Not enough memory to process tileset.\n")) return -1;
+
+    // TIS header and any data preceding the tiles are passed through unchanged
+    int ofsTiles, tileCount;
+    if (!evalOp(fread(tile, 1, TIS_HEADER_SIZE, fin) == TIS_HEADER_SIZE, "Error: Not a valid TIS file: %s\n", tisSource)) return -1;
+    if (!parseTISHeader(tile, tisSource, &ofsTiles, &tileCount)) return -1;
+    if (!evalOp(ofsTiles >= TIS_HEADER_SIZE && tileCount >= 0, "Error: Not a valid TIS file: %s\n", tisSource)) return -1;
+    bool tilesOnly = (tileData != NULL);
+    uint8_t *outData finally(cleanTileData) = tilesOnly ? malloc((size_t)tileCount * TILE_SIZE + 1) : NULL;
+    if (!evalOp(!tilesOnly || outData != NULL, "Error: Not enough memory to process tileset.\n")) return -1;
+    for (size_t len = TIS_HEADER_SIZE, pos = 0; len > 0; pos += len) {
+        if (!tilesOnly && !evalOp(fwrite(tile, 1, len, fout) == len, "Error: Could not write output stream: %s\n", outTarget)) return -1;
+        len = (ofsTiles - TIS_HEADER_SIZE - pos < TILE_SIZE) ? ofsTiles - TIS_HEADER_SIZE - pos : TILE_SIZE;
+        if (!evalOp(fread(tile, 1, len, fin) == len, "Error: Not a valid TIS file: %s\n", tisSource)) return -1;
+    }
+    info->bytesRead += ofsTiles;
+    if (!tilesOnly) info->bytesWritten += ofsTiles;
+
+    // each tile lists the tile pairs referencing it, a pair is converted when both of its tiles have been read
+    int numPairs = (int)tilevecGetSize(tileList);
+    int *pending = arenaCalloc(&arena, tileCount + 1, sizeof(int));     // unconverted tile pairs referencing the tile
+    int *refStart = arenaCalloc(&arena, tileCount + 2, sizeof(int));    // first entry of the tile in refPairs
+    int *refPairs = arenaAlloc(&arena, (2 * (size_t)numPairs + 1) * sizeof(int));
+    int *missing = arenaAlloc(&arena, ((size_t)numPairs + 1) * sizeof(int));    // number of tiles not read yet
+    if (!evalOp(pending && refStart && refPairs && missing, "Error: Not enough memory to process tileset.\n")) return -1;
+    for (int i = 0; i < numPairs; ++i) {
+        const tile_t *tileInfo = tilevecGetItem(tileList, i);
+        const int refs[2] = { tileInfo->pri, tileInfo->sec };
+        for (int j = 0; j < 2; ++j) {
+            if (refs[j] < 0 || refs[j] >= tileCount) {
+                printMsg(OUTPUT_ERR, "Error: Invalid tile reference %d. Only %d tiles available in TIS file: %s\n", refs[j], tileCount, tisSource);
+                return -1;
+            }
+            pending[refs[j]]++;
+            refStart[refs[j] + 2]++;
+        }
+        missing[i] = 2;
+    }
+    for (int t = 0; t < tileCount; ++t)
+        refStart[t + 2] += refStart[t + 1];
+    for (int i = 0; i < numPairs; ++i) {
+        const tile_t *tileInfo = tilevecGetItem(tileList, i);
+        refPairs[refStart[tileInfo->pri + 1]++] = i;
+        refPairs[refStart[tileInfo->sec + 1]++] = i;
+    }
+
+    uint8_t *pixels_pri = arenaAlloc(&arena, TILE_SIZE);
+    uint8_t *pixels_sec = arenaAlloc(&arena, TILE_SIZE);
+    uint8_t *pixels_pri_out = arenaAlloc(&arena, TILE_SIZE);
+    uint8_t *pixels_sec_out = arenaAlloc(&arena, TILE_SIZE);
+    uint32_t *pixels_rgba = arenaAlloc(&arena, TILE_DIM * TILE_DIM * sizeof(uint32_t));
+    palcache_t *palCache = (param_tile_error >= 0.0) ? arenaAlloc(&arena, sizeof(palcache_t)) : NULL;
+    streamtiles_t buffer finally(cleanStreamTiles) = { calloc(tileCount + 1, sizeof(uint8_t*)), tileCount };
+    if (!pixels_pri || !pixels_sec || !pixels_pri_out || !pixels_sec_out || !pixels_rgba || (param_tile_error >= 0.0 && !palCache) || !buffer.tiles) {
+        printMsg(OUTPUT_ERR, "Error: Not enough memory to process tileset.\n");
+        return -1;
+    }
+    palCacheInit(palCache);
+
+    // tiles are written in order, so tiles following an unconverted tile are buffered until it has been converted
+    int num_processed = 0, next = 0;
+    for (int t = 0; t < tileCount; ++t) {
+        if (isInterrupted()) {
+            printMsg(OUTPUT_ERR, "Error: Conversion interrupted: %s\n", tisSource);
+            return -1;
+        }
+        uint8_t *data = (pending[t] > 0 || next < t) ? malloc(TILE_SIZE) : tile;
+        if (!evalOp(data != NULL, "Error: Not enough memory to process tileset.\n")) return -1;
+        if (data != tile) buffer.tiles[t] = data;
+        STATS_BEGIN(tRead);
+        if (fread(data, 1, TILE_SIZE, fin) != TILE_SIZE) {
+            printMsg(OUTPUT_ERR, "Error: Error reading tile %d from TIS stream: %s\n", t, tisSource);
+            return -1;
+        }
+        STATS_END(STAGE_READ_TILES, tRead);
+        STATS_ADD(COUNTER_BYTES_READ, TILE_SIZE);
+        STATS_ADD(COUNTER_IO_CALLS, 1);
+        info->bytesRead += TILE_SIZE;
 
+        for (int r = refStart[t]; r < refStart[t + 1]; ++r) {
+            int pair = refPairs[r];
+            if (--missing[pair] > 0) continue;
+            const tile_t *tileInfo = tilevecGetItem(tileList, pair);
+            TRACE_SCOPE(traceTile, "tile pair", TRACE_CAT_TILE, NULL, tileInfo->pri);
+            pending[tileInfo->pri]--;
+            pending[tileInfo->sec]--;
+            int mode = states ? states[pair] : getMode(param_mode, buffer.tiles[tileInfo->pri]);
+            memcpy(pixels_pri, buffer.tiles[tileInfo->pri], TILE_SIZE);
+            memcpy(pixels_sec, buffer.tiles[tileInfo->sec], TILE_SIZE);
+            if (!convertTilePair(mode, tileInfo, pixels_pri, pixels_sec, pixels_pri_out, pixels_sec_out, pixels_rgba, palCache, info, tisSource)) return -1;
+            memcpy(buffer.tiles[tileInfo->pri], pixels_pri_out, TILE_SIZE);
+            memcpy(buffer.tiles[tileInfo->sec], pixels_sec_out, TILE_SIZE);
             num_processed++;
         }
+
+        // writing all tiles that are final
+        STATS_BEGIN(tWrite);
+        for (; next <= t && pending[next] == 0; ++next) {
+            const uint8_t *src = buffer.tiles[next] ? buffer.tiles[next] : tile;
+            if (outData) {
+                memcpy(outData + (size_t)next * TILE_SIZE, src, TILE_SIZE);
+            } else if (fwrite(src, 1, TILE_SIZE, fout) != TILE_SIZE) {
+                printMsg(OUTPUT_ERR, "Error: Error writing tile %d to output stream: %s\n", next, outTarget);
+                return -1;
+            }
+            free(buffer.tiles[next]);
+            buffer.tiles[next] = NULL;
+            STATS_ADD(COUNTER_BYTES_WRITTEN, TILE_SIZE);
+            STATS_ADD(COUNTER_IO_CALLS, 1);
+            info->bytesWritten += TILE_SIZE;
+        }
+        STATS_END(STAGE_WRITE_TILES, tWrite);
     }
 
+    // data following the tiles is passed through unchanged
+    size_t len;
+    while (!tilesOnly && (len = fread(tile, 1, TILE_SIZE, fin)) > 0) {
+        if (!evalOp(fwrite(tile, 1, len, fout) == len, "Error: Could not write output stream: %s\n", outTarget)) return -1;
+        info->bytesRead += len;
+        info->bytesWritten += len;
+    }
+    if (!evalOp(!ferror(fin), "Error: Could not read TIS stream: %s\n", tisSource)) return -1;
+    if (!tilesOnly && !evalOp(fflush(fout) == 0 && !ferror(fout), "Error: Could not write output stream: %s\n", outTarget)) return -1;
+    printPairSummary(palCache, info);
+    if (numTiles) *numTiles = tileCount;
+    if (tileData) {
+        *tileData = outData;
+        outData = NULL;
+    }
     return num_processed;
 }
 
+// Internally used. Performs the actual conversion job of convertStream().
+static int convertStreamJob(const char *wedSource, const char *tisSource, const char *outTarget, jobinfo_t *info) {
+    if (!wedSource || !tisSource || !outTarget || !info) {
+        printMsg(OUTPUT_ERR, "Error: Internal error.\n");
+        return -1;
+    }
+    arena_t arena finally(cleanArena);
+    arenaInit(&arena, 0);
+    tilevec_t tileList;
+    if (!evalOp(tilevecInit(&tileList, 1, &arena), "Error: Not enough memory to process tileset.\n")) return -1;
+    snprintf(info->tisSource, sizeof(info->tisSource), "%s", tisSource);
+    snprintf(info->tisFile, sizeof(info->tisFile), "%s", outTarget);
+
+    // WED data is small enough to be read as a whole
+    printMsg(OUTPUT_MSG, "Parsing WED stream \"%s\"...\n", wedSource);
+    FILE *fwed finally(cleanStream) = openStream(wedSource, false);
+    if (!evalOp(fwed != NULL, "Error: Unable to open WED stream: %s\n", wedSource)) return -1;
+    size_t wedSize = 0;
+    uint8_t *wedData finally(cleanMem8) = readStream(fwed, &wedSize);
+    if (!evalOp(wedData != NULL, "Error: Could not read WED stream: %s\n", wedSource)) return -1;
+    info->bytesRead += wedSize;
+    char tisName[15] = {0};
+    if (!parseWEDData(wedData, wedSize, wedSource, tisName, &tileList)) return -1;
+    info->tilePairs = (int)tilevecGetSize(&tileList);
+
+    // converted tileset is written while the TIS stream is read
+    printMsg(OUTPUT_MSG, "Processing TIS stream \"%s\" (%s)...\n", tisSource, tisName);
+    FILE *fin finally(cleanStream) = openStream(tisSource, false);
+    if (!evalOp(fin != NULL, "Error: Unable to open TIS stream: %s\n", tisSource)) return -1;
+    FILE *fout finally(cleanStream) = openStream(outTarget, true);
+    if (!evalOp(fout != NULL, "Error: Unable to open output stream: %s\n", outTarget)) return -1;
+    return streamTiles(&tileList, NULL, fin, tisSource, fout, outTarget, NULL, NULL, info);
+}
+
+int convertStream(const char *wedSource, const char *tisSource, const char *outTarget, jobinfo_t *info) {
+    jobinfo_t jobInfo;
+    if (!info) info = &jobInfo;
+    memset(info, 0, sizeof(jobinfo_t));
+
+    TRACE_SCOPE(traceJob, "convert stream", TRACE_CAT_JOB, wedSource, -1);
+    double wall = clockTime(CLOCK_MONOTONIC), cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+    int retVal = convertStreamJob(wedSource, tisSource, outTarget, info);
+    logSummarize();
+    info->wallTime = clockTime(CLOCK_MONOTONIC) - wall;
+    info->cpuTime = clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    info->success = (retVal >= 0);
+    info->tilesSkipped = info->tilePairs - info->tilesToEE - info->tilesFromEE;
+    return retVal;
+}
+
+
+// Internally used. Performs the actual conversion job of convertTileData().
+static int convertTileDataJob(const char *wedFile, array_t *searchPath, char *tisName, uint8_t **data, int *tileCount, uint64_t *reserved,
+                              jobinfo_t *info) {
+    if (!wedFile || !searchPath || !tisName || !data || !tileCount || !reserved || !info) {
+        printMsg(OUTPUT_ERR, "Error: Internal error.\n");
+        return -1;
+    }
+    arena_t arena finally(cleanArena);
+    arenaInit(&arena, 0);
+    tilevec_t tileList;
+    if (!evalOp(tilevecInit(&tileList, 1, &arena), "Error: Not enough memory to process tileset.\n")) return -1;
+
+    printMsg(OUTPUT_MSG, "Parsing WED file \"%s\"...\n", wedFile);
+    if (!parseWED(wedFile, tisName, &tileList, &arena)) return -1;
+    info->bytesRead += (uint64_t)fileSize(wedFile);
+    info->tilePairs = (int)tilevecGetSize(&tileList);
+    char tisFile[FILENAME_MAX];
+    if (!evalOp(findTISFile(searchPath, tisName, tisFile), "Error: Could not find TIS file: %s\n", tisName)) return -1;
+    strcpy(info->tisSource, tisFile);
+    if (!evalOp(!isTISV2File(tisFile), "Error: PVRZ-based tilesets can't be converted into memory: %s\n", tisFile)) return -1;
+    // reservation includes the converted tile data and is passed on with it
+    uint64_t bytes finally(cleanBudget) = budgetAcquire(estimateMemory(tisFile, true));
+
+    // converted tiles are collected in memory, the source TIS file is only read
+    printMsg(OUTPUT_MSG, "Processing TIS file \"%s\"...\n", tisFile);
+    const uint8_t *states = NULL;
+    if (param_mode == MODE_AUTO && !(states = classifyTISFile(tisFile, &tileList, &arena, info))) return -1;
+    FILE *fin finally(cleanFile) = fopen(tisFile, "rb");
+    if (!evalOp(fin != NULL, "Error: Unable to open TIS file: %s\n", tisFile)) return -1;
+    int retVal = streamTiles(&tileList, states, fin, tisFile, NULL, tisName, data, tileCount, info);
+    if (retVal >= 0) {
+        *reserved = bytes;
+        bytes = 0;
+    }
+    return retVal;
+}
+
+int convertTileData(const char *wedFile, array_t *searchPath, char *tisName, uint8_t **data, int *tileCount, uint64_t *reserved,
+                    jobinfo_t *info) {
+    jobinfo_t jobInfo;
+    if (!info) info = &jobInfo;
+    memset(info, 0, sizeof(jobinfo_t));
+
+    TRACE_SCOPE(traceJob, "convert WED", TRACE_CAT_JOB, wedFile, -1);
+    double wall = clockTime(CLOCK_MONOTONIC), cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+    int retVal = convertTileDataJob(wedFile, searchPath, tisName, data, tileCount, reserved, info);
+    logSummarize();
+    info->wallTime = clockTime(CLOCK_MONOTONIC) - wall;
+    info->cpuTime = clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    info->success = (retVal >= 0);
+    info->tilesSkipped = info->tilePairs - info->tilesToEE - info->tilesFromEE;
+    return retVal;
+}
+
+
+int analyze(const char *wedFile, array_t *searchPath, jobinfo_t *info) {
+    jobinfo_t jobInfo;
+    if (!info) info = &jobInfo;
+    memset(info, 0, sizeof(jobinfo_t));
+    info->analyzed = true;
+    if (!wedFile || !searchPath) {
+        printMsg(OUTPUT_ERR, "Error: Internal error.\n");
+        return -1;
+    }
+
+    TRACE_SCOPE(traceJob, "analyze WED", TRACE_CAT_JOB, wedFile, -1);
+    double wall = clockTime(CLOCK_MONOTONIC), cpu = clockTime(CLOCK_THREAD_CPUTIME_ID);
+    arena_t arena finally(cleanArena);
+    arenaInit(&arena, 0);
+    tilevec_t tileList;
+    if (!tilevecInit(&tileList, 1, &arena)) return -1;
+    char tisName[15] = {0};
+
+    // cataloged results are used as long as WED and TIS files are unchanged
+    const catalogentry_t *entry = catalogFind(wedFile);
+    if (entry && (entry->numPairs == 0 || catalogIsTisCurrent(entry))) {
+        printMsg(OUTPUT_MSG, "Analyzing cataloged WED file \"%s\"...\n", wedFile);
+        strcpy(info->tisSource, catalogGetString(entry->tisPath));
+        strcpy(info->tisFile, info->tisSource);
+        info->tilePairs = (int)entry->numPairs;
+        info->tilesToEE = entry->tilesToEE;
+        info->tilesFromEE = entry->tilesFromEE;
+        printMsg(OUTPUT_MSG, "  Overlay tile pairs: %d (to EE: %d, from EE: %d)\n", info->tilePairs, info->tilesToEE, info->tilesFromEE);
+        info->wallTime = clockTime(CLOCK_MONOTONIC) - wall;
+        info->cpuTime = clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+        info->success = true;
+        return info->tilePairs;
+    }
+
+    printMsg(OUTPUT_MSG, "Analyzing WED file \"%s\"...\n", wedFile);
+    if (!parseWED(wedFile, tisName, &tileList, &arena)) return -1;
+    info->tilePairs = (int)tilevecGetSize(&tileList);
+    info->bytesRead += (uint64_t)fileSize(wedFile);
+    if (!evalOp(findTISFile(searchPath, tisName, info->tisSource), "Error: Could not find TIS file: %s\n", tisName)) return -1;
+    strcpy(info->tisFile, info->tisSource);
+
+    // tiles are only inspected through a read-only mapping
+    tismap_t map finally(cleanTisMap);
+    if (!tisMapOpen(&map, info->tisSource)) return -1;
+    info->bytesRead += TIS_HEADER_SIZE;
+
+    // PVRZ-based tiles are palettized the same way as during conversion
+    pvrzcache_t cache finally(pvrzCacheFree);
+    pvrzCacheInit(&cache, info->tisSource, searchPath);
+    size_t numPairs = tilevecGetSize(&tileList);
+    const uint8_t **primaries = arenaCalloc(&arena, numPairs + 1, sizeof(uint8_t*));
+    uint8_t *states = arenaAlloc(&arena, numPairs + 1);
+    uint32_t *pixels = (map.tileSize == TIS_V2_TILE_SIZE) ? arenaAlloc(&arena, TILE_DIM * TILE_DIM * sizeof(uint32_t)) : NULL;
+    uint8_t *tiles = pixels ? arenaAlloc(&arena, (numPairs + 1) * TILE_SIZE) : NULL;
+    if (!evalOp(primaries && states && (map.tileSize != TIS_V2_TILE_SIZE || tiles), "Error: Not enough memory to process tileset.\n")) return -1;
+    for (size_t i = 0; i < numPairs; ++i) {
+        const tile_t *tileInfo = tilevecGetItem(&tileList, i);
+        if (tileInfo->pri < 0 || tileInfo->pri >= map.tileCount || tileInfo->sec >= map.tileCount) {
+            printMsg(OUTPUT_ERR, "Error: Invalid tile reference (%d, %d). Only %d tiles available in TIS file: %s\n",
+                     tileInfo->pri, tileInfo->sec, map.tileCount, info->tisSource);
+            info->invalidRefs++;
+            continue;
+        }
+        primaries[i] = tisMapGetTile(&map, tileInfo->pri);
+        if (tiles) {
+            uint8_t *tile = tiles + i * TILE_SIZE;
+            if (!pvrzDecodeTile(&cache, primaries[i], pixels) ||
+                !evalOp(createPaletteTile(pixels, tile), "Error: Could not generate palette for tile %d in TIS file: %s\n",
+                        tileInfo->pri, info->tisSource)) return -1;
+            primaries[i] = tile;
+        }
+        info->bytesRead += map.tileSize;
+    }
+
+    // the whole tileset is classified at once
+    tisclass_t tisClass;
+    classifyTileset(primaries, (int)numPairs, states, &tisClass);
+    info->tilesToEE = tisClass.pairsToEE;
+    info->tilesFromEE = tisClass.pairsFromEE;
+    applyClassification(&tisClass, &tileList, info->tisSource, info);
+
+    info->bytesRead += cache.bytesRead;
+    printMsg(OUTPUT_MSG, "  TIS file: %s (%d tiles)\n", info->tisSource, map.tileCount);
+    printMsg(OUTPUT_MSG, "  Overlay tile pairs: %d (to EE: %d, from EE: %d, invalid: %d)\n",
+             info->tilePairs, info->tilesToEE, info->tilesFromEE, info->invalidRefs);
+    if (tisClass.mode != MODE_NONE)
+        printMsg(OUTPUT_MSG, "  Classification: %s (confidence: %.1f%%, outliers: %d%s)\n", (tisClass.mode == MODE_TO_EE) ? "to EE" : "from EE",
+                 100.0 * tisClass.confidence, tisClass.numOutliers, tisClass.ambiguous ? ", ambiguous" : "");
+    info->wallTime = clockTime(CLOCK_MONOTONIC) - wall;
+    info->cpuTime = clockTime(CLOCK_THREAD_CPUTIME_ID) - cpu;
+    info->success = (info->invalidRefs == 0);
+    return info->success ? info->tilePairs : -1;
+}
+
+
+// Internally used. Return whether any pixel of the palette-based tile refers to palette index 0.
+static bool hasIndexZero(const uint8_t *pixels) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (int p = 1024; p < TILE_SIZE; p += 64) {
+        __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pixels + p)), zero);
+        __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pixels + p + 16)), zero);
+        __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pixels + p + 32)), zero);
+        __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(pixels + p + 48)), zero);
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3))))
+            return true;
+    }
+    return false;
+#else
+    return memchr(pixels + 1024, 0, TILE_SIZE - 1024) != NULL;
+#endif
+}
 
 int getMode(int mode, const uint8_t *pixels_pri) {
     switch (mode) {
@@ -169,24 +916,44 @@ int getMode(int mode, const uint8_t *pixels_pri) {
         return mode;
     case MODE_AUTO:
     {
-        int mode2 = MODE_TO_EE;
-        if (pixels_pri) {
-            if (((uint32_t*)pixels_pri)[0] == TRANSPARENT) {
-                for (int i = 1024; i < TILE_SIZE; ++i) {
-                    if (pixels_pri[i] == 0) {
-                        mode2 = MODE_FROM_EE;
-                        break;
-                    }
-                }
-            }
-        }
-        return mode2;
+        if (pixels_pri && ((uint32_t*)pixels_pri)[0] == TRANSPARENT && hasIndexZero(pixels_pri))
+            return MODE_FROM_EE;
+        return MODE_TO_EE;
     }
     default:
         return mode;
     }
 }
 
+void classifyTileset(const uint8_t **primaries, int numPairs, uint8_t *states, tisclass_t *result) {
+    if (!result) return;
+    memset(result, 0, sizeof(tisclass_t));
+    result->mode = MODE_NONE;
+    if (!primaries || !states) return;
+
+    for (int i = 0; i < numPairs; ++i) {
+        states[i] = primaries[i] ? (uint8_t)getMode(MODE_AUTO, primaries[i]) : MODE_NONE;
+        if (states[i] == MODE_TO_EE)
+            result->pairsToEE++;
+        else if (states[i] == MODE_FROM_EE)
+            result->pairsFromEE++;
+    }
+    int total = result->pairsToEE + result->pairsFromEE;
+    if (total == 0) return;
+
+    result->mode = (result->pairsFromEE > result->pairsToEE) ? MODE_FROM_EE : MODE_TO_EE;
+    int agreeing = (result->mode == MODE_FROM_EE) ? result->pairsFromEE : result->pairsToEE;
+    result->confidence = (double)agreeing / total;
+    result->ambiguous = (result->confidence < CLASSIFY_MIN_CONFIDENCE);
+    for (int i = 0; i < numPairs && result->numOutliers < total - agreeing; ++i) {
+        if (states[i] != MODE_NONE && states[i] != result->mode) {
+            if (result->numOutliers < CLASSIFY_MAX_OUTLIERS)
+                result->outliers[result->numOutliers] = i;
+            result->numOutliers++;
+        }
+    }
+}
+
 
 bool tileToEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out) {
     if (!tileInfo || !pixels_pri || !pixels_sec || !pixels_pri_out || !pixels_sec_out) {
@@ -195,7 +962,7 @@ bool tileToEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *
     }
 
     if (param_mode == MODE_AUTO)
-        printMsg(OUTPUT_LOG, "Conversion mode for tiles (%d, %d): classic->EE\n", tileInfo->pri, tileInfo->sec);
+        printMsgLimited(LOG_TILE_MODE, "Conversion mode for tiles (%d, %d): classic->EE\n", tileInfo->pri, tileInfo->sec);
 
     // preparing palette
     memcpy(pixels_pri_out, pixels_pri, TILE_SIZE);
@@ -223,52 +990,60 @@ bool tileToEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *
 }
 
 
-bool tileFromEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out, const char *tisFile) {
-    if (!tileInfo || !pixels_pri || !pixels_sec || !pixels_pri_out || !pixels_sec_out) {
+bool tileFromEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out, uint32_t *pixels_rgba, const char *tisFile) {
+    if (!tileInfo || !pixels_pri || !pixels_sec || !pixels_pri_out || !pixels_sec_out || !pixels_rgba) {
         printMsg(OUTPUT_ERR, "Error: Internal error.\n");
         return false;
     }
 
     if (param_mode == MODE_AUTO)
-        printMsg(OUTPUT_LOG, "Conversion mode for tiles (%d, %d): EE->classic\n", tileInfo->pri, tileInfo->sec);
+        printMsgLimited(LOG_TILE_MODE, "Conversion mode for tiles (%d, %d): EE->classic\n", tileInfo->pri, tileInfo->sec);
 
-    // preparing primary output tile
-    // assembling primary output tile from both input tiles
-    uint32_t *pixels_rgba finally(cleanMem32) = malloc(TILE_DIM * TILE_DIM * sizeof(uint32_t));
     uint32_t *pal_pri = (uint32_t*)pixels_pri;
     uint32_t *pal_sec = (uint32_t*)pixels_sec;
-    bool useTransparent = false;
-#define OPAQUE 0xff000000
-    for (int p = 1024; p < TILE_SIZE; ++p) {
-        if (pixels_pri[p]) {
-            pixels_rgba[p - 1024] = pal_pri[pixels_pri[p]] | OPAQUE;
-        } else if (pixels_sec[p]) {
-            pixels_rgba[p - 1024] = pal_sec[pixels_sec[p]] | OPAQUE;
-        } else {
-            pixels_rgba[p - 1024] = TRANSPARENT | OPAQUE;
-            useTransparent = true;
+    bool exact = false;
+    if (param_tile_error >= 0.0) {
+        // preparing primary output tile from the color histogram of both input tiles if it fits into a single palette:
+        // keys 0..255 refer to the primary palette, 256..511 to the secondary palette, 512 to the transparent color
+        uint16_t keys[4096];
+        int counts[513] = { 0 };
+        for (int p = 0; p < 4096; ++p) {
+            int key = pixels_pri[1024 + p] ? pixels_pri[1024 + p] : (pixels_sec[1024 + p] ? 256 + pixels_sec[1024 + p] : 512);
+            keys[p] = (uint16_t)key;
+            counts[key]++;
         }
-    }
-#undef OPAQUE
-    if (!evalOp(createRemappedTile(pixels_rgba, pixels_pri_out, useTransparent),
-                "Error: Could not generate palette for tile %d in TIS file: %s\n", tileInfo->pri, tisFile)) return false;
 
-    // fixing palette order
-    int colIdx = colorIndex(pixels_pri_out, 256, TRANSPARENT);
-    if (colIdx > 0) {
-        // swapping palette entry
-        uint32_t *pal = (uint32_t*)pixels_pri_out;
-        pal[0] ^= pal[colIdx];
-        pal[colIdx] ^= pal[0];
-        pal[0] ^= pal[colIdx];
-        // swapping color indices
-        for (int p = 1024; p < TILE_SIZE; ++p) {
-            if (pixels_pri_out[p] == 0)
-                pixels_pri_out[p] = colIdx;
-            else if (pixels_pri_out[p] == colIdx)
-                pixels_pri_out[p] = 0;
+        // adding colors in order of appearance
+        colorhist_t hist;
+        int16_t keyToHist[513];
+        memset(keyToHist, 0xff, sizeof(keyToHist));
+        colorHistInit(&hist);
+        for (int p = 0; p < 4096; ++p) {
+            int key = keys[p];
+            if (keyToHist[key] >= 0) continue;
+            uint32_t color = (key < 256) ? pal_pri[key] : ((key < 512) ? pal_sec[key - 256] : TRANSPARENT);
+            keyToHist[key] = (int16_t)colorHistAdd(&hist, color, counts[key], key == 512);
+        }
+
+        // remapping pixels by index lookup
+        exact = (hist.count <= 256);
+        if (exact) {
+            memset(pixels_pri_out, 0, 1024);
+            memcpy(pixels_pri_out, hist.colors, hist.count * sizeof(uint32_t));
+            for (int p = 0; p < 4096; ++p)
+                pixels_pri_out[1024 + p] = (uint8_t)keyToHist[keys[p]];
+            STATS_ADD(COUNTER_QUANT_TIER_EXACT, 1);
         }
     }
+    if (!exact) {
+        // assembling primary output tile from both input tiles, merging colors or quantizing the pixels
+        bool useTransparent = compositeTiles(pixels_pri, pixels_sec, pixels_rgba);
+        if (!evalOp(createRemappedTile(pixels_rgba, pixels_pri_out, useTransparent),
+                    "Error: Could not generate palette for tile %d in TIS file: %s\n", tileInfo->pri, tisFile)) return false;
+    }
+
+    // fixing palette order
+    moveColorToFront(pixels_pri_out, TRANSPARENT);
 
     // preparing secondary output tile
     memcpy(pixels_sec_out, pixels_pri, TILE_SIZE);
@@ -277,8 +1052,8 @@ bool tileFromEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t
 }
 
 
-bool parseWED(const char *wedFile, char *tisName, array_t *tileList) {
-    if (!wedFile || !tisName || !tileList) {
+bool parseWED(const char *wedFile, char *tisName, tilevec_t *tileList, arena_t *arena) {
+    if (!wedFile || !tisName || !tileList || !arena) {
         printMsg(OUTPUT_ERR, "Internal error.\n");
         return false;
     }
@@ -295,16 +1070,29 @@ bool parseWED(const char *wedFile, char *tisName, array_t *tileList) {
     fseek(fp, 0, SEEK_END);
     long file_size = ftell(fp);
     if (!evalOp(file_size >= 0, "Error: Could not read from WED file: %s\n", wedFile)) return false;
-    void *data finally(cleanMem) = malloc(file_size);
+    void *data = arenaAlloc(arena, file_size);
+    if (!evalOp(data != NULL, "Error: Not enough memory to load WED file: %s\n", wedFile)) return false;
     fseek(fp, 0, SEEK_SET);
     if (!evalOp(fread(data, 1, (size_t)file_size, fp) == (size_t)file_size, "Error: Unexpected end of file: %s\n", wedFile)) return false;
+    STATS_ADD(COUNTER_BYTES_READ, file_size);
+    STATS_ADD(COUNTER_IO_CALLS, 5);    // open, seek, tell, seek, read
+
+    return parseWEDData(data, (size_t)file_size, wedFile, tisName, tileList);
+}
+
+
+bool parseWEDData(void *data, size_t size, const char *wedFile, char *tisName, tilevec_t *tileList) {
+    if (!data || !tisName || !tileList) return false;
+    if (!wedFile) wedFile = "(memory)";
 
     // parsing overlay data
     char sig[9] = {0};
     int32_t ofs_ovl;
+    if (!evalOp(size >= 0x20, "Error: Not a valid WED file: %s\n", wedFile)) return false;
     if (!getString(data, 0, 8, sig)) return false;
     if (!evalOp(strcmp(sig, "WED V1.3") == 0, "Error: Not a valid WED file: %s\n", wedFile)) return false;
     if (!getLong(data, 0x10, &ofs_ovl)) return false;
+    if (!evalOp(ofs_ovl >= 0 && (size_t)ofs_ovl + 0x18 <= size, "Error: Invalid overlay data in WED file: %s\n", wedFile)) return false;
 
     // getting TIS filename
     char tisResref[9] = {0};
@@ -320,8 +1108,10 @@ bool parseWED(const char *wedFile, char *tisName, array_t *tileList) {
     if (!getShort(data, ofs_ovl + 2, &num_height)) return false;
     if (!getLong(data, ofs_ovl + 0x10, &ofs_tilemap)) return false;
     if (!getLong(data, ofs_ovl + 0x14, &ofs_lookup)) return false;
-    size_t num_tiles = num_width * num_height;
-    if (arrayExpand(tileList, num_tiles) != num_tiles) {
+    size_t num_tiles = (num_width > 0 && num_height > 0) ? (size_t)num_width * num_height : 0;
+    if (!evalOp(ofs_tilemap >= 0 && ofs_lookup >= 0 && (size_t)ofs_tilemap + num_tiles * 10 <= size,
+                "Error: Invalid overlay data in WED file: %s\n", wedFile)) return false;
+    if (!tilevecReserve(tileList, num_tiles)) {
         printMsg(OUTPUT_ERR, "Error: Not enough memory to process tileset.\n");
         return false;
     }
@@ -333,15 +1123,15 @@ bool parseWED(const char *wedFile, char *tisName, array_t *tileList) {
         if (!getByte(data, ofs + 6, &flags)) return false;
         if (flags) {
             if (!getShort(data, ofs, &tile_pri_idx)) return false;
+            if (!evalOp(tile_pri_idx >= 0 && (size_t)ofs_lookup + tile_pri_idx * 2 + 2 <= size,
+                        "Error: Invalid tile lookup index %d in WED file: %s\n", tile_pri_idx, wedFile)) return false;
             if (!getShort(data, ofs_lookup + tile_pri_idx * 2, &tile_pri)) return false;
             pri = tile_pri;
             sec = tile_sec;
         }
         if (pri != -1 && sec != -1) {
-            tile_t *t = malloc(sizeof(tile_t));
-            t->pri = pri;
-            t->sec = sec;
-            arrayAddItem(tileList, t);
+            tile_t t = { pri, sec };
+            tilevecAdd(tileList, t);
         }
     }
 
@@ -352,22 +1142,37 @@ bool parseWED(const char *wedFile, char *tisName, array_t *tileList) {
 FILE* parseTISFile(const char *tisFile, int *ofsTiles, int *tileCount) {
     if (!tisFile) return NULL;
 
-    char sig[9] = {0};
-    int32_t count, size, ofs, dim;
+    uint8_t header[TIS_HEADER_SIZE];
     FILE *fp = fopen(tisFile, "r+b");
     if (!evalOp(fp != NULL, "Error: Unable to open TIS file: %s\n", tisFile)) return NULL;
-    if (!readString(fp, 0, 8, sig)) { fclose(fp); return NULL; }
-    if (!evalOp(strcmp(sig, "TIS V1  ") == 0, "Error: Not a valid TIS file: %s\n", tisFile)) { fclose(fp); return NULL; }
-    if (!readLong(fp, 0x08, &count)) { fclose(fp); return NULL; }
-    if (!readLong(fp, 0x0c, &size)) { fclose(fp); return NULL; }
-    if (!evalOp(size == TILE_SIZE, "Error: Not a palette-based TIS file: %s\n", tisFile)) { fclose(fp); return NULL; }
-    if (!readLong(fp, 0x10, &ofs)) { fclose(fp); return NULL; }
-    if (!readLong(fp, 0x14, &dim)) { fclose(fp); return NULL; }
-    if (!evalOp(dim == TILE_DIM, "Error: Unexpected tile size: %d\n", dim)) { fclose(fp); return NULL; }
+    if (!evalOp(fread(header, 1, sizeof(header), fp) == sizeof(header), "Error: Not a valid TIS file: %s\n", tisFile)) { fclose(fp); return NULL; }
+    if (!parseTISHeader(header, tisFile, ofsTiles, tileCount)) { fclose(fp); return NULL; }
+
+    STATS_ADD(COUNTER_BYTES_READ, TIS_HEADER_SIZE);
+    STATS_ADD(COUNTER_IO_CALLS, 2);    // open, read
+
+    return fp;
+}
+
+
+bool parseTISHeader(const uint8_t *header, const char *tisFile, int *ofsTiles, int *tileCount) {
+    if (!header) return false;
+
+    char sig[9] = {0};
+    int32_t count, size, ofs, dim;
+    void *ptr = (void*)header;
+    getString(ptr, 0, 8, sig);
+    if (!evalOp(strcmp(sig, "TIS V1  ") == 0, "Error: Not a valid TIS file: %s\n", tisFile)) return false;
+    getLong(ptr, 0x08, &count);
+    getLong(ptr, 0x0c, &size);
+    if (!evalOp(size == TILE_SIZE, "Error: Not a palette-based TIS file: %s\n", tisFile)) return false;
+    getLong(ptr, 0x10, &ofs);
+    getLong(ptr, 0x14, &dim);
+    if (!evalOp(dim == TILE_DIM, "Error: Unexpected tile size: %d\n", dim)) return false;
 
     if (tileCount) *tileCount = count;
     if (ofsTiles) *ofsTiles = ofs;
-    return fp;
+    return true;
 }
 
 
@@ -1,9 +1,75 @@
 #ifndef TIS2OVL_H_INCLUDED
 #define TIS2OVL_H_INCLUDED
 
+#include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include "global.h"
 #include "arrays.h"
+#include "vector.h"
+#include "arena.h"
+
+/// Size of a single palette-based tile in bytes (palette + pixel data).
+#define TILE_SIZE 5120
+/// Width and height of a tile in pixels.
+#define TILE_DIM 64
+/// Size of the TIS file header in bytes.
+#define TIS_HEADER_SIZE 0x18
+
+/// Palette entry of the transparent color (BGRA).
+#define TRANSPARENT 0x0000ff00
+
+/// Min. share of overlay tile pairs agreeing with the conversion state of a tileset. Tilesets below are ambiguous.
+#define CLASSIFY_MIN_CONFIDENCE 0.9
+/// Max. number of outlier tile pairs listed by classifyTileset().
+#define CLASSIFY_MAX_OUTLIERS 16
+
+/// Primary and secondary tile index of an overlay cell.
+typedef struct {
+    int pri, sec;
+} tile_t;
+
+/// Contiguous list of tile_t elements.
+def_vector(tilevec, tile_t)
+
+/// Conversion state of a whole tileset (see classifyTileset()).
+typedef struct {
+    int mode;                               // conversion mode of the tileset, MODE_NONE if no tile pairs were classified
+    int pairsToEE;                          // tile pairs in classic state
+    int pairsFromEE;                        // tile pairs in EE state
+    double confidence;                      // share of classified tile pairs agreeing with "mode"
+    int numOutliers;                        // number of tile pairs disagreeing with "mode"
+    int outliers[CLASSIFY_MAX_OUTLIERS];    // indices of the first outlier tile pairs
+    bool ambiguous;                         // whether confidence is below CLASSIFY_MIN_CONFIDENCE
+} tisclass_t;
+
+/// Result information of a single conversion job.
+typedef struct {
+    char tisSource[FILENAME_MAX];   // resolved path of the source TIS file
+    char tisFile[FILENAME_MAX];     // resolved path of the processed TIS file
+    int tilePairs;              // number of overlay tile pairs defined by the WED file
+    int tilesToEE;              // tile pairs converted from classic to EE
+    int tilesFromEE;            // tile pairs converted from EE to classic
+    int tilesSkipped;           // tile pairs not processed
+    int tilesCached;            // tile pairs converted from EE by cached palettes (included in tilesFromEE)
+    int quantizerCalls;         // number of quantizer backend invocations (tier 3)
+    int quantizerErrors;        // number of tile pairs that could not be quantized
+    int invalidRefs;            // tile references out of range of the TIS file
+    int fidelityTiles;          // tile pairs measured by --fidelity
+    uint64_t squaredError;      // sum of squared color component differences of all measured tile pairs
+    double minPsnr;             // PSNR of the worst measured tile pair in dB
+    double maxPixelError;       // largest color error of a single pixel on a 0-255 scale
+    int classifiedMode;         // conversion mode of the whole tileset, MODE_NONE if not classified
+    int outliers;               // tile pairs disagreeing with the classified mode
+    double confidence;          // share of tile pairs agreeing with the classified mode
+    bool ambiguous;             // whether the classified mode is below CLASSIFY_MIN_CONFIDENCE
+    uint64_t bytesRead;         // bytes read from WED and TIS files
+    uint64_t bytesWritten;      // bytes written to TIS files
+    double wallTime;            // elapsed time in seconds
+    double cpuTime;             // CPU time of the processing thread in seconds
+    bool success;               // whether conversion finished successfully
+    bool analyzed;              // whether job was only analyzed (tile counts refer to required conversions)
+} jobinfo_t;
 
 /// Print usage information.
 void printHelp(const char *name);
@@ -11,8 +77,70 @@ void printHelp(const char *name);
 /// Print version information.
 void printVersion();
 
-/// Performs tileset conversion based on "mode".
-int convert(const char *wedFile, array_t *searchPath, const char *outputDir);
+/// Performs tileset conversion based on "mode". Job results are stored in "info" if specified.
+/// Returns number of converted tile pairs, or -1 on error.
+int convert(const char *wedFile, array_t *searchPath, const char *outputDir, jobinfo_t *info);
+
+/// Performs tileset conversion of streams (see openStream()) based on "mode". The TIS stream is read strictly sequentially.
+/// Only tiles of tile pairs that are not converted yet and the tiles following them are kept in memory. The converted
+/// tileset is written to "outTarget". Job results are stored in "info" if specified.
+/// Returns number of converted tile pairs, or -1 on error.
+int convertStream(const char *wedSource, const char *tisSource, const char *outTarget, jobinfo_t *info);
+
+/// Performs tileset conversion based on "mode" without modifying any files. The converted tile data (without TIS header)
+/// is stored in a newly allocated buffer "data" of "tileCount" tiles, to be released by free(). The TIS filename
+/// referenced by the WED file is stored in "tisName" (at least 15 bytes). The memory budget reserved for the tileset
+/// (see budgetAcquire()) is stored in "reserved", to be released by budgetRelease() after "data" has been freed.
+/// Job results are stored in "info" if specified.
+/// Returns number of converted tile pairs, or -1 on error.
+int convertTileData(const char *wedFile, array_t *searchPath, char *tisName, uint8_t **data, int *tileCount, uint64_t *reserved,
+                    jobinfo_t *info);
+
+/// Analyzes tileset referenced by WED file without modifying any files. Detected conversion directions are stored in "info".
+/// Returns number of overlay tile pairs, or -1 on error.
+int analyze(const char *wedFile, array_t *searchPath, jobinfo_t *info);
+
+
+/// Detect conversion mode from pixel data of the primary tile.
+int getMode(int mode, const uint8_t *pixels_pri);
+
+/**
+ * Detect the conversion state of a whole tileset in a single pass over the primary tiles of all overlay tile pairs.
+ * The tileset is classified by the state of the majority of tile pairs, ties are resolved in favor of MODE_TO_EE.
+ * \param primaries    Palette-based primary tile of each tile pair. NULL for tile pairs to ignore.
+ * \param numPairs     Number of tile pairs.
+ * \param states       Receives the conversion mode detected for each tile pair, MODE_NONE for ignored tile pairs.
+ * \param result       Receives the classification of the tileset.
+ */
+void classifyTileset(const uint8_t **primaries, int numPairs, uint8_t *states, tisclass_t *result);
+
+/// Convert a single tile pair from classic to EE mode.
+bool tileToEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out);
+
+/// Convert a single tile pair from EE to classic mode. If quantization tiers are enabled, tile pairs with no more than 256
+/// distinct colors take their palette from the combined color histogram of both input tiles. Other tile pairs are
+/// quantized per pixel (see createRemappedTile()). "pixels_rgba" is scratch space for 64x64 truecolor pixels.
+bool tileFromEE(const tile_t *tileInfo, const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint8_t *pixels_pri_out, uint8_t *pixels_sec_out,
+                uint32_t *pixels_rgba, const char *tisFile);
+
+/// Composite an EE tile pair into 64x64 opaque BGRA pixels. Transparent pixels are set to TRANSPARENT.
+/// Returns whether transparent pixels are present.
+bool compositeTiles(const uint8_t *pixels_pri, const uint8_t *pixels_sec, uint32_t *pixels_rgba);
+
+/// Retrieve TIS filename and overlay tile pairs from WED file. Transient data is allocated from "arena".
+bool parseWED(const char *wedFile, char *tisName, tilevec_t *tileList, arena_t *arena);
+
+/// Retrieve TIS filename and overlay tile pairs from "size" bytes of WED data in memory. "wedFile" is only used for log messages.
+bool parseWEDData(void *data, size_t size, const char *wedFile, char *tisName, tilevec_t *tileList);
+
+/// Open TIS file for reading and writing and retrieve header information. Returns NULL on error.
+FILE* parseTISFile(const char *tisFile, int *ofsTiles, int *tileCount);
+
+/// Validate TIS header data and retrieve header information. "tisFile" is only used for log messages.
+bool parseTISHeader(const uint8_t *header, const char *tisFile, int *ofsTiles, int *tileCount);
+
+/// Store full path of TIS file based on given search path list and TIS filename.
+bool findTISFile(array_t *searchPath, const char *tisName, char *tisFile);
 
 
 /// Performs tileset conversion from classic into EE format.
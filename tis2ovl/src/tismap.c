@@ -0,0 +1,123 @@
+#include <string.h>
+#include "compat.h"
+#include "functions.h"
+#include "tis2ovl.h"
+#include "tismap.h"
+#include "tisv2.h"
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+bool tisMapOpen(tismap_t *map, const char *tisFile) {
+    if (!map || !tisFile) return false;
+    memset(map, 0, sizeof(tismap_t));
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFile(tisFile, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (!evalOp(hFile != INVALID_HANDLE_VALUE, "Error: Unable to open TIS file: %s\n", tisFile)) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0) {
+        CloseHandle(hFile);
+        printMsg(OUTPUT_ERR, "Error: Not a valid TIS file: %s\n", tisFile);
+        return false;
+    }
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *data = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data) {
+        if (hMapping) CloseHandle(hMapping);
+        CloseHandle(hFile);
+        printMsg(OUTPUT_ERR, "Error: Unable to map TIS file: %s\n", tisFile);
+        return false;
+    }
+    map->hFile = hFile;
+    map->hMapping = hMapping;
+    map->data = data;
+    map->size = (size_t)size.QuadPart;
+    map->mapped = true;
+#else
+    int fd = open(tisFile, O_RDONLY);
+    if (!evalOp(fd >= 0, "Error: Unable to open TIS file: %s\n", tisFile)) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        printMsg(OUTPUT_ERR, "Error: Not a valid TIS file: %s\n", tisFile);
+        return false;
+    }
+    map->size = (size_t)st.st_size;
+    void *data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        map->data = data;
+        map->mapped = true;
+    } else {
+        // fall back to reading the whole file
+        uint8_t *buf = malloc(map->size);
+        size_t len = 0;
+        while (buf && len < map->size) {
+            ssize_t n = read(fd, buf + len, map->size - len);
+            if (n <= 0) break;
+            len += (size_t)n;
+        }
+        if (!buf || len != map->size) {
+            free(buf);
+            close(fd);
+            printMsg(OUTPUT_ERR, "Error: Could not read TIS file: %s\n", tisFile);
+            return false;
+        }
+        map->data = buf;
+    }
+    close(fd);
+#endif
+
+    if (!evalOp(map->size >= TIS_HEADER_SIZE, "Error: Not a valid TIS file: %s\n", tisFile)) {
+        tisMapClose(map);
+        return false;
+    }
+    if (isTISV2(map->data)) {
+        // tile records of PVRZ-based tilesets
+        int32_t count, ofs;
+        getLong((void*)map->data, 0x08, &count);
+        getLong((void*)map->data, 0x10, &ofs);
+        map->tileCount = count;
+        map->ofsTiles = ofs;
+        map->tileSize = TIS_V2_TILE_SIZE;
+    } else if (parseTISHeader(map->data, tisFile, &map->ofsTiles, &map->tileCount)) {
+        map->tileSize = TILE_SIZE;
+    } else {
+        tisMapClose(map);
+        return false;
+    }
+    if (map->ofsTiles < 0 || map->tileCount < 0 ||
+        (uint64_t)map->ofsTiles + (uint64_t)map->tileCount * map->tileSize > map->size) {
+        printMsg(OUTPUT_ERR, "Error: TIS file is truncated: %s\n", tisFile);
+        tisMapClose(map);
+        return false;
+    }
+    return true;
+}
+
+void tisMapClose(tismap_t *map) {
+    if (map && map->data) {
+        if (map->mapped) {
+#ifdef _WIN32
+            UnmapViewOfFile(map->data);
+            CloseHandle(map->hMapping);
+            CloseHandle(map->hFile);
+#else
+            munmap((void*)map->data, map->size);
+#endif
+        } else {
+            free((void*)map->data);
+        }
+        memset(map, 0, sizeof(tismap_t));
+    }
+}
+
+void cleanTisMap(tismap_t *map) {
+    tisMapClose(map);
+}
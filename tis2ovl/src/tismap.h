@@ -0,0 +1,35 @@
+#ifndef TISMAP_H_INCLUDED
+#define TISMAP_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Read-only memory mapping of a TIS file.
+typedef struct {
+    const uint8_t *data;    // file content
+    size_t size;            // file size in bytes
+    int tileCount;          // number of tiles in the TIS file
+    int ofsTiles;           // offset to tile data
+    int tileSize;           // size of a single tile in bytes (palette-based tile or PVRZ tile record)
+    bool mapped;            // whether data is memory-mapped (otherwise allocated)
+#ifdef _WIN32
+    void *hFile, *hMapping;
+#endif
+} tismap_t;
+
+/// Map specified TIS file read-only into memory and validate its header. Returns success state.
+bool tisMapOpen(tismap_t *map, const char *tisFile);
+
+/// Release the mapping. Mapping can't be used until opened again by tisMapOpen().
+void tisMapClose(tismap_t *map);
+
+/// Return pointer to palette and pixel data (or PVRZ tile record) of the specified tile. Returns NULL if out of range.
+static inline const uint8_t* tisMapGetTile(const tismap_t *map, int index) {
+    return (map && map->data && index >= 0 && index < map->tileCount) ? map->data + map->ofsTiles + (size_t)index * map->tileSize : NULL;
+}
+
+/// Cleanup function for mapping variables, to be used with "finally".
+void cleanTisMap(tismap_t *map);
+
+#endif // TISMAP_H_INCLUDED
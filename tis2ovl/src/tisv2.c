@@ -0,0 +1,888 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+#include "compat.h"
+#include "functions.h"
+#include "colors.h"
+#include "stats.h"
+#include "trace.h"
+#include "budget.h"
+#include "tis2ovl.h"
+#include "tismap.h"
+#include "tisv2.h"
+
+// Signature of PVR version 3 files
+#define PVR3_SIGNATURE  0x03525650
+// Size of the PVR version 3 header
+#define PVR3_HEADER_SIZE 0x34
+// Number of tile records read at once from PVRZ-based TIS files
+#define TIS_V2_RECORD_CHUNK 1024
+
+def_cleanFunc(cleanPixels, uint32_t*)
+def_cleanFunc(cleanMemInt, int*)
+
+bool isTISV2(const uint8_t *header) {
+    if (!header) return false;
+    int32_t size = 0;
+    getLong((void*)header, 0x0c, &size);
+    return (memcmp(header, "TIS V1  ", 8) == 0 && size == TIS_V2_TILE_SIZE);
+}
+
+bool isTISV2File(const char *tisFile) {
+    if (!tisFile) return false;
+    FILE *fp finally(cleanFile) = fopen(tisFile, "rb");
+    uint8_t header[TIS_HEADER_SIZE];
+    return (fp && fread(header, 1, sizeof(header), fp) == sizeof(header) && isTISV2(header));
+}
+
+// Internally used. Store name of the PVRZ files without page number for the given TIS file, e.g. "ar0100.tis" -> "a0100".
+static void getPVRZBaseName(const char *tisFile, char *baseName) {
+    memset(baseName, 0, 16);
+    const char *name = strrchr(tisFile, '/');
+    name = name ? name + 1 : tisFile;
+    size_t len = strcspn(name, ".");
+    if (len > 8) len = 8;
+    if (len > 0) {
+        baseName[0] = name[0];
+        if (len > 2)
+            memcpy(baseName + 1, name + 2, len - 2);
+    }
+    lowerString(baseName);
+}
+
+void pvrzCacheInit(pvrzcache_t *cache, const char *tisName, array_t *searchPath) {
+    if (!cache) return;
+    memset(cache, 0, sizeof(pvrzcache_t));
+    for (int i = 0; i < PVRZ_CACHE_PAGES; ++i)
+        cache->pages[i].page = -1;
+    cache->capacity = budgetScale(PVRZ_CACHE_PAGES, PVRZ_PAGE_SIZE);
+    cache->searchPath = searchPath;
+    if (tisName)
+        getPVRZBaseName(tisName, cache->baseName);
+}
+
+void pvrzCacheFree(pvrzcache_t *cache) {
+    if (!cache) return;
+    for (int i = 0; i < PVRZ_CACHE_PAGES; ++i) {
+        free(cache->pages[i].data);
+        cache->pages[i].data = NULL;
+        cache->pages[i].page = -1;
+    }
+}
+
+// Internally used. Load and decompress the given PVRZ file into the page structure.
+static bool loadPVRZ(const char *fileName, pvrzpage_t *page, uint64_t *bytesRead) {
+    TRACE_SCOPE(tracePage, "load PVRZ", TRACE_CAT_IO, fileName, -1);
+    int64_t fileSize2 = fileSize(fileName);
+    if (!evalOp(fileSize2 > 4, "Error: Not a valid PVRZ file: %s\n", fileName)) return false;
+    FILE *fp finally(cleanFile) = fopen(fileName, "rb");
+    if (!evalOp(fp != NULL, "Error: Unable to open PVRZ file: %s\n", fileName)) return false;
+    uint8_t *input finally(cleanMem8) = malloc((size_t)fileSize2);
+    if (!evalOp(input != NULL, "Error: Not enough memory to load PVRZ file: %s\n", fileName)) return false;
+    if (!evalOp(fread(input, 1, (size_t)fileSize2, fp) == (size_t)fileSize2, "Error: Could not read PVRZ file: %s\n", fileName)) return false;
+    STATS_ADD(COUNTER_BYTES_READ, fileSize2);
+    STATS_ADD(COUNTER_IO_CALLS, 2);
+    if (bytesRead) *bytesRead += (uint64_t)fileSize2;
+
+    // decompressing PVR data
+    int32_t size32 = 0;
+    getLong(input, 0, &size32);
+    uLongf size = (uint32_t)size32;
+    if (!evalOp(size > PVR3_HEADER_SIZE, "Error: Not a valid PVRZ file: %s\n", fileName)) return false;
+    uint8_t *data = malloc(size);
+    if (!evalOp(data != NULL, "Error: Not enough memory to load PVRZ file: %s\n", fileName)) return false;
+    if (uncompress(data, &size, input + 4, (uLong)(fileSize2 - 4)) != Z_OK || size <= PVR3_HEADER_SIZE) {
+        free(data);
+        printMsg(OUTPUT_ERR, "Error: Could not decompress PVRZ file: %s\n", fileName);
+        return false;
+    }
+
+    // validating PVR header
+    int32_t sig, formatLo, formatHi, height, width, metaSize;
+    getLong(data, 0x00, &sig);
+    getLong(data, 0x08, &formatLo);
+    getLong(data, 0x0c, &formatHi);
+    getLong(data, 0x18, &height);
+    getLong(data, 0x1c, &width);
+    getLong(data, 0x30, &metaSize);
+    int blockSize = (formatLo == PVR_DXT1) ? 8 : 16;
+    size_t ofs = PVR3_HEADER_SIZE + (size_t)(uint32_t)metaSize;
+    if (sig != PVR3_SIGNATURE || formatHi != 0 || (formatLo != PVR_DXT1 && formatLo != PVR_DXT5) ||
+        width <= 0 || height <= 0 || (width & 3) || (height & 3) ||
+        ofs > size || (size - ofs) / blockSize < (size_t)(width / 4) * (size_t)(height / 4)) {
+        free(data);
+        printMsg(OUTPUT_ERR, "Error: Unsupported PVRZ file: %s\n", fileName);
+        return false;
+    }
+    memmove(data, data + ofs, size - ofs);
+
+    page->width = width;
+    page->height = height;
+    page->format = formatLo;
+    page->data = data;
+    return true;
+}
+
+// Internally used. Return the requested page from the cache. Page is loaded if needed.
+static pvrzpage_t* getPage(pvrzcache_t *cache, int page) {
+    cache->counter++;
+    pvrzpage_t *slot = &cache->pages[0];
+    for (int i = 0; i < cache->capacity; ++i) {
+        pvrzpage_t *p = &cache->pages[i];
+        if (p->page == page) {
+            p->lastUsed = cache->counter;
+            return p;
+        }
+        if (p->lastUsed < slot->lastUsed)
+            slot = p;
+    }
+
+    // replacing least recently used page
+    free(slot->data);
+    memset(slot, 0, sizeof(pvrzpage_t));
+    slot->page = -1;
+    char pvrzName[32], pvrzFile[FILENAME_MAX];
+    snprintf(pvrzName, sizeof(pvrzName), "%s%02d.pvrz", cache->baseName, page);
+    if (!evalOp(findTISFile(cache->searchPath, pvrzName, pvrzFile), "Error: Could not find PVRZ file: %s\n", pvrzName)) return NULL;
+    if (!loadPVRZ(pvrzFile, slot, &cache->bytesRead)) return NULL;
+    slot->page = page;
+    slot->lastUsed = cache->counter;
+    return slot;
+}
+
+bool pvrzDecodeTile(pvrzcache_t *cache, const uint8_t *record, uint32_t *pixels) {
+    if (!cache || !record || !pixels) return false;
+    int32_t pageIndex, x, y;
+    getLong((void*)record, 0, &pageIndex);
+    getLong((void*)record, 4, &x);
+    getLong((void*)record, 8, &y);
+    if (pageIndex < 0) {
+        // tile without page reference is solid black
+        for (int i = 0; i < TILE_DIM * TILE_DIM; ++i)
+            pixels[i] = 0xff000000;
+        return true;
+    }
+
+    pvrzpage_t *page = getPage(cache, pageIndex);
+    if (!page) return false;
+    if (!evalOp(x >= 0 && y >= 0 && !(x & 3) && !(y & 3) && x + TILE_DIM <= page->width && y + TILE_DIM <= page->height,
+                "Error: Invalid tile location (%d, %d) in PVRZ page %d\n", x, y, pageIndex)) return false;
+
+    // only blocks covered by the tile are decoded
+    int blocksPerRow = page->width / 4;
+    int blockSize = (page->format == PVR_DXT1) ? 8 : 16;
+    for (int by = 0; by < TILE_DIM / 4; ++by) {
+        const uint8_t *block = page->data + ((size_t)(y / 4 + by) * blocksPerRow + x / 4) * blockSize;
+        for (int bx = 0; bx < TILE_DIM / 4; ++bx, block += blockSize) {
+            uint32_t *dst = pixels + by * 4 * TILE_DIM + bx * 4;
+            if (page->format == PVR_DXT1)
+                dxt1DecodeBlock(block, dst, TILE_DIM);
+            else
+                dxt5DecodeBlock(block, dst, TILE_DIM);
+        }
+    }
+    return true;
+}
+
+// Internally used. Expand RGB565 color to opaque BGRA.
+static inline uint32_t expand565(uint16_t c) {
+    uint32_t r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+// Internally used. Return weighted mix of two opaque BGRA colors.
+static inline uint32_t mixColors(uint32_t c1, uint32_t c2, int w1, int w2, int div) {
+    uint32_t retVal = 0xff000000;
+    for (int shift = 0; shift < 24; shift += 8) {
+        uint32_t v = (((c1 >> shift) & 0xff) * w1 + ((c2 >> shift) & 0xff) * w2) / div;
+        retVal |= v << shift;
+    }
+    return retVal;
+}
+
+// Internally used. Decode color part of a DXT block. "punchThrough" enables DXT1 mode with transparent color.
+static void decodeColorBlock(const uint8_t *block, uint32_t *pixels, int stride, bool punchThrough) {
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    uint32_t colors[4];
+    colors[0] = expand565(c0);
+    colors[1] = expand565(c1);
+    if (c0 > c1 || !punchThrough) {
+        colors[2] = mixColors(colors[0], colors[1], 2, 1, 3);
+        colors[3] = mixColors(colors[0], colors[1], 1, 2, 3);
+    } else {
+        colors[2] = mixColors(colors[0], colors[1], 1, 1, 2);
+        colors[3] = 0;
+    }
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    for (int i = 0; i < 16; ++i, indices >>= 2)
+        pixels[(i >> 2) * stride + (i & 3)] = colors[indices & 3];
+}
+
+void dxt1DecodeBlock(const uint8_t *block, uint32_t *pixels, int stride) {
+    if (!block || !pixels) return;
+    decodeColorBlock(block, pixels, stride, true);
+}
+
+void dxt5DecodeBlock(const uint8_t *block, uint32_t *pixels, int stride) {
+    if (!block || !pixels) return;
+    decodeColorBlock(block + 8, pixels, stride, false);
+
+    int a0 = block[0], a1 = block[1];
+    uint32_t alpha[8] = { a0, a1 };
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i)
+            alpha[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (int i = 1; i < 5; ++i)
+            alpha[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (int i = 7; i >= 2; --i)
+        indices = (indices << 8) | block[i];
+    for (int i = 0; i < 16; ++i, indices >>= 3) {
+        uint32_t *p = &pixels[(i >> 2) * stride + (i & 3)];
+        *p = (*p & 0x00ffffff) | (alpha[indices & 7] << 24);
+    }
+}
+
+// Pixels of a 4x4 block prepared for DXT encoding
+typedef struct {
+    int16_t r[16], g[16], b[16];    // color components of opaque pixels
+    uint32_t transparent;           // bit mask of transparent pixels
+} dxtblock_t;
+
+// Internally used. Reduce color components to RGB565.
+static inline uint16_t packColor565(float r, float g, float b) {
+    int r5 = (int)(r * 31.0f / 255.0f + 0.5f), g6 = (int)(g * 63.0f / 255.0f + 0.5f), b5 = (int)(b * 31.0f / 255.0f + 0.5f);
+    r5 = (r5 < 0) ? 0 : (r5 > 31) ? 31 : r5;
+    g6 = (g6 < 0) ? 0 : (g6 > 63) ? 63 : g6;
+    b5 = (b5 < 0) ? 0 : (b5 > 31) ? 31 : b5;
+    return (uint16_t)((r5 << 11) | (g6 << 5) | b5);
+}
+
+// Internally used. Select nearest palette entry for every opaque pixel. Stores 2-bit indices and returns the squared error.
+static uint32_t selectIndices(const dxtblock_t *blk, const uint32_t *palette, int numColors, uint32_t *indices) {
+    int32_t dist[16], best[16];
+#ifdef __SSE2__
+    for (int half = 0; half < 16; half += 8) {
+        __m128i r = _mm_loadu_si128((const __m128i*)(blk->r + half));
+        __m128i g = _mm_loadu_si128((const __m128i*)(blk->g + half));
+        __m128i b = _mm_loadu_si128((const __m128i*)(blk->b + half));
+        __m128i minLo = _mm_set1_epi32(INT32_MAX), minHi = minLo, idxLo = _mm_setzero_si128(), idxHi = idxLo;
+        for (int k = 0; k < numColors; ++k) {
+            __m128i dr = _mm_sub_epi16(r, _mm_set1_epi16((palette[k] >> 16) & 0xff));
+            __m128i dg = _mm_sub_epi16(g, _mm_set1_epi16((palette[k] >> 8) & 0xff));
+            __m128i db = _mm_sub_epi16(b, _mm_set1_epi16(palette[k] & 0xff));
+            // squares of 16-bit differences are expanded to 32 bits
+            __m128i lo, hi, dLo, dHi;
+            lo = _mm_mullo_epi16(dr, dr); hi = _mm_mulhi_epi16(dr, dr);
+            dLo = _mm_unpacklo_epi16(lo, hi); dHi = _mm_unpackhi_epi16(lo, hi);
+            lo = _mm_mullo_epi16(dg, dg); hi = _mm_mulhi_epi16(dg, dg);
+            dLo = _mm_add_epi32(dLo, _mm_unpacklo_epi16(lo, hi)); dHi = _mm_add_epi32(dHi, _mm_unpackhi_epi16(lo, hi));
+            lo = _mm_mullo_epi16(db, db); hi = _mm_mulhi_epi16(db, db);
+            dLo = _mm_add_epi32(dLo, _mm_unpacklo_epi16(lo, hi)); dHi = _mm_add_epi32(dHi, _mm_unpackhi_epi16(lo, hi));
+            __m128i k4 = _mm_set1_epi32(k);
+            __m128i ltLo = _mm_cmplt_epi32(dLo, minLo), ltHi = _mm_cmplt_epi32(dHi, minHi);
+            minLo = _mm_or_si128(_mm_and_si128(ltLo, dLo), _mm_andnot_si128(ltLo, minLo));
+            minHi = _mm_or_si128(_mm_and_si128(ltHi, dHi), _mm_andnot_si128(ltHi, minHi));
+            idxLo = _mm_or_si128(_mm_and_si128(ltLo, k4), _mm_andnot_si128(ltLo, idxLo));
+            idxHi = _mm_or_si128(_mm_and_si128(ltHi, k4), _mm_andnot_si128(ltHi, idxHi));
+        }
+        _mm_storeu_si128((__m128i*)(dist + half), minLo);
+        _mm_storeu_si128((__m128i*)(dist + half + 4), minHi);
+        _mm_storeu_si128((__m128i*)(best + half), idxLo);
+        _mm_storeu_si128((__m128i*)(best + half + 4), idxHi);
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        dist[i] = INT32_MAX;
+        best[i] = 0;
+        for (int k = 0; k < numColors; ++k) {
+            int dr = blk->r[i] - (int)((palette[k] >> 16) & 0xff);
+            int dg = blk->g[i] - (int)((palette[k] >> 8) & 0xff);
+            int db = blk->b[i] - (int)(palette[k] & 0xff);
+            int d = dr * dr + dg * dg + db * db;
+            if (d < dist[i]) {
+                dist[i] = d;
+                best[i] = k;
+            }
+        }
+    }
+#endif
+
+    uint32_t error = 0, bits = 0;
+    for (int i = 15; i >= 0; --i) {
+        if (blk->transparent & (1u << i)) {
+            bits = (bits << 2) | 3;
+        } else {
+            bits = (bits << 2) | (uint32_t)best[i];
+            error += (uint32_t)dist[i];
+        }
+    }
+    *indices = bits;
+    return error;
+}
+
+// Internally used. Encode block with the given endpoints. Endpoints are reordered as required by the block mode.
+// Returns squared error of the encoded block.
+static uint32_t encodeEndpoints(const dxtblock_t *blk, uint16_t c0, uint16_t c1, uint8_t *block) {
+    uint32_t palette[4];
+    int numColors;
+    if (blk->transparent || c0 == c1) {
+        // three colors and transparent black
+        if (c0 > c1) { uint16_t t = c0; c0 = c1; c1 = t; }
+        palette[0] = expand565(c0);
+        palette[1] = expand565(c1);
+        palette[2] = mixColors(palette[0], palette[1], 1, 1, 2);
+        numColors = 3;
+    } else {
+        if (c0 < c1) { uint16_t t = c0; c0 = c1; c1 = t; }
+        palette[0] = expand565(c0);
+        palette[1] = expand565(c1);
+        palette[2] = mixColors(palette[0], palette[1], 2, 1, 3);
+        palette[3] = mixColors(palette[0], palette[1], 1, 2, 3);
+        numColors = 4;
+    }
+    uint32_t indices;
+    uint32_t error = selectIndices(blk, palette, numColors, &indices);
+    block[0] = c0 & 0xff; block[1] = c0 >> 8;
+    block[2] = c1 & 0xff; block[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = (indices >> (i * 8)) & 0xff;
+    return error;
+}
+
+// Internally used. Compute endpoints from the bounding box of the opaque pixels, inset by 1/16 of the range.
+// The box diagonal is chosen by the correlation of each component with the component of largest range.
+static void fitBoundingBox(const dxtblock_t *blk, float *e0, float *e1) {
+    int mn[3] = { 255, 255, 255 }, mx[3] = { 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        if (blk->transparent & (1u << i)) continue;
+        const int c[3] = { blk->r[i], blk->g[i], blk->b[i] };
+        for (int j = 0; j < 3; ++j) {
+            if (c[j] < mn[j]) mn[j] = c[j];
+            if (c[j] > mx[j]) mx[j] = c[j];
+        }
+    }
+    int major = 1;
+    for (int j = 0; j < 3; ++j)
+        if (mx[j] - mn[j] > mx[major] - mn[major]) major = j;
+    const int16_t *comp[3] = { blk->r, blk->g, blk->b };
+    for (int j = 0; j < 3; ++j) {
+        int cov = 0;
+        if (j != major) {
+            int midMajor = mn[major] + mx[major], mid = mn[j] + mx[j];
+            for (int i = 0; i < 16; ++i)
+                if (!(blk->transparent & (1u << i)))
+                    cov += (2 * comp[major][i] - midMajor) * (2 * comp[j][i] - mid);
+        }
+        float inset = (mx[j] - mn[j]) / 16.0f;
+        e0[j] = (cov < 0) ? mn[j] + inset : mx[j] - inset;
+        e1[j] = (cov < 0) ? mx[j] - inset : mn[j] + inset;
+    }
+}
+
+// Internally used. Compute endpoints from the principal axis of the opaque pixels.
+static void fitPrincipalAxis(const dxtblock_t *blk, float *e0, float *e1) {
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    int n = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (blk->transparent & (1u << i)) continue;
+        mean[0] += blk->r[i]; mean[1] += blk->g[i]; mean[2] += blk->b[i];
+        n++;
+    }
+    for (int j = 0; j < 3; ++j) mean[j] /= n;
+
+    float cov[6] = { 0.0f };    // rr, rg, rb, gg, gb, bb
+    for (int i = 0; i < 16; ++i) {
+        if (blk->transparent & (1u << i)) continue;
+        float r = blk->r[i] - mean[0], g = blk->g[i] - mean[1], b = blk->b[i] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // power iteration
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iter = 0; iter < 4; ++iter) {
+        float v[3] = { cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                       cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                       cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2] };
+        float len = fabsf(v[0]) > fabsf(v[1]) ? fabsf(v[0]) : fabsf(v[1]);
+        if (fabsf(v[2]) > len) len = fabsf(v[2]);
+        if (len < 1e-6f) break;
+        for (int j = 0; j < 3; ++j) axis[j] = v[j] / len;
+    }
+    float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        if (blk->transparent & (1u << i)) continue;
+        float t = ((blk->r[i] - mean[0]) * axis[0] + (blk->g[i] - mean[1]) * axis[1] + (blk->b[i] - mean[2]) * axis[2]) / norm;
+        if (t < tMin) tMin = t;
+        if (t > tMax) tMax = t;
+    }
+    for (int j = 0; j < 3; ++j) {
+        e0[j] = mean[j] + tMax * axis[j];
+        e1[j] = mean[j] + tMin * axis[j];
+    }
+}
+
+// Internally used. Compute least squares endpoints for the indices of the given block. Returns false if not solvable.
+static bool fitLeastSquares(const dxtblock_t *blk, const uint8_t *block, float *e0, float *e1) {
+    uint16_t c0 = block[0] | (block[1] << 8), c1 = block[2] | (block[3] << 8);
+    bool fourColors = (c0 > c1);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f }, bx[3] = { 0.0f };
+    for (int i = 0; i < 16; ++i, indices >>= 2) {
+        int idx = indices & 3;
+        if (!fourColors && idx == 3) continue;
+        static const float weights4[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        static const float weights3[3] = { 1.0f, 0.0f, 0.5f };
+        float a = fourColors ? weights4[idx] : weights3[idx], b = 1.0f - a;
+        const float c[3] = { blk->r[i], blk->g[i], blk->b[i] };
+        aa += a * a; bb += b * b; ab += a * b;
+        for (int j = 0; j < 3; ++j) {
+            ax[j] += a * c[j];
+            bx[j] += b * c[j];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+    for (int j = 0; j < 3; ++j) {
+        e0[j] = (ax[j] * bb - bx[j] * ab) / det;
+        e1[j] = (bx[j] * aa - ax[j] * ab) / det;
+    }
+    return true;
+}
+
+void dxt1EncodeBlock(const uint32_t *pixels, int stride, uint8_t *block, int quality) {
+    if (!pixels || !block) return;
+    dxtblock_t blk;
+    blk.transparent = 0;
+    for (int i = 0; i < 16; ++i) {
+        uint32_t p = pixels[(i >> 2) * stride + (i & 3)];
+        blk.r[i] = (p >> 16) & 0xff;
+        blk.g[i] = (p >> 8) & 0xff;
+        blk.b[i] = p & 0xff;
+        if ((p >> 24) < 128) {
+            blk.transparent |= 1u << i;
+            blk.r[i] = blk.g[i] = blk.b[i] = 0;
+        }
+    }
+    if (blk.transparent == 0xffff) {
+        static const uint8_t empty[8] = { 0, 0, 0, 0, 0xff, 0xff, 0xff, 0xff };
+        memcpy(block, empty, 8);
+        return;
+    }
+
+    float e0[3], e1[3];
+    if (quality <= DXT_FAST)
+        fitBoundingBox(&blk, e0, e1);
+    else
+        fitPrincipalAxis(&blk, e0, e1);
+    uint32_t error = encodeEndpoints(&blk, packColor565(e0[0], e0[1], e0[2]), packColor565(e1[0], e1[1], e1[2]), block);
+
+    if (quality >= DXT_BEST && error > 0) {
+        // bounding box endpoints and least squares refinement are tried as well
+        uint8_t candidate[8];
+        fitBoundingBox(&blk, e0, e1);
+        uint32_t err = encodeEndpoints(&blk, packColor565(e0[0], e0[1], e0[2]), packColor565(e1[0], e1[1], e1[2]), candidate);
+        if (err < error) {
+            error = err;
+            memcpy(block, candidate, 8);
+        }
+        for (int iter = 0; iter < 2 && error > 0 && fitLeastSquares(&blk, block, e0, e1); ++iter) {
+            err = encodeEndpoints(&blk, packColor565(e0[0], e0[1], e0[2]), packColor565(e1[0], e1[1], e1[2]), candidate);
+            if (err >= error) break;
+            error = err;
+            memcpy(block, candidate, 8);
+        }
+    }
+}
+
+bool convertTISV2(const char *tisFile, array_t *searchPath, const char *outFile, uint64_t *bytesRead, uint64_t *bytesWritten) {
+    if (!tisFile || !outFile) return false;
+    TRACE_SCOPE(traceConvert, "convert TIS V2", TRACE_CAT_JOB, tisFile, -1);
+    printMsg(OUTPUT_MSG, "Decoding PVRZ-based TIS file \"%s\"...\n", tisFile);
+
+    // validating header, tile records are read in chunks while decoding
+    int64_t size = fileSize(tisFile);
+    if (!evalOp(size >= TIS_HEADER_SIZE, "Error: Not a valid TIS file: %s\n", tisFile)) return false;
+    FILE *fp finally(cleanFile) = fopen(tisFile, "rb");
+    if (!evalOp(fp != NULL, "Error: Unable to open TIS file: %s\n", tisFile)) return false;
+    uint8_t data[TIS_HEADER_SIZE];
+    if (!evalOp(fread(data, 1, TIS_HEADER_SIZE, fp) == TIS_HEADER_SIZE, "Error: Could not read TIS file: %s\n", tisFile)) return false;
+    STATS_ADD(COUNTER_IO_CALLS, 2);
+    int32_t tileCount, ofsTiles, dim;
+    getLong(data, 0x08, &tileCount);
+    getLong(data, 0x10, &ofsTiles);
+    getLong(data, 0x14, &dim);
+    if (!evalOp(isTISV2(data) && dim == TILE_DIM && tileCount >= 0 && ofsTiles >= 0 &&
+                (int64_t)ofsTiles + (int64_t)tileCount * TIS_V2_TILE_SIZE <= size,
+                "Error: Not a valid PVRZ-based TIS file: %s\n", tisFile)) return false;
+    if (!evalOp(fseek(fp, ofsTiles, SEEK_SET) == 0, "Error: Could not read TIS file: %s\n", tisFile)) return false;
+    uint64_t recordBytes = TIS_HEADER_SIZE + (uint64_t)tileCount * TIS_V2_TILE_SIZE;
+    STATS_ADD(COUNTER_BYTES_READ, recordBytes);
+
+    // palette-based tiles are written to a temporary file first, since input and output file may be identical
+    char tmpFile[FILENAME_MAX + 8];
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", outFile);
+    FILE *fout = fopen(tmpFile, "wb");
+    if (!evalOp(fout != NULL, "Error: Could not create output TIS file: %s\n", outFile)) return false;
+    uint8_t header[TIS_HEADER_SIZE] = { 'T', 'I', 'S', ' ', 'V', '1', ' ', ' ' };
+    for (int i = 0; i < 4; ++i) {
+        header[0x08 + i] = ((uint32_t)tileCount >> (i * 8)) & 0xff;
+        header[0x0c + i] = ((uint32_t)TILE_SIZE >> (i * 8)) & 0xff;
+        header[0x10 + i] = ((uint32_t)TIS_HEADER_SIZE >> (i * 8)) & 0xff;
+        header[0x14 + i] = ((uint32_t)TILE_DIM >> (i * 8)) & 0xff;
+    }
+    bool success = (fwrite(header, 1, sizeof(header), fout) == sizeof(header));
+
+    pvrzcache_t cache;
+    pvrzCacheInit(&cache, tisFile, searchPath);
+    uint32_t *pixels finally(cleanPixels) = malloc(TILE_DIM * TILE_DIM * sizeof(uint32_t));
+    uint8_t tile[TILE_SIZE], records[TIS_V2_RECORD_CHUNK * TIS_V2_TILE_SIZE];
+    success = success && (pixels != NULL);
+    for (int i = 0; success && i < tileCount; ++i) {
+        if (isInterrupted()) {
+            printMsg(OUTPUT_ERR, "Error: Conversion interrupted: %s\n", tisFile);
+            success = false;
+            break;
+        }
+        int chunkPos = i % TIS_V2_RECORD_CHUNK;
+        if (chunkPos == 0) {
+            size_t num = (tileCount - i < TIS_V2_RECORD_CHUNK) ? (size_t)(tileCount - i) : TIS_V2_RECORD_CHUNK;
+            success = evalOp(fread(records, TIS_V2_TILE_SIZE, num, fp) == num, "Error: Could not read TIS file: %s\n", tisFile);
+            if (!success) break;
+        }
+        success = pvrzDecodeTile(&cache, records + (size_t)chunkPos * TIS_V2_TILE_SIZE, pixels) &&
+                  evalOp(createPaletteTile(pixels, tile), "Error: Could not generate palette for tile %d in TIS file: %s\n", i, tisFile) &&
+                  evalOp(fwrite(tile, 1, TILE_SIZE, fout) == TILE_SIZE, "Error: Could not write output TIS file: %s\n", outFile);
+    }
+    pvrzCacheFree(&cache);
+    success = (fclose(fout) == 0) && success;
+    if (success) {
+        remove(outFile);
+        success = evalOp(rename(tmpFile, outFile) == 0, "Error: Could not create output TIS file: %s\n", outFile);
+    }
+    if (!success) {
+        remove(tmpFile);
+        return false;
+    }
+
+    uint64_t written = TIS_HEADER_SIZE + (uint64_t)tileCount * TILE_SIZE;
+    STATS_ADD(COUNTER_BYTES_WRITTEN, written);
+    STATS_ADD(COUNTER_IO_CALLS, 2 + (uint64_t)tileCount);
+    if (bytesRead) *bytesRead += recordBytes + cache.bytesRead;
+    if (bytesWritten) *bytesWritten += written;
+    return true;
+}
+
+// Shared state of the PVRZ encoder threads
+typedef struct {
+    const tismap_t *map;        // palette-based input tiles
+    const int *slots;           // tile index for each page slot, -1 for unused slots
+    int numSlots;
+    uint8_t **pages;            // DXT1 data of each page
+    int *pageCols;              // number of tile columns of each page
+    int *pageRows;              // number of tile rows of each page
+    int numPages;
+    int endSlot, endPage;       // end of the current page window
+    const char *outDir;         // output directory of PVRZ files
+    const char *baseName;       // PVRZ file name without page number
+    int quality;
+    int next;                   // next work item
+    bool failed;
+    uint64_t bytesWritten;
+    pthread_mutex_t lock;
+} pvrzwriter_t;
+
+// Internally used. Return next work item below "end", or -1 if finished.
+static int nextWorkItem(pvrzwriter_t *writer, int end) {
+    pthread_mutex_lock(&writer->lock);
+    if (isInterrupted()) writer->failed = true;
+    int retVal = (writer->failed || writer->next >= end) ? -1 : writer->next++;
+    pthread_mutex_unlock(&writer->lock);
+    return retVal;
+}
+
+// Internally used. Thread function: Encode tiles into page slots.
+static void* encodeWorker(void *arg) {
+    pvrzwriter_t *writer = arg;
+    uint32_t pixels[TILE_DIM * TILE_DIM];
+    int slot;
+    while ((slot = nextWorkItem(writer, writer->endSlot)) >= 0) {
+        if (writer->slots[slot] < 0) continue;
+        const uint8_t *tile = tisMapGetTile(writer->map, writer->slots[slot]);
+        const uint32_t *palette = (const uint32_t*)tile;
+        for (int i = 0; i < TILE_DIM * TILE_DIM; ++i) {
+            uint32_t color = palette[tile[1024 + i]];
+            pixels[i] = (color == TRANSPARENT) ? 0 : (color | 0xff000000);
+        }
+
+        int page = slot / (PVRZ_PAGE_TILES * PVRZ_PAGE_TILES), pos = slot % (PVRZ_PAGE_TILES * PVRZ_PAGE_TILES);
+        int cols = writer->pageCols[page], blocksPerRow = cols * TILE_DIM / 4;
+        int x = (pos % cols) * TILE_DIM / 4, y = (pos / cols) * TILE_DIM / 4;
+        for (int by = 0; by < TILE_DIM / 4; ++by) {
+            uint8_t *block = writer->pages[page] + ((size_t)(y + by) * blocksPerRow + x) * 8;
+            for (int bx = 0; bx < TILE_DIM / 4; ++bx, block += 8)
+                dxt1EncodeBlock(pixels + by * 4 * TILE_DIM + bx * 4, TILE_DIM, block, writer->quality);
+        }
+    }
+    return NULL;
+}
+
+// Internally used. Write a single PVRZ page. PVR data is compressed while writing.
+static bool writePage(pvrzwriter_t *writer, int page) {
+    char pvrzFile[FILENAME_MAX];
+    snprintf(pvrzFile, sizeof(pvrzFile), "%s/%s%02d.pvrz", writer->outDir, writer->baseName, page);
+    TRACE_SCOPE(tracePage, "write PVRZ", TRACE_CAT_IO, pvrzFile, page);
+    int width = writer->pageCols[page] * TILE_DIM, height = writer->pageRows[page] * TILE_DIM;
+    size_t dataSize = (size_t)width * height / 2;
+
+    uint8_t header[PVR3_HEADER_SIZE] = {0};
+    const uint32_t fields[] = { PVR3_SIGNATURE, 0, PVR_DXT1, 0, 0, 0, height, width, 1, 1, 1, 1, 0 };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(*fields); ++i)
+        for (int j = 0; j < 4; ++j)
+            header[i * 4 + j] = (fields[i] >> (j * 8)) & 0xff;
+
+    FILE *fp finally(cleanFile) = fopen(pvrzFile, "wb");
+    if (!evalOp(fp != NULL, "Error: Could not create PVRZ file: %s\n", pvrzFile)) return false;
+    uint32_t size = (uint32_t)(PVR3_HEADER_SIZE + dataSize);
+    uint8_t prefix[4] = { size & 0xff, (size >> 8) & 0xff, (size >> 16) & 0xff, size >> 24 };
+    bool success = (fwrite(prefix, 1, 4, fp) == 4);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    int level = (writer->quality <= DXT_FAST) ? Z_BEST_SPEED : (writer->quality >= DXT_BEST) ? Z_BEST_COMPRESSION : Z_DEFAULT_COMPRESSION;
+    if (!evalOp(success && deflateInit(&zs, level) == Z_OK, "Error: Could not write PVRZ file: %s\n", pvrzFile)) return false;
+    uint8_t out[16384];
+    uint64_t written = 4;
+    for (int part = 0; success && part < 2; ++part) {
+        zs.next_in = part ? writer->pages[page] : header;
+        zs.avail_in = part ? (uInt)dataSize : PVR3_HEADER_SIZE;
+        int flush = part ? Z_FINISH : Z_NO_FLUSH, ret;
+        do {
+            zs.next_out = out;
+            zs.avail_out = sizeof(out);
+            ret = deflate(&zs, flush);
+            size_t len = sizeof(out) - zs.avail_out;
+            if (ret == Z_STREAM_ERROR || fwrite(out, 1, len, fp) != len) {
+                success = false;
+                break;
+            }
+            written += len;
+        } while (zs.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+    }
+    deflateEnd(&zs);
+    if (!evalOp(success && fflush(fp) == 0, "Error: Could not write PVRZ file: %s\n", pvrzFile)) return false;
+
+    STATS_ADD(COUNTER_BYTES_WRITTEN, written);
+    pthread_mutex_lock(&writer->lock);
+    writer->bytesWritten += written;
+    pthread_mutex_unlock(&writer->lock);
+    return true;
+}
+
+// Internally used. Thread function: Write pages.
+static void* writeWorker(void *arg) {
+    pvrzwriter_t *writer = arg;
+    int page;
+    while ((page = nextWorkItem(writer, writer->endPage)) >= 0) {
+        if (!writePage(writer, page)) {
+            pthread_mutex_lock(&writer->lock);
+            writer->failed = true;
+            pthread_mutex_unlock(&writer->lock);
+        }
+    }
+    return NULL;
+}
+
+// Internally used. Run the given thread function on up to "count" threads, including the calling thread.
+// Work items are processed starting at "first".
+static void runWorkers(pvrzwriter_t *writer, void* (*func)(void*), int first, int count) {
+    writer->next = first;
+    int numThreads = cpuCount();
+    if (numThreads > count) numThreads = count;
+    pthread_t *threads = (numThreads > 1) ? malloc((numThreads - 1) * sizeof(pthread_t)) : NULL;
+    int started = 0;
+    while (threads && started < numThreads - 1 && pthread_create(&threads[started], NULL, func, writer) == 0)
+        started++;
+    func(writer);
+    for (int i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+bool writeTISV2(const char *tisFile, const tilevec_t *tileList, const char *outFile, int quality, uint64_t *bytesRead, uint64_t *bytesWritten) {
+    if (!tisFile || !outFile) return false;
+    TRACE_SCOPE(traceWrite, "write TIS V2", TRACE_CAT_JOB, outFile, -1);
+    printMsg(OUTPUT_MSG, "Writing PVRZ-based TIS file \"%s\"...\n", outFile);
+
+    tismap_t map finally(cleanTisMap);
+    if (!tisMapOpen(&map, tisFile)) return false;
+    if (!evalOp(map.tileSize == TILE_SIZE, "Error: Not a palette-based TIS file: %s\n", tisFile)) return false;
+    int count = map.tileCount;
+
+    // tiles of overlay pairs are placed next to each other, all other tiles keep their order
+    int *partner finally(cleanMemInt) = malloc((count + 1) * sizeof(int));
+    int *slots finally(cleanMemInt) = malloc((2 * (size_t)count + 1) * sizeof(int));
+    uint8_t *placed finally(cleanMem8) = calloc(count + 1, 1);
+    if (!evalOp(partner && slots && placed, "Error: Not enough memory to process tileset.\n")) return false;
+    for (int i = 0; i < count; ++i) partner[i] = -1;
+    for (size_t i = 0, imax = tileList ? tilevecGetSize(tileList) : 0; i < imax; ++i) {
+        const tile_t *tileInfo = tilevecGetItem(tileList, i);
+        if (tileInfo->pri < 0 || tileInfo->pri >= count || tileInfo->sec < 0 || tileInfo->sec >= count) continue;
+        if (partner[tileInfo->pri] < 0) partner[tileInfo->pri] = tileInfo->sec;
+        if (partner[tileInfo->sec] < 0) partner[tileInfo->sec] = tileInfo->pri;
+    }
+    const int pageSlots = PVRZ_PAGE_TILES * PVRZ_PAGE_TILES;
+    int numSlots = 0;
+    for (int i = 0; i < count; ++i) {
+        if (placed[i]) continue;
+        int j = partner[i];
+        bool pair = (j >= 0 && !placed[j]);
+        // pairs are not split across pages
+        if (pair && numSlots % pageSlots == pageSlots - 1)
+            slots[numSlots++] = -1;
+        slots[numSlots++] = i;
+        placed[i] = 1;
+        if (pair) {
+            slots[numSlots++] = j;
+            placed[j] = 1;
+        }
+    }
+
+    // full pages have 16x16 tiles, the last page is reduced to the smallest power of two dimensions
+    pvrzwriter_t writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.map = &map;
+    writer.slots = slots;
+    writer.numSlots = numSlots;
+    writer.numPages = (numSlots + pageSlots - 1) / pageSlots;
+    writer.outDir = ".";
+    writer.quality = quality;
+    char outDir[FILENAME_MAX], baseName[16];
+    strcpy(outDir, outFile);
+    char *p = strrchr(outDir, '/');
+    if (p) {
+        *p = 0;
+        writer.outDir = (p == outDir) ? "/" : outDir;
+    }
+    getPVRZBaseName(outFile, baseName);
+    writer.baseName = baseName;
+    // PVRZ files are referenced by resource names of at most 8 characters: base name and two-digit page number
+    if (!evalOp(strlen(baseName) > 0 && strlen(baseName) <= PVRZ_MAX_BASE_NAME,
+                "Error: TIS filename is too long for PVRZ-based tilesets (max. %d characters): %s\n", PVRZ_MAX_BASE_NAME + 1, outFile)) return false;
+    if (!evalOp(writer.numPages <= PVRZ_MAX_PAGES, "Error: Tileset needs %d PVRZ pages, only %d are supported: %s\n",
+                writer.numPages, PVRZ_MAX_PAGES, outFile)) return false;
+    pthread_mutex_init(&writer.lock, NULL);
+    writer.pages = calloc(writer.numPages + 1, sizeof(uint8_t*));
+    writer.pageCols = calloc(writer.numPages + 1, sizeof(int));
+    writer.pageRows = calloc(writer.numPages + 1, sizeof(int));
+    bool success = (writer.pages && writer.pageCols && writer.pageRows);
+    for (int page = 0; success && page < writer.numPages; ++page) {
+        int tiles = (page < writer.numPages - 1) ? pageSlots : numSlots - page * pageSlots;
+        int cols = 1, rows = 1;
+        while (cols < PVRZ_PAGE_TILES && cols < tiles) cols *= 2;
+        while (rows * cols < tiles) rows *= 2;
+        writer.pageCols[page] = cols;
+        writer.pageRows[page] = rows;
+    }
+    if (!success)
+        printMsg(OUTPUT_ERR, "Error: Not enough memory to process tileset.\n");
+
+    // pages are kept in memory only from encoding until they are written
+    int window = budgetScale(writer.numPages, PVRZ_PAGE_SIZE / 2);
+    for (int first = 0; success && first < writer.numPages; first += window) {
+        int last = (first + window < writer.numPages) ? first + window : writer.numPages;
+        for (int page = first; success && page < last; ++page) {
+            writer.pages[page] = calloc((size_t)writer.pageCols[page] * writer.pageRows[page], TILE_DIM * TILE_DIM / 2);
+            success = evalOp(writer.pages[page] != NULL, "Error: Not enough memory to process tileset.\n");
+        }
+        if (success) {
+            writer.endSlot = (last * pageSlots < numSlots) ? last * pageSlots : numSlots;
+            TRACE_BEGIN("encode DXT1", TRACE_CAT_TILE, NULL, writer.endSlot - first * pageSlots);
+            runWorkers(&writer, encodeWorker, first * pageSlots, writer.endSlot - first * pageSlots);
+            TRACE_END("encode DXT1", TRACE_CAT_TILE);
+            success = !writer.failed;
+        }
+        if (success) {
+            writer.endPage = last;
+            runWorkers(&writer, writeWorker, first, last - first);
+            success = !writer.failed;
+        }
+        for (int page = first; page < last; ++page) {
+            free(writer.pages[page]);
+            writer.pages[page] = NULL;
+        }
+    }
+    if (success)
+        STATS_ADD(COUNTER_BYTES_READ, (uint64_t)count * TILE_SIZE);
+    if (!success && isInterrupted())
+        printMsg(OUTPUT_ERR, "Error: Conversion interrupted: %s\n", outFile);
+
+    // tile records refer to the page slots
+    uint8_t *records = success ? malloc(TIS_HEADER_SIZE + (size_t)count * TIS_V2_TILE_SIZE + 1) : NULL;
+    if (records) {
+        memcpy(records, "TIS V1  ", 8);
+        const uint32_t header[] = { count, TIS_V2_TILE_SIZE, TIS_HEADER_SIZE, TILE_DIM };
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                records[8 + i * 4 + j] = (header[i] >> (j * 8)) & 0xff;
+        for (int slot = 0; slot < numSlots; ++slot) {
+            if (slots[slot] < 0) continue;
+            int page = slot / pageSlots, pos = slot % pageSlots, cols = writer.pageCols[page];
+            const uint32_t rec[] = { page, (pos % cols) * TILE_DIM, (pos / cols) * TILE_DIM };
+            uint8_t *dst = records + TIS_HEADER_SIZE + (size_t)slots[slot] * TIS_V2_TILE_SIZE;
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 4; ++j)
+                    dst[i * 4 + j] = (rec[i] >> (j * 8)) & 0xff;
+        }
+    }
+    for (int page = 0; writer.pages && page < writer.numPages; ++page)
+        free(writer.pages[page]);
+    free(writer.pages);
+    free(writer.pageCols);
+    free(writer.pageRows);
+    pthread_mutex_destroy(&writer.lock);
+    if (!success) return false;
+    if (!evalOp(records != NULL, "Error: Not enough memory to process tileset.\n")) return false;
+
+    // TIS file is replaced last, input may be identical to output
+    size_t size = TIS_HEADER_SIZE + (size_t)count * TIS_V2_TILE_SIZE;
+    char tmpFile[FILENAME_MAX + 8];
+    snprintf(tmpFile, sizeof(tmpFile), "%s.tmp", outFile);
+    FILE *fp = fopen(tmpFile, "wb");
+    success = (fp != NULL && fwrite(records, 1, size, fp) == size);
+    free(records);
+    if (fp) success = (fclose(fp) == 0) && success;
+    tisMapClose(&map);
+    if (success) {
+        remove(outFile);
+        success = (rename(tmpFile, outFile) == 0);
+    }
+    if (!success) {
+        remove(tmpFile);
+        printMsg(OUTPUT_ERR, "Error: Could not create output TIS file: %s\n", outFile);
+        return false;
+    }
+
+    STATS_ADD(COUNTER_BYTES_WRITTEN, size);
+    STATS_ADD(COUNTER_IO_CALLS, 2 + 2 * (uint64_t)writer.numPages);
+    if (bytesRead) *bytesRead += TIS_HEADER_SIZE + (uint64_t)count * TILE_SIZE;
+    if (bytesWritten) *bytesWritten += size + writer.bytesWritten;
+    printMsg(OUTPUT_MSG, "  %d tiles encoded on %d PVRZ page(s).\n", count, writer.numPages);
+    return true;
+}
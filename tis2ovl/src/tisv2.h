@@ -0,0 +1,110 @@
+#ifndef TISV2_H_INCLUDED
+#define TISV2_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "arrays.h"
+#include "tis2ovl.h"
+
+/// Size of a tile record in PVRZ-based TIS files.
+#define TIS_V2_TILE_SIZE    12
+
+/// Max. number of PVRZ pages kept in memory. Reduced if a memory budget is set.
+#define PVRZ_CACHE_PAGES    8
+
+/// Max. size of the DXT data of a loaded PVRZ page (DXT5, 1024x1024 pixels).
+#define PVRZ_PAGE_SIZE      (1024 * 1024)
+
+/// Number of tile columns and rows of a full PVRZ page (1024x1024 pixels).
+#define PVRZ_PAGE_TILES     16
+
+/// Max. number of PVRZ pages of a single tileset (two-digit page numbers).
+#define PVRZ_MAX_PAGES      100
+/// Max. length of the PVRZ base name, so that PVRZ resource names fit into 8 characters.
+#define PVRZ_MAX_BASE_NAME  6
+
+/// Supported PVR pixel formats.
+enum PVR_FORMAT { PVR_DXT1 = 7, PVR_DXT5 = 11 };
+
+/// A loaded PVRZ page. Pixel data is kept in compressed (DXT) form and only decoded block-wise when needed.
+typedef struct {
+    int page;           // page number, -1 if unused
+    int width, height;  // page dimensions in pixels
+    int format;         // pixel format (see PVR_FORMAT)
+    uint8_t *data;      // DXT block data
+    uint64_t lastUsed;  // access counter value of the last access
+} pvrzpage_t;
+
+/// Cache of PVRZ pages referenced by a single TIS file.
+typedef struct {
+    char baseName[16];                  // PVRZ file name without page number and extension
+    array_t *searchPath;                // directories to search for PVRZ files
+    pvrzpage_t pages[PVRZ_CACHE_PAGES]; // loaded pages
+    int capacity;                       // number of usable page slots
+    uint64_t counter;                   // access counter
+    uint64_t bytesRead;                 // number of bytes read from PVRZ files
+} pvrzcache_t;
+
+/// Return whether the given TIS header refers to a PVRZ-based TIS file.
+bool isTISV2(const uint8_t *header);
+
+/// Return whether the given file is a PVRZ-based TIS file.
+bool isTISV2File(const char *tisFile);
+
+/// Initialize PVRZ page cache for the given TIS file name (e.g. "ar0100.tis").
+void pvrzCacheInit(pvrzcache_t *cache, const char *tisName, array_t *searchPath);
+
+/// Release all pages of the PVRZ page cache.
+void pvrzCacheFree(pvrzcache_t *cache);
+
+/**
+ * Decode a single tile from the given PVRZ page. Only the DXT blocks covering the tile are decoded.
+ * \param cache     PVRZ page cache.
+ * \param record    Tile record of a PVRZ-based TIS file.
+ * \param pixels    Storage for 64x64 pixels in BGRA format.
+ * \return whether operation was successful.
+ */
+bool pvrzDecodeTile(pvrzcache_t *cache, const uint8_t *record, uint32_t *pixels);
+
+/// Decode a single DXT1 block into 4x4 pixels in BGRA format. "stride" specifies the pixel distance between rows.
+void dxt1DecodeBlock(const uint8_t *block, uint32_t *pixels, int stride);
+
+/// Decode a single DXT5 block into 4x4 pixels in BGRA format. "stride" specifies the pixel distance between rows.
+void dxt5DecodeBlock(const uint8_t *block, uint32_t *pixels, int stride);
+
+/**
+ * Encode 4x4 pixels in BGRA format into a single DXT1 block. Pixels with alpha < 128 are encoded as transparent.
+ * \param pixels    First pixel of the block.
+ * \param stride    Pixel distance between rows.
+ * \param block     Storage for the 8 bytes of the DXT1 block.
+ * \param quality   Encoder quality level (see DXT_QUALITY).
+ */
+void dxt1EncodeBlock(const uint32_t *pixels, int stride, uint8_t *block, int quality);
+
+/**
+ * Convert a PVRZ-based TIS file into a palette-based TIS file.
+ * \param tisFile       PVRZ-based TIS input file.
+ * \param searchPath    Directories to search for PVRZ files.
+ * \param outFile       Palette-based TIS output file. May be identical to "tisFile".
+ * \param bytesRead     Optional storage for number of bytes read.
+ * \param bytesWritten  Optional storage for number of bytes written.
+ * \return whether operation was successful.
+ */
+bool convertTISV2(const char *tisFile, array_t *searchPath, const char *outFile, uint64_t *bytesRead, uint64_t *bytesWritten);
+
+/**
+ * Convert a palette-based TIS file into a PVRZ-based TIS file with DXT1 encoded PVRZ pages.
+ * Tiles are encoded by multiple threads. Both tiles of each overlay tile pair are placed next to each other on the
+ * same page. Pages are encoded and written in windows that fit into the memory budget.
+ * \param tisFile       Palette-based TIS input file.
+ * \param tileList      Overlay tile pairs of the tileset.
+ * \param outFile       PVRZ-based TIS output file. May be identical to "tisFile". PVRZ files are written to the
+ *                      same directory.
+ * \param quality       Encoder quality level (see DXT_QUALITY).
+ * \param bytesRead     Optional storage for number of bytes read.
+ * \param bytesWritten  Optional storage for number of bytes written.
+ * \return whether operation was successful.
+ */
+bool writeTISV2(const char *tisFile, const tilevec_t *tileList, const char *outFile, int quality, uint64_t *bytesRead, uint64_t *bytesWritten);
+
+#endif // TISV2_H_INCLUDED
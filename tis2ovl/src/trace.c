@@ -0,0 +1,159 @@
+#include <string.h>
+#include <time.h>
+#include "compat.h"
+#include "functions.h"
+#include "trace.h"
+
+#ifdef TIS2OVL_STATS
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Number of events per thread. Oldest events are overwritten when the ring buffer is full.
+#define RING_SIZE (1 << 16)
+#define LABEL_SIZE 40
+
+// A single trace event.
+typedef struct {
+    uint64_t ts;            // timestamp in nanoseconds
+    const char *name;       // static event name
+    const char *cat;        // static event category
+    int64_t arg;            // numeric argument (-1 if unused)
+    char phase;             // 'B' or 'E'
+    char label[LABEL_SIZE]; // string argument (empty if unused)
+} event_t;
+
+// Ring buffer of a single thread. Written only by the owning thread.
+typedef struct ring_t {
+    struct ring_t *next;
+    int tid;
+    char name[32];
+    atomic_uint_fast64_t head;  // total number of events recorded
+    event_t events[RING_SIZE];
+} ring_t;
+
+bool trace_enabled = false;
+
+static char *traceFile = NULL;
+static uint64_t traceEpoch = 0;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static ring_t *ringList = NULL;
+static int ringCount = 0;
+static __thread ring_t *localRing = NULL;
+
+// Internally used. Return ring buffer of the calling thread, register it on first use.
+ring_t* getLocalRing();
+
+static inline uint64_t traceNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+bool traceStart(const char *fileName) {
+    if (!fileName || !*fileName) return false;
+    free(traceFile);
+    traceFile = strdup(fileName);
+    if (!traceFile) return false;
+    traceEpoch = traceNow();
+    trace_enabled = true;
+    return true;
+}
+
+void traceSetThreadName(const char *name) {
+    ring_t *ring = getLocalRing();
+    if (ring && name) {
+        strncpy(ring->name, name, sizeof(ring->name) - 1);
+        ring->name[sizeof(ring->name) - 1] = '\0';
+    }
+}
+
+void traceEvent(char phase, const char *name, const char *cat, const char *label, int64_t arg) {
+    ring_t *ring = getLocalRing();
+    if (!ring) return;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    event_t *e = &ring->events[head & (RING_SIZE - 1)];
+    e->ts = traceNow();
+    e->name = name;
+    e->cat = cat;
+    e->arg = arg;
+    e->phase = phase;
+    if (label) {
+        strncpy(e->label, label, LABEL_SIZE - 1);
+        e->label[LABEL_SIZE - 1] = '\0';
+    } else {
+        e->label[0] = '\0';
+    }
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void cleanTraceScope(trace_scope_t *scope) {
+    if (scope && scope->active && trace_enabled)
+        traceEvent('E', scope->name, scope->cat, NULL, -1);
+}
+
+bool traceStop() {
+    if (!trace_enabled || !traceFile) return true;
+    trace_enabled = false;
+
+    FILE *fp finally(cleanFile) = fopen(traceFile, "w");
+    if (!evalOp(fp != NULL, "Error: Could not create trace file: %s\n", traceFile)) return false;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    uint64_t dropped = 0;
+    pthread_mutex_lock(&traceLock);
+    for (ring_t *ring = ringList; ring; ring = ring->next) {
+        // thread metadata
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", ring->tid);
+        printJSONString(fp, ring->name[0] ? ring->name : "thread");
+        fprintf(fp, "}}");
+        first = false;
+
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t start = (head > RING_SIZE) ? head - RING_SIZE : 0;
+        dropped += start;
+        for (uint64_t i = start; i < head; ++i) {
+            const event_t *e = &ring->events[i & (RING_SIZE - 1)];
+            uint64_t ts = (e->ts > traceEpoch) ? e->ts - traceEpoch : 0;
+            fprintf(fp, ",\n{\"name\":");
+            printJSONString(fp, e->name);
+            fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%d",
+                    e->cat, e->phase, (unsigned long long)(ts / 1000), (unsigned)(ts % 1000), ring->tid);
+            if (e->phase == 'B' && (e->label[0] || e->arg >= 0)) {
+                fprintf(fp, ",\"args\":{");
+                if (e->label[0]) {
+                    fprintf(fp, "\"file\":");
+                    printJSONString(fp, e->label);
+                }
+                if (e->arg >= 0)
+                    fprintf(fp, "%s\"tile\":%lld", e->label[0] ? "," : "", (long long)e->arg);
+                fprintf(fp, "}");
+            }
+            fprintf(fp, "}");
+        }
+    }
+    pthread_mutex_unlock(&traceLock);
+    fprintf(fp, "\n],\"otherData\":{\"dropped_events\":%llu}}\n", (unsigned long long)dropped);
+    if (dropped)
+        printMsg(OUTPUT_ERR, "Warning: Trace buffer overflow. %llu oldest event(s) were dropped.\n", (unsigned long long)dropped);
+    return evalOp(!ferror(fp), "Error: Could not write trace file: %s\n", traceFile);
+}
+
+
+// Internally used. Return ring buffer of the calling thread, register it on first use.
+ring_t* getLocalRing() {
+    if (!localRing) {
+        ring_t *ring = calloc(1, sizeof(ring_t));
+        if (ring) {
+            pthread_mutex_lock(&traceLock);
+            ring->tid = ++ringCount;
+            if (ring->tid == 1) strcpy(ring->name, "main");
+            ring->next = ringList;
+            ringList = ring;
+            pthread_mutex_unlock(&traceLock);
+            localRing = ring;
+        }
+    }
+    return localRing;
+}
+
+#endif  // TIS2OVL_STATS
@@ -0,0 +1,64 @@
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Trace event categories.
+#define TRACE_CAT_JOB   "job"
+#define TRACE_CAT_TILE  "tile"
+#define TRACE_CAT_IO    "io"
+
+#ifdef TIS2OVL_STATS
+
+/// Indicates whether trace events are recorded. Set by traceStart().
+extern bool trace_enabled;
+
+/// Start recording trace events. Events are written to "fileName" by traceStop(). Returns success state.
+bool traceStart(const char *fileName);
+
+/// Stop recording and write all recorded events as Chrome trace JSON. Returns success state.
+bool traceStop();
+
+/// Assign a name to the calling thread which is shown in the trace viewer.
+void traceSetThreadName(const char *name);
+
+/**
+ * Record a begin or end event for the calling thread.
+ * \param phase     'B' for begin, 'E' for end events.
+ * \param name      Static string with the event name.
+ * \param cat       Static string with the event category.
+ * \param label     Optional string argument that is copied into the event (truncated if needed).
+ * \param arg       Optional numeric argument (ignored if negative).
+ */
+void traceEvent(char phase, const char *name, const char *cat, const char *label, int64_t arg);
+
+/// Scope of an event that is ended automatically when the scope variable goes out of scope.
+typedef struct {
+    const char *name, *cat;
+    bool active;
+} trace_scope_t;
+
+/// Cleanup function for trace scope variables.
+void cleanTraceScope(trace_scope_t *scope);
+
+#define TRACE_BEGIN(name, cat, label, arg) do { if (trace_enabled) traceEvent('B', (name), (cat), (label), (arg)); } while (0)
+#define TRACE_END(name, cat) do { if (trace_enabled) traceEvent('E', (name), (cat), NULL, -1); } while (0)
+/// Begin an event that is ended when the variable "var" goes out of scope.
+#define TRACE_SCOPE(var, name, cat, label, arg) \
+    trace_scope_t var __attribute((cleanup (cleanTraceScope))) = { (name), (cat), trace_enabled }; \
+    if (var.active) traceEvent('B', (name), (cat), (label), (arg))
+
+#else   // TIS2OVL_STATS
+
+// Instrumentation is compiled out
+static inline bool traceStart(const char *fileName) { (void)fileName; return false; }
+static inline bool traceStop() { return true; }
+static inline void traceSetThreadName(const char *name) { (void)name; }
+#define TRACE_BEGIN(name, cat, label, arg) do {} while (0)
+#define TRACE_END(name, cat) do {} while (0)
+#define TRACE_SCOPE(var, name, cat, label, arg) do {} while (0)
+
+#endif  // TIS2OVL_STATS
+
+#endif // TRACE_H_INCLUDED
@@ -0,0 +1,75 @@
+#ifndef VECTOR_H_INCLUDED
+#define VECTOR_H_INCLUDED
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "arena.h"
+
+/**
+ * Auto-generate a typed vector that stores elements of the given type contiguously in memory.
+ * Vectors initialized with an arena take their storage from it and don't have to be freed explicitly.
+ *
+ * Example: def_vector(intvec, int) defines the type "intvec_t" and the functions
+ * intvecInit(), intvecFree(), intvecGetSize(), intvecReserve(), intvecAdd(), intvecGetItem() and intvecClear().
+ */
+#define def_vector(name, type) \
+typedef struct { \
+    type *data;         /* contiguous element storage */ \
+    size_t len;         /* number of elements in the vector */ \
+    size_t cap;         /* maximum capacity */ \
+    arena_t *arena;     /* optional storage provider */ \
+} name##_t; \
+\
+/* Ensure that vector can hold at least "capacity" elements. Returns false on error or if the size would overflow. */ \
+static inline bool name##Reserve(name##_t *vec, size_t capacity) { \
+    if (!vec) return false; \
+    if (capacity <= vec->cap) return true; \
+    if (capacity > SIZE_MAX / sizeof(type)) return false; \
+    type *data = vec->arena ? arenaRealloc(vec->arena, vec->data, sizeof(type) * vec->cap, sizeof(type) * capacity) \
+                            : realloc(vec->data, sizeof(type) * capacity); \
+    if (!data) return false; \
+    vec->data = data; \
+    vec->cap = capacity; \
+    return true; \
+} \
+\
+/* Create empty vector with specified capacity. Storage is taken from "arena" if specified. Returns success state. */ \
+static inline bool name##Init(name##_t *vec, size_t capacity, arena_t *arena) { \
+    if (!vec) return false; \
+    vec->data = NULL; \
+    vec->len = vec->cap = 0; \
+    vec->arena = arena; \
+    return name##Reserve(vec, capacity ? capacity : 16); \
+} \
+\
+/* Release vector storage. Vector can't be used until initialized again. */ \
+static inline void name##Free(name##_t *vec) { \
+    if (vec) { \
+        if (!vec->arena) free(vec->data); \
+        vec->data = NULL; \
+        vec->len = vec->cap = 0; \
+    } \
+} \
+\
+/* Return number of elements in the vector. */ \
+static inline size_t name##GetSize(const name##_t *vec) { return vec ? vec->len : 0; } \
+\
+/* Append copy of "item" to the end of the vector. Capacity is expanded automatically if needed. */ \
+static inline bool name##Add(name##_t *vec, type item) { \
+    if (!vec) return false; \
+    if (vec->len >= vec->cap && (vec->cap > SIZE_MAX / 2 || !name##Reserve(vec, vec->cap ? vec->cap * 2 : 16))) return false; \
+    vec->data[vec->len++] = item; \
+    return true; \
+} \
+\
+/* Return pointer to the specified element. Returns NULL on error. */ \
+static inline type* name##GetItem(const name##_t *vec, size_t index) { \
+    return (vec && index < vec->len) ? &vec->data[index] : NULL; \
+} \
+\
+/* Remove all elements from the vector without adjusting capacity. */ \
+static inline void name##Clear(name##_t *vec) { if (vec) vec->len = 0; }
+
+#endif // VECTOR_H_INCLUDED
@@ -0,0 +1,192 @@
+#include <string.h>
+#include <strings.h>
+#include "compat.h"
+#include "functions.h"
+#include "watch.h"
+
+#ifdef __linux__
+#   include <errno.h>
+#   include <poll.h>
+#   include <unistd.h>
+#   include <sys/inotify.h>
+#   include <sys/stat.h>
+
+// File events that indicate a finished write operation
+#define WATCH_EVENTS    (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+// Internally used. Return signature of the specified file.
+static filesig_t fileSig(const char *fileName) {
+    filesig_t sig = { -1, 0 };
+    struct stat st;
+    if (fileName && stat(fileName, &st) == 0) {
+        sig.size = (int64_t)st.st_size;
+        sig.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    }
+    return sig;
+}
+
+// Internally used. Return signature of the TIS file referenced by the given job.
+static filesig_t tisSig(const watch_t *watch, const watchjob_t *job) {
+    char tisFile[FILENAME_MAX];
+    if (*job->tisName && findTISFile(watch->searchPath, job->tisName, tisFile))
+        return fileSig(tisFile);
+    return fileSig(NULL);
+}
+
+// Internally used. Add directory of the specified file to the watch.
+static bool addWatch(watch_t *watch, const char *path, bool isFile) {
+    char dir[FILENAME_MAX];
+    strncpy(dir, path, FILENAME_MAX - 1);
+    dir[FILENAME_MAX - 1] = 0;
+    if (isFile) {
+        char *p = strrchr(dir, '/');
+        if (p == dir) p[1] = 0;
+        else if (p) *p = 0;
+        else strcpy(dir, ".");
+    }
+    // watch descriptors of identical directories are reused by inotify
+    return evalOp(inotify_add_watch(watch->fd, dir, WATCH_EVENTS) >= 0, "Error: Could not watch directory: %s\n", dir);
+}
+
+// Internally used. Flag all jobs referring to the given file name. Returns whether any job has been flagged.
+static bool markJobs(watch_t *watch, const char *fileName) {
+    bool retVal = false;
+    for (size_t i = 0; i < watch->jobCount; ++i) {
+        watchjob_t *job = &watch->jobs[i];
+        const char *wedName = strrchr(job->wedFile, '/');
+        wedName = wedName ? wedName + 1 : job->wedFile;
+        if (strcasecmp(fileName, wedName) == 0 || (*job->tisName && strcasecmp(fileName, job->tisName) == 0)) {
+            job->pending = true;
+            retVal = true;
+        }
+    }
+    return retVal;
+}
+
+bool watchInit(watch_t *watch, array_t *wedList, array_t *searchPath) {
+    if (!watch || !wedList || !searchPath) return false;
+    memset(watch, 0, sizeof(watch_t));
+    watch->searchPath = searchPath;
+    watch->fd = inotify_init1(IN_CLOEXEC);
+    if (!evalOp(watch->fd >= 0, "Error: Could not initialize file monitoring.\n")) return false;
+
+    watch->jobCount = arrayGetSize(wedList);
+    watch->jobs = calloc(watch->jobCount ? watch->jobCount : 1, sizeof(watchjob_t));
+    if (!evalOp(watch->jobs != NULL, "Error: Could not allocate memory.\n")) {
+        watchFree(watch);
+        return false;
+    }
+    for (size_t i = 0; i < watch->jobCount; ++i) {
+        watchjob_t *job = &watch->jobs[i];
+        job->wedFile = arrayGetItem(wedList, i);
+        job->wedSig = job->tisSig = fileSig(NULL);
+        if (!addWatch(watch, job->wedFile, true)) {
+            watchFree(watch);
+            return false;
+        }
+    }
+    for (size_t i = 0; i < arrayGetSize(searchPath); ++i) {
+        if (!addWatch(watch, arrayGetItem(searchPath, i), false)) {
+            watchFree(watch);
+            return false;
+        }
+    }
+    return true;
+}
+
+void watchFree(watch_t *watch) {
+    if (!watch) return;
+    if (watch->fd >= 0)
+        close(watch->fd);
+    free(watch->jobs);
+    memset(watch, 0, sizeof(watch_t));
+    watch->fd = -1;
+}
+
+void watchUpdate(watch_t *watch, const char *wedFile, const jobinfo_t *info) {
+    if (!watch || !wedFile) return;
+    for (size_t i = 0; i < watch->jobCount; ++i) {
+        watchjob_t *job = &watch->jobs[i];
+        if (strcmp(job->wedFile, wedFile) != 0) continue;
+        if (info && *info->tisSource) {
+            const char *name = strrchr(info->tisSource, '/');
+            strcpy(job->tisName, name ? name + 1 : info->tisSource);
+        }
+        job->wedSig = fileSig(job->wedFile);
+        job->tisSig = tisSig(watch, job);
+        job->pending = false;
+    }
+}
+
+int watchWait(watch_t *watch, array_t *changed) {
+    if (!watch || watch->fd < 0 || !changed) return -1;
+    arrayClear(changed, false);
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (!isInterrupted()) {
+        // wait for the first relevant event, then until no more events arrive within the debounce interval
+        bool pending = false;
+        for (;;) {
+            struct pollfd pfd = { watch->fd, POLLIN, 0 };
+            int ret = poll(&pfd, 1, pending ? WATCH_DEBOUNCE_MS : -1);
+            if (ret < 0 && errno == EINTR) {
+                if (isInterrupted()) return 0;
+                continue;
+            }
+            if (!evalOp(ret >= 0, "Error: Could not wait for file events.\n")) return -1;
+            if (ret == 0) break;
+
+            ssize_t len = read(watch->fd, buffer, sizeof(buffer));
+            if (len < 0 && errno == EINTR) continue;
+            if (!evalOp(len > 0, "Error: Could not read file events.\n")) return -1;
+            for (char *p = buffer; p < buffer + len; ) {
+                const struct inotify_event *event = (const struct inotify_event*)p;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    for (size_t i = 0; i < watch->jobCount; ++i)
+                        watch->jobs[i].pending = true;
+                    pending = true;
+                } else if (event->len && markJobs(watch, event->name)) {
+                    pending = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        // only report files whose content actually changed, which skips files written by the conversion itself
+        for (size_t i = 0; i < watch->jobCount; ++i) {
+            watchjob_t *job = &watch->jobs[i];
+            if (!job->pending) continue;
+            job->pending = false;
+            filesig_t wed = fileSig(job->wedFile), tis = tisSig(watch, job);
+            if (memcmp(&wed, &job->wedSig, sizeof(filesig_t)) != 0 || memcmp(&tis, &job->tisSig, sizeof(filesig_t)) != 0)
+                arrayAddItem(changed, (void*)job->wedFile);
+        }
+        if (arrayGetSize(changed))
+            return (int)arrayGetSize(changed);
+    }
+    return 0;
+}
+
+#else
+
+bool watchInit(watch_t *watch, array_t *wedList, array_t *searchPath) {
+    (void)wedList; (void)searchPath;
+    if (watch) memset(watch, 0, sizeof(watch_t));
+    printMsg(OUTPUT_ERR, "Error: Watch mode is not supported on this platform.\n");
+    return false;
+}
+
+void watchFree(watch_t *watch) {
+    if (watch) memset(watch, 0, sizeof(watch_t));
+}
+
+void watchUpdate(watch_t *watch, const char *wedFile, const jobinfo_t *info) {
+    (void)watch; (void)wedFile; (void)info;
+}
+
+int watchWait(watch_t *watch, array_t *changed) {
+    (void)watch; (void)changed;
+    return -1;
+}
+
+#endif
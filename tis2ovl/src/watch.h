@@ -0,0 +1,49 @@
+#ifndef WATCH_H_INCLUDED
+#define WATCH_H_INCLUDED
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "arrays.h"
+#include "tis2ovl.h"
+
+/// Time in milliseconds without further file events before pending changes are processed.
+#define WATCH_DEBOUNCE_MS   250
+
+/// File signature used to detect content changes.
+typedef struct {
+    int64_t size;       // file size in bytes, or -1 if file does not exist
+    int64_t mtime;      // modification time in nanoseconds
+} filesig_t;
+
+/// State of a single watched WED file.
+typedef struct {
+    const char *wedFile;            // WED file path
+    char tisName[FILENAME_MAX];     // file name of the referenced TIS file, empty if unknown
+    filesig_t wedSig, tisSig;       // file signatures after last conversion
+    bool pending;                   // whether file events referred to this job since last check
+} watchjob_t;
+
+/// Watch mode state.
+typedef struct {
+    int fd;                 // inotify instance
+    array_t *searchPath;    // TIS search paths
+    watchjob_t *jobs;       // list of watched WED files
+    size_t jobCount;        // number of watched WED files
+} watch_t;
+
+/// Set up file monitoring for the given WED files and TIS search paths. Returns success state.
+bool watchInit(watch_t *watch, array_t *wedList, array_t *searchPath);
+
+/// Release all resources allocated by the watch. Watch can't be used until initialized again by watchInit().
+void watchFree(watch_t *watch);
+
+/// Store file signatures of the given WED file and its TIS file after conversion. Changes made by the conversion itself are
+/// ignored this way.
+void watchUpdate(watch_t *watch, const char *wedFile, const jobinfo_t *info);
+
+/// Wait until WED or TIS files have been changed and store the affected WED files in "changed".
+/// Returns number of changed WED files, 0 if interrupted by SIGINT or SIGTERM (see initInterruptHandler()), or -1 on error.
+int watchWait(watch_t *watch, array_t *changed);
+
+#endif // WATCH_H_INCLUDED